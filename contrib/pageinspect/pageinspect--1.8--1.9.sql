@@ -0,0 +1,18 @@
+/* contrib/pageinspect/pageinspect--1.8--1.9.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pageinspect UPDATE TO '1.9'" to load this file. \quit
+
+--
+-- spgist_tree_stats()
+--
+CREATE FUNCTION spgist_tree_stats(IN index_oid regclass,
+    OUT tree_depth int4,
+    OUT inner_tuples int8,
+    OUT all_the_same int8,
+    OUT leaf_tuples int8,
+    OUT avg_fanout float8,
+    OUT max_fanout int4,
+    OUT avg_leaf_depth float8)
+AS 'MODULE_PATHNAME', 'spgist_tree_stats'
+LANGUAGE C STRICT PARALLEL SAFE;
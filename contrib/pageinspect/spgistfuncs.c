@@ -0,0 +1,274 @@
+/*
+ * spgistfuncs.c
+ *		Functions to investigate the structure of SP-GiST indexes
+ *
+ * Copyright (c) 2019, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		contrib/pageinspect/spgistfuncs.c
+ */
+
+#include "postgres.h"
+
+#include "pageinspect.h"
+
+#include "access/htup_details.h"
+#include "access/spgist_private.h"
+#include "catalog/pg_am.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "nodes/pg_list.h"
+#include "storage/bufmgr.h"
+#include "utils/builtins.h"
+#include "utils/rel.h"
+
+PG_FUNCTION_INFO_V1(spgist_tree_stats);
+
+#define IS_SPGIST(r) ((r)->rd_rel->relam == SPGIST_AM_OID)
+
+/* A tuple still to be visited, and its depth in the tree */
+typedef struct SpGistStatsItem
+{
+	ItemPointerData ptr;
+	int			depth;
+} SpGistStatsItem;
+
+/* ------------------------------------------------
+ * structure for SP-GiST tree statistics
+ * ------------------------------------------------
+ */
+typedef struct SpGistTreeStats
+{
+	int			tree_depth;
+	int64		inner_tuples;
+	int64		all_the_same;
+	int64		leaf_tuples;
+	int64		downlinks;
+	int			max_fanout;
+	int64		leaf_depth_sum;
+} SpGistTreeStats;
+
+static List *
+push_item(List *stack, ItemPointer ptr, int depth)
+{
+	SpGistStatsItem *item = palloc(sizeof(SpGistStatsItem));
+
+	item->ptr = *ptr;
+	item->depth = depth;
+	return lappend(stack, item);
+}
+
+static void
+count_leaf_tuple(SpGistTreeStats *stats, int depth)
+{
+	stats->leaf_tuples++;
+	stats->leaf_depth_sum += depth;
+	stats->tree_depth = Max(stats->tree_depth, depth);
+}
+
+/*
+ * Walk the whole tree, starting from the root, and accumulate statistics
+ * about its shape.
+ *
+ * The depth of a tuple is one more than the number of inner tuples above it,
+ * so a leaf tuple on a leaf root page has depth 1.  Redirection tuples are
+ * followed without counting them as a level.  Only the regular tree is
+ * visited, not the separate tree of null entries.
+ *
+ * The pages are locked one at a time, so if the index is being modified
+ * concurrently, the results may be inconsistent.
+ */
+static void
+collect_tree_stats(Relation rel, SpGistTreeStats *stats)
+{
+	List	   *stack = NIL;
+	ItemPointerData root;
+
+	memset(stats, 0, sizeof(SpGistTreeStats));
+
+	ItemPointerSet(&root, SPGIST_ROOT_BLKNO, FirstOffsetNumber);
+	stack = push_item(stack, &root, 1);
+
+	while (stack != NIL)
+	{
+		SpGistStatsItem *item = (SpGistStatsItem *) llast(stack);
+		BlockNumber blkno = ItemPointerGetBlockNumber(&item->ptr);
+		OffsetNumber offnum = ItemPointerGetOffsetNumber(&item->ptr);
+		int			depth = item->depth;
+		Buffer		buffer;
+		Page		page;
+		OffsetNumber max;
+
+		stack = list_truncate(stack, list_length(stack) - 1);
+		pfree(item);
+
+		CHECK_FOR_INTERRUPTS();
+
+		buffer = ReadBuffer(rel, blkno);
+		LockBuffer(buffer, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buffer);
+		max = PageGetMaxOffsetNumber(page);
+
+		if (PageIsNew(page) || SpGistPageIsDeleted(page))
+			elog(ERROR, "unexpected empty or deleted page %u in SP-GiST index \"%s\"",
+				 blkno, RelationGetRelationName(rel));
+
+		if (SpGistBlockIsRoot(blkno) && SpGistPageIsLeaf(page))
+		{
+			/* the root leaf page holds unchained, live tuples only */
+			for (offnum = FirstOffsetNumber; offnum <= max; offnum++)
+			{
+				SpGistLeafTuple leafTuple;
+
+				leafTuple = (SpGistLeafTuple)
+					PageGetItem(page, PageGetItemId(page, offnum));
+				if (leafTuple->tupstate == SPGIST_LIVE)
+					count_leaf_tuple(stats, depth);
+			}
+		}
+		else if (SpGistPageIsLeaf(page))
+		{
+			/* follow the chain of leaf tuples starting at offnum */
+			while (offnum != InvalidOffsetNumber)
+			{
+				SpGistLeafTuple leafTuple;
+
+				if (offnum < FirstOffsetNumber || offnum > max)
+					elog(ERROR, "invalid offset %u in SP-GiST leaf chain of index \"%s\"",
+						 offnum, RelationGetRelationName(rel));
+
+				leafTuple = (SpGistLeafTuple)
+					PageGetItem(page, PageGetItemId(page, offnum));
+
+				if (leafTuple->tupstate == SPGIST_REDIRECT)
+				{
+					/* the chain was moved elsewhere, at the same depth */
+					stack = push_item(stack,
+									  &((SpGistDeadTuple) leafTuple)->pointer,
+									  depth);
+					break;
+				}
+				if (leafTuple->tupstate == SPGIST_DEAD)
+				{
+					/* the chain is empty */
+					break;
+				}
+
+				count_leaf_tuple(stats, depth);
+				offnum = leafTuple->nextOffset;
+			}
+		}
+		else
+		{
+			SpGistInnerTuple innerTuple;
+			SpGistNodeTuple node;
+			int			fanout = 0;
+			int			i;
+
+			if (offnum < FirstOffsetNumber || offnum > max)
+				elog(ERROR, "invalid offset %u of SP-GiST inner tuple in index \"%s\"",
+					 offnum, RelationGetRelationName(rel));
+
+			innerTuple = (SpGistInnerTuple)
+				PageGetItem(page, PageGetItemId(page, offnum));
+
+			if (innerTuple->tupstate == SPGIST_REDIRECT)
+			{
+				stack = push_item(stack,
+								  &((SpGistDeadTuple) innerTuple)->pointer,
+								  depth);
+			}
+			else if (innerTuple->tupstate == SPGIST_LIVE)
+			{
+				stats->inner_tuples++;
+				if (innerTuple->allTheSame)
+					stats->all_the_same++;
+				stats->tree_depth = Max(stats->tree_depth, depth);
+
+				SGITITERATE(innerTuple, i, node)
+				{
+					if (ItemPointerIsValid(&node->t_tid))
+					{
+						fanout++;
+						stack = push_item(stack, &node->t_tid, depth + 1);
+					}
+				}
+
+				stats->downlinks += fanout;
+				stats->max_fanout = Max(stats->max_fanout, fanout);
+			}
+			else
+				elog(ERROR, "unexpected SP-GiST inner tuple state %d in index \"%s\"",
+					 innerTuple->tupstate, RelationGetRelationName(rel));
+		}
+
+		UnlockReleaseBuffer(buffer);
+	}
+}
+
+/* ------------------------------------------------
+ * spgist_tree_stats()
+ *
+ * Usage: SELECT * FROM spgist_tree_stats('spgist_idx');
+ * ------------------------------------------------
+ */
+Datum
+spgist_tree_stats(PG_FUNCTION_ARGS)
+{
+	Oid			indexRelid = PG_GETARG_OID(0);
+	Relation	indexRel;
+	SpGistTreeStats stats;
+	TupleDesc	tupleDesc;
+	HeapTuple	tuple;
+	Datum		values[7];
+	bool		nulls[7];
+	int			j;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to use raw page functions"))));
+
+	indexRel = index_open(indexRelid, AccessShareLock);
+
+	if (!IS_SPGIST(indexRel))
+		elog(ERROR, "relation \"%s\" is not an SP-GiST index",
+			 RelationGetRelationName(indexRel));
+
+	if (RELATION_IS_OTHER_TEMP(indexRel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot access temporary tables of other sessions")));
+
+	collect_tree_stats(indexRel, &stats);
+
+	index_close(indexRel, AccessShareLock);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupleDesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	tupleDesc = BlessTupleDesc(tupleDesc);
+
+	MemSet(nulls, 0, sizeof(nulls));
+
+	j = 0;
+	values[j++] = Int32GetDatum(stats.tree_depth);
+	values[j++] = Int64GetDatum(stats.inner_tuples);
+	values[j++] = Int64GetDatum(stats.all_the_same);
+	values[j++] = Int64GetDatum(stats.leaf_tuples);
+	if (stats.inner_tuples > 0)
+		values[j++] = Float8GetDatum((double) stats.downlinks /
+									 stats.inner_tuples);
+	else
+		nulls[j++] = true;
+	values[j++] = Int32GetDatum(stats.max_fanout);
+	if (stats.leaf_tuples > 0)
+		values[j++] = Float8GetDatum((double) stats.leaf_depth_sum /
+									 stats.leaf_tuples);
+	else
+		nulls[j++] = true;
+
+	tuple = heap_form_tuple(tupleDesc, values, nulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
@@ -0,0 +1,19 @@
+CREATE TABLE test_spgist (p point);
+CREATE INDEX test_spgist_idx ON test_spgist USING spgist (p);
+
+-- An empty index consists of a single leaf page
+SELECT tree_depth, inner_tuples, leaf_tuples, avg_fanout IS NULL AS no_fanout
+FROM spgist_tree_stats('test_spgist_idx');
+
+INSERT INTO test_spgist SELECT point(i % 100, i / 100) FROM generate_series(0, 9999) i;
+
+SELECT tree_depth > 1 AS multilevel, leaf_tuples,
+       max_fanout <= 4 AS max_fanout_ok,
+       avg_fanout BETWEEN 1 AND 4 AS avg_fanout_ok,
+       avg_leaf_depth <= tree_depth AS avg_leaf_depth_ok
+FROM spgist_tree_stats('test_spgist_idx');
+
+CREATE INDEX test_spgist_btree_idx ON test_spgist USING btree ((p[0]));
+SELECT * FROM spgist_tree_stats('test_spgist_btree_idx');
+
+DROP TABLE test_spgist;
@@ -16,6 +16,10 @@
  * writing is the INET type, where IPv6 values cannot be merged with IPv4
  * values.
  *
+ * The union does not need to be of the same type as the indexed values.  An
+ * opclass can store it as another type, such as a box for the bounding box
+ * of points, by providing a function to convert each new value to that type.
+ *
  * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -43,11 +47,12 @@
  * Procedure numbers must not use values reserved for BRIN itself; see
  * brin_internal.h.
  */
-#define		INCLUSION_MAX_PROCNUMS	4	/* maximum support procs we need */
+#define		INCLUSION_MAX_PROCNUMS	5	/* maximum support procs we need */
 #define		PROCNUM_MERGE			11	/* required */
 #define		PROCNUM_MERGEABLE		12	/* optional */
 #define		PROCNUM_CONTAINS		13	/* optional */
 #define		PROCNUM_EMPTY			14	/* optional */
+#define		PROCNUM_CONVERT			15	/* optional */
 
 
 /*
@@ -81,6 +86,8 @@ typedef struct InclusionOpaque
 	FmgrInfo	strategy_procinfos[RTMaxStrategyNumber];
 } InclusionOpaque;
 
+static bool inclusion_add_value(BrinDesc *bdesc, BrinValues *column,
+								Datum newval, Oid colloid);
 static FmgrInfo *inclusion_get_procinfo(BrinDesc *bdesc, uint16 attno,
 										uint16 procnum);
 static FmgrInfo *inclusion_get_strategy_procinfo(BrinDesc *bdesc, uint16 attno,
@@ -142,10 +149,7 @@ brin_inclusion_add_value(PG_FUNCTION_ARGS)
 	bool		isnull = PG_GETARG_BOOL(3);
 	Oid			colloid = PG_GET_COLLATION();
 	FmgrInfo   *finfo;
-	Datum		result;
-	bool		new = false;
-	AttrNumber	attno;
-	Form_pg_attribute attr;
+	bool		result;
 
 	/*
 	 * If the new value is null, we record that we saw it if it's the first
@@ -160,6 +164,44 @@ brin_inclusion_add_value(PG_FUNCTION_ARGS)
 		PG_RETURN_BOOL(true);
 	}
 
+	/*
+	 * If the opclass stores the union as another type than that of the
+	 * indexed values, convert the new value to it first.  The converted value
+	 * is copied if it's kept, so free it afterwards, as we could be called
+	 * for every row of a large table in the same memory context.
+	 */
+	finfo = inclusion_get_procinfo(bdesc, column->bv_attno, PROCNUM_CONVERT);
+	if (finfo != NULL)
+	{
+		Form_pg_attribute attr;
+
+		newval = FunctionCall1Coll(finfo, colloid, newval);
+		result = inclusion_add_value(bdesc, column, newval, colloid);
+
+		attr = TupleDescAttr(bdesc->bd_tupdesc, column->bv_attno - 1);
+		if (!attr->attbyval)
+			pfree(DatumGetPointer(newval));
+
+		PG_RETURN_BOOL(result);
+	}
+
+	PG_RETURN_BOOL(inclusion_add_value(bdesc, column, newval, colloid));
+}
+
+/*
+ * Workhorse for brin_inclusion_add_value, for a non-null value of the type
+ * of the union
+ */
+static bool
+inclusion_add_value(BrinDesc *bdesc, BrinValues *column, Datum newval,
+					Oid colloid)
+{
+	FmgrInfo   *finfo;
+	Datum		result;
+	bool		new = false;
+	AttrNumber	attno;
+	Form_pg_attribute attr;
+
 	attno = column->bv_attno;
 	attr = TupleDescAttr(bdesc->bd_tupdesc, attno - 1);
 
@@ -182,7 +224,7 @@ brin_inclusion_add_value(PG_FUNCTION_ARGS)
 	 * containing unmergeable values.
 	 */
 	if (DatumGetBool(column->bv_values[INCLUSION_UNMERGEABLE]))
-		PG_RETURN_BOOL(false);
+		return false;
 
 	/*
 	 * If the opclass supports the concept of empty values, test the passed
@@ -195,14 +237,14 @@ brin_inclusion_add_value(PG_FUNCTION_ARGS)
 		if (!DatumGetBool(column->bv_values[INCLUSION_CONTAINS_EMPTY]))
 		{
 			column->bv_values[INCLUSION_CONTAINS_EMPTY] = BoolGetDatum(true);
-			PG_RETURN_BOOL(true);
+			return true;
 		}
 
-		PG_RETURN_BOOL(false);
+		return false;
 	}
 
 	if (new)
-		PG_RETURN_BOOL(true);
+		return true;
 
 	/* Check if the new value is already contained. */
 	finfo = inclusion_get_procinfo(bdesc, attno, PROCNUM_CONTAINS);
@@ -210,7 +252,7 @@ brin_inclusion_add_value(PG_FUNCTION_ARGS)
 		DatumGetBool(FunctionCall2Coll(finfo, colloid,
 									   column->bv_values[INCLUSION_UNION],
 									   newval)))
-		PG_RETURN_BOOL(false);
+		return false;
 
 	/*
 	 * Check if the new value is mergeable to the existing union.  If it is
@@ -227,7 +269,7 @@ brin_inclusion_add_value(PG_FUNCTION_ARGS)
 										newval)))
 	{
 		column->bv_values[INCLUSION_UNMERGEABLE] = BoolGetDatum(true);
-		PG_RETURN_BOOL(true);
+		return true;
 	}
 
 	/* Finally, merge the new value to the existing union. */
@@ -239,7 +281,7 @@ brin_inclusion_add_value(PG_FUNCTION_ARGS)
 		pfree(DatumGetPointer(column->bv_values[INCLUSION_UNION]));
 	column->bv_values[INCLUSION_UNION] = result;
 
-	PG_RETURN_BOOL(true);
+	return true;
 }
 
 /*
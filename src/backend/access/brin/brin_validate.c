@@ -42,6 +42,7 @@ brinvalidate(Oid opclassoid)
 	Form_pg_opclass classform;
 	Oid			opfamilyoid;
 	Oid			opcintype;
+	Oid			storagetype;
 	char	   *opclassname;
 	HeapTuple	familytup;
 	Form_pg_opfamily familyform;
@@ -77,6 +78,34 @@ brinvalidate(Oid opclassoid)
 	oprlist = SearchSysCacheList1(AMOPSTRATEGY, ObjectIdGetDatum(opfamilyoid));
 	proclist = SearchSysCacheList1(AMPROCNUM, ObjectIdGetDatum(opfamilyoid));
 
+	/*
+	 * An opclass that stores its summaries as another type than the indexed
+	 * one, like point_inclusion_ops, may need operators on the storage type
+	 * for its support functions to apply to the summaries.  Unless the
+	 * opfamily also supports the storage type as an indexed type, with
+	 * support functions of its own, those operators needn't form a complete
+	 * set.  Remember the storage type in that case, so that we can ignore
+	 * them below.
+	 */
+	storagetype = InvalidOid;
+	if (OidIsValid(classform->opckeytype) &&
+		classform->opckeytype != opcintype)
+	{
+		storagetype = classform->opckeytype;
+		for (i = 0; i < proclist->n_members; i++)
+		{
+			HeapTuple	proctup = &proclist->members[i]->tuple;
+			Form_pg_amproc procform = (Form_pg_amproc) GETSTRUCT(proctup);
+
+			if (procform->amproclefttype == storagetype &&
+				procform->amprocrighttype == storagetype)
+			{
+				storagetype = InvalidOid;
+				break;
+			}
+		}
+	}
+
 	/* Check individual support functions */
 	for (i = 0; i < proclist->n_members; i++)
 	{
@@ -168,9 +197,11 @@ brinvalidate(Oid opclassoid)
 			 * operators may have unique strategies.  (This is not a great
 			 * heuristic, in particular an erroneous number used in a
 			 * cross-type operator will not get noticed; but the core BRIN
-			 * opfamilies are messy enough to make it necessary.)
+			 * opfamilies are messy enough to make it necessary.)  Operators
+			 * on the storage type, see above, don't count either.
 			 */
-			if (oprform->amoplefttype == oprform->amoprighttype)
+			if (oprform->amoplefttype == oprform->amoprighttype &&
+				oprform->amoplefttype != storagetype)
 				allops |= ((uint64) 1) << oprform->amopstrategy;
 		}
 
@@ -220,7 +251,8 @@ brinvalidate(Oid opclassoid)
 		 * such cross-type cases, either.)
 		 */
 		if (thisgroup->functionset == 0 &&
-			thisgroup->lefttype != thisgroup->righttype)
+			(thisgroup->lefttype != thisgroup->righttype ||
+			 thisgroup->lefttype == storagetype))
 			continue;
 
 		/*
@@ -429,6 +429,16 @@ static relopt_real realRelOpts[] =
 		},
 		-1, 0.0, 1e10
 	},
+	{
+		{
+			"looseness",
+			"Enlarges the cells of loose SP-GiST partitioning by this factor",
+			RELOPT_KIND_SPGIST,
+			ShareUpdateExclusiveLock	/* since it applies only to later
+										 * index builds */
+		},
+		SPGIST_DEFAULT_LOOSENESS, SPGIST_MIN_LOOSENESS, SPGIST_MAX_LOOSENESS
+	},
 	/* list terminator */
 	{{NULL}}
 };
@@ -439,6 +449,16 @@ relopt_enum_elt_def gistBufferingOptValues[] =
 	{"auto", GIST_OPTION_BUFFERING_AUTO},
 	{"on", GIST_OPTION_BUFFERING_ON},
 	{"off", GIST_OPTION_BUFFERING_OFF},
+	{"sorted", GIST_OPTION_BUFFERING_SORTED},
+	{(const char *) NULL}		/* list terminator */
+};
+
+/* values from spgSplitStrategy */
+relopt_enum_elt_def spgSplitStrategyValues[] =
+{
+	{"mean", spgSplitMean},
+	{"median", spgSplitMedian},
+	{"histogram", spgSplitHistogram},
 	{(const char *) NULL}		/* list terminator */
 };
 
@@ -462,7 +482,18 @@ static relopt_enum enumRelOpts[] =
 		},
 		gistBufferingOptValues,
 		GIST_OPTION_BUFFERING_AUTO,
-		gettext_noop("Valid values are \"on\", \"off\", and \"auto\".")
+		gettext_noop("Valid values are \"on\", \"off\", \"auto\", and \"sorted\".")
+	},
+	{
+		{
+			"split_strategy",
+			"Chooses how SP-GiST operator classes that support it pick split points",
+			RELOPT_KIND_SPGIST,
+			ShareUpdateExclusiveLock	/* affects only later page splits */
+		},
+		spgSplitStrategyValues,
+		spgSplitMean,
+		gettext_noop("Valid values are \"mean\", \"median\", and \"histogram\".")
 	},
 	{
 		{
@@ -73,7 +73,8 @@ gisthandler(PG_FUNCTION_ARGS)
 	amroutine->amstorage = true;
 	amroutine->amclusterable = true;
 	amroutine->ampredlocks = true;
-	amroutine->amcanparallel = false;
+	amroutine->amcanparallel = true;
+	amroutine->amcanbuildparallel = true;
 	amroutine->amcaninclude = true;
 	amroutine->amkeytype = InvalidOid;
 
@@ -86,7 +87,7 @@ gisthandler(PG_FUNCTION_ARGS)
 	amroutine->amcostestimate = gistcostestimate;
 	amroutine->amoptions = gistoptions;
 	amroutine->amproperty = gistproperty;
-	amroutine->ambuildphasename = NULL;
+	amroutine->ambuildphasename = gistbuildphasename;
 	amroutine->amvalidate = gistvalidate;
 	amroutine->ambeginscan = gistbeginscan;
 	amroutine->amrescan = gistrescan;
@@ -95,9 +96,10 @@ gisthandler(PG_FUNCTION_ARGS)
 	amroutine->amendscan = gistendscan;
 	amroutine->ammarkpos = NULL;
 	amroutine->amrestrpos = NULL;
-	amroutine->amestimateparallelscan = NULL;
-	amroutine->aminitparallelscan = NULL;
-	amroutine->amparallelrescan = NULL;
+	amroutine->amestimateparallelscan = gistestimateparallelscan;
+	amroutine->aminitparallelscan = gistinitparallelscan;
+	amroutine->amparallelrescan = gistparallelrescan;
+	amroutine->amknnbatch = gistknnbatch;
 
 	PG_RETURN_POINTER(amroutine);
 }
@@ -1573,6 +1575,15 @@ initGISTstate(Relation index)
 		else
 			giststate->fetchFn[i].fn_oid = InvalidOid;
 
+		/* opclasses are not required to provide a BatchConsistent method */
+		if (OidIsValid(index_getprocid(index, i + 1, GIST_BATCH_CONSISTENT_PROC)))
+			fmgr_info_copy(&(giststate->batchConsistentFn[i]),
+						   index_getprocinfo(index, i + 1,
+											 GIST_BATCH_CONSISTENT_PROC),
+						   scanCxt);
+		else
+			giststate->batchConsistentFn[i].fn_oid = InvalidOid;
+
 		/*
 		 * If the index column has a specified collation, we should honor that
 		 * while doing comparisons.  However, we may have a collatable storage
@@ -1602,6 +1613,7 @@ initGISTstate(Relation index)
 		giststate->equalFn[i].fn_oid = InvalidOid;
 		giststate->distanceFn[i].fn_oid = InvalidOid;
 		giststate->fetchFn[i].fn_oid = InvalidOid;
+		giststate->batchConsistentFn[i].fn_oid = InvalidOid;
 		giststate->supportCollation[i] = InvalidOid;
 	}
 
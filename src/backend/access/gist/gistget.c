@@ -99,6 +99,21 @@ gistkillitems(IndexScanDesc scan)
 	so->numKilled = 0;
 }
 
+/*
+ * Add an item to the search queue, keeping track of the queue's peak size
+ */
+static void
+gistAddSearchItem(IndexScanDesc scan, GISTSearchItem *item)
+{
+	GISTScanOpaque so = (GISTScanOpaque) scan->opaque;
+
+	pairingheap_add(so->queue, &item->phNode);
+
+	so->queueLength++;
+	if (so->queueLength > scan->instrument.queue_peak)
+		scan->instrument.queue_peak = so->queueLength;
+}
+
 /*
  * gistindex_keytest() -- does this index tuple satisfy the scan key(s)?
  *
@@ -303,6 +318,129 @@ gistindex_keytest(IndexScanDesc scan,
 	return true;
 }
 
+/*
+ * gistindex_keytest_batch() -- which tuples on a leaf page satisfy the scan
+ * key(s)?
+ *
+ * This is the same test as gistindex_keytest(), for all the tuples on a leaf
+ * page at once, in a non-ordered scan.  Instead of calling the Consistent
+ * function of each scan key for every tuple, the BatchConsistent function is
+ * called once per scan key with the keys of all the tuples that passed the
+ * previous scan keys.  The caller must have checked that every scan key has
+ * a BatchConsistent function, and that none of them is a NULL test.
+ *
+ * match[] and recheck[] are indexed by offset number minus one.  Killed
+ * tuples are reported as not matching, if the scan ignores them.
+ *
+ * Like gistindex_keytest(), this must be invoked in a short-lived memory
+ * context.
+ */
+static void
+gistindex_keytest_batch(IndexScanDesc scan, Page page,
+						bool *match, bool *recheck)
+{
+	GISTScanOpaque so = (GISTScanOpaque) scan->opaque;
+	GISTSTATE  *giststate = so->giststate;
+	Relation	r = scan->indexRelation;
+	OffsetNumber maxoff = PageGetMaxOffsetNumber(page);
+	OffsetNumber offsets[MaxIndexTuplesPerPage];
+	Datum		keys[MaxIndexTuplesPerPage];
+	bool		batchMatch[MaxIndexTuplesPerPage];
+	bool		batchRecheck[MaxIndexTuplesPerPage];
+	OffsetNumber i;
+	int			nkey;
+
+	Assert(GistPageIsLeaf(page));
+	Assert(so->useBatchConsistent);
+
+	for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+	{
+		ItemId		iid = PageGetItemId(page, i);
+
+		if (scan->ignore_killed_tuples && ItemIdIsDead(iid))
+			match[i - 1] = false;
+		else if (GistTupleIsInvalid((IndexTuple) PageGetItem(page, iid)))
+			elog(ERROR, "invalid GiST tuple found on leaf page");
+		else
+			match[i - 1] = true;
+		recheck[i - 1] = false;
+	}
+
+	for (nkey = 0; nkey < scan->numberOfKeys; nkey++)
+	{
+		ScanKey		key = &scan->keyData[nkey];
+		GISTLeafBatch batch;
+		int			nentries = 0;
+		int			j;
+
+		Assert(!(key->sk_flags & SK_ISNULL));
+
+		/* Collect the keys of the tuples that are still candidates */
+		for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+		{
+			IndexTuple	it;
+			Datum		datum;
+			bool		isNull;
+			GISTENTRY	de;
+
+			if (!match[i - 1])
+				continue;
+
+			it = (IndexTuple) PageGetItem(page, PageGetItemId(page, i));
+			datum = index_getattr(it,
+								  key->sk_attno,
+								  giststate->leafTupdesc,
+								  &isNull);
+			if (isNull)
+			{
+				match[i - 1] = false;
+				continue;
+			}
+
+			gistdentryinit(giststate, key->sk_attno - 1, &de,
+						   datum, r, page, i,
+						   false, isNull);
+
+			offsets[nentries] = i;
+			keys[nentries] = de.key;
+			batchMatch[nentries] = false;
+			batchRecheck[nentries] = true;
+			nentries++;
+		}
+
+		if (nentries == 0)
+			break;
+
+		/*
+		 * Call the BatchConsistent function.  As in gistindex_keytest(), the
+		 * recheck flags start out true in case the function forgets to set
+		 * them.
+		 */
+		batch.rel = r;
+		batch.page = page;
+		batch.nentries = nentries;
+		batch.offsets = offsets;
+		batch.keys = keys;
+		batch.query = key->sk_argument;
+		batch.strategy = key->sk_strategy;
+		batch.subtype = key->sk_subtype;
+		batch.match = batchMatch;
+		batch.recheck = batchRecheck;
+
+		FunctionCall1Coll(&so->batchConsistentFns[nkey],
+						  key->sk_collation,
+						  PointerGetDatum(&batch));
+
+		for (j = 0; j < nentries; j++)
+		{
+			if (!batchMatch[j])
+				match[offsets[j] - 1] = false;
+			else
+				recheck[offsets[j] - 1] |= batchRecheck[j];
+		}
+	}
+}
+
 /*
  * Scan all items on the GiST index page identified by *pageItem, and insert
  * them into the queue (or directly to output areas)
@@ -338,6 +476,9 @@ gistScanPage(IndexScanDesc scan, GISTSearchItem *pageItem,
 	OffsetNumber maxoff;
 	OffsetNumber i;
 	MemoryContext oldcxt;
+	bool		batched = false;
+	bool		batchMatch[MaxIndexTuplesPerPage];
+	bool		batchRecheck[MaxIndexTuplesPerPage];
 
 	Assert(!GISTSearchItemIsHeap(*pageItem));
 
@@ -377,7 +518,7 @@ gistScanPage(IndexScanDesc scan, GISTSearchItem *pageItem,
 		memcpy(item->distances, myDistances,
 			   sizeof(item->distances[0]) * scan->numberOfOrderBys);
 
-		pairingheap_add(so->queue, &item->phNode);
+		gistAddSearchItem(scan, item);
 
 		MemoryContextSwitchTo(oldcxt);
 	}
@@ -408,6 +549,22 @@ gistScanPage(IndexScanDesc scan, GISTSearchItem *pageItem,
 	 */
 	so->curPageLSN = BufferGetLSNAtomic(buffer);
 
+	/*
+	 * On a leaf page of a non-ordered scan, test all the tuples at once if
+	 * the opclasses allow it.
+	 */
+	if (so->useBatchConsistent && scan->numberOfOrderBys == 0 &&
+		GistPageIsLeaf(page))
+	{
+		oldcxt = MemoryContextSwitchTo(so->giststate->tempCxt);
+
+		gistindex_keytest_batch(scan, page, batchMatch, batchRecheck);
+
+		MemoryContextSwitchTo(oldcxt);
+		MemoryContextReset(so->giststate->tempCxt);
+		batched = true;
+	}
+
 	/*
 	 * check all tuples on page
 	 */
@@ -429,21 +586,41 @@ gistScanPage(IndexScanDesc scan, GISTSearchItem *pageItem,
 
 		it = (IndexTuple) PageGetItem(page, iid);
 
-		/*
-		 * Must call gistindex_keytest in tempCxt, and clean up any leftover
-		 * junk afterward.
-		 */
-		oldcxt = MemoryContextSwitchTo(so->giststate->tempCxt);
+		if (batched)
+		{
+			match = batchMatch[i - 1];
+			recheck = batchRecheck[i - 1];
+			recheck_distances = false;
+		}
+		else
+		{
+			/*
+			 * Must call gistindex_keytest in tempCxt, and clean up any
+			 * leftover junk afterward.
+			 */
+			oldcxt = MemoryContextSwitchTo(so->giststate->tempCxt);
 
-		match = gistindex_keytest(scan, it, page, i,
-								  &recheck, &recheck_distances);
+			match = gistindex_keytest(scan, it, page, i,
+									  &recheck, &recheck_distances);
 
-		MemoryContextSwitchTo(oldcxt);
-		MemoryContextReset(so->giststate->tempCxt);
+			MemoryContextSwitchTo(oldcxt);
+			MemoryContextReset(so->giststate->tempCxt);
+		}
+
+		if (GistPageIsLeaf(page))
+			scan->instrument.leaf_tested++;
+		else
+			scan->instrument.inner_visited++;
 
 		/* Ignore tuple if it doesn't match */
 		if (!match)
+		{
+			scan->instrument.consistent_rejected++;
 			continue;
+		}
+
+		if (GistPageIsLeaf(page) && recheck)
+			scan->instrument.leaf_rechecked++;
 
 		if (tbm && GistPageIsLeaf(page))
 		{
@@ -522,7 +699,7 @@ gistScanPage(IndexScanDesc scan, GISTSearchItem *pageItem,
 			memcpy(item->distances, so->distances,
 				   sizeof(item->distances[0]) * nOrderBys);
 
-			pairingheap_add(so->queue, &item->phNode);
+			gistAddSearchItem(scan, item);
 
 			MemoryContextSwitchTo(oldcxt);
 		}
@@ -544,6 +721,7 @@ getNextGISTSearchItem(GISTScanOpaque so)
 	if (!pairingheap_is_empty(so->queue))
 	{
 		item = (GISTSearchItem *) pairingheap_remove_first(so->queue);
+		so->queueLength--;
 	}
 	else
 	{
@@ -607,6 +785,134 @@ getNextNearest(IndexScanDesc scan)
 	return res;
 }
 
+/*
+ * Within a parallel scan, read the root page and publish the pages below it
+ * that have to be scanned.  Called by the first participant to start.
+ */
+static void
+gistParallelReadRoot(IndexScanDesc scan, GISTParallelScanDesc gps)
+{
+	GISTScanOpaque so = (GISTScanOpaque) scan->opaque;
+	Relation	r = scan->indexRelation;
+	Buffer		buffer;
+	Page		page;
+	int			nblocks = 0;
+
+	buffer = ReadBuffer(r, GIST_ROOT_BLKNO);
+	LockBuffer(buffer, GIST_SHARE);
+	PredicateLockPage(r, BufferGetBlockNumber(buffer), scan->xs_snapshot);
+	gistcheckpage(r, buffer);
+	page = BufferGetPage(buffer);
+	TestForOldSnapshot(scan->xs_snapshot, r, page);
+
+	if (GistPageIsLeaf(page))
+	{
+		/* Not worth dividing up; somebody just scans the root */
+		gps->rootlsn = InvalidXLogRecPtr;
+		gps->blocks[nblocks++] = GIST_ROOT_BLKNO;
+	}
+	else
+	{
+		OffsetNumber maxoff = PageGetMaxOffsetNumber(page);
+		OffsetNumber i;
+
+		/* Child pages are scanned just as gistScanPage would queue them */
+		gps->rootlsn = BufferGetLSNAtomic(buffer);
+
+		for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+		{
+			ItemId		iid = PageGetItemId(page, i);
+			IndexTuple	it;
+			bool		match;
+			bool		recheck;
+			bool		recheck_distances;
+			MemoryContext oldcxt;
+
+			if (scan->ignore_killed_tuples && ItemIdIsDead(iid))
+				continue;
+
+			it = (IndexTuple) PageGetItem(page, iid);
+
+			oldcxt = MemoryContextSwitchTo(so->giststate->tempCxt);
+			match = gistindex_keytest(scan, it, page, i,
+									  &recheck, &recheck_distances);
+			MemoryContextSwitchTo(oldcxt);
+			MemoryContextReset(so->giststate->tempCxt);
+
+			scan->instrument.inner_visited++;
+			if (match)
+				gps->blocks[nblocks++] = ItemPointerGetBlockNumber(&it->t_tid);
+			else
+				scan->instrument.consistent_rejected++;
+		}
+	}
+
+	UnlockReleaseBuffer(buffer);
+
+	SpinLockAcquire(&gps->mutex);
+	gps->nblocks = nblocks;
+	gps->nextblock = 0;
+	gps->status = GISTPARALLEL_READY;
+	SpinLockRelease(&gps->mutex);
+	ConditionVariableBroadcast(&gps->cv);
+}
+
+/*
+ * Within a parallel scan, claim the next page below the root to be scanned,
+ * and return a search item for it.  Returns NULL if there are none left.
+ *
+ * A participant scans the whole subtree below each page it claims before
+ * claiming another, exactly as a serial scan that had read the root at the
+ * same moment would.
+ */
+static GISTSearchItem *
+gistParallelNextItem(IndexScanDesc scan)
+{
+	GISTScanOpaque so = (GISTScanOpaque) scan->opaque;
+	ParallelIndexScanDesc parallel_scan = scan->parallel_scan;
+	GISTParallelScanDesc gps;
+	GISTSearchItem *item;
+	BlockNumber blkno = InvalidBlockNumber;
+	GistNSN		parentlsn = InvalidXLogRecPtr;
+
+	gps = (GISTParallelScanDesc) OffsetToPointer((void *) parallel_scan,
+												 parallel_scan->ps_offset);
+
+	for (;;)
+	{
+		GISTParallelStatus status;
+
+		SpinLockAcquire(&gps->mutex);
+		status = gps->status;
+		if (status == GISTPARALLEL_NOT_STARTED)
+			gps->status = GISTPARALLEL_ADVANCING;
+		else if (status == GISTPARALLEL_READY &&
+				 gps->nextblock < gps->nblocks)
+		{
+			blkno = gps->blocks[gps->nextblock++];
+			parentlsn = gps->rootlsn;
+		}
+		SpinLockRelease(&gps->mutex);
+
+		if (status == GISTPARALLEL_READY)
+			break;
+		if (status == GISTPARALLEL_NOT_STARTED)
+			gistParallelReadRoot(scan, gps);
+		else
+			ConditionVariableSleep(&gps->cv, WAIT_EVENT_GIST_ROOT);
+	}
+	ConditionVariableCancelSleep();
+
+	if (blkno == InvalidBlockNumber)
+		return NULL;
+
+	item = MemoryContextAlloc(so->queueCxt, SizeOfGISTSearchItem(0));
+	item->blkno = blkno;
+	item->data.parentlsn = parentlsn;
+
+	return item;
+}
+
 /*
  * gistgettuple() -- Get the next tuple in the scan
  */
@@ -634,13 +940,20 @@ gistgettuple(IndexScanDesc scan, ScanDirection dir)
 		if (so->pageDataCxt)
 			MemoryContextReset(so->pageDataCxt);
 
-		fakeItem.blkno = GIST_ROOT_BLKNO;
-		memset(&fakeItem.data.parentlsn, 0, sizeof(GistNSN));
-		gistScanPage(scan, &fakeItem, NULL, NULL, NULL);
+		/* In a parallel scan, the root is read by gistParallelNextItem */
+		if (scan->parallel_scan == NULL)
+		{
+			fakeItem.blkno = GIST_ROOT_BLKNO;
+			memset(&fakeItem.data.parentlsn, 0, sizeof(GistNSN));
+			gistScanPage(scan, &fakeItem, NULL, NULL, NULL);
+		}
 	}
 
 	if (scan->numberOfOrderBys > 0)
 	{
+		/* The planner doesn't consider parallel distance-ordered scans */
+		Assert(scan->parallel_scan == NULL);
+
 		/* Must fetch tuples in strict distance order */
 		return getNextNearest(scan);
 	}
@@ -716,6 +1029,10 @@ gistgettuple(IndexScanDesc scan, ScanDirection dir)
 
 				item = getNextGISTSearchItem(so);
 
+				/* In a parallel scan, move on to the next subtree */
+				if (!item && scan->parallel_scan)
+					item = gistParallelNextItem(scan);
+
 				if (!item)
 					return false;
 
@@ -784,6 +1101,137 @@ gistgetbitmap(IndexScanDesc scan, TIDBitmap *tbm)
 	return ntids;
 }
 
+/*
+ * Entry in the queue of a batched nearest-neighbour search
+ */
+typedef struct GISTKnnBatchItem
+{
+	pairingheap_node phNode;
+	double		priority;		/* smallest distance to a query needing it */
+	GISTSearchItem *item;		/* index page to visit */
+} GISTKnnBatchItem;
+
+static int
+pairingheap_GISTKnnBatchItem_cmp(const pairingheap_node *a,
+								 const pairingheap_node *b, void *arg)
+{
+	const GISTKnnBatchItem *sa = (const GISTKnnBatchItem *) a;
+	const GISTKnnBatchItem *sb = (const GISTKnnBatchItem *) b;
+
+	/* Items with smaller priority value come first */
+	if (sa->priority < sb->priority)
+		return 1;
+	if (sa->priority > sb->priority)
+		return -1;
+	return 0;
+}
+
+/* Convert the distances of a queue item for index_knn_batch_* */
+static void
+gistKnnBatchDistances(GISTSearchItem *item, int nOrderBys, double *distances)
+{
+	int			i;
+
+	for (i = 0; i < nOrderBys; i++)
+		distances[i] = item->distances[i].isnull ?
+			get_float8_infinity() : item->distances[i].value;
+}
+
+/*
+ * gistknnbatch() -- find the nearest neighbours of all ORDER BY arguments
+ *
+ * gistScanPage computes the distances of every entry of a page to all the
+ * ORDER BY arguments at once, and pushes the entries into so->queue.  We
+ * drain that queue after each page: heap tuples are handed to the batch,
+ * and child pages that could still improve the result of some query move to
+ * our own queue, which is ordered by the smallest distance to any query that
+ * needs the page rather than lexicographically.  Null index entries are not
+ * returned.
+ */
+void
+gistknnbatch(IndexScanDesc scan, IndexKnnBatch batch)
+{
+	GISTScanOpaque so = (GISTScanOpaque) scan->opaque;
+	int			nOrderBys = scan->numberOfOrderBys;
+	double	   *distances;
+	pairingheap *queue;
+	GISTSearchItem fakeItem;
+	GISTKnnBatchItem *next;
+
+	Assert(nOrderBys > 0);
+
+	if (!so->qual_ok)
+		return;
+
+	pgstat_count_index_scan(scan->indexRelation);
+
+	so->firstCall = false;
+	distances = (double *) palloc(sizeof(double) * nOrderBys);
+	queue = pairingheap_allocate(pairingheap_GISTKnnBatchItem_cmp, NULL);
+
+	/* Begin the scan by processing the root page */
+	fakeItem.blkno = GIST_ROOT_BLKNO;
+	memset(&fakeItem.data.parentlsn, 0, sizeof(GistNSN));
+	gistScanPage(scan, &fakeItem, NULL, NULL, NULL);
+
+	for (;;)
+	{
+		GISTSearchItem *item;
+		double		priority;
+
+		/* Sort out what the last page gave us */
+		while ((item = getNextGISTSearchItem(so)) != NULL)
+		{
+			gistKnnBatchDistances(item, nOrderBys, distances);
+
+			if (GISTSearchItemIsHeap(*item))
+			{
+				/* Null index entries have no distance to anything */
+				if (item->distances[0].isnull)
+				{
+					pfree(item);
+					continue;
+				}
+				if (item->data.heap.recheckDistances)
+					ereport(ERROR,
+							(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							 errmsg("batched nearest-neighbor search requires exact distances")));
+				index_knn_batch_add(batch, &item->data.heap.heapPtr, distances);
+			}
+			else if (index_knn_batch_useful(batch, distances, &priority))
+			{
+				next = (GISTKnnBatchItem *) palloc(sizeof(GISTKnnBatchItem));
+				next->priority = priority;
+				next->item = item;
+				pairingheap_add(queue, &next->phNode);
+				continue;
+			}
+			pfree(item);
+		}
+
+		if (pairingheap_is_empty(queue))
+			break;
+
+		next = (GISTKnnBatchItem *) pairingheap_remove_first(queue);
+		item = next->item;
+		pfree(next);
+
+		/* The results may have improved since the page was queued */
+		gistKnnBatchDistances(item, nOrderBys, distances);
+		if (index_knn_batch_useful(batch, distances, &priority))
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			gistScanPage(scan, item, item->distances, NULL, NULL);
+		}
+
+		pfree(item);
+	}
+
+	pairingheap_free(queue);
+	pfree(distances);
+}
+
 /*
  * Can we do index-only scans on the given index column?
  *
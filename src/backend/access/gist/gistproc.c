@@ -17,6 +17,7 @@
  */
 #include "postgres.h"
 
+#include <float.h>
 #include <math.h>
 
 #include "access/gist.h"
@@ -24,6 +25,7 @@
 #include "utils/builtins.h"
 #include "utils/float.h"
 #include "utils/geo_decls.h"
+#include "utils/sortsupport.h"
 
 
 static bool gist_box_leaf_consistent(BOX *key, BOX *query,
@@ -130,6 +132,55 @@ gist_box_consistent(PG_FUNCTION_ARGS)
 												 strategy));
 }
 
+/*
+ * The GiST BatchConsistent method for boxes
+ *
+ * Tests a batch of leaf keys at once.  The overlap and containment
+ * strategies, which are the most commonly used ones, are served by the
+ * functions in geo_batch.c; the rest just call gist_box_leaf_consistent()
+ * for each key.
+ */
+Datum
+gist_box_batch_consistent(PG_FUNCTION_ARGS)
+{
+	GISTLeafBatch *batch = (GISTLeafBatch *) PG_GETARG_POINTER(0);
+	BOX		   *query = DatumGetBoxP(batch->query);
+	BOX		  **keys;
+	int			i;
+
+	keys = (BOX **) palloc(sizeof(BOX *) * batch->nentries);
+	for (i = 0; i < batch->nentries; i++)
+	{
+		keys[i] = DatumGetBoxP(batch->keys[i]);
+		/* All cases served by this function are exact */
+		batch->recheck[i] = false;
+	}
+
+	switch (batch->strategy)
+	{
+		case RTOverlapStrategyNumber:
+			box_ov_batch(keys, batch->nentries, query, batch->match);
+			break;
+		case RTContainsStrategyNumber:
+		case RTOldContainsStrategyNumber:
+			box_contain_batch(keys, batch->nentries, query, batch->match);
+			break;
+		case RTContainedByStrategyNumber:
+		case RTOldContainedByStrategyNumber:
+			box_contained_batch(keys, batch->nentries, query, batch->match);
+			break;
+		default:
+			for (i = 0; i < batch->nentries; i++)
+				batch->match[i] = gist_box_leaf_consistent(keys[i], query,
+														   batch->strategy);
+			break;
+	}
+
+	pfree(keys);
+
+	PG_RETURN_VOID();
+}
+
 /*
  * Increase BOX b to include addon.
  */
@@ -1405,30 +1456,37 @@ gist_point_consistent(PG_FUNCTION_ARGS)
 		case CircleStrategyNumberGroup:
 			{
 				CIRCLE	   *query = PG_GETARG_CIRCLE_P(1);
+				BOX		   *box = DatumGetBoxP(entry->key);
 
-				result = DatumGetBool(DirectFunctionCall5(
-														  gist_circle_consistent,
-														  PointerGetDatum(entry),
-														  CirclePGetDatum(query),
-														  Int16GetDatum(RTOverlapStrategyNumber),
-														  0, PointerGetDatum(recheck)));
-
-				if (GIST_LEAF(entry) && result)
+				if (GIST_LEAF(entry))
 				{
 					/*
-					 * We are on leaf page and quick check shows overlapping
-					 * of polygon's bounding box and point
+					 * Leaf keys are points stored as boxes.  A NaN coordinate
+					 * doesn't compare equal to itself, though.
 					 */
-					BOX		   *box = DatumGetBoxP(entry->key);
-
-					Assert(box->high.x == box->low.x
-						   && box->high.y == box->low.y);
+					Assert((box->high.x == box->low.x || isnan(box->high.x))
+						   && (box->high.y == box->low.y || isnan(box->high.y)));
 					result = DatumGetBool(DirectFunctionCall2(
 															  circle_contain_pt,
 															  CirclePGetDatum(query),
 															  PointPGetDatum(&box->high)));
-					*recheck = false;
 				}
+				else
+				{
+					/*
+					 * The subtree can only contain points within the circle
+					 * if its bounding box is at most the radius away from
+					 * the center.  That prunes more than testing for overlap
+					 * with the circle's bounding box, and in a nearest-
+					 * neighbor search with the same center, it keeps the
+					 * pages beyond the radius out of the queue.  The
+					 * comparison is fuzzy, so that rounding errors can't
+					 * lose points that circle_contain_pt() would accept.
+					 */
+					result = FPle(computeDistance(false, box, &query->center),
+								  query->radius);
+				}
+				*recheck = false;
 			}
 			break;
 		default:
@@ -1440,6 +1498,72 @@ gist_point_consistent(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(result);
 }
 
+/*
+ * The GiST BatchConsistent method for points
+ *
+ * Tests a batch of leaf keys at once.  point <@ box is served by
+ * box_ov_exact_batch(); see gist_point_consistent() for why that is the
+ * right test.  Other strategies are tested one key at a time, as in
+ * gist_point_consistent().
+ */
+Datum
+gist_point_batch_consistent(PG_FUNCTION_ARGS)
+{
+	GISTLeafBatch *batch = (GISTLeafBatch *) PG_GETARG_POINTER(0);
+	StrategyNumber strategyGroup = batch->strategy / GeoStrategyNumberOffset;
+	int			i;
+
+	switch (strategyGroup)
+	{
+		case PointStrategyNumberGroup:
+			for (i = 0; i < batch->nentries; i++)
+			{
+				batch->match[i] =
+					gist_point_consistent_internal(batch->strategy % GeoStrategyNumberOffset,
+												   true,
+												   DatumGetBoxP(batch->keys[i]),
+												   DatumGetPointP(batch->query));
+				batch->recheck[i] = false;
+			}
+			break;
+		case BoxStrategyNumberGroup:
+			{
+				BOX		  **keys;
+
+				keys = (BOX **) palloc(sizeof(BOX *) * batch->nentries);
+				for (i = 0; i < batch->nentries; i++)
+				{
+					keys[i] = DatumGetBoxP(batch->keys[i]);
+					batch->recheck[i] = false;
+				}
+
+				box_ov_exact_batch(keys, batch->nentries,
+								   DatumGetBoxP(batch->query), batch->match);
+
+				pfree(keys);
+			}
+			break;
+		default:
+			for (i = 0; i < batch->nentries; i++)
+			{
+				GISTENTRY	entry;
+
+				gistentryinit(entry, batch->keys[i], batch->rel, batch->page,
+							  batch->offsets[i], false);
+				batch->match[i] =
+					DatumGetBool(DirectFunctionCall5(gist_point_consistent,
+													 PointerGetDatum(&entry),
+													 batch->query,
+													 Int16GetDatum(batch->strategy),
+													 ObjectIdGetDatum(batch->subtype),
+													 PointerGetDatum(&batch->recheck[i])));
+			}
+			break;
+	}
+
+	PG_RETURN_VOID();
+}
+
 Datum
 gist_point_distance(PG_FUNCTION_ARGS)
 {
@@ -1544,3 +1668,127 @@ gist_poly_distance(PG_FUNCTION_ARGS)
 
 	PG_RETURN_FLOAT8(distance);
 }
+
+/*
+ * Sort support for sorted GiST index builds
+ *
+ * The entries are ordered by the position of their bounding box's center on
+ * a Hilbert curve, so that entries that are close to each other in the sort
+ * order are close to each other in space too, and the pages that are filled
+ * from consecutive entries cover compact, rarely overlapping areas.  The
+ * point opclass stores points as boxes, so this serves it as well.
+ *
+ * The coordinates are rounded to float4, and mapped to uint32s that sort in
+ * the same order, to get a 64-bit position on the curve.  That loses some
+ * precision, but we only need an order that groups nearby entries.
+ */
+static uint32
+ieee_float32_to_uint32(float8 f)
+{
+	union
+	{
+		float4		f;
+		uint32		i;
+	}			u;
+
+	if (isnan(f))
+		return PG_UINT32_MAX;	/* NaNs sort last */
+
+	/* float4 conversion of an out-of-range value isn't well defined */
+	if (f > FLT_MAX)
+		u.f = get_float4_infinity();
+	else if (f < -FLT_MAX)
+		u.f = -get_float4_infinity();
+	else
+		u.f = (float4) f;
+
+	/*
+	 * Map negative values to the range 0 - 7FFFFFFF, by inverting all the
+	 * bits, and positive values (and 0) to the range 80000000 - FFFFFFFF, by
+	 * setting the sign bit.
+	 */
+	if ((u.i & 0x80000000) != 0)
+		u.i ^= 0xFFFFFFFF;
+	else
+		u.i |= 0x80000000;
+
+	return u.i;
+}
+
+static uint64
+gist_bbox_hilbert_key(BOX *box)
+{
+	/* halve first, so that the sum can't overflow */
+	float8		x = box->low.x / 2 + box->high.x / 2;
+	float8		y = box->low.y / 2 + box->high.y / 2;
+
+	return hilbert_curve_position(ieee_float32_to_uint32(x),
+								  ieee_float32_to_uint32(y), 32);
+}
+
+static int
+gist_bbox_hilbert_cmp(Datum a, Datum b, SortSupport ssup)
+{
+	uint64		ka = gist_bbox_hilbert_key(DatumGetBoxP(a));
+	uint64		kb = gist_bbox_hilbert_key(DatumGetBoxP(b));
+
+	if (ka > kb)
+		return 1;
+	else if (ka < kb)
+		return -1;
+	else
+		return 0;
+}
+
+#if SIZEOF_DATUM >= 8
+/*
+ * On 64-bit systems, the position on the curve fits in a Datum, so it can be
+ * used as an abbreviated key, and is computed only once per entry.
+ */
+static Datum
+gist_bbox_hilbert_abbrev_convert(Datum original, SortSupport ssup)
+{
+	return UInt64GetDatum(gist_bbox_hilbert_key(DatumGetBoxP(original)));
+}
+
+static int
+gist_bbox_hilbert_cmp_abbrev(Datum a, Datum b, SortSupport ssup)
+{
+	uint64		ka = DatumGetUInt64(a);
+	uint64		kb = DatumGetUInt64(b);
+
+	if (ka > kb)
+		return 1;
+	else if (ka < kb)
+		return -1;
+	else
+		return 0;
+}
+
+static bool
+gist_bbox_hilbert_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	/* The abbreviated key is the whole key, so it always pays off */
+	return false;
+}
+#endif
+
+Datum
+gist_box_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+#if SIZEOF_DATUM >= 8
+	if (ssup->abbreviate)
+	{
+		ssup->comparator = gist_bbox_hilbert_cmp_abbrev;
+		ssup->abbrev_converter = gist_bbox_hilbert_abbrev_convert;
+		ssup->abbrev_abort = gist_bbox_hilbert_abbrev_abort;
+		ssup->abbrev_full_comparator = gist_bbox_hilbert_cmp;
+		PG_RETURN_VOID();
+	}
+#endif
+
+	ssup->comparator = gist_bbox_hilbert_cmp;
+	PG_RETURN_VOID();
+}
@@ -99,6 +99,10 @@ gistbeginscan(Relation r, int nkeys, int norderbys)
 	/* workspaces with size dependent on numberOfOrderBys: */
 	so->distances = palloc(sizeof(so->distances[0]) * scan->numberOfOrderBys);
 	so->qual_ok = true;			/* in case there are zero keys */
+
+	/* workspace with size dependent on numberOfKeys: */
+	so->batchConsistentFns = palloc0(sizeof(FmgrInfo) * scan->numberOfKeys);
+	so->useBatchConsistent = false;
 	if (scan->numberOfOrderBys > 0)
 	{
 		scan->xs_orderbyvals = palloc0(sizeof(Datum) * scan->numberOfOrderBys);
@@ -212,6 +216,7 @@ gistrescan(IndexScanDesc scan, ScanKey key, int nkeys,
 	/* create new, empty pairing heap for search queue */
 	oldCxt = MemoryContextSwitchTo(so->queueCxt);
 	so->queue = pairingheap_allocate(pairingheap_GISTSearchItem_cmp, scan);
+	so->queueLength = 0;
 	MemoryContextSwitchTo(oldCxt);
 
 	so->firstCall = true;
@@ -246,12 +251,20 @@ gistrescan(IndexScanDesc scan, ScanKey key, int nkeys,
 		 * Next, if any of keys is a NULL and that key is not marked with
 		 * SK_SEARCHNULL/SK_SEARCHNOTNULL then nothing can be found (ie, we
 		 * assume all indexable operators are strict).
+		 *
+		 * Finally, if every key has a batch consistent function, leaf pages
+		 * of a non-ordered scan can be tested one key at a time for all the
+		 * entries on the page.  NULL tests can't be batched, so don't bother
+		 * if there are any.
 		 */
 		so->qual_ok = true;
+		so->useBatchConsistent = true;
 
 		for (i = 0; i < scan->numberOfKeys; i++)
 		{
 			ScanKey		skey = scan->keyData + i;
+			FmgrInfo   *batchfn = &(so->batchConsistentFns[i]);
+			void	   *batch_extra = batchfn->fn_extra;
 
 			/*
 			 * Copy consistent support function to ScanKey structure instead
@@ -269,6 +282,21 @@ gistrescan(IndexScanDesc scan, ScanKey key, int nkeys,
 			{
 				if (!(skey->sk_flags & (SK_SEARCHNULL | SK_SEARCHNOTNULL)))
 					so->qual_ok = false;
+				so->useBatchConsistent = false;
+			}
+
+			/* Likewise for the batch consistent function, if there is one */
+			if (OidIsValid(so->giststate->batchConsistentFn[skey->sk_attno - 1].fn_oid))
+			{
+				fmgr_info_copy(batchfn,
+							   &(so->giststate->batchConsistentFn[skey->sk_attno - 1]),
+							   so->giststate->scanCxt);
+				batchfn->fn_extra = batch_extra;
+			}
+			else
+			{
+				batchfn->fn_oid = InvalidOid;
+				so->useBatchConsistent = false;
 			}
 		}
 
@@ -356,3 +384,55 @@ gistendscan(IndexScanDesc scan)
 	 */
 	freeGISTstate(so->giststate);
 }
+
+/*
+ * gistestimateparallelscan -- estimate storage for GISTParallelScanDescData
+ */
+Size
+gistestimateparallelscan(void)
+{
+	return sizeof(GISTParallelScanDescData);
+}
+
+/*
+ * gistinitparallelscan -- initialize GISTParallelScanDesc for parallel scan
+ */
+void
+gistinitparallelscan(void *target)
+{
+	GISTParallelScanDesc gps = (GISTParallelScanDesc) target;
+
+	SpinLockInit(&gps->mutex);
+	ConditionVariableInit(&gps->cv);
+	gps->status = GISTPARALLEL_NOT_STARTED;
+	gps->rootlsn = InvalidXLogRecPtr;
+	gps->nblocks = 0;
+	gps->nextblock = 0;
+}
+
+/*
+ * gistparallelrescan() -- reset parallel scan
+ */
+void
+gistparallelrescan(IndexScanDesc scan)
+{
+	GISTParallelScanDesc gps;
+	ParallelIndexScanDesc parallel_scan = scan->parallel_scan;
+
+	Assert(parallel_scan);
+
+	gps = (GISTParallelScanDesc) OffsetToPointer((void *) parallel_scan,
+												 parallel_scan->ps_offset);
+
+	/*
+	 * In theory, we don't need to acquire the spinlock here, because there
+	 * shouldn't be any other workers running at this point, but we do so for
+	 * consistency.
+	 */
+	SpinLockAcquire(&gps->mutex);
+	gps->status = GISTPARALLEL_NOT_STARTED;
+	gps->rootlsn = InvalidXLogRecPtr;
+	gps->nblocks = 0;
+	gps->nextblock = 0;
+	SpinLockRelease(&gps->mutex);
+}
@@ -125,6 +125,8 @@ RelationGetIndexScan(Relation indexRelation, int nkeys, int norderbys)
 	scan->xs_hitup = NULL;
 	scan->xs_hitupdesc = NULL;
 
+	memset(&scan->instrument, 0, sizeof(IndexScanInstrumentation));
+
 	return scan;
 }
 
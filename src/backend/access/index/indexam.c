@@ -327,6 +327,9 @@ index_endscan(IndexScanDesc scan)
 	/* End the AM's scan */
 	scan->indexRelation->rd_indam->amendscan(scan);
 
+	/* Add the work it did to the statistics of the index */
+	pgstat_count_index_traversal(scan->indexRelation, &scan->instrument);
+
 	/* Release index refcount acquired by index_beginscan */
 	RelationDecrementReferenceCount(scan->indexRelation);
 
@@ -0,0 +1,454 @@
+/*-------------------------------------------------------------------------
+ *
+ * knnbatch.c
+ *	  batched nearest-neighbour searches
+ *
+ * A k-nearest-neighbour join, such as
+ *
+ *		SELECT ... FROM q CROSS JOIN LATERAL
+ *			(SELECT ... FROM t ORDER BY t.p <-> q.p LIMIT k)
+ *
+ * performs one ordered index scan per outer row, so the upper levels of the
+ * index are read and their distances computed again for every query point.
+ * An access method that supports amknnbatch can instead answer all the
+ * query points in a single traversal: the scan is started with one ORDER BY
+ * key per query point, so every index entry carries a vector of distances,
+ * one per query.  We keep a bounded result list of the k best matches so far
+ * for each query, and the access method descends into a subtree only if it
+ * could still improve the result of at least one query.  Subtrees are visited
+ * in order of the smallest distance to any query that still needs them, so
+ * the bounds tighten quickly.
+ *
+ * The result lists are kept here, so that the access methods only need to
+ * implement the traversal, and report candidate heap tuples with
+ * index_knn_batch_add().
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/index/knnbatch.c
+ *
+ * INTERFACE ROUTINES
+ *		index_knn_batch - find the k nearest neighbours of several values
+ *		index_knn_batch_results - get the result of one query
+ *		index_knn_batch_end - release a batch
+ *		index_knn_batch_useful - would entries at these distances help?
+ *		index_knn_batch_add - report a heap tuple found by the traversal
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/amapi.h"
+#include "access/relscan.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "catalog/index.h"
+#include "catalog/objectaddress.h"
+#include "catalog/pg_amop.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "executor/tuptable.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/float.h"
+#include "utils/geo_decls.h"
+#include "utils/lsyscache.h"
+#include "utils/regproc.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
+
+typedef struct IndexKnnBatchData
+{
+	IndexScanDesc scan;			/* the scan driving the traversal */
+	TupleTableSlot *slot;		/* for checking heap tuple visibility */
+	int			nqueries;
+	int			k;
+
+	/*
+	 * Result lists.  For query i, entries i * k to i * k + nresults[i] - 1 of
+	 * "tids" and "distances" hold the best matches found so far, in order of
+	 * increasing distance.
+	 */
+	int		   *nresults;
+	ItemPointerData *tids;
+	double	   *distances;
+} IndexKnnBatchData;
+
+/*
+ * Does an entry at the given distance from query "i" belong in its result?
+ */
+static inline bool
+knn_batch_improves(IndexKnnBatch batch, int i, double distance)
+{
+	if (batch->nresults[i] < batch->k)
+		return true;
+	return distance < batch->distances[(Size) i * batch->k + batch->k - 1];
+}
+
+/*
+ * index_knn_batch - find the k nearest neighbours of several values
+ *
+ * "orderbyop" is an ordering operator of the first index column's operator
+ * family, and "queries" are the values to order by, one search per value.
+ * All the searches are answered by a single traversal of the index, using
+ * the access method's amknnbatch callback.  The caller must hold a suitable
+ * lock on both relations, and release the result with index_knn_batch_end.
+ */
+IndexKnnBatch
+index_knn_batch(Relation heapRelation, Relation indexRelation,
+				Snapshot snapshot, Oid orderbyop,
+				Datum *queries, int nqueries, int k)
+{
+	IndexKnnBatch batch;
+	IndexScanDesc scan;
+	ScanKey		orderbys;
+	int			strategy;
+	Oid			lefttype;
+	Oid			righttype;
+	RegProcedure opfuncid;
+	int			i;
+
+	Assert(nqueries > 0 && k > 0);
+
+	if (indexRelation->rd_indam->amknnbatch == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("access method \"%s\" does not support batched nearest-neighbor searches",
+						get_am_name(indexRelation->rd_rel->relam))));
+
+	if (!SearchSysCacheExists3(AMOPOPID,
+							   ObjectIdGetDatum(orderbyop),
+							   CharGetDatum(AMOP_ORDER),
+							   ObjectIdGetDatum(indexRelation->rd_opfamily[0])))
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("operator %s is not an ordering operator of index \"%s\"",
+						format_operator(orderbyop),
+						RelationGetRelationName(indexRelation))));
+
+	get_op_opfamily_properties(orderbyop, indexRelation->rd_opfamily[0], true,
+							   &strategy, &lefttype, &righttype);
+	opfuncid = get_opcode(orderbyop);
+
+	orderbys = (ScanKey) palloc(sizeof(ScanKeyData) * nqueries);
+	for (i = 0; i < nqueries; i++)
+		ScanKeyEntryInitialize(&orderbys[i],
+							   SK_ORDER_BY,
+							   1,
+							   strategy,
+							   righttype,
+							   indexRelation->rd_indcollation[0],
+							   opfuncid,
+							   queries[i]);
+
+	batch = (IndexKnnBatch) palloc(sizeof(IndexKnnBatchData));
+	batch->nqueries = nqueries;
+	batch->k = k;
+	batch->nresults = (int *) palloc0(sizeof(int) * nqueries);
+	batch->tids = (ItemPointerData *)
+		palloc(mul_size(sizeof(ItemPointerData), mul_size(nqueries, k)));
+	batch->distances = (double *)
+		palloc(mul_size(sizeof(double), mul_size(nqueries, k)));
+
+	scan = index_beginscan(heapRelation, indexRelation, snapshot, 0, nqueries);
+	index_rescan(scan, NULL, 0, orderbys, nqueries);
+	batch->scan = scan;
+	batch->slot = table_slot_create(heapRelation, NULL);
+
+	indexRelation->rd_indam->amknnbatch(scan, batch);
+
+	ExecDropSingleTupleTableSlot(batch->slot);
+	batch->slot = NULL;
+	index_endscan(scan);
+	batch->scan = NULL;
+	pfree(orderbys);
+
+	return batch;
+}
+
+/*
+ * index_knn_batch_results - get the result of one query
+ *
+ * Sets *tids and *distances to arrays of the heap tuples nearest to query
+ * number "query", nearest first, and returns their number.
+ */
+int
+index_knn_batch_results(IndexKnnBatch batch, int query,
+						ItemPointer *tids, double **distances)
+{
+	Assert(query >= 0 && query < batch->nqueries);
+
+	*tids = &batch->tids[(Size) query * batch->k];
+	*distances = &batch->distances[(Size) query * batch->k];
+	return batch->nresults[query];
+}
+
+/*
+ * index_knn_batch_end - release a batch
+ */
+void
+index_knn_batch_end(IndexKnnBatch batch)
+{
+	pfree(batch->nresults);
+	pfree(batch->tids);
+	pfree(batch->distances);
+	pfree(batch);
+}
+
+/*
+ * index_knn_batch_useful - would entries at these distances help?
+ *
+ * "distances" holds one lower bound per query for the entries of an index
+ * subtree.  Returns true if the subtree could improve the result of some
+ * query, and sets *priority to the smallest bound among those queries.  The
+ * access method should visit useful subtrees in increasing order of priority
+ * and skip the rest; a subtree that was useful when it was queued must be
+ * checked again before it is visited, since the results may have improved
+ * in the meantime.
+ */
+bool
+index_knn_batch_useful(IndexKnnBatch batch, const double *distances,
+					   double *priority)
+{
+	bool		useful = false;
+	int			i;
+
+	*priority = get_float8_infinity();
+	for (i = 0; i < batch->nqueries; i++)
+	{
+		if (knn_batch_improves(batch, i, distances[i]))
+		{
+			useful = true;
+			if (distances[i] < *priority)
+				*priority = distances[i];
+		}
+	}
+
+	return useful;
+}
+
+/*
+ * index_knn_batch_add - report a heap tuple found by the traversal
+ *
+ * "distances" holds the exact distance of the tuple from each query.  The
+ * tuple is added to the result of every query it improves, if it is visible
+ * to the scan's snapshot.
+ */
+void
+index_knn_batch_add(IndexKnnBatch batch, ItemPointer tid,
+					const double *distances)
+{
+	IndexScanDesc scan = batch->scan;
+	bool		checked = false;
+	int			i;
+
+	for (i = 0; i < batch->nqueries; i++)
+	{
+		ItemPointer tids;
+		double	   *dists;
+		int			n;
+		int			j;
+
+		if (!knn_batch_improves(batch, i, distances[i]))
+			continue;
+
+		/*
+		 * Check visibility when the tuple first turns out to matter, and
+		 * remember the TID of the visible member of a HOT chain.
+		 */
+		if (!checked)
+		{
+			bool		call_again = false;
+			bool		all_dead = false;
+
+			if (!table_index_fetch_tuple(scan->xs_heapfetch, tid,
+										 scan->xs_snapshot, batch->slot,
+										 &call_again, &all_dead))
+				return;
+			tid = &batch->slot->tts_tid;
+			checked = true;
+		}
+
+		/* Insert it in order, pushing out the current k'th entry if full */
+		tids = &batch->tids[(Size) i * batch->k];
+		dists = &batch->distances[(Size) i * batch->k];
+		n = batch->nresults[i];
+		if (n == batch->k)
+			n--;
+		for (j = n; j > 0 && dists[j - 1] > distances[i]; j--)
+		{
+			tids[j] = tids[j - 1];
+			dists[j] = dists[j - 1];
+		}
+		tids[j] = *tid;
+		dists[j] = distances[i];
+		if (batch->nresults[i] < batch->k)
+			batch->nresults[i]++;
+	}
+}
+
+/*
+ * SQL-callable interface to find the nearest neighbours of several points
+ *
+ * Returns up to k rows per non-null element of the points array, giving the
+ * (1-based) array position, the TID of the heap tuple and its distance.
+ */
+Datum
+index_nearest_neighbors(PG_FUNCTION_ARGS)
+{
+#define INDEX_NEAREST_NEIGHBORS_COLS	3
+	Oid			indexoid = PG_GETARG_OID(0);
+	ArrayType  *queryarr = PG_GETARG_ARRAYTYPE_P(1);
+	int32		k = PG_GETARG_INT32(2);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	Oid			heapoid;
+	Relation	heapRel;
+	Relation	indexRel;
+	AclResult	aclresult;
+	Datum	   *elems;
+	bool	   *elemnulls;
+	int			nelems;
+	Datum	   *queries;
+	int		   *positions;
+	int			nqueries;
+	IndexKnnBatch batch;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (k <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of neighbors must be greater than zero")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/*
+	 * We must lock table before index to avoid deadlocks.  However, if the
+	 * passed indexoid isn't an index then IndexGetRelation() will fail.
+	 * Rather than emitting a not-very-helpful error message, postpone
+	 * complaining, expecting that the is-it-an-index test below will fail.
+	 */
+	heapoid = IndexGetRelation(indexoid, true);
+	if (OidIsValid(heapoid))
+		heapRel = table_open(heapoid, AccessShareLock);
+	else
+		heapRel = NULL;
+
+	indexRel = index_open(indexoid, AccessShareLock);
+
+	if (indexRel->rd_rel->relkind != RELKIND_INDEX)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not an index",
+						RelationGetRelationName(indexRel))));
+
+	/*
+	 * Since we did the IndexGetRelation call above without any lock, it's
+	 * barely possible that a race against an index drop/recreation could have
+	 * netted us the wrong table.  Recheck.
+	 */
+	if (heapRel == NULL || heapoid != IndexGetRelation(indexoid, false))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_TABLE),
+				 errmsg("could not open parent table of index %s",
+						RelationGetRelationName(indexRel))));
+
+	/* The result reveals the contents of the table */
+	aclresult = pg_class_aclcheck(heapoid, GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, get_relkind_objtype(heapRel->rd_rel->relkind),
+					   RelationGetRelationName(heapRel));
+
+	/* Null elements have no neighbours; search for the others */
+	deconstruct_array(queryarr, POINTOID, sizeof(Point), false, 'd',
+					  &elems, &elemnulls, &nelems);
+	queries = (Datum *) palloc(sizeof(Datum) * Max(nelems, 1));
+	positions = (int *) palloc(sizeof(int) * Max(nelems, 1));
+	nqueries = 0;
+	for (i = 0; i < nelems; i++)
+	{
+		if (elemnulls[i])
+			continue;
+		queries[nqueries] = elems[i];
+		positions[nqueries] = i + 1;
+		nqueries++;
+	}
+
+	if (nqueries > 0)
+	{
+		batch = index_knn_batch(heapRel, indexRel, GetActiveSnapshot(),
+								OID_POINT_DISTANCE_OP,
+								queries, nqueries, k);
+
+		for (i = 0; i < nqueries; i++)
+		{
+			ItemPointer tids;
+			double	   *distances;
+			int			n;
+			int			j;
+
+			n = index_knn_batch_results(batch, i, &tids, &distances);
+			for (j = 0; j < n; j++)
+			{
+				Datum		values[INDEX_NEAREST_NEIGHBORS_COLS];
+				bool		nulls[INDEX_NEAREST_NEIGHBORS_COLS];
+
+				MemSet(nulls, 0, sizeof(nulls));
+
+				values[0] = Int32GetDatum(positions[i]);
+				values[1] = PointerGetDatum(&tids[j]);
+				values[2] = Float8GetDatum(distances[j]);
+
+				tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+			}
+		}
+
+		index_knn_batch_end(batch);
+	}
+
+	index_close(indexRel, AccessShareLock);
+	table_close(heapRel, AccessShareLock);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
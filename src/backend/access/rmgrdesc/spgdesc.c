@@ -15,6 +15,7 @@
 #include "postgres.h"
 
 #include "access/spgxlog.h"
+#include "access/transam.h"
 
 void
 spg_desc(StringInfo buf, XLogReaderState *record)
@@ -67,7 +68,16 @@ spg_desc(StringInfo buf, XLogReaderState *record)
 			}
 			break;
 		case XLOG_SPGIST_VACUUM_LEAF:
-			/* no further information */
+			{
+				spgxlogVacuumLeaf *xlrec = (spgxlogVacuumLeaf *) rec;
+
+				appendStringInfo(buf, "dead %u, placeholder %u, move %u, chain %u",
+								 xlrec->nDead, xlrec->nPlaceholder,
+								 xlrec->nMove, xlrec->nChain);
+				if (TransactionIdIsValid(xlrec->latestRemovedXid))
+					appendStringInfo(buf, ", latestRemovedXid %u",
+									 xlrec->latestRemovedXid);
+			}
 			break;
 		case XLOG_SPGIST_VACUUM_ROOT:
 			/* no further information */
@@ -0,0 +1,1809 @@
+/*-------------------------------------------------------------------------
+ *
+ * spgbulk.c
+ *	  bulk loading of SP-GiST indexes
+ *
+ * Rather than inserting tuples one at a time, which makes every leaf chain
+ * go through repeated picksplit and moveLeafs cycles, an index build can
+ * collect all the leaf datums first and then partition the whole set
+ * recursively, top-down, using the opclass's picksplit function.  Each
+ * partition that fits on a page is written out as one leaf chain; larger
+ * partitions get an inner tuple and are split further.  See the README
+ * for more details.
+ *
+ * In a parallel build, each participant collects the items from its part
+ * of the heap in a shared temporary file.  The leader then splits the
+ * whole set at the root, all participants route their own items to the
+ * root's nodes, and finally the participants take turns claiming a node
+ * and loading its subtree.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *			src/backend/access/spgist/spgbulk.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/spgist_private.h"
+#include "commands/progress.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/buffile.h"
+#include "storage/bufmgr.h"
+#include "storage/condition_variable.h"
+#include "storage/lwlock.h"
+#include "storage/sharedfileset.h"
+#include "storage/spin.h"
+#include "utils/datum.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+
+/*
+ * Opclass picksplit functions allocate per-tuple work arrays with plain
+ * palloc, so we never hand them more tuples than this at once.
+ */
+#define SPGIST_BULK_MAX_ITEMS	((int) (MaxAllocSize / (4 * sizeof(Datum))))
+
+/* Phases of a parallel bulk load, see spgBulkFinish */
+#define SPGIST_BULK_PHASE_SCAN		0	/* collecting items */
+#define SPGIST_BULK_PHASE_ROUTE		1	/* routing them to the root's nodes */
+#define SPGIST_BULK_PHASE_LOAD		2	/* loading the nodes' subtrees */
+#define SPGIST_BULK_PHASE_DONE		3	/* leader loads everything alone */
+
+/* Kinds of shared temporary files, besides per-node ones; see bulkFileName */
+#define SPGIST_BULK_FILE_ITEMS		(-1)
+#define SPGIST_BULK_FILE_LEFTOVERS	(-2)
+
+/*
+ * A set of items to be loaded, held in memory.  datums[] are the original
+ * input datums (needed by the choose function), leafDatums[] the values to
+ * be stored in leaf tuples at the current level.  For opclasses without a
+ * compress method the two are usually identical.
+ */
+typedef struct SpGistBulkItems
+{
+	int			nitems;
+	ItemPointerData *heapPtrs;
+	Datum	   *leafDatums;
+	Datum	   *datums;
+} SpGistBulkItems;
+
+/*
+ * Header of an item written to a temporary file; the leaf datum and, if
+ * datumSize isn't zero, the input datum follow.  Null items, which only
+ * appear among the set-aside items, have neither.
+ */
+typedef struct SpGistBulkItemHeader
+{
+	ItemPointerData heapPtr;
+	bool		isnull;
+	uint32		leafSize;
+	uint32		datumSize;		/* 0 if input datum is the leaf datum */
+} SpGistBulkItemHeader;
+
+/*
+ * A sequence of temporary files, read as one.  In a parallel build, the
+ * items routed to a node of the root are spread over one file per
+ * participant.
+ */
+typedef struct SpGistBulkInput
+{
+	int			nfiles;
+	int			curfile;
+	BufFile   **files;
+} SpGistBulkInput;
+
+/*
+ * State shared by the participants of a parallel build, allocated in
+ * dynamic shared memory by the leader.
+ */
+struct SpGistBulkShared
+{
+	int			maxParticipants;	/* length of hasLeftovers[] */
+	SharedFileSet fileset;
+
+	/*
+	 * The participants are all members of the same lock group, so the
+	 * relation extension lock doesn't keep them from extending the index at
+	 * the same time.  This lock does.
+	 */
+	LWLock		extensionLock;
+
+	/* broadcast whenever phase or ndone changes */
+	ConditionVariable cv;
+
+	/* mutex protects all the fields below */
+	slock_t		mutex;
+	int			nParticipants;	/* set by leader when workers are running */
+	int			phase;
+	int			ndone;			/* participants done with current phase */
+	int64		nitems;			/* number of items collected */
+	Size		nbytes;			/* their total itemMemSpace */
+	Size		leafSpace;		/* their total leafTupleSpace */
+
+	/* the root's nodes, and what was routed to them */
+	int			nNodes;
+	int			nextNode;		/* next node to be claimed for loading */
+	int64		nodeItems[SGITMAXNNODES];
+	Size		nodeBytes[SGITMAXNNODES];
+	int			nodeLevels[SGITMAXNNODES];
+	ItemPointerData nodeChildren[SGITMAXNNODES];
+
+	/* does a participant have a file of set-aside items? */
+	bool		hasLeftovers[FLEXIBLE_ARRAY_MEMBER];
+};
+
+struct SpGistBulkState
+{
+	Relation	index;
+	SpGistState *state;
+	MemoryContext cxt;			/* context for temp files and this struct */
+
+	FmgrInfo   *compressProc;	/* NULL if opclass has no compress method */
+	FmgrInfo   *chooseProc;
+	FmgrInfo   *picksplitProc;
+
+	Size		memLimit;		/* memory we may use for items, in bytes */
+	int			chainSpace;		/* max space to fill with one leaf chain */
+
+	/* items collected so far, as long as they fit in memLimit */
+	MemoryContext spoolCxt;
+	SpGistBulkItems spool;
+	int			spoolSize;		/* allocated length of spool arrays */
+	Size		spoolBytes;
+
+	/* once memory is exhausted, all items are written here instead */
+	BufFile    *spill;
+	int64		spillItems;
+	Size		spillBytes;
+
+	/* total leafTupleSpace of the items collected */
+	Size		leafSpace;
+
+	/* items that couldn't be routed in bulk; inserted one by one at end */
+	BufFile    *leftovers;
+
+	/* number of items loaded so far, for progress reporting */
+	int64		nloaded;
+
+	/* parallel build only */
+	SpGistBulkShared *shared;
+	bool		isWorker;
+	int			participant;
+};
+
+
+/*
+ * Space needed on a page by a leaf tuple containing leafDatum, including
+ * its line pointer.  This must agree with spgFormLeafTuple.
+ */
+static int
+leafTupleSpace(SpGistState *state, Datum leafDatum)
+{
+	int			size;
+
+	size = SGLTHDRSZ + SpGistGetTypeSize(&state->attLeafType, leafDatum);
+	if (size < SGDTSIZE)
+		size = SGDTSIZE;
+
+	return size + sizeof(ItemIdData);
+}
+
+/*
+ * Size in bytes of the datum itself (0 for pass-by-value types)
+ */
+static Size
+datumDataSize(SpGistTypeDesc *att, Datum datum)
+{
+	if (att->attbyval)
+		return 0;
+	return datumGetSize(datum, att->attbyval, att->attlen);
+}
+
+/*
+ * Estimate of the memory an item occupies while we hold it in memory,
+ * including its share of the work arrays used while partitioning.
+ */
+static Size
+itemMemSpace(SpGistBulkState *bs, Datum leafDatum, Datum datum)
+{
+	Size		size;
+
+	size = sizeof(ItemPointerData) + 2 * sizeof(Datum) + sizeof(int);
+	size += datumDataSize(&bs->state->attLeafType, leafDatum);
+	if (datum != leafDatum)
+		size += datumDataSize(&bs->state->attType, datum);
+
+	return size;
+}
+
+/*
+ * Name of a shared temporary file of a participant: the items it collected,
+ * the items it set aside, or the items it routed to the root's node kind.
+ */
+static void
+bulkFileName(char *name, int participant, int kind)
+{
+	if (kind == SPGIST_BULK_FILE_ITEMS)
+		snprintf(name, MAXPGPATH, "p%d", participant);
+	else if (kind == SPGIST_BULK_FILE_LEFTOVERS)
+		snprintf(name, MAXPGPATH, "p%d.leftovers", participant);
+	else
+		snprintf(name, MAXPGPATH, "p%d.n%d", participant, kind);
+}
+
+/*
+ * Create a temporary file in bs->cxt.  In a parallel build, it's a shared
+ * file named after our participant number and the given kind.
+ */
+static BufFile *
+bulkCreateFile(SpGistBulkState *bs, int kind)
+{
+	MemoryContext oldcxt = MemoryContextSwitchTo(bs->cxt);
+	BufFile    *file;
+
+	if (bs->shared)
+	{
+		char		name[MAXPGPATH];
+
+		bulkFileName(name, bs->participant, kind);
+		file = BufFileCreateShared(&bs->shared->fileset, name);
+	}
+	else
+		file = BufFileCreateTemp(false);
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return file;
+}
+
+/*
+ * Write one item to a temporary file
+ */
+static void
+bulkWriteItem(SpGistBulkState *bs, BufFile *file, ItemPointer heapPtr,
+			  Datum leafDatum, Datum datum, bool isnull)
+{
+	SpGistTypeDesc *leafType = &bs->state->attLeafType;
+	SpGistTypeDesc *inputType = &bs->state->attType;
+	SpGistBulkItemHeader hdr;
+	void	   *leafData = NULL;
+	void	   *data = NULL;
+
+	hdr.heapPtr = *heapPtr;
+	hdr.isnull = isnull;
+
+	if (isnull)
+	{
+		hdr.leafSize = 0;
+		hdr.datumSize = 0;
+	}
+	else
+	{
+		if (leafType->attbyval)
+		{
+			hdr.leafSize = sizeof(Datum);
+			leafData = &leafDatum;
+		}
+		else
+		{
+			hdr.leafSize = datumDataSize(leafType, leafDatum);
+			leafData = DatumGetPointer(leafDatum);
+		}
+
+		if (datum == leafDatum)
+			hdr.datumSize = 0;
+		else if (inputType->attbyval)
+		{
+			hdr.datumSize = sizeof(Datum);
+			data = &datum;
+		}
+		else
+		{
+			hdr.datumSize = datumDataSize(inputType, datum);
+			data = DatumGetPointer(datum);
+		}
+	}
+
+	if (BufFileWrite(file, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+		(hdr.leafSize > 0 &&
+		 BufFileWrite(file, leafData, hdr.leafSize) != hdr.leafSize) ||
+		(hdr.datumSize > 0 &&
+		 BufFileWrite(file, data, hdr.datumSize) != hdr.datumSize))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to SP-GiST build temporary file: %m")));
+}
+
+/*
+ * Read back one datum of an item
+ */
+static Datum
+bulkReadDatum(BufFile *file, SpGistTypeDesc *att, uint32 size)
+{
+	Datum		datum;
+	void	   *ptr;
+
+	if (att->attbyval)
+	{
+		Assert(size == sizeof(Datum));
+		ptr = &datum;
+	}
+	else
+	{
+		ptr = palloc(size);
+		datum = PointerGetDatum(ptr);
+	}
+
+	if (BufFileRead(file, ptr, size) != size)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from SP-GiST build temporary file: %m")));
+
+	return datum;
+}
+
+/*
+ * Read the next item from a temporary file into CurrentMemoryContext.
+ * Returns false at end of file.
+ *
+ * isnull may be NULL if the file can't contain null items.
+ */
+static bool
+bulkReadItem(SpGistBulkState *bs, BufFile *file, ItemPointer heapPtr,
+			 Datum *leafDatum, Datum *datum, bool *isnull)
+{
+	SpGistBulkItemHeader hdr;
+	size_t		nread;
+
+	nread = BufFileRead(file, &hdr, sizeof(hdr));
+	if (nread == 0)
+		return false;
+	if (nread != sizeof(hdr))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from SP-GiST build temporary file: %m")));
+
+	*heapPtr = hdr.heapPtr;
+	if (isnull)
+		*isnull = hdr.isnull;
+	else
+		Assert(!hdr.isnull);
+
+	if (hdr.isnull)
+	{
+		*leafDatum = *datum = (Datum) 0;
+		return true;
+	}
+
+	*leafDatum = bulkReadDatum(file, &bs->state->attLeafType, hdr.leafSize);
+	if (hdr.datumSize == 0)
+		*datum = *leafDatum;
+	else
+		*datum = bulkReadDatum(file, &bs->state->attType, hdr.datumSize);
+
+	return true;
+}
+
+static void
+bulkRewind(BufFile *file)
+{
+	if (BufFileSeek(file, 0, 0L, SEEK_SET))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not rewind SP-GiST build temporary file: %m")));
+}
+
+/*
+ * Make an input out of an array of temporary files, which it takes over
+ */
+static SpGistBulkInput *
+bulkMakeInput(BufFile **files, int nfiles)
+{
+	SpGistBulkInput *input = (SpGistBulkInput *) palloc(sizeof(SpGistBulkInput));
+
+	input->nfiles = nfiles;
+	input->curfile = 0;
+	input->files = files;
+
+	return input;
+}
+
+/*
+ * Make an input out of a single temporary file
+ */
+static SpGistBulkInput *
+bulkMakeFileInput(BufFile *file)
+{
+	BufFile   **files = (BufFile **) palloc(sizeof(BufFile *));
+
+	files[0] = file;
+
+	return bulkMakeInput(files, 1);
+}
+
+/*
+ * Open the shared files of the given kind of all participants as one input
+ */
+static SpGistBulkInput *
+bulkOpenSharedInput(SpGistBulkState *bs, int kind)
+{
+	int			nfiles = bs->shared->nParticipants;
+	BufFile   **files = (BufFile **) palloc(sizeof(BufFile *) * nfiles);
+	int			i;
+
+	for (i = 0; i < nfiles; i++)
+	{
+		char		name[MAXPGPATH];
+
+		bulkFileName(name, i, kind);
+		files[i] = BufFileOpenShared(&bs->shared->fileset, name);
+	}
+
+	return bulkMakeInput(files, nfiles);
+}
+
+static bool
+bulkInputRead(SpGistBulkState *bs, SpGistBulkInput *input,
+			  ItemPointer heapPtr, Datum *leafDatum, Datum *datum)
+{
+	while (input->curfile < input->nfiles)
+	{
+		if (bulkReadItem(bs, input->files[input->curfile],
+						 heapPtr, leafDatum, datum, NULL))
+			return true;
+		input->curfile++;
+	}
+
+	return false;
+}
+
+static void
+bulkInputRewind(SpGistBulkInput *input)
+{
+	int			i;
+
+	for (i = 0; i < input->nfiles; i++)
+		bulkRewind(input->files[i]);
+	input->curfile = 0;
+}
+
+static void
+bulkInputClose(SpGistBulkInput *input)
+{
+	int			i;
+
+	for (i = 0; i < input->nfiles; i++)
+		BufFileClose(input->files[i]);
+	pfree(input->files);
+	pfree(input);
+}
+
+/*
+ * Set an item aside, to be inserted normally after the bulk load
+ */
+static void
+bulkSetAside(SpGistBulkState *bs, ItemPointer heapPtr, Datum leafDatum,
+			 Datum datum, bool isnull)
+{
+	if (bs->leftovers == NULL)
+		bs->leftovers = bulkCreateFile(bs, SPGIST_BULK_FILE_LEFTOVERS);
+
+	bulkWriteItem(bs, bs->leftovers, heapPtr, leafDatum, datum, isnull);
+}
+
+/*
+ * Set aside all the items of an input, and close it
+ */
+static void
+bulkSetAsideInput(SpGistBulkState *bs, SpGistBulkInput *input)
+{
+	MemoryContext itemCxt,
+				oldcxt;
+	ItemPointerData heapPtr;
+	Datum		leafDatum;
+	Datum		datum;
+
+	itemCxt = AllocSetContextCreate(CurrentMemoryContext,
+									"SP-GiST bulk load item",
+									ALLOCSET_DEFAULT_SIZES);
+	oldcxt = MemoryContextSwitchTo(itemCxt);
+
+	bulkInputRewind(input);
+	while (bulkInputRead(bs, input, &heapPtr, &leafDatum, &datum))
+	{
+		bulkSetAside(bs, &heapPtr, leafDatum, datum, false);
+		MemoryContextReset(itemCxt);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(itemCxt);
+	bulkInputClose(input);
+}
+
+/*
+ * Call the opclass's picksplit function on a set of leaf datums, and
+ * force allTheSame mode if it failed to separate them, like doPickSplit.
+ */
+static void
+bulkPickSplit(SpGistBulkState *bs, int nitems, Datum *leafDatums, int level,
+			  spgPickSplitOut *out, bool *allTheSame)
+{
+	spgPickSplitIn in;
+	bool		includeNew;
+	int			i;
+
+	in.nTuples = nitems;
+	in.datums = leafDatums;
+	in.level = level;
+	in.looseness = bs->state->looseness;
+	in.splitStrategy = bs->state->splitStrategy;
+
+	memset(out, 0, sizeof(*out));
+
+	FunctionCall2Coll(bs->picksplitProc,
+					  bs->index->rd_indcollation[0],
+					  PointerGetDatum(&in),
+					  PointerGetDatum(out));
+
+	*allTheSame = spgCheckAllTheSame(&in, out, false, &includeNew);
+
+	for (i = 0; i < nitems; i++)
+	{
+		if (out->mapTuplesToNodes[i] < 0 ||
+			out->mapTuplesToNodes[i] >= out->nNodes)
+			elog(ERROR, "inconsistent result of SPGiST picksplit function");
+	}
+}
+
+/*
+ * Call the opclass's choose function for an item, as spgdoinsert would
+ * when descending into innerTuple.  nodeLabels are the tuple's labels as
+ * returned by spgExtractNodeLabels.
+ */
+static void
+bulkChoose(SpGistBulkState *bs, Datum datum, Datum leafDatum, int level,
+		   SpGistInnerTuple innerTuple, Datum *nodeLabels, spgChooseOut *out)
+{
+	spgChooseIn in;
+
+	in.datum = datum;
+	in.leafDatum = leafDatum;
+	in.level = level;
+	in.looseness = bs->state->looseness;
+	in.allTheSame = innerTuple->allTheSame;
+	in.hasPrefix = (innerTuple->prefixSize > 0);
+	in.prefixDatum = SGITDATUM(innerTuple, bs->state);
+	in.nNodes = innerTuple->nNodes;
+	in.nodeLabels = nodeLabels;
+
+	memset(out, 0, sizeof(*out));
+
+	FunctionCall2Coll(bs->chooseProc,
+					  bs->index->rd_indcollation[0],
+					  PointerGetDatum(&in),
+					  PointerGetDatum(out));
+}
+
+/*
+ * Get a buffer with room for needSpace bytes, as SpGistGetBuffer does
+ */
+static Buffer
+bulkGetBuffer(SpGistBulkState *bs, int flags, int needSpace)
+{
+	Buffer		buffer;
+	bool		isNew;
+
+	if (bs->shared)
+		LWLockAcquire(&bs->shared->extensionLock, LW_EXCLUSIVE);
+
+	buffer = SpGistGetBuffer(bs->index, flags, needSpace, &isNew);
+
+	if (bs->shared)
+		LWLockRelease(&bs->shared->extensionLock);
+
+	return buffer;
+}
+
+/*
+ * Form an inner tuple from a picksplit result, with invalid downlinks, and
+ * store it.  The root's inner tuple goes to the root page, which we
+ * reinitialize as an inner page; otherwise we follow the same triple-parity
+ * rule as doPickSplit.  The tuple's address is returned in *result, and
+ * a copy of it as function result.
+ */
+static SpGistInnerTuple
+bulkAddInnerTuple(SpGistBulkState *bs, spgPickSplitOut *out, bool allTheSame,
+				  BlockNumber parentBlkno, ItemPointer result)
+{
+	SpGistInnerTuple innerTuple;
+	SpGistNodeTuple *nodes;
+	Buffer		buffer;
+	Page		page;
+	OffsetNumber offnum;
+	int			i;
+
+	nodes = (SpGistNodeTuple *) palloc(sizeof(SpGistNodeTuple) * out->nNodes);
+	for (i = 0; i < out->nNodes; i++)
+	{
+		Datum		label = (Datum) 0;
+		bool		labelisnull = (out->nodeLabels == NULL);
+
+		if (!labelisnull)
+			label = out->nodeLabels[i];
+		nodes[i] = spgFormNodeTuple(bs->state, label, labelisnull);
+	}
+	innerTuple = spgFormInnerTuple(bs->state,
+								   out->hasPrefix, out->prefixDatum,
+								   out->nNodes, nodes);
+	innerTuple->allTheSame = allTheSame;
+
+	if (parentBlkno == InvalidBlockNumber)
+	{
+		buffer = ReadBuffer(bs->index, SPGIST_ROOT_BLKNO);
+		LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buffer);
+
+		SpGistInitBuffer(buffer, 0);
+		offnum = PageAddItem(page, (Item) innerTuple, innerTuple->size,
+							 InvalidOffsetNumber, false, false);
+		if (offnum != FirstOffsetNumber)
+			elog(ERROR, "failed to add item of size %u to SPGiST index page",
+				 innerTuple->size);
+	}
+	else
+	{
+		buffer = bulkGetBuffer(bs, GBUF_INNER_PARITY(parentBlkno + 1),
+							   innerTuple->size + sizeof(ItemIdData));
+		page = BufferGetPage(buffer);
+
+		offnum = SpGistPageAddNewItem(bs->state, page,
+									  (Item) innerTuple, innerTuple->size,
+									  NULL, false);
+	}
+
+	MarkBufferDirty(buffer);
+	ItemPointerSet(result, BufferGetBlockNumber(buffer), offnum);
+
+	SpGistSetLastUsedPage(bs->index, buffer);
+	UnlockReleaseBuffer(buffer);
+
+	return innerTuple;
+}
+
+/*
+ * Read back a copy of an inner tuple, stored by another participant
+ */
+static SpGistInnerTuple
+bulkReadInnerTuple(SpGistBulkState *bs, ItemPointer inner)
+{
+	Buffer		buffer;
+	Page		page;
+	SpGistInnerTuple innerTuple;
+	SpGistInnerTuple result;
+
+	buffer = ReadBuffer(bs->index, ItemPointerGetBlockNumber(inner));
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buffer);
+
+	innerTuple = (SpGistInnerTuple)
+		PageGetItem(page, PageGetItemId(page, ItemPointerGetOffsetNumber(inner)));
+	result = (SpGistInnerTuple) palloc(innerTuple->size);
+	memcpy(result, innerTuple, innerTuple->size);
+
+	UnlockReleaseBuffer(buffer);
+
+	return result;
+}
+
+/*
+ * Fill in the downlinks of an inner tuple stored by bulkAddInnerTuple,
+ * once its children have been loaded.
+ */
+static void
+bulkSetDownlinks(SpGistBulkState *bs, ItemPointer inner, int nNodes,
+				 ItemPointerData *children)
+{
+	Buffer		buffer;
+	Page		page;
+	SpGistInnerTuple innerTuple;
+	int			i;
+
+	buffer = ReadBuffer(bs->index, ItemPointerGetBlockNumber(inner));
+	LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+	page = BufferGetPage(buffer);
+
+	innerTuple = (SpGistInnerTuple)
+		PageGetItem(page, PageGetItemId(page, ItemPointerGetOffsetNumber(inner)));
+
+	for (i = 0; i < nNodes; i++)
+	{
+		if (ItemPointerIsValid(&children[i]))
+			spgUpdateNodeLink(innerTuple, i,
+							  ItemPointerGetBlockNumber(&children[i]),
+							  ItemPointerGetOffsetNumber(&children[i]));
+	}
+
+	MarkBufferDirty(buffer);
+	UnlockReleaseBuffer(buffer);
+}
+
+/*
+ * Store a set of items as one leaf chain, and return the chain head.
+ *
+ * On the root page leaf tuples aren't chained, and there's no downlink
+ * to return.
+ */
+static void
+bulkAddLeafChain(SpGistBulkState *bs, SpGistBulkItems *items, int totalSize,
+				 bool isRoot, ItemPointer result)
+{
+	Buffer		buffer;
+	Page		page;
+	OffsetNumber head = InvalidOffsetNumber;
+	int			n;
+
+	if (isRoot)
+	{
+		buffer = ReadBuffer(bs->index, SPGIST_ROOT_BLKNO);
+		LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+	}
+	else
+		buffer = bulkGetBuffer(bs, GBUF_LEAF,
+							   Min(totalSize, SPGIST_PAGE_CAPACITY));
+	page = BufferGetPage(buffer);
+
+	/*
+	 * Add in reverse, so that the chain comes out in input order.  The root
+	 * page is scanned in offset order instead, so fill it front to back.
+	 */
+	for (n = 0; n < items->nitems; n++)
+	{
+		int			i = isRoot ? n : items->nitems - 1 - n;
+		SpGistLeafTuple leafTuple;
+
+		leafTuple = spgFormLeafTuple(bs->state, &items->heapPtrs[i],
+									 items->leafDatums[i], false);
+		leafTuple->nextOffset = isRoot ? InvalidOffsetNumber : head;
+		head = SpGistPageAddNewItem(bs->state, page,
+									(Item) leafTuple, leafTuple->size,
+									NULL, false);
+		pfree(leafTuple);
+	}
+
+	MarkBufferDirty(buffer);
+
+	if (isRoot)
+		ItemPointerSetInvalid(result);
+	else
+		ItemPointerSet(result, BufferGetBlockNumber(buffer), head);
+
+	SpGistSetLastUsedPage(bs->index, buffer);
+	UnlockReleaseBuffer(buffer);
+
+	bs->nloaded += items->nitems;
+	pgstat_progress_update_param(PROGRESS_CREATEIDX_TUPLES_DONE, bs->nloaded);
+}
+
+/*
+ * Load a set of items held in memory as the subtree below a node of the
+ * inner tuple on page parentBlkno (InvalidBlockNumber for the root), and
+ * return the address of the subtree's top in *result.
+ */
+static void
+bulkLoadItems(SpGistBulkState *bs, SpGistBulkItems *items, int level,
+			  BlockNumber parentBlkno, ItemPointer result)
+{
+	MemoryContext cxt,
+				oldcxt;
+	spgPickSplitOut out;
+	bool		allTheSame;
+	SpGistInnerTuple innerTuple;
+	Datum	   *nodeLabels;
+	ItemPointerData inner;
+	ItemPointerData *children;
+	SpGistBulkItems *parts;
+	int		   *firstItem;
+	int			totalSize = 0;
+	int			i,
+				n;
+
+	check_stack_depth();
+	CHECK_FOR_INTERRUPTS();
+
+	for (i = 0; i < items->nitems && totalSize <= bs->chainSpace; i++)
+		totalSize += leafTupleSpace(bs->state, items->leafDatums[i]);
+
+	/*
+	 * If the items fit on a page, we're done.  A single item always goes to
+	 * a leaf; it's been checked to fit on a page when it was added.
+	 */
+	if (totalSize <= bs->chainSpace || items->nitems == 1)
+	{
+		bulkAddLeafChain(bs, items, totalSize,
+						 parentBlkno == InvalidBlockNumber, result);
+		return;
+	}
+
+	cxt = AllocSetContextCreate(CurrentMemoryContext,
+								"SP-GiST bulk load",
+								ALLOCSET_DEFAULT_SIZES);
+	oldcxt = MemoryContextSwitchTo(cxt);
+
+	bulkPickSplit(bs, items->nitems, items->leafDatums, level,
+				  &out, &allTheSame);
+	innerTuple = bulkAddInnerTuple(bs, &out, allTheSame, parentBlkno, &inner);
+	nodeLabels = spgExtractNodeLabels(bs->state, innerTuple);
+
+	/* Distribute the items to their nodes, keeping their order */
+	parts = (SpGistBulkItems *) palloc0(sizeof(SpGistBulkItems) * out.nNodes);
+	firstItem = (int *) palloc(sizeof(int) * out.nNodes);
+	for (i = items->nitems - 1; i >= 0; i--)
+	{
+		n = out.mapTuplesToNodes[i];
+		parts[n].nitems++;
+		firstItem[n] = i;
+	}
+	for (n = 0; n < out.nNodes; n++)
+	{
+		if (parts[n].nitems == 0)
+			continue;
+		parts[n].heapPtrs = (ItemPointerData *)
+			palloc(sizeof(ItemPointerData) * parts[n].nitems);
+		parts[n].leafDatums = (Datum *) palloc(sizeof(Datum) * parts[n].nitems);
+		parts[n].datums = (Datum *) palloc(sizeof(Datum) * parts[n].nitems);
+		parts[n].nitems = 0;
+	}
+	for (i = 0; i < items->nitems; i++)
+	{
+		SpGistBulkItems *part = &parts[out.mapTuplesToNodes[i]];
+
+		part->heapPtrs[part->nitems] = items->heapPtrs[i];
+		part->leafDatums[part->nitems] = out.leafTupleDatums[i];
+		part->datums[part->nitems] = items->datums[i];
+		part->nitems++;
+	}
+
+	/*
+	 * Load each node's items.  The level of a child is whatever the choose
+	 * function would report when descending to it, so ask it about one of
+	 * the node's items.
+	 */
+	children = (ItemPointerData *) palloc(sizeof(ItemPointerData) * out.nNodes);
+	for (n = 0; n < out.nNodes; n++)
+	{
+		spgChooseOut cout;
+
+		ItemPointerSetInvalid(&children[n]);
+		if (parts[n].nitems == 0)
+			continue;
+
+		bulkChoose(bs, items->datums[firstItem[n]],
+				   items->leafDatums[firstItem[n]], level,
+				   innerTuple, nodeLabels, &cout);
+		if (cout.resultType != spgMatchNode)
+			elog(ERROR, "inconsistent result of SPGiST choose function");
+
+		bulkLoadItems(bs, &parts[n], level + cout.result.matchNode.levelAdd,
+					  ItemPointerGetBlockNumber(&inner), &children[n]);
+	}
+
+	bulkSetDownlinks(bs, &inner, out.nNodes, children);
+	*result = inner;
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(cxt);
+}
+
+/*
+ * Run picksplit on an evenly spaced sample of the nitems items of an input,
+ * small enough to fit in memory, and store the resulting inner tuple as
+ * bulkAddInnerTuple does.
+ */
+static SpGistInnerTuple
+bulkSplitInput(SpGistBulkState *bs, SpGistBulkInput *input, int64 nitems,
+			   Size nbytes, int level, BlockNumber parentBlkno,
+			   ItemPointer result)
+{
+	MemoryContext sampleCxt,
+				itemCxt,
+				oldcxt;
+	Datum	   *sample;
+	int64		sampleSize;
+	int64		step;
+	int64		i;
+	int			nsample = 0;
+	ItemPointerData heapPtr;
+	Datum		leafDatum;
+	Datum		datum;
+	spgPickSplitOut out;
+	bool		allTheSame;
+	SpGistInnerTuple innerTuple;
+
+	sampleSize = Min(SPGIST_BULK_MAX_ITEMS,
+					 bs->memLimit / Max(nbytes / nitems, 1));
+	sampleSize = Max(sampleSize, 2);
+	step = (nitems + sampleSize - 1) / sampleSize;
+
+	sampleCxt = AllocSetContextCreate(CurrentMemoryContext,
+									  "SP-GiST bulk load sample",
+									  ALLOCSET_DEFAULT_SIZES);
+	itemCxt = AllocSetContextCreate(CurrentMemoryContext,
+									"SP-GiST bulk load item",
+									ALLOCSET_DEFAULT_SIZES);
+
+	oldcxt = MemoryContextSwitchTo(sampleCxt);
+	sample = (Datum *) palloc(sizeof(Datum) * sampleSize);
+
+	bulkInputRewind(input);
+	for (i = 0; i < nitems; i++)
+	{
+		bool		keep = (i % step == 0);
+
+		MemoryContextSwitchTo(keep ? sampleCxt : itemCxt);
+		if (!bulkInputRead(bs, input, &heapPtr, &leafDatum, &datum))
+			elog(ERROR, "unexpected end of SP-GiST build temporary file");
+		if (keep)
+			sample[nsample++] = leafDatum;
+		MemoryContextReset(itemCxt);
+	}
+
+	MemoryContextSwitchTo(sampleCxt);
+	bulkPickSplit(bs, nsample, sample, level, &out, &allTheSame);
+
+	/* Only the inner tuple itself is needed from here on */
+	MemoryContextSwitchTo(oldcxt);
+	innerTuple = bulkAddInnerTuple(bs, &out, allTheSame, parentBlkno, result);
+
+	MemoryContextDelete(itemCxt);
+	MemoryContextDelete(sampleCxt);
+
+	return innerTuple;
+}
+
+/*
+ * Route every item of an input to one of the nodes of innerTuple, which is
+ * at the given level, using the choose function.  Each node's items are
+ * written to childFiles[n], which is created in CurrentMemoryContext if
+ * it's NULL, and counted in the other arrays.  Items for which choose asks
+ * to change the inner tuple can't be handled that way; they are set aside.
+ */
+static void
+bulkRouteInput(SpGistBulkState *bs, SpGistBulkInput *input, int level,
+			   SpGistInnerTuple innerTuple, BufFile **childFiles,
+			   int64 *childItems, Size *childBytes, int *childLevels)
+{
+	MemoryContext itemCxt,
+				oldcxt;
+	Datum	   *nodeLabels;
+	int			nNodes = innerTuple->nNodes;
+	int			nextNode = 0;
+	ItemPointerData heapPtr;
+	Datum		leafDatum;
+	Datum		datum;
+
+	nodeLabels = spgExtractNodeLabels(bs->state, innerTuple);
+
+	itemCxt = AllocSetContextCreate(CurrentMemoryContext,
+									"SP-GiST bulk load item",
+									ALLOCSET_DEFAULT_SIZES);
+	oldcxt = MemoryContextSwitchTo(itemCxt);
+
+	bulkInputRewind(input);
+	while (bulkInputRead(bs, input, &heapPtr, &leafDatum, &datum))
+	{
+		spgChooseOut cout;
+		int			n;
+
+		CHECK_FOR_INTERRUPTS();
+
+		bulkChoose(bs, datum, leafDatum, level, innerTuple, nodeLabels, &cout);
+
+		if (cout.resultType == spgMatchNode)
+		{
+			Datum		restDatum = cout.result.matchNode.restDatum;
+
+			/* as in spgdoinsert, core picks the node in allTheSame case */
+			if (innerTuple->allTheSame)
+				n = nextNode++ % nNodes;
+			else
+				n = cout.result.matchNode.nodeN;
+			if (n < 0 || n >= nNodes)
+				elog(ERROR, "inconsistent result of SPGiST choose function");
+
+			if (childFiles[n] == NULL)
+			{
+				MemoryContextSwitchTo(oldcxt);
+				childFiles[n] = BufFileCreateTemp(false);
+				MemoryContextSwitchTo(itemCxt);
+			}
+			if (childItems[n] == 0)
+				childLevels[n] = level + cout.result.matchNode.levelAdd;
+
+			bulkWriteItem(bs, childFiles[n], &heapPtr, restDatum, datum, false);
+			childItems[n]++;
+			childBytes[n] += itemMemSpace(bs, restDatum, datum);
+		}
+		else
+		{
+			bulkSetAside(bs, &heapPtr, leafDatum, datum, false);
+		}
+
+		MemoryContextReset(itemCxt);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(itemCxt);
+}
+
+/*
+ * Load the nitems items of an input, like bulkLoadItems.  The input is
+ * closed on return.
+ *
+ * If the items fit in memory, they are simply read back and loaded from
+ * there.  Otherwise we split a sample of them to form the inner tuple,
+ * route every item to one of its nodes, writing each node's items to a new
+ * file, and load those in turn.
+ */
+static void
+bulkLoadInput(SpGistBulkState *bs, SpGistBulkInput *input, int64 nitems,
+			  Size nbytes, int level, BlockNumber parentBlkno,
+			  ItemPointer result)
+{
+	MemoryContext cxt,
+				oldcxt;
+	SpGistInnerTuple innerTuple;
+	int			nNodes;
+	ItemPointerData inner;
+	ItemPointerData *children;
+	BufFile   **childFiles;
+	int64	   *childItems;
+	Size	   *childBytes;
+	int		   *childLevels;
+	int			n;
+
+	check_stack_depth();
+	CHECK_FOR_INTERRUPTS();
+
+	cxt = AllocSetContextCreate(CurrentMemoryContext,
+								"SP-GiST bulk load",
+								ALLOCSET_DEFAULT_SIZES);
+	oldcxt = MemoryContextSwitchTo(cxt);
+
+	if (nitems <= SPGIST_BULK_MAX_ITEMS && nbytes <= bs->memLimit)
+	{
+		SpGistBulkItems items;
+		ItemPointerData heapPtr;
+		Datum		leafDatum;
+		Datum		datum;
+
+		items.nitems = 0;
+		items.heapPtrs = (ItemPointerData *)
+			palloc(sizeof(ItemPointerData) * nitems);
+		items.leafDatums = (Datum *) palloc(sizeof(Datum) * nitems);
+		items.datums = (Datum *) palloc(sizeof(Datum) * nitems);
+
+		bulkInputRewind(input);
+		while (bulkInputRead(bs, input, &heapPtr, &leafDatum, &datum))
+		{
+			Assert(items.nitems < nitems);
+			items.heapPtrs[items.nitems] = heapPtr;
+			items.leafDatums[items.nitems] = leafDatum;
+			items.datums[items.nitems] = datum;
+			items.nitems++;
+		}
+		bulkInputClose(input);
+
+		bulkLoadItems(bs, &items, level, parentBlkno, result);
+
+		MemoryContextSwitchTo(oldcxt);
+		MemoryContextDelete(cxt);
+		return;
+	}
+
+	innerTuple = bulkSplitInput(bs, input, nitems, nbytes, level,
+								parentBlkno, &inner);
+	nNodes = innerTuple->nNodes;
+
+	childFiles = (BufFile **) palloc0(sizeof(BufFile *) * nNodes);
+	childItems = (int64 *) palloc0(sizeof(int64) * nNodes);
+	childBytes = (Size *) palloc0(sizeof(Size) * nNodes);
+	childLevels = (int *) palloc0(sizeof(int) * nNodes);
+
+	bulkRouteInput(bs, input, level, innerTuple,
+				   childFiles, childItems, childBytes, childLevels);
+	bulkInputClose(input);
+
+	children = (ItemPointerData *) palloc(sizeof(ItemPointerData) * nNodes);
+	for (n = 0; n < nNodes; n++)
+	{
+		SpGistBulkInput *child;
+
+		ItemPointerSetInvalid(&children[n]);
+		if (childFiles[n] == NULL)
+			continue;
+		child = bulkMakeFileInput(childFiles[n]);
+
+		/*
+		 * If all the items went to the same node, splitting this node in
+		 * turn might never make progress, for instance if the items are all
+		 * equal and the opclass can't use allTheSame mode.  Leave the node
+		 * empty and set the items aside instead.
+		 */
+		if (childItems[n] == nitems)
+		{
+			bulkSetAsideInput(bs, child);
+			continue;
+		}
+
+		bulkLoadInput(bs, child, childItems[n], childBytes[n],
+					  childLevels[n], ItemPointerGetBlockNumber(&inner),
+					  &children[n]);
+	}
+
+	bulkSetDownlinks(bs, &inner, nNodes, children);
+	*result = inner;
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(cxt);
+}
+
+/*
+ * Move the items collected in memory to a temporary file
+ */
+static void
+bulkSpill(SpGistBulkState *bs)
+{
+	int			i;
+
+	bs->spill = bulkCreateFile(bs, SPGIST_BULK_FILE_ITEMS);
+
+	for (i = 0; i < bs->spool.nitems; i++)
+		bulkWriteItem(bs, bs->spill, &bs->spool.heapPtrs[i],
+					  bs->spool.leafDatums[i], bs->spool.datums[i], false);
+	bs->spillItems = bs->spool.nitems;
+	bs->spillBytes = bs->spoolBytes;
+
+	/* From now on, all items go directly to the file */
+	MemoryContextReset(bs->spoolCxt);
+	bs->spool.nitems = 0;
+	bs->spool.heapPtrs = NULL;
+	bs->spool.leafDatums = NULL;
+	bs->spool.datums = NULL;
+	bs->spoolSize = 0;
+	bs->spoolBytes = 0;
+}
+
+/*
+ * Insert the set-aside items in a temporary file one by one
+ */
+static void
+bulkInsertLeftovers(SpGistBulkState *bs, BufFile *file)
+{
+	MemoryContext tmpCxt,
+				oldcxt;
+	ItemPointerData heapPtr;
+	Datum		leafDatum;
+	Datum		datum;
+	bool		isnull;
+
+	tmpCxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "SP-GiST bulk load leftovers",
+								   ALLOCSET_DEFAULT_SIZES);
+	oldcxt = MemoryContextSwitchTo(tmpCxt);
+
+	bulkRewind(file);
+	while (bulkReadItem(bs, file, &heapPtr, &leafDatum, &datum, &isnull))
+	{
+		/* see spgistBuildCallback about retrying */
+		while (!spgdoinsert(bs->index, bs->state, &heapPtr, datum, isnull))
+			;
+		MemoryContextReset(tmpCxt);
+
+		bs->nloaded++;
+		pgstat_progress_update_param(PROGRESS_CREATEIDX_TUPLES_DONE,
+									 bs->nloaded);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(tmpCxt);
+}
+
+/*
+ * In a parallel build, report that we're done with the current phase.  If
+ * it's our last one, also hand our set-aside items over to the leader.
+ */
+static void
+bulkPhaseDone(SpGistBulkState *bs, bool last)
+{
+	SpGistBulkShared *shared = bs->shared;
+	bool		hasLeftovers = false;
+
+	if (last && bs->leftovers)
+	{
+		BufFileExportShared(bs->leftovers);
+		BufFileClose(bs->leftovers);
+		bs->leftovers = NULL;
+		hasLeftovers = true;
+	}
+
+	SpinLockAcquire(&shared->mutex);
+	if (hasLeftovers)
+		shared->hasLeftovers[bs->participant] = true;
+	shared->ndone++;
+	SpinLockRelease(&shared->mutex);
+
+	ConditionVariableBroadcast(&shared->cv);
+}
+
+/*
+ * Within a worker, wait for the leader to move on from the given phase,
+ * and return the new phase.
+ */
+static int
+bulkWaitForPhase(SpGistBulkShared *shared, int phase)
+{
+	int			newphase;
+
+	for (;;)
+	{
+		SpinLockAcquire(&shared->mutex);
+		newphase = shared->phase;
+		SpinLockRelease(&shared->mutex);
+
+		if (newphase != phase)
+			break;
+
+		ConditionVariableSleep(&shared->cv,
+							   WAIT_EVENT_PARALLEL_CREATE_INDEX_BUILD);
+	}
+	ConditionVariableCancelSleep();
+
+	return newphase;
+}
+
+/*
+ * Within the leader, wait for all participants to be done with the current
+ * phase.
+ */
+static void
+bulkWaitForParticipants(SpGistBulkShared *shared, uint32 wait_event_info)
+{
+	for (;;)
+	{
+		bool		done;
+
+		SpinLockAcquire(&shared->mutex);
+		done = (shared->ndone == shared->nParticipants);
+		SpinLockRelease(&shared->mutex);
+
+		if (done)
+			break;
+
+		ConditionVariableSleep(&shared->cv, wait_event_info);
+	}
+	ConditionVariableCancelSleep();
+}
+
+/*
+ * Within the leader, move all participants on to the next phase
+ */
+static void
+bulkSetPhase(SpGistBulkShared *shared, int phase)
+{
+	SpinLockAcquire(&shared->mutex);
+	shared->phase = phase;
+	shared->ndone = 0;
+	SpinLockRelease(&shared->mutex);
+
+	ConditionVariableBroadcast(&shared->cv);
+}
+
+/*
+ * Route the items we collected ourselves to the nodes of the root, in a
+ * parallel build.
+ */
+static void
+bulkParallelRoute(SpGistBulkState *bs)
+{
+	SpGistBulkShared *shared = bs->shared;
+	ItemPointerData root;
+	SpGistInnerTuple innerTuple;
+	SpGistBulkInput *input;
+	BufFile   **childFiles;
+	int64	   *childItems;
+	Size	   *childBytes;
+	int		   *childLevels;
+	char		name[MAXPGPATH];
+	int			nNodes;
+	int			n;
+
+	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE,
+								 PROGRESS_SPGIST_PHASE_PARTITION);
+
+	ItemPointerSet(&root, SPGIST_ROOT_BLKNO, FirstOffsetNumber);
+	innerTuple = bulkReadInnerTuple(bs, &root);
+	nNodes = innerTuple->nNodes;
+
+	bulkFileName(name, bs->participant, SPGIST_BULK_FILE_ITEMS);
+	input = bulkMakeFileInput(BufFileOpenShared(&shared->fileset, name));
+
+	/* Every participant has a file for every node, to keep things simple */
+	childFiles = (BufFile **) palloc(sizeof(BufFile *) * nNodes);
+	childItems = (int64 *) palloc0(sizeof(int64) * nNodes);
+	childBytes = (Size *) palloc0(sizeof(Size) * nNodes);
+	childLevels = (int *) palloc0(sizeof(int) * nNodes);
+	for (n = 0; n < nNodes; n++)
+		childFiles[n] = bulkCreateFile(bs, n);
+
+	bulkRouteInput(bs, input, 0, innerTuple,
+				   childFiles, childItems, childBytes, childLevels);
+	bulkInputClose(input);
+
+	for (n = 0; n < nNodes; n++)
+	{
+		BufFileExportShared(childFiles[n]);
+		BufFileClose(childFiles[n]);
+	}
+
+	SpinLockAcquire(&shared->mutex);
+	for (n = 0; n < nNodes; n++)
+	{
+		if (childItems[n] == 0)
+			continue;
+		shared->nodeItems[n] += childItems[n];
+		shared->nodeBytes[n] += childBytes[n];
+		shared->nodeLevels[n] = childLevels[n];
+	}
+	SpinLockRelease(&shared->mutex);
+
+	pfree(childFiles);
+	pfree(childItems);
+	pfree(childBytes);
+	pfree(childLevels);
+	pfree(innerTuple);
+}
+
+/*
+ * Claim nodes of the root and load their subtrees until there are none
+ * left, in a parallel build.
+ */
+static void
+bulkParallelLoad(SpGistBulkState *bs)
+{
+	SpGistBulkShared *shared = bs->shared;
+
+	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE,
+								 PROGRESS_SPGIST_PHASE_LOAD);
+
+	for (;;)
+	{
+		SpGistBulkInput *input;
+		ItemPointerData child;
+		int			n;
+
+		SpinLockAcquire(&shared->mutex);
+		n = shared->nextNode++;
+		SpinLockRelease(&shared->mutex);
+
+		if (n >= shared->nNodes)
+			break;
+		if (shared->nodeItems[n] == 0)
+			continue;
+
+		input = bulkOpenSharedInput(bs, n);
+
+		/* see bulkLoadInput */
+		if (shared->nodeItems[n] == shared->nitems)
+		{
+			bulkSetAsideInput(bs, input);
+			continue;
+		}
+
+		bulkLoadInput(bs, input, shared->nodeItems[n], shared->nodeBytes[n],
+					  shared->nodeLevels[n], SPGIST_ROOT_BLKNO, &child);
+
+		SpinLockAcquire(&shared->mutex);
+		shared->nodeChildren[n] = child;
+		SpinLockRelease(&shared->mutex);
+	}
+}
+
+/*
+ * Finish collecting items as a participant in a parallel build, and make
+ * them available to the others.
+ */
+static void
+bulkParallelScanDone(SpGistBulkState *bs)
+{
+	SpGistBulkShared *shared = bs->shared;
+
+	Assert(bs->spill != NULL && bs->spool.nitems == 0);
+
+	BufFileExportShared(bs->spill);
+	BufFileClose(bs->spill);
+	bs->spill = NULL;
+
+	SpinLockAcquire(&shared->mutex);
+	shared->nitems += bs->spillItems;
+	shared->nbytes += bs->spillBytes;
+	shared->leafSpace += bs->leafSpace;
+	SpinLockRelease(&shared->mutex);
+
+	bulkPhaseDone(bs, false);
+}
+
+/*
+ * spgBulkFinish for a parallel worker: follow the leader through the
+ * phases of the build.
+ */
+static void
+bulkWorkerFinish(SpGistBulkState *bs)
+{
+	int			phase;
+
+	bulkParallelScanDone(bs);
+
+	phase = bulkWaitForPhase(bs->shared, SPGIST_BULK_PHASE_SCAN);
+	if (phase == SPGIST_BULK_PHASE_ROUTE)
+	{
+		bulkParallelRoute(bs);
+		bulkPhaseDone(bs, false);
+
+		phase = bulkWaitForPhase(bs->shared, SPGIST_BULK_PHASE_ROUTE);
+		Assert(phase == SPGIST_BULK_PHASE_LOAD);
+		bulkParallelLoad(bs);
+	}
+
+	bulkPhaseDone(bs, true);
+}
+
+/*
+ * spgBulkFinish for the leader of a parallel build
+ */
+static void
+bulkLeaderFinish(SpGistBulkState *bs)
+{
+	SpGistBulkShared *shared = bs->shared;
+	SpGistBulkInput *input;
+	int			i;
+
+	bulkParallelScanDone(bs);
+	bulkWaitForParticipants(shared, WAIT_EVENT_PARALLEL_CREATE_INDEX_SCAN);
+
+	pgstat_progress_update_param(PROGRESS_CREATEIDX_TUPLES_TOTAL,
+								 shared->nitems);
+
+	if (shared->leafSpace <= bs->chainSpace)
+	{
+		ItemPointerData top;
+
+		/*
+		 * Everything fits in one leaf chain, so there's nothing to split.
+		 * Let the workers go, and do it ourselves.
+		 */
+		bulkSetPhase(shared, SPGIST_BULK_PHASE_DONE);
+
+		pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE,
+									 PROGRESS_SPGIST_PHASE_LOAD);
+		if (shared->nitems > 0)
+		{
+			input = bulkOpenSharedInput(bs, SPGIST_BULK_FILE_ITEMS);
+			bulkLoadInput(bs, input, shared->nitems, shared->nbytes,
+						  0, InvalidBlockNumber, &top);
+		}
+
+		bulkPhaseDone(bs, true);
+		bulkWaitForParticipants(shared, WAIT_EVENT_PARALLEL_CREATE_INDEX_BUILD);
+	}
+	else
+	{
+		ItemPointerData root;
+		SpGistInnerTuple innerTuple;
+
+		/* Split the whole set at the root, and have everyone route items */
+		input = bulkOpenSharedInput(bs, SPGIST_BULK_FILE_ITEMS);
+		innerTuple = bulkSplitInput(bs, input, shared->nitems, shared->nbytes,
+									0, InvalidBlockNumber, &root);
+		bulkInputClose(input);
+		Assert(ItemPointerGetBlockNumber(&root) == SPGIST_ROOT_BLKNO &&
+			   ItemPointerGetOffsetNumber(&root) == FirstOffsetNumber);
+
+		SpinLockAcquire(&shared->mutex);
+		shared->nNodes = innerTuple->nNodes;
+		shared->nextNode = 0;
+		for (i = 0; i < shared->nNodes; i++)
+			ItemPointerSetInvalid(&shared->nodeChildren[i]);
+		SpinLockRelease(&shared->mutex);
+		pfree(innerTuple);
+
+		bulkSetPhase(shared, SPGIST_BULK_PHASE_ROUTE);
+		bulkParallelRoute(bs);
+		bulkPhaseDone(bs, false);
+		bulkWaitForParticipants(shared, WAIT_EVENT_PARALLEL_CREATE_INDEX_BUILD);
+
+		/* Now load the nodes' subtrees, and link them to the root */
+		bulkSetPhase(shared, SPGIST_BULK_PHASE_LOAD);
+		bulkParallelLoad(bs);
+		bulkPhaseDone(bs, true);
+		bulkWaitForParticipants(shared, WAIT_EVENT_PARALLEL_CREATE_INDEX_BUILD);
+
+		bulkSetDownlinks(bs, &root, shared->nNodes, shared->nodeChildren);
+	}
+
+	/* Finally, insert everybody's set-aside items */
+	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE,
+								 PROGRESS_SPGIST_PHASE_LEFTOVERS);
+	for (i = 0; i < shared->nParticipants; i++)
+	{
+		BufFile    *file;
+		char		name[MAXPGPATH];
+
+		if (!shared->hasLeftovers[i])
+			continue;
+
+		bulkFileName(name, i, SPGIST_BULK_FILE_LEFTOVERS);
+		file = BufFileOpenShared(&shared->fileset, name);
+		bulkInsertLeftovers(bs, file);
+		BufFileClose(file);
+	}
+}
+
+/*
+ * Returns size of shared memory required for a parallel bulk load with up
+ * to nParticipants participants.
+ */
+Size
+spgBulkEstimateShared(int nParticipants)
+{
+	return add_size(offsetof(SpGistBulkShared, hasLeftovers),
+					mul_size(sizeof(bool), nParticipants));
+}
+
+/*
+ * Initialize the shared state of a parallel bulk load, within the leader
+ */
+void
+spgBulkInitializeShared(SpGistBulkShared *shared, int nParticipants,
+						dsm_segment *seg)
+{
+	int			i;
+
+	shared->maxParticipants = nParticipants;
+	SharedFileSetInit(&shared->fileset, seg);
+	LWLockInitialize(&shared->extensionLock, LWTRANCHE_SPGIST_BUILD);
+	ConditionVariableInit(&shared->cv);
+	SpinLockInit(&shared->mutex);
+
+	shared->nParticipants = 0;
+	shared->phase = SPGIST_BULK_PHASE_SCAN;
+	shared->ndone = 0;
+	shared->nitems = 0;
+	shared->nbytes = 0;
+	shared->leafSpace = 0;
+	shared->nNodes = 0;
+	shared->nextNode = 0;
+	memset(shared->nodeItems, 0, sizeof(shared->nodeItems));
+	memset(shared->nodeBytes, 0, sizeof(shared->nodeBytes));
+	memset(shared->nodeLevels, 0, sizeof(shared->nodeLevels));
+	for (i = 0; i < nParticipants; i++)
+		shared->hasLeftovers[i] = false;
+}
+
+/*
+ * Attach to the shared state of a parallel bulk load, within a worker
+ */
+void
+spgBulkAttachShared(SpGistBulkShared *shared, dsm_segment *seg)
+{
+	SharedFileSetAttach(&shared->fileset, seg);
+}
+
+/*
+ * Start a bulk load into an empty index, using up to memKB kilobytes of
+ * memory to hold items before spilling them to temporary files.
+ *
+ * coordinate is NULL unless we're participating in a parallel build.
+ */
+SpGistBulkState *
+spgBulkBegin(Relation index, SpGistState *state, int memKB,
+			 SpGistBulkCoordinate coordinate)
+{
+	SpGistBulkState *bs = (SpGistBulkState *) palloc0(sizeof(SpGistBulkState));
+
+	bs->index = index;
+	bs->state = state;
+	bs->cxt = CurrentMemoryContext;
+
+	if (OidIsValid(index_getprocid(index, 1, SPGIST_COMPRESS_PROC)))
+		bs->compressProc = index_getprocinfo(index, 1, SPGIST_COMPRESS_PROC);
+	bs->chooseProc = index_getprocinfo(index, 1, SPGIST_CHOOSE_PROC);
+	bs->picksplitProc = index_getprocinfo(index, 1, SPGIST_PICKSPLIT_PROC);
+
+	bs->memLimit = memKB * 1024L;
+
+	/*
+	 * Fill leaf pages only up to the fillfactor, leaving room for later
+	 * insertions into each chain, as SpGistGetBuffer does.
+	 */
+	bs->chainSpace = SPGIST_PAGE_CAPACITY -
+		RelationGetTargetPageFreeSpace(index, SPGIST_DEFAULT_FILLFACTOR);
+
+	bs->spoolCxt = AllocSetContextCreate(CurrentMemoryContext,
+										 "SP-GiST bulk load spool",
+										 ALLOCSET_DEFAULT_SIZES);
+
+	if (coordinate)
+	{
+		SpGistBulkShared *shared = coordinate->sharedbulk;
+
+		Assert(coordinate->participant < shared->maxParticipants);
+		bs->shared = shared;
+		bs->isWorker = coordinate->isWorker;
+		bs->participant = coordinate->participant;
+
+		if (!bs->isWorker)
+		{
+			Assert(coordinate->nParticipants <= shared->maxParticipants);
+			SpinLockAcquire(&shared->mutex);
+			shared->nParticipants = coordinate->nParticipants;
+			SpinLockRelease(&shared->mutex);
+		}
+
+		/* The others will need our items, so they all go to a shared file */
+		bs->spill = bulkCreateFile(bs, SPGIST_BULK_FILE_ITEMS);
+	}
+
+	return bs;
+}
+
+/*
+ * Add an item to the bulk load.  Nulls live in a separate tree that has
+ * nothing to split, so they are set aside and inserted normally at the end.
+ */
+void
+spgBulkAdd(SpGistBulkState *bs, ItemPointer heapPtr, Datum datum, bool isnull)
+{
+	SpGistState *state = bs->state;
+	MemoryContext oldcxt;
+	Datum		leafDatum;
+	int			leafSize;
+
+	if (isnull)
+	{
+		bulkSetAside(bs, heapPtr, (Datum) 0, (Datum) 0, true);
+		return;
+	}
+
+	/* Prepare the leaf datum the same way spgdoinsert does */
+	if (state->attType.attlen == -1)
+		datum = PointerGetDatum(PG_DETOAST_DATUM(datum));
+
+	if (bs->compressProc)
+		leafDatum = FunctionCall1Coll(bs->compressProc,
+									  bs->index->rd_indcollation[0],
+									  datum);
+	else
+		leafDatum = datum;
+
+	leafSize = leafTupleSpace(state, leafDatum);
+	if (leafSize > SPGIST_PAGE_CAPACITY)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("index row size %zu exceeds maximum %zu for index \"%s\"",
+						leafSize - sizeof(ItemIdData),
+						SPGIST_PAGE_CAPACITY - sizeof(ItemIdData),
+						RelationGetRelationName(bs->index)),
+				 errhint("Values larger than a buffer page cannot be indexed.")));
+	bs->leafSpace += leafSize;
+
+	if (bs->spill)
+	{
+		bulkWriteItem(bs, bs->spill, heapPtr, leafDatum, datum, false);
+		bs->spillItems++;
+		bs->spillBytes += itemMemSpace(bs, leafDatum, datum);
+		return;
+	}
+
+	oldcxt = MemoryContextSwitchTo(bs->spoolCxt);
+
+	if (bs->spool.nitems >= bs->spoolSize)
+	{
+		if (bs->spoolSize == 0)
+		{
+			bs->spoolSize = 1024;
+			bs->spool.heapPtrs = (ItemPointerData *)
+				palloc(sizeof(ItemPointerData) * bs->spoolSize);
+			bs->spool.leafDatums = (Datum *)
+				palloc(sizeof(Datum) * bs->spoolSize);
+			bs->spool.datums = (Datum *) palloc(sizeof(Datum) * bs->spoolSize);
+		}
+		else
+		{
+			bs->spoolSize *= 2;
+			bs->spool.heapPtrs = (ItemPointerData *)
+				repalloc(bs->spool.heapPtrs,
+						 sizeof(ItemPointerData) * bs->spoolSize);
+			bs->spool.leafDatums = (Datum *)
+				repalloc(bs->spool.leafDatums, sizeof(Datum) * bs->spoolSize);
+			bs->spool.datums = (Datum *)
+				repalloc(bs->spool.datums, sizeof(Datum) * bs->spoolSize);
+		}
+	}
+
+	bs->spool.heapPtrs[bs->spool.nitems] = *heapPtr;
+	bs->spool.leafDatums[bs->spool.nitems] =
+		datumCopy(leafDatum, state->attLeafType.attbyval,
+				  state->attLeafType.attlen);
+	if (datum == leafDatum)
+		bs->spool.datums[bs->spool.nitems] =
+			bs->spool.leafDatums[bs->spool.nitems];
+	else
+		bs->spool.datums[bs->spool.nitems] =
+			datumCopy(datum, state->attType.attbyval, state->attType.attlen);
+	bs->spool.nitems++;
+	bs->spoolBytes += itemMemSpace(bs, leafDatum, datum);
+
+	MemoryContextSwitchTo(oldcxt);
+
+	if (bs->spoolBytes > bs->memLimit ||
+		bs->spool.nitems >= SPGIST_BULK_MAX_ITEMS)
+		bulkSpill(bs);
+}
+
+/*
+ * Build the tree from all the items added, and clean up.
+ *
+ * In a parallel build, every participant calls this once it has added the
+ * items from its part of the heap, and it returns when the participant's
+ * part in the build is over.  The leader does the steps that involve all
+ * the items: splitting the root, and inserting the items set aside.
+ */
+void
+spgBulkFinish(SpGistBulkState *bs)
+{
+	if (bs->shared && bs->isWorker)
+		bulkWorkerFinish(bs);
+	else if (bs->shared)
+		bulkLeaderFinish(bs);
+	else
+	{
+		ItemPointerData top;
+
+		pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE,
+									 PROGRESS_SPGIST_PHASE_LOAD);
+
+		if (bs->spill)
+		{
+			pgstat_progress_update_param(PROGRESS_CREATEIDX_TUPLES_TOTAL,
+										 bs->spillItems);
+			bulkLoadInput(bs, bulkMakeFileInput(bs->spill),
+						  bs->spillItems, bs->spillBytes,
+						  0, InvalidBlockNumber, &top);
+		}
+		else if (bs->spool.nitems > 0)
+		{
+			pgstat_progress_update_param(PROGRESS_CREATEIDX_TUPLES_TOTAL,
+										 bs->spool.nitems);
+			bulkLoadItems(bs, &bs->spool, 0, InvalidBlockNumber, &top);
+		}
+
+		/* Insert any items the bulk load had to set aside */
+		if (bs->leftovers)
+		{
+			pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE,
+										 PROGRESS_SPGIST_PHASE_LEFTOVERS);
+			bulkInsertLeftovers(bs, bs->leftovers);
+			BufFileClose(bs->leftovers);
+		}
+	}
+
+	MemoryContextDelete(bs->spoolCxt);
+	pfree(bs);
+}
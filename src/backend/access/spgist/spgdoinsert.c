@@ -18,6 +18,8 @@
 #include "access/genam.h"
 #include "access/spgist_private.h"
 #include "access/spgxlog.h"
+#include "access/tableam.h"
+#include "access/xlog.h"
 #include "access/xloginsert.h"
 #include "miscadmin.h"
 #include "storage/bufmgr.h"
@@ -376,6 +378,65 @@ checkSplitConditions(Relation index, SpGistState *state,
 	return totalSize;
 }
 
+/*
+ * Try to make room on the leaf page described by current, by deleting the
+ * tuples that index scans have marked as killed, i.e. found to point to heap
+ * tuples that are dead to everyone.
+ *
+ * When a row is updated, the new index entry usually goes into the same leaf
+ * as the old one if the key changed only a little, e.g. a moving object's
+ * position.  Reclaiming the space of the killed old versions there lets the
+ * page absorb a stream of such updates without being split, and without
+ * waiting for VACUUM.
+ *
+ * Returns true if any tuples were deleted.  The chain that current points to
+ * stays at the same offset, though it may now start with a DEAD tuple.
+ */
+static bool
+deleteKilledLeafTuples(Relation index, SpGistState *state,
+					   SPPageDesc *current)
+{
+	bool		deletable[MaxIndexTuplesPerPage + 1];
+	ItemPointerData heapTids[MaxIndexTuplesPerPage];
+	int			nDeletable = 0;
+	TransactionId latestRemovedXid = InvalidTransactionId;
+	OffsetNumber i,
+				max = PageGetMaxOffsetNumber(current->page);
+
+	/* Without the heap, we can't tell standbys what is being removed */
+	if (state->heapRel == NULL)
+		return false;
+
+	memset(deletable, 0, sizeof(deletable));
+	for (i = FirstOffsetNumber; i <= max; i++)
+	{
+		ItemId		itemId = PageGetItemId(current->page, i);
+		SpGistLeafTuple lt;
+
+		if (!ItemIdIsDead(itemId))
+			continue;
+		lt = (SpGistLeafTuple) PageGetItem(current->page, itemId);
+		if (lt->tupstate != SPGIST_LIVE)
+			continue;
+
+		deletable[i] = true;
+		heapTids[nDeletable++] = lt->heapPtr;
+	}
+
+	if (nDeletable == 0)
+		return false;
+
+	if (XLogStandbyInfoActive() && RelationNeedsWAL(index))
+		latestRemovedXid =
+			table_compute_xid_horizon_for_tuples(state->heapRel,
+												 heapTids, nDeletable);
+
+	spgDeleteLeafTuples(index, state, current->buffer, deletable, nDeletable,
+						latestRemovedXid);
+
+	return true;
+}
+
 /*
  * current points to a leaf-tuple chain that we wanted to add newLeafTuple to,
  * but the chain has to be moved because there's not enough room to add
@@ -594,9 +655,9 @@ setRedirectionTuple(SPPageDesc *current, OffsetNumber position,
  * be split across pages.  (Exercise for the reader: figure out why this
  * fixes the problem even when there is only one old tuple.)
  */
-static bool
-checkAllTheSame(spgPickSplitIn *in, spgPickSplitOut *out, bool tooBig,
-				bool *includeNew)
+bool
+spgCheckAllTheSame(spgPickSplitIn *in, spgPickSplitOut *out, bool tooBig,
+				   bool *includeNew)
 {
 	int			theNode;
 	int			limit;
@@ -711,6 +772,8 @@ doPickSplit(Relation index, SpGistState *state,
 				maxToInclude;
 
 	in.level = level;
+	in.looseness = state->looseness;
+	in.splitStrategy = state->splitStrategy;
 
 	/*
 	 * Allocate per-leaf-tuple work arrays with max possible size
@@ -847,7 +910,7 @@ doPickSplit(Relation index, SpGistState *state,
 	{
 		/*
 		 * Perform dummy split that puts all tuples into one node.
-		 * checkAllTheSame will override this and force allTheSame mode.
+		 * spgCheckAllTheSame will override this and force allTheSame mode.
 		 */
 		out.hasPrefix = false;
 		out.nNodes = 1;
@@ -871,15 +934,15 @@ doPickSplit(Relation index, SpGistState *state,
 	 * Check to see if the picksplit function failed to separate the values,
 	 * ie, it put them all into the same child node.  If so, select allTheSame
 	 * mode and create a random split instead.  See comments for
-	 * checkAllTheSame as to why we need to know if the new leaf tuples could
+	 * spgCheckAllTheSame as to why we need to know if the new leaf tuples could
 	 * fit on one page.
 	 */
-	allTheSame = checkAllTheSame(&in, &out,
-								 totalLeafSizes > SPGIST_PAGE_CAPACITY,
-								 &includeNew);
+	allTheSame = spgCheckAllTheSame(&in, &out,
+									totalLeafSizes > SPGIST_PAGE_CAPACITY,
+									&includeNew);
 
 	/*
-	 * If checkAllTheSame decided we must exclude the new tuple, don't
+	 * If spgCheckAllTheSame decided we must exclude the new tuple, don't
 	 * consider it any further.
 	 */
 	if (includeNew)
@@ -891,7 +954,7 @@ doPickSplit(Relation index, SpGistState *state,
 	}
 
 	/*
-	 * Allocate per-node work arrays.  Since checkAllTheSame could replace
+	 * Allocate per-node work arrays.  Since spgCheckAllTheSame could replace
 	 * out.nNodes with a value larger than the number of tuples on the input
 	 * page, we can't allocate these arrays before here.
 	 */
@@ -2049,6 +2112,18 @@ spgdoinsert(Relation index, SpGistState *state,
 						sizeToSplit;
 
 			leafTuple = spgFormLeafTuple(state, heapPtr, leafDatum, isnull);
+
+			/*
+			 * If it doesn't fit, see if deleting killed tuples makes room,
+			 * before resorting to moving or splitting the chain.  The root
+			 * page is left alone; it is split the first time it fills up
+			 * anyway.
+			 */
+			if (leafTuple->size + sizeof(ItemIdData) >
+				SpGistPageGetFreeSpace(current.page, 1) &&
+				!isNew && !SpGistBlockIsRoot(current.blkno))
+				(void) deleteKilledLeafTuples(index, state, &current);
+
 			if (leafTuple->size + sizeof(ItemIdData) <=
 				SpGistPageGetFreeSpace(current.page, 1))
 			{
@@ -2113,6 +2188,7 @@ spgdoinsert(Relation index, SpGistState *state,
 			in.datum = datum;
 			in.leafDatum = leafDatum;
 			in.level = level;
+			in.looseness = state->looseness;
 			in.allTheSame = innerTuple->allTheSame;
 			in.hasPrefix = (innerTuple->prefixSize > 0);
 			in.prefixDatum = SGITDATUM(innerTuple, state);
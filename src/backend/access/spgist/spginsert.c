@@ -3,7 +3,8 @@
  * spginsert.c
  *	  Externally visible index creation/insertion routines
  *
- * All the actual insertion logic is in spgdoinsert.c.
+ * All the actual insertion logic is in spgdoinsert.c, and the bulk loading
+ * used by index builds is in spgbulk.c.  This file sets up parallel builds.
  *
  * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -17,26 +18,127 @@
 #include "postgres.h"
 
 #include "access/genam.h"
+#include "access/parallel.h"
 #include "access/spgist_private.h"
 #include "access/spgxlog.h"
+#include "access/table.h"
 #include "access/tableam.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "access/xloginsert.h"
 #include "catalog/index.h"
+#include "commands/progress.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/bufmgr.h"
 #include "storage/smgr.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"		/* pgrminclude ignore */
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
 
 
+/* Magic numbers for parallel state sharing */
+#define PARALLEL_KEY_SPGIST_SHARED		UINT64CONST(0xA000000000000001)
+#define PARALLEL_KEY_BULK_SHARED		UINT64CONST(0xA000000000000002)
+#define PARALLEL_KEY_QUERY_TEXT			UINT64CONST(0xA000000000000003)
+
+/*
+ * Status record for parallel SP-GiST index build, shared by all
+ * participants.  The bulk loading itself is coordinated through a separate
+ * SpGistBulkShared struct, which spgbulk.c manages.
+ */
+typedef struct SpGistShared
+{
+	/*
+	 * These fields are not modified during the build.  They primarily exist
+	 * for the benefit of worker processes that need to set up state
+	 * corresponding to that used by the leader.
+	 */
+	Oid			heaprelid;
+	Oid			indexrelid;
+	bool		isconcurrent;
+	int			scanparticipants;	/* for dividing maintenance_work_mem */
+
+	/* mutex protects all fields after it */
+	slock_t		mutex;
+
+	/*
+	 * Statistics maintained by participants, and reported back to leader at
+	 * end of their parallel scan.
+	 */
+	double		reltuples;
+	double		indtuples;
+	bool		brokenhotchain;
+
+	/*
+	 * ParallelTableScanDescData data follows. Can't directly embed here, as
+	 * implementations of the parallel table scan desc interface might need
+	 * stronger alignment.
+	 */
+} SpGistShared;
+
+/*
+ * Return pointer to a SpGistShared's parallel table scan.
+ *
+ * c.f. shm_toc_allocate as to why BUFFERALIGN is used, rather than just
+ * MAXALIGN.
+ */
+#define ParallelTableScanFromSpGistShared(shared) \
+	(ParallelTableScanDesc) ((char *) (shared) + BUFFERALIGN(sizeof(SpGistShared)))
+
+/*
+ * Status for leader in parallel index build.
+ */
+typedef struct SpGistLeader
+{
+	/* parallel context itself */
+	ParallelContext *pcxt;
+
+	/*
+	 * nparticipants is the exact number of worker processes successfully
+	 * launched, plus the leader, which always participates.
+	 */
+	int			nparticipants;
+
+	/*
+	 * Leader process convenience pointers to shared state (leader avoids TOC
+	 * lookups).  snapshot is the snapshot used by the scan iff an MVCC
+	 * snapshot is required.
+	 */
+	SpGistShared *spgshared;
+	SpGistBulkShared *sharedbulk;
+	Snapshot	snapshot;
+} SpGistLeader;
+
 typedef struct
 {
 	SpGistState spgstate;		/* SPGiST's working state */
 	int64		indtuples;		/* total number of tuples indexed */
 	MemoryContext tmpCtx;		/* per-tuple temporary context */
+	SpGistBulkState *bulkstate; /* bulk load state, or NULL */
+
+	/*
+	 * spgleader is only present when a parallel index build is performed,
+	 * and only in the leader process.
+	 */
+	SpGistLeader *spgleader;
 } SpGistBuildState;
 
+static void _spg_begin_parallel(SpGistBuildState *buildstate, Relation heap,
+								Relation index, bool isconcurrent,
+								int request);
+static void _spg_end_parallel(SpGistLeader *spgleader);
+static Size _spg_parallel_estimate_shared(Relation heap, Snapshot snapshot);
+static double _spg_parallel_heapscan(SpGistBuildState *buildstate,
+									 bool *brokenhotchain);
+static void _spg_parallel_scan(SpGistBuildState *buildstate, Relation heap,
+							   Relation index, SpGistShared *spgshared,
+							   SpGistBulkShared *sharedbulk,
+							   int participant, int nparticipants,
+							   int memKB, bool isWorker);
+
 
 /* Callback to process one heap tuple during table_index_build_scan */
 static void
@@ -49,16 +151,22 @@ spgistBuildCallback(Relation index, HeapTuple htup, Datum *values,
 	/* Work in temp context, and reset it after each tuple */
 	oldCtx = MemoryContextSwitchTo(buildstate->tmpCtx);
 
-	/*
-	 * Even though no concurrent insertions can be happening, we still might
-	 * get a buffer-locking failure due to bgwriter or checkpointer taking a
-	 * lock on some buffer.  So we need to be willing to retry.  We can flush
-	 * any temp data when retrying.
-	 */
-	while (!spgdoinsert(index, &buildstate->spgstate, &htup->t_self,
-						*values, *isnull))
+	/* Collect the value for bulk loading, if possible */
+	if (buildstate->bulkstate)
+		spgBulkAdd(buildstate->bulkstate, &htup->t_self, *values, *isnull);
+	else
 	{
-		MemoryContextReset(buildstate->tmpCtx);
+		/*
+		 * Even though no concurrent insertions can be happening, we still
+		 * might get a buffer-locking failure due to bgwriter or checkpointer
+		 * taking a lock on some buffer.  So we need to be willing to retry.
+		 * We can flush any temp data when retrying.
+		 */
+		while (!spgdoinsert(index, &buildstate->spgstate, &htup->t_self,
+							*values, *isnull))
+		{
+			MemoryContextReset(buildstate->tmpCtx);
+		}
 	}
 
 	/* Update total tuple count */
@@ -98,7 +206,7 @@ spgbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 
 	START_CRIT_SECTION();
 
-	SpGistInitMetapage(BufferGetPage(metabuffer));
+	SpGistInitMetapage(BufferGetPage(metabuffer), SpGistGetLooseness(index));
 	MarkBufferDirty(metabuffer);
 	SpGistInitBuffer(rootbuffer, SPGIST_LEAF);
 	MarkBufferDirty(rootbuffer);
@@ -118,14 +226,49 @@ spgbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 	initSpGistState(&buildstate.spgstate, index);
 	buildstate.spgstate.isBuild = true;
 	buildstate.indtuples = 0;
+	buildstate.bulkstate = NULL;
+	buildstate.spgleader = NULL;
 
 	buildstate.tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
 											  "SP-GiST build temporary context",
 											  ALLOCSET_DEFAULT_SIZES);
 
-	reltuples = table_index_build_scan(heap, index, indexInfo, true, true,
-									   spgistBuildCallback, (void *) &buildstate,
-									   NULL);
+	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE,
+								 PROGRESS_SPGIST_PHASE_INDEXBUILD_TABLESCAN);
+
+	/*
+	 * Unless the opclass relies on the choose function to shorten values
+	 * that are too long for a page, we can load the tree in bulk rather
+	 * than growing it one tuple at a time.  Bulk loads can be done in
+	 * parallel, if requested; in that case the leader has already scanned
+	 * its share of the heap when _spg_begin_parallel returns.
+	 */
+	if (!buildstate.spgstate.config.longValuesOK)
+	{
+		if (indexInfo->ii_ParallelWorkers > 0)
+			_spg_begin_parallel(&buildstate, heap, index,
+								indexInfo->ii_Concurrent,
+								indexInfo->ii_ParallelWorkers);
+		if (!buildstate.spgleader)
+			buildstate.bulkstate = spgBulkBegin(index, &buildstate.spgstate,
+												maintenance_work_mem, NULL);
+	}
+
+	if (!buildstate.spgleader)
+	{
+		reltuples = table_index_build_scan(heap, index, indexInfo, true, true,
+										   spgistBuildCallback,
+										   (void *) &buildstate, NULL);
+		if (buildstate.bulkstate)
+			spgBulkFinish(buildstate.bulkstate);
+	}
+	else
+	{
+		spgBulkFinish(buildstate.bulkstate);
+		reltuples = _spg_parallel_heapscan(&buildstate,
+										   &indexInfo->ii_BrokenHotChain);
+		_spg_end_parallel(buildstate.spgleader);
+	}
 
 	MemoryContextDelete(buildstate.tmpCtx);
 
@@ -159,7 +302,7 @@ spgbuildempty(Relation index)
 
 	/* Construct metapage. */
 	page = (Page) palloc(BLCKSZ);
-	SpGistInitMetapage(page);
+	SpGistInitMetapage(page, SpGistGetLooseness(index));
 
 	/*
 	 * Write the page and log it unconditionally.  This is important
@@ -219,6 +362,7 @@ spginsert(Relation index, Datum *values, bool *isnull,
 	oldCtx = MemoryContextSwitchTo(insertCtx);
 
 	initSpGistState(&spgstate, index);
+	spgstate.heapRel = heapRel;
 
 	/*
 	 * We might have to repeat spgdoinsert() multiple times, if conflicts
@@ -230,6 +374,7 @@ spginsert(Relation index, Datum *values, bool *isnull,
 	{
 		MemoryContextReset(insertCtx);
 		initSpGistState(&spgstate, index);
+		spgstate.heapRel = heapRel;
 	}
 
 	SpGistUpdateMetaPage(index);
@@ -240,3 +385,342 @@ spginsert(Relation index, Datum *values, bool *isnull,
 	/* return false since we've not done any unique check */
 	return false;
 }
+
+/*
+ * Create parallel context, and launch workers for leader.
+ *
+ * buildstate argument should be initialized, except for bulkstate.
+ *
+ * isconcurrent indicates if operation is CREATE INDEX CONCURRENTLY.
+ *
+ * request is the target number of parallel worker processes to launch.
+ *
+ * Sets buildstate's SpGistLeader, which caller must use to shut down
+ * parallel mode by passing it to _spg_end_parallel() at the very end of its
+ * index build.  If not even a single worker process can be launched, this
+ * is never set, and caller should proceed with a serial index build.
+ * Otherwise, the leader has scanned its share of the heap on return, and
+ * buildstate's bulkstate is ready to be finished.
+ */
+static void
+_spg_begin_parallel(SpGistBuildState *buildstate, Relation heap,
+					Relation index, bool isconcurrent, int request)
+{
+	ParallelContext *pcxt;
+	int			scanparticipants;
+	Snapshot	snapshot;
+	Size		estspgshared;
+	Size		estbulk;
+	SpGistShared *spgshared;
+	SpGistBulkShared *sharedbulk;
+	SpGistLeader *spgleader = (SpGistLeader *) palloc0(sizeof(SpGistLeader));
+	char	   *sharedquery;
+	int			querylen;
+
+	/*
+	 * Enter parallel mode, and create context for parallel build of SP-GiST
+	 * index
+	 */
+	EnterParallelMode();
+	Assert(request > 0);
+	pcxt = CreateParallelContext("postgres", "_spg_parallel_build_main",
+								 request);
+	scanparticipants = request + 1;
+
+	/*
+	 * Prepare for scan of the base relation.  In a normal index build, we use
+	 * SnapshotAny because we must retrieve all tuples and do our own time
+	 * qual checks (because we have to index RECENTLY_DEAD tuples).  In a
+	 * concurrent build, we take a regular MVCC snapshot and index whatever's
+	 * live according to that.
+	 */
+	if (!isconcurrent)
+		snapshot = SnapshotAny;
+	else
+		snapshot = RegisterSnapshot(GetTransactionSnapshot());
+
+	/*
+	 * Estimate size for our own PARALLEL_KEY_SPGIST_SHARED workspace, and
+	 * PARALLEL_KEY_BULK_SHARED bulk load workspace
+	 */
+	estspgshared = _spg_parallel_estimate_shared(heap, snapshot);
+	shm_toc_estimate_chunk(&pcxt->estimator, estspgshared);
+	estbulk = spgBulkEstimateShared(scanparticipants);
+	shm_toc_estimate_chunk(&pcxt->estimator, estbulk);
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	/* Finally, estimate PARALLEL_KEY_QUERY_TEXT space */
+	querylen = strlen(debug_query_string);
+	shm_toc_estimate_chunk(&pcxt->estimator, querylen + 1);
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+
+	/* Everyone's had a chance to ask for space, so now create the DSM */
+	InitializeParallelDSM(pcxt);
+
+	/* Store shared build state, for which we reserved space */
+	spgshared = (SpGistShared *) shm_toc_allocate(pcxt->toc, estspgshared);
+	/* Initialize immutable state */
+	spgshared->heaprelid = RelationGetRelid(heap);
+	spgshared->indexrelid = RelationGetRelid(index);
+	spgshared->isconcurrent = isconcurrent;
+	spgshared->scanparticipants = scanparticipants;
+	SpinLockInit(&spgshared->mutex);
+	/* Initialize mutable state */
+	spgshared->reltuples = 0.0;
+	spgshared->indtuples = 0.0;
+	spgshared->brokenhotchain = false;
+	table_parallelscan_initialize(heap,
+								  ParallelTableScanFromSpGistShared(spgshared),
+								  snapshot);
+
+	/* Store shared bulk load state, and let spgbulk.c initialize it */
+	sharedbulk = (SpGistBulkShared *) shm_toc_allocate(pcxt->toc, estbulk);
+	spgBulkInitializeShared(sharedbulk, scanparticipants, pcxt->seg);
+
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_SPGIST_SHARED, spgshared);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_BULK_SHARED, sharedbulk);
+
+	/* Store query string for workers */
+	sharedquery = (char *) shm_toc_allocate(pcxt->toc, querylen + 1);
+	memcpy(sharedquery, debug_query_string, querylen + 1);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_QUERY_TEXT, sharedquery);
+
+	/* Launch workers, saving status for leader/caller */
+	LaunchParallelWorkers(pcxt);
+	spgleader->pcxt = pcxt;
+	spgleader->nparticipants = pcxt->nworkers_launched + 1;
+	spgleader->spgshared = spgshared;
+	spgleader->sharedbulk = sharedbulk;
+	spgleader->snapshot = snapshot;
+
+	ereport(DEBUG1,
+			(errmsg_plural("launched %d parallel worker for building index \"%s\"",
+						   "launched %d parallel workers for building index \"%s\"",
+						   pcxt->nworkers_launched,
+						   pcxt->nworkers_launched,
+						   RelationGetRelationName(index))));
+
+	/* If no workers were successfully launched, back out (do serial build) */
+	if (pcxt->nworkers_launched == 0)
+	{
+		_spg_end_parallel(spgleader);
+		return;
+	}
+
+	/* Save leader state now that it's clear build will be parallel */
+	buildstate->spgleader = spgleader;
+
+	/*
+	 * Join heap scan ourselves.  The leader's participant number comes after
+	 * the workers', which use their ParallelWorkerNumber.  Might as well use
+	 * reliable figure when doling out maintenance_work_mem (when requested
+	 * number of workers were not launched, this will be somewhat higher than
+	 * it is for other workers).
+	 */
+	_spg_parallel_scan(buildstate, heap, index, spgshared, sharedbulk,
+					   pcxt->nworkers_launched, spgleader->nparticipants,
+					   maintenance_work_mem / spgleader->nparticipants, false);
+
+	/*
+	 * Caller needs to wait for all launched workers when we return.  Make
+	 * sure that the failure-to-start case will not hang forever.
+	 */
+	WaitForParallelWorkersToAttach(pcxt);
+}
+
+/*
+ * Shut down workers, destroy parallel context, and end parallel mode.
+ */
+static void
+_spg_end_parallel(SpGistLeader *spgleader)
+{
+	/* Shutdown worker processes */
+	WaitForParallelWorkersToFinish(spgleader->pcxt);
+	/* Free last reference to MVCC snapshot, if one was used */
+	if (IsMVCCSnapshot(spgleader->snapshot))
+		UnregisterSnapshot(spgleader->snapshot);
+	DestroyParallelContext(spgleader->pcxt);
+	ExitParallelMode();
+}
+
+/*
+ * Returns size of shared memory required to store state for a parallel
+ * SP-GiST index build based on the snapshot its parallel scan will use.
+ */
+static Size
+_spg_parallel_estimate_shared(Relation heap, Snapshot snapshot)
+{
+	/* c.f. shm_toc_allocate as to why BUFFERALIGN is used */
+	return add_size(BUFFERALIGN(sizeof(SpGistShared)),
+					table_parallelscan_estimate(heap, snapshot));
+}
+
+/*
+ * Within leader, collect the statistics of the heap scan.
+ *
+ * When called, the leader's spgBulkFinish() has returned, so every
+ * participant has long finished its part of the heap scan.
+ *
+ * Fills in fields needed for ambuild statistics, and lets caller set
+ * field indicating that some participant encountered a broken HOT chain.
+ *
+ * Returns the total number of heap tuples scanned.
+ */
+static double
+_spg_parallel_heapscan(SpGistBuildState *buildstate, bool *brokenhotchain)
+{
+	SpGistShared *spgshared = buildstate->spgleader->spgshared;
+	double		reltuples;
+
+	SpinLockAcquire(&spgshared->mutex);
+	buildstate->indtuples = spgshared->indtuples;
+	if (spgshared->brokenhotchain)
+		*brokenhotchain = true;
+	reltuples = spgshared->reltuples;
+	SpinLockRelease(&spgshared->mutex);
+
+	return reltuples;
+}
+
+/*
+ * Perform a participant's portion of the parallel heap scan, collecting the
+ * items into a bulk load that's coordinated with the other participants.
+ *
+ * memKB is the amount of working memory to use for the bulk load within
+ * each participant.
+ *
+ * On return, buildstate's bulkstate is ready for spgBulkFinish().
+ */
+static void
+_spg_parallel_scan(SpGistBuildState *buildstate, Relation heap,
+				   Relation index, SpGistShared *spgshared,
+				   SpGistBulkShared *sharedbulk, int participant,
+				   int nparticipants, int memKB, bool isWorker)
+{
+	SpGistBulkCoordinate coordinate;
+	TableScanDesc scan;
+	double		reltuples;
+	IndexInfo  *indexInfo;
+	int64		indtuples;
+
+	/* Initialize local bulk load coordination state */
+	coordinate = palloc0(sizeof(SpGistBulkCoordinateData));
+	coordinate->isWorker = isWorker;
+	coordinate->participant = participant;
+	coordinate->nParticipants = nparticipants;
+	coordinate->sharedbulk = sharedbulk;
+
+	buildstate->bulkstate = spgBulkBegin(index, &buildstate->spgstate,
+										 memKB, coordinate);
+
+	/* Join parallel scan */
+	indtuples = buildstate->indtuples;
+	indexInfo = BuildIndexInfo(index);
+	indexInfo->ii_Concurrent = spgshared->isconcurrent;
+	scan = table_beginscan_parallel(heap,
+									ParallelTableScanFromSpGistShared(spgshared));
+	reltuples = table_index_build_scan(heap, index, indexInfo, true, true,
+									   spgistBuildCallback,
+									   (void *) buildstate, scan);
+
+	/* Record ambuild statistics, and whether we encountered a broken chain */
+	SpinLockAcquire(&spgshared->mutex);
+	spgshared->reltuples += reltuples;
+	spgshared->indtuples += buildstate->indtuples - indtuples;
+	if (indexInfo->ii_BrokenHotChain)
+		spgshared->brokenhotchain = true;
+	SpinLockRelease(&spgshared->mutex);
+}
+
+/*
+ * Perform work within a launched parallel process.
+ */
+void
+_spg_parallel_build_main(dsm_segment *seg, shm_toc *toc)
+{
+	char	   *sharedquery;
+	SpGistShared *spgshared;
+	SpGistBulkShared *sharedbulk;
+	SpGistBuildState buildstate;
+	Relation	heapRel;
+	Relation	indexRel;
+	LOCKMODE	heapLockmode;
+	LOCKMODE	indexLockmode;
+	const int	index[] = {
+		PROGRESS_CREATEIDX_COMMAND,
+		PROGRESS_CREATEIDX_INDEX_OID,
+		PROGRESS_CREATEIDX_ACCESS_METHOD_OID,
+		PROGRESS_CREATEIDX_PHASE,
+		PROGRESS_CREATEIDX_SUBPHASE
+	};
+	int64		val[5];
+
+	/* Set debug_query_string for individual workers first */
+	sharedquery = shm_toc_lookup(toc, PARALLEL_KEY_QUERY_TEXT, false);
+	debug_query_string = sharedquery;
+
+	/* Report the query string from leader */
+	pgstat_report_activity(STATE_RUNNING, debug_query_string);
+
+	/* Look up SP-GiST shared state */
+	spgshared = shm_toc_lookup(toc, PARALLEL_KEY_SPGIST_SHARED, false);
+
+	/* Open relations using lock modes known to be obtained by index.c */
+	if (!spgshared->isconcurrent)
+	{
+		heapLockmode = ShareLock;
+		indexLockmode = AccessExclusiveLock;
+	}
+	else
+	{
+		heapLockmode = ShareUpdateExclusiveLock;
+		indexLockmode = RowExclusiveLock;
+	}
+
+	/* Open relations within worker */
+	heapRel = table_open(spgshared->heaprelid, heapLockmode);
+	indexRel = index_open(spgshared->indexrelid, indexLockmode);
+
+	/*
+	 * Unlike the sort in a B-tree build, each participant does a good share
+	 * of the tree building itself, so let it report its own progress.
+	 */
+	pgstat_progress_start_command(PROGRESS_COMMAND_CREATE_INDEX,
+								  spgshared->heaprelid);
+	val[0] = spgshared->isconcurrent ?
+		PROGRESS_CREATEIDX_COMMAND_CREATE_CONCURRENTLY :
+		PROGRESS_CREATEIDX_COMMAND_CREATE;
+	val[1] = spgshared->indexrelid;
+	val[2] = indexRel->rd_rel->relam;
+	val[3] = PROGRESS_CREATEIDX_PHASE_BUILD;
+	val[4] = PROGRESS_SPGIST_PHASE_INDEXBUILD_TABLESCAN;
+	pgstat_progress_update_multi_param(5, index, val);
+
+	/* Look up shared state private to spgbulk.c */
+	sharedbulk = shm_toc_lookup(toc, PARALLEL_KEY_BULK_SHARED, false);
+	spgBulkAttachShared(sharedbulk, seg);
+
+	/* Initialize worker's own build state, as spgbuild does */
+	initSpGistState(&buildstate.spgstate, indexRel);
+	buildstate.spgstate.isBuild = true;
+	buildstate.indtuples = 0;
+	buildstate.tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
+											  "SP-GiST build temporary context",
+											  ALLOCSET_DEFAULT_SIZES);
+	buildstate.bulkstate = NULL;
+	buildstate.spgleader = NULL;
+
+	/* Scan our share of the heap, and then help build the tree */
+	_spg_parallel_scan(&buildstate, heapRel, indexRel, spgshared, sharedbulk,
+					   ParallelWorkerNumber, -1,
+					   maintenance_work_mem / spgshared->scanparticipants,
+					   true);
+	spgBulkFinish(buildstate.bulkstate);
+
+	MemoryContextDelete(buildstate.tmpCtx);
+
+	pgstat_progress_end_command();
+
+	index_close(indexRel, indexLockmode);
+	table_close(heapRel, heapLockmode);
+}
@@ -162,6 +162,7 @@ spg_kd_inner_consistent(PG_FUNCTION_ARGS)
 	spgInnerConsistentIn *in = (spgInnerConsistentIn *) PG_GETARG_POINTER(0);
 	spgInnerConsistentOut *out = (spgInnerConsistentOut *) PG_GETARG_POINTER(1);
 	double		coord;
+	bool		needBoxes;
 	int			which;
 	int			i;
 	BOX			bboxes[2];
@@ -176,6 +177,7 @@ spg_kd_inner_consistent(PG_FUNCTION_ARGS)
 
 	/* "which" is a bitmask of children that satisfy all constraints */
 	which = (1 << 1) | (1 << 2);
+	needBoxes = (in->norderbys > 0);
 
 	for (i = 0; i < in->nkeys; i++)
 	{
@@ -218,6 +220,13 @@ spg_kd_inner_consistent(PG_FUNCTION_ARGS)
 				break;
 			case RTContainedByStrategyNumber:
 
+				/* Circles are checked against the children's areas below */
+				if (in->scankeys[i].sk_subtype == CIRCLEOID)
+				{
+					needBoxes = true;
+					break;
+				}
+
 				/*
 				 * For this operator, the query is a box not a point.  We
 				 * cheat to the extent of assuming that DatumGetPointP won't
@@ -264,14 +273,14 @@ spg_kd_inner_consistent(PG_FUNCTION_ARGS)
 	 * them.  In order to do that, we need calculate bounding boxes for both
 	 * children nodes.  Calculation of those bounding boxes on non-zero level
 	 * require knowledge of bounding box of upper node.  So, we save bounding
-	 * boxes to traversalValues.
+	 * boxes to traversalValues.  Point <@ circle conditions need the boxes
+	 * too, to skip the children that are too far from the center.
 	 */
-	if (in->norderbys > 0)
+	if (needBoxes)
 	{
 		BOX			infArea;
 		BOX		   *area;
 
-		out->distances = (double **) palloc(sizeof(double *) * in->nNodes);
 		out->traversalValues = (void **) palloc(sizeof(void *) * in->nNodes);
 
 		if (in->level == 0)
@@ -313,25 +322,33 @@ spg_kd_inner_consistent(PG_FUNCTION_ARGS)
 	{
 		if (which & (1 << i))
 		{
-			out->nodeNumbers[out->nNodes] = i - 1;
-
-			if (in->norderbys > 0)
+			if (needBoxes)
 			{
-				MemoryContext oldCtx = MemoryContextSwitchTo(in->traversalMemoryContext);
-				BOX		   *box = box_copy(&bboxes[i - 1]);
+				MemoryContext oldCtx;
+				BOX		   *box;
 
+				if (!spg_box_overlaps_circles(&bboxes[i - 1],
+											  in->scankeys, in->nkeys))
+					continue;
+
+				oldCtx = MemoryContextSwitchTo(in->traversalMemoryContext);
+				box = box_copy(&bboxes[i - 1]);
 				MemoryContextSwitchTo(oldCtx);
 
 				out->traversalValues[out->nNodes] = box;
-
-				out->distances[out->nNodes] = spg_key_orderbys_distances(BoxPGetDatum(box), false,
-																		 in->orderbys, in->norderbys);
 			}
 
+			out->nodeNumbers[out->nNodes] = i - 1;
 			out->nNodes++;
 		}
 	}
 
+	if (in->norderbys > 0)
+		out->distances =
+			spg_boxes_orderbys_distances((BOX **) out->traversalValues,
+										 out->nNodes,
+										 in->orderbys, in->norderbys);
+
 	/* Set up level increments, too */
 	out->levelAdds = (int *) palloc(sizeof(int) * 2);
 	out->levelAdds[0] = 1;
@@ -18,41 +18,14 @@
 #include <math.h>
 
 #include "access/spgist_private.h"
+#include "catalog/pg_type.h"
 #include "utils/builtins.h"
 #include "utils/float.h"
 #include "utils/geo_decls.h"
 
+/* Same as point_distance(), without going through fmgr */
 #define point_point_distance(p1,p2) \
-	DatumGetFloat8(DirectFunctionCall2(point_distance, \
-									   PointPGetDatum(p1), PointPGetDatum(p2)))
-
-/* Point-box distance in the assumption that box is aligned by axis */
-static double
-point_box_distance(Point *point, BOX *box)
-{
-	double		dx,
-				dy;
-
-	if (isnan(point->x) || isnan(box->low.x) ||
-		isnan(point->y) || isnan(box->low.y))
-		return get_float8_nan();
-
-	if (point->x < box->low.x)
-		dx = box->low.x - point->x;
-	else if (point->x > box->high.x)
-		dx = point->x - box->high.x;
-	else
-		dx = 0.0;
-
-	if (point->y < box->low.y)
-		dy = box->low.y - point->y;
-	else if (point->y > box->high.y)
-		dy = point->y - box->high.y;
-	else
-		dy = 0.0;
-
-	return HYPOT(dx, dy);
-}
+	HYPOT(float8_mi((p1)->x, (p2)->x), float8_mi((p1)->y, (p2)->y))
 
 /*
  * Returns distances from given key to array of ordering scan keys.  Leaf key
@@ -71,13 +44,94 @@ spg_key_orderbys_distances(Datum key, bool isLeaf,
 	{
 		Point	   *point = DatumGetPointP(orderbys->sk_argument);
 
-		*distance = isLeaf ? point_point_distance(point, DatumGetPointP(key))
-			: point_box_distance(point, DatumGetBoxP(key));
+		if (isLeaf)
+			*distance = point_point_distance(point, DatumGetPointP(key));
+		else
+		{
+			BOX		   *box = DatumGetBoxP(key);
+
+			point_box_distance_batch(&box, 1, point, distance);
+		}
 	}
 
 	return distances;
 }
 
+/*
+ * Returns distances from each of the given boxes to the array of ordering
+ * scan keys, which are expected to be points.  This is for inner_consistent
+ * methods, which need the distances of all the child nodes of an inner tuple.
+ * The distances are computed one scan key at a time for all the boxes, with
+ * point_box_distance_batch(), and all of them are stored in a single
+ * allocation.  The boxes are expected to be aligned by axis.
+ */
+double **
+spg_boxes_orderbys_distances(BOX **boxes, int nboxes,
+							 ScanKey orderbys, int norderbys)
+{
+	double	  **result;
+	double	   *distances;
+	float8	   *batch;
+	int			sk_num;
+	int			i;
+
+	result = (double **) palloc(sizeof(double *) * nboxes);
+	distances = (double *) palloc(sizeof(double) * nboxes * norderbys);
+	batch = (float8 *) palloc(sizeof(float8) * nboxes);
+
+	for (i = 0; i < nboxes; i++)
+		result[i] = distances + i * norderbys;
+
+	for (sk_num = 0; sk_num < norderbys; sk_num++)
+	{
+		Point	   *point = DatumGetPointP(orderbys[sk_num].sk_argument);
+
+		point_box_distance_batch(boxes, nboxes, point, batch);
+		for (i = 0; i < nboxes; i++)
+			result[i][sk_num] = batch[i];
+	}
+
+	pfree(batch);
+
+	return result;
+}
+
+/*
+ * Can a point of the given box satisfy all the point <@ circle scan keys?
+ * Scan keys of other types are ignored.
+ *
+ * This is for inner_consistent methods of point opclasses that know the
+ * area covered by each child node.  A circle can only contain a point of the
+ * box if the distance from its center to the box is at most its radius, so a
+ * search for the points within some distance of a center point only visits
+ * the nodes whose lower-bound distance is small enough, also when the results
+ * are ordered by their distance to the same point.  The comparison is fuzzy,
+ * so that rounding errors can't lose points that circle_contain_pt() would
+ * accept.
+ */
+bool
+spg_box_overlaps_circles(BOX *box, ScanKey scankeys, int nkeys)
+{
+	int			i;
+
+	for (i = 0; i < nkeys; i++)
+	{
+		CIRCLE	   *circle;
+		float8		distance;
+
+		if (scankeys[i].sk_subtype != CIRCLEOID)
+			continue;
+
+		circle = DatumGetCircleP(scankeys[i].sk_argument);
+		point_box_distance_batch(&box, 1, &circle->center, &distance);
+
+		if (!FPle(distance, circle->radius))
+			return false;
+	}
+
+	return true;
+}
+
 BOX *
 box_copy(BOX *orig)
 {
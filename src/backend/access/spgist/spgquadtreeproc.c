@@ -15,6 +15,8 @@
 
 #include "postgres.h"
 
+#include <float.h>
+
 #include "access/spgist.h"
 #include "access/stratnum.h"
 #include "access/spgist_private.h"
@@ -51,32 +53,88 @@ spg_quad_config(PG_FUNCTION_ARGS)
  *
  * Points on one of the axes are taken to lie in the lowest-numbered
  * adjacent quadrant.
+ *
+ * This used to be spelled out as a cascade of point_above(), point_horiz()
+ * etc. calls through DirectFunctionCall2, which made fmgr overhead dominate
+ * index builds.  Those functions are just fuzzy comparisons of one
+ * coordinate, so we evaluate the same FP macros inline instead:
+ * "above or horizontal" is FPge on y, "right or vertical" is FPge on x,
+ * "below or horizontal" is FPle on y.  The quadrant is then picked from a
+ * lookup table without any data-dependent branches.
+ *
+ * If a coordinate difference is NaN, none of the comparisons hold, which
+ * the original formulation reported as an impossible case; so do we.
  */
-static int16
+static const int16 quadrantMap[4] = {4, 3, 2, 1};
+
+static inline int16
 getQuadrant(Point *centroid, Point *tst)
 {
-	if ((SPTEST(point_above, tst, centroid) ||
-		 SPTEST(point_horiz, tst, centroid)) &&
-		(SPTEST(point_right, tst, centroid) ||
-		 SPTEST(point_vert, tst, centroid)))
-		return 1;
-
-	if (SPTEST(point_below, tst, centroid) &&
-		(SPTEST(point_right, tst, centroid) ||
-		 SPTEST(point_vert, tst, centroid)))
-		return 2;
-
-	if ((SPTEST(point_below, tst, centroid) ||
-		 SPTEST(point_horiz, tst, centroid)) &&
-		SPTEST(point_left, tst, centroid))
-		return 3;
-
-	if (SPTEST(point_above, tst, centroid) &&
-		SPTEST(point_left, tst, centroid))
-		return 4;
-
-	elog(ERROR, "getQuadrant: impossible case");
-	return 0;
+	bool		xge = FPge(tst->x, centroid->x);
+	bool		xlt = FPlt(tst->x, centroid->x);
+	bool		yge = FPge(tst->y, centroid->y);
+	bool		ylt = FPlt(tst->y, centroid->y);
+	bool		yle = FPle(tst->y, centroid->y);
+	int			ysel;
+
+	if (unlikely(!((xge | xlt) & (yge | ylt))))
+		elog(ERROR, "getQuadrant: impossible case");
+
+	/* right side splits at "above or horizontal", left at "below or horizontal" */
+	ysel = (xge & yge) | (!xge & yle);
+
+	return quadrantMap[(xge << 1) | ysel];
+}
+
+/*
+ * Classify an array of points at once, storing zero-based node numbers.
+ *
+ * This is the same computation as getQuadrant(), but the coordinates are
+ * first gathered into local arrays so that the comparison loop runs over
+ * contiguous memory and can be vectorized by the compiler.  The validity
+ * check is folded into a single flag tested once per batch.
+ */
+#define QUADRANT_BATCH	64
+
+static void
+getQuadrants(Point *centroid, Datum *datums, int n, int *quadrants)
+{
+	double		xs[QUADRANT_BATCH];
+	double		ys[QUADRANT_BATCH];
+	double		cx = centroid->x;
+	double		cy = centroid->y;
+	int			start;
+
+	for (start = 0; start < n; start += QUADRANT_BATCH)
+	{
+		int			cnt = Min(n - start, QUADRANT_BATCH);
+		bool		valid = true;
+		int			i;
+
+		for (i = 0; i < cnt; i++)
+		{
+			Point	   *p = DatumGetPointP(datums[start + i]);
+
+			xs[i] = p->x;
+			ys[i] = p->y;
+		}
+
+		for (i = 0; i < cnt; i++)
+		{
+			bool		xge = FPge(xs[i], cx);
+			bool		xlt = FPlt(xs[i], cx);
+			bool		yge = FPge(ys[i], cy);
+			bool		ylt = FPlt(ys[i], cy);
+			bool		yle = FPle(ys[i], cy);
+			int			ysel = (xge & yge) | (!xge & yle);
+
+			valid &= (xge | xlt) & (yge | ylt);
+			quadrants[start + i] = quadrantMap[(xge << 1) | ysel] - 1;
+		}
+
+		if (unlikely(!valid))
+			elog(ERROR, "getQuadrant: impossible case");
+	}
 }
 
 /* Returns bounding box of a given quadrant inside given bounding box */
@@ -142,168 +200,311 @@ spg_quad_choose(PG_FUNCTION_ARGS)
 	PG_RETURN_VOID();
 }
 
-#ifdef USE_MEDIAN
-static int
-x_cmp(const void *a, const void *b, void *arg)
+/*
+ * Centroid selection for picksplit.
+ *
+ * The centroid determines how evenly the points are distributed among the
+ * four children.  The mean is cheap and works well for uniformly spread
+ * data, but with skewed data (say, many points in a few dense clusters) it
+ * is pulled towards the outliers, leaving most points in one quadrant and
+ * producing deep trees.  The split_strategy reloption selects one of:
+ *
+ * mean: the average of the X and Y coordinates.
+ *
+ * median: the median X and Y coordinates, each found by selection in
+ * expected linear time.  Each half-plane then gets half of the points, but
+ * the quadrants can still be unbalanced if the coordinates are correlated.
+ *
+ * histogram: a sample of the points is binned into an equi-depth grid, and
+ * of the grid lines, the pair that minimizes the size of the largest
+ * quadrant is used.  This copes with correlated coordinates, e.g. points
+ * along a diagonal, where the median puts half the points in each of two
+ * quadrants.
+ */
+#define SPLIT_HISTOGRAM_SAMPLE	256 /* max number of points sampled */
+#define SPLIT_HISTOGRAM_BINS	8	/* grid size in each dimension */
+
+static void
+swapFloat8(float8 *a, float8 *b)
 {
-	Point	   *pa = *(Point **) a;
-	Point	   *pb = *(Point **) b;
+	float8		tmp = *a;
 
-	if (pa->x == pb->x)
-		return 0;
-	return (pa->x > pb->x) ? 1 : -1;
+	*a = *b;
+	*b = tmp;
 }
 
-static int
-y_cmp(const void *a, const void *b, void *arg)
+/*
+ * Return the k'th smallest (counting from zero) of the n values, reordering
+ * the array.
+ *
+ * This is quickselect, with median-of-three pivots and a three-way partition
+ * so that runs of equal values don't make it quadratic.  NaNs are ordered
+ * after all other values, as by float8_cmp_internal.
+ */
+static float8
+selectKthFloat8(float8 *values, int n, int k)
 {
-	Point	   *pa = *(Point **) a;
-	Point	   *pb = *(Point **) b;
+	int			lo = 0;
+	int			hi = n - 1;
+
+	Assert(k >= 0 && k < n);
+
+	while (lo < hi)
+	{
+		float8		a = values[lo],
+					b = values[lo + (hi - lo) / 2],
+					c = values[hi],
+					pivot;
+		int			lt = lo,
+					i = lo,
+					gt = hi;
+
+		if (float8_cmp_internal(a, b) < 0)
+			pivot = (float8_cmp_internal(b, c) < 0) ? b :
+				(float8_cmp_internal(a, c) < 0) ? c : a;
+		else
+			pivot = (float8_cmp_internal(a, c) < 0) ? a :
+				(float8_cmp_internal(b, c) < 0) ? c : b;
 
-	if (pa->y == pb->y)
-		return 0;
-	return (pa->y > pb->y) ? 1 : -1;
+		/* [lo, lt) < pivot, [lt, i) = pivot, (gt, hi] > pivot */
+		while (i <= gt)
+		{
+			int			cmp = float8_cmp_internal(values[i], pivot);
+
+			if (cmp < 0)
+				swapFloat8(&values[lt++], &values[i++]);
+			else if (cmp > 0)
+				swapFloat8(&values[i], &values[gt--]);
+			else
+				i++;
+		}
+
+		if (k < lt)
+			hi = lt - 1;
+		else if (k > gt)
+			lo = gt + 1;
+		else
+			return pivot;
+	}
+
+	return values[k];
 }
-#endif
 
-Datum
-spg_quad_picksplit(PG_FUNCTION_ARGS)
+static int
+float8Cmp(const void *a, const void *b)
 {
-	spgPickSplitIn *in = (spgPickSplitIn *) PG_GETARG_POINTER(0);
-	spgPickSplitOut *out = (spgPickSplitOut *) PG_GETARG_POINTER(1);
-	int			i;
-	Point	   *centroid;
-
-#ifdef USE_MEDIAN
-	/* Use the median values of x and y as the centroid point */
-	Point	  **sorted;
+	return float8_cmp_internal(*(const float8 *) a, *(const float8 *) b);
+}
 
-	sorted = palloc(sizeof(*sorted) * in->nTuples);
-	for (i = 0; i < in->nTuples; i++)
-		sorted[i] = DatumGetPointP(in->datums[i]);
+/* Which bin of the grid a coordinate falls into, given the inner bounds */
+static int
+histogramBin(float8 value, const float8 *bounds)
+{
+	int			bin = 0;
 
-	centroid = palloc(sizeof(*centroid));
+	while (bin < SPLIT_HISTOGRAM_BINS - 1 &&
+		   float8_cmp_internal(bounds[bin], value) <= 0)
+		bin++;
+	return bin;
+}
 
-	qsort(sorted, in->nTuples, sizeof(*sorted), x_cmp);
-	centroid->x = sorted[in->nTuples >> 1]->x;
-	qsort(sorted, in->nTuples, sizeof(*sorted), y_cmp);
-	centroid->y = sorted[in->nTuples >> 1]->y;
-#else
-	/* Use the average values of x and y as the centroid point */
-	centroid = palloc0(sizeof(*centroid));
+/* Use the average values of x and y as the centroid point */
+static void
+centroidMean(Point *centroid, Datum *datums, int n)
+{
+	int			i;
 
-	for (i = 0; i < in->nTuples; i++)
+	centroid->x = 0;
+	centroid->y = 0;
+	for (i = 0; i < n; i++)
 	{
-		centroid->x += DatumGetPointP(in->datums[i])->x;
-		centroid->y += DatumGetPointP(in->datums[i])->y;
+		centroid->x += DatumGetPointP(datums[i])->x;
+		centroid->y += DatumGetPointP(datums[i])->y;
 	}
 
-	centroid->x /= in->nTuples;
-	centroid->y /= in->nTuples;
-#endif
+	centroid->x /= n;
+	centroid->y /= n;
+}
 
-	out->hasPrefix = true;
-	out->prefixDatum = PointPGetDatum(centroid);
+/* Use the median values of x and y as the centroid point */
+static void
+centroidMedian(Point *centroid, Datum *datums, int n)
+{
+	float8	   *xs = palloc(sizeof(float8) * n);
+	float8	   *ys = palloc(sizeof(float8) * n);
+	int			i;
 
-	out->nNodes = 4;
-	out->nodeLabels = NULL;		/* we don't need node labels */
+	for (i = 0; i < n; i++)
+	{
+		xs[i] = DatumGetPointP(datums[i])->x;
+		ys[i] = DatumGetPointP(datums[i])->y;
+	}
 
-	out->mapTuplesToNodes = palloc(sizeof(int) * in->nTuples);
-	out->leafTupleDatums = palloc(sizeof(Datum) * in->nTuples);
+	centroid->x = selectKthFloat8(xs, n, n >> 1);
+	centroid->y = selectKthFloat8(ys, n, n >> 1);
 
-	for (i = 0; i < in->nTuples; i++)
+	pfree(xs);
+	pfree(ys);
+}
+
+/*
+ * Use the pair of equi-depth grid lines that best balances the quadrants,
+ * judging by a sample of the points
+ */
+static void
+centroidHistogram(Point *centroid, Datum *datums, int n)
+{
+	int			nsample = Min(n, SPLIT_HISTOGRAM_SAMPLE);
+	float8		xs[SPLIT_HISTOGRAM_SAMPLE];
+	float8		ys[SPLIT_HISTOGRAM_SAMPLE];
+	float8		sorted[SPLIT_HISTOGRAM_SAMPLE];
+	float8		xbounds[SPLIT_HISTOGRAM_BINS - 1];
+	float8		ybounds[SPLIT_HISTOGRAM_BINS - 1];
+
+	/* cum[i][j] is the number of sampled points in bins x < i and y < j */
+	int			cum[SPLIT_HISTOGRAM_BINS + 1][SPLIT_HISTOGRAM_BINS + 1];
+	int			bestX = SPLIT_HISTOGRAM_BINS / 2,
+				bestY = SPLIT_HISTOGRAM_BINS / 2,
+				bestMax = INT_MAX,
+				bestDist = INT_MAX;
+	int			i,
+				j;
+
+	/* Take an evenly spaced sample, deterministically */
+	for (i = 0; i < nsample; i++)
 	{
-		Point	   *p = DatumGetPointP(in->datums[i]);
-		int			quadrant = getQuadrant(centroid, p) - 1;
+		Point	   *p = DatumGetPointP(datums[(int64) i * n / nsample]);
 
-		out->leafTupleDatums[i] = PointPGetDatum(p);
-		out->mapTuplesToNodes[i] = quadrant;
+		xs[i] = p->x;
+		ys[i] = p->y;
 	}
 
-	PG_RETURN_VOID();
-}
+	/* Place the grid lines at equal fractions of the sorted sample */
+	memcpy(sorted, xs, sizeof(float8) * nsample);
+	qsort(sorted, nsample, sizeof(float8), float8Cmp);
+	for (i = 1; i < SPLIT_HISTOGRAM_BINS; i++)
+		xbounds[i - 1] = sorted[i * nsample / SPLIT_HISTOGRAM_BINS];
 
+	memcpy(sorted, ys, sizeof(float8) * nsample);
+	qsort(sorted, nsample, sizeof(float8), float8Cmp);
+	for (i = 1; i < SPLIT_HISTOGRAM_BINS; i++)
+		ybounds[i - 1] = sorted[i * nsample / SPLIT_HISTOGRAM_BINS];
 
-Datum
-spg_quad_inner_consistent(PG_FUNCTION_ARGS)
-{
-	spgInnerConsistentIn *in = (spgInnerConsistentIn *) PG_GETARG_POINTER(0);
-	spgInnerConsistentOut *out = (spgInnerConsistentOut *) PG_GETARG_POINTER(1);
-	Point	   *centroid;
-	BOX			infbbox;
-	BOX		   *bbox = NULL;
-	int			which;
-	int			i;
+	/* Count the sampled points in each cell of the grid */
+	memset(cum, 0, sizeof(cum));
+	for (i = 0; i < nsample; i++)
+		cum[histogramBin(xs[i], xbounds) + 1][histogramBin(ys[i], ybounds) + 1]++;
 
-	Assert(in->hasPrefix);
-	centroid = DatumGetPointP(in->prefixDatum);
+	for (i = 1; i <= SPLIT_HISTOGRAM_BINS; i++)
+		for (j = 1; j <= SPLIT_HISTOGRAM_BINS; j++)
+			cum[i][j] += cum[i - 1][j] + cum[i][j - 1] - cum[i - 1][j - 1];
 
 	/*
-	 * When ordering scan keys are specified, we've to calculate distance for
-	 * them.  In order to do that, we need calculate bounding boxes for all
-	 * children nodes.  Calculation of those bounding boxes on non-zero level
-	 * require knowledge of bounding box of upper node.  So, we save bounding
-	 * boxes to traversalValues.
+	 * Try each pair of inner grid lines.  Ties are broken in favor of the
+	 * lines closest to the middle of the grid, i.e. to the medians.
 	 */
-	if (in->norderbys > 0)
+	for (i = 1; i < SPLIT_HISTOGRAM_BINS; i++)
 	{
-		out->distances = (double **) palloc(sizeof(double *) * in->nNodes);
-		out->traversalValues = (void **) palloc(sizeof(void *) * in->nNodes);
-
-		if (in->level == 0)
+		for (j = 1; j < SPLIT_HISTOGRAM_BINS; j++)
 		{
-			double		inf = get_float8_infinity();
-
-			infbbox.high.x = inf;
-			infbbox.high.y = inf;
-			infbbox.low.x = -inf;
-			infbbox.low.y = -inf;
-			bbox = &infbbox;
-		}
-		else
-		{
-			bbox = in->traversalValue;
-			Assert(bbox);
+			int			lowLow = cum[i][j];
+			int			lowHigh = cum[i][SPLIT_HISTOGRAM_BINS] - lowLow;
+			int			highLow = cum[SPLIT_HISTOGRAM_BINS][j] - lowLow;
+			int			highHigh = nsample - lowLow - lowHigh - highLow;
+			int			largest = Max(Max(lowLow, lowHigh),
+									  Max(highLow, highHigh));
+			int			dist = Abs(2 * i - SPLIT_HISTOGRAM_BINS) +
+			Abs(2 * j - SPLIT_HISTOGRAM_BINS);
+
+			if (largest < bestMax || (largest == bestMax && dist < bestDist))
+			{
+				bestX = i;
+				bestY = j;
+				bestMax = largest;
+				bestDist = dist;
+			}
 		}
 	}
 
-	if (in->allTheSame)
+	centroid->x = xbounds[bestX - 1];
+	centroid->y = ybounds[bestY - 1];
+}
+
+/*
+ * Split the given points around a centroid chosen by the index's split
+ * strategy.  "points" holds the points as Point pointers, in the order of
+ * in->datums; the leaf datums themselves are kept as they are.
+ */
+static void
+quadPickSplit(spgPickSplitIn *in, spgPickSplitOut *out, Datum *points)
+{
+	int			i;
+	Point	   *centroid;
+
+	centroid = palloc(sizeof(*centroid));
+
+	switch (in->splitStrategy)
 	{
-		/* Report that all nodes should be visited */
-		out->nNodes = in->nNodes;
-		out->nodeNumbers = (int *) palloc(sizeof(int) * in->nNodes);
-		for (i = 0; i < in->nNodes; i++)
-		{
-			out->nodeNumbers[i] = i;
+		case spgSplitMean:
+			centroidMean(centroid, points, in->nTuples);
+			break;
+		case spgSplitMedian:
+			centroidMedian(centroid, points, in->nTuples);
+			break;
+		case spgSplitHistogram:
+			centroidHistogram(centroid, points, in->nTuples);
+			break;
+		default:
+			elog(ERROR, "unrecognized SP-GiST split strategy: %d",
+				 (int) in->splitStrategy);
+	}
 
-			if (in->norderbys > 0)
-			{
-				MemoryContext oldCtx = MemoryContextSwitchTo(in->traversalMemoryContext);
+	out->hasPrefix = true;
+	out->prefixDatum = PointPGetDatum(centroid);
 
-				/* Use parent quadrant box as traversalValue */
-				BOX		   *quadrant = box_copy(bbox);
+	out->nNodes = 4;
+	out->nodeLabels = NULL;		/* we don't need node labels */
 
-				MemoryContextSwitchTo(oldCtx);
+	out->mapTuplesToNodes = palloc(sizeof(int) * in->nTuples);
+	out->leafTupleDatums = palloc(sizeof(Datum) * in->nTuples);
 
-				out->traversalValues[i] = quadrant;
-				out->distances[i] = spg_key_orderbys_distances(BoxPGetDatum(quadrant), false,
-															   in->orderbys, in->norderbys);
-			}
-		}
-		PG_RETURN_VOID();
-	}
+	getQuadrants(centroid, points, in->nTuples, out->mapTuplesToNodes);
 
-	Assert(in->nNodes == 4);
+	for (i = 0; i < in->nTuples; i++)
+		out->leafTupleDatums[i] = in->datums[i];
+}
+
+Datum
+spg_quad_picksplit(PG_FUNCTION_ARGS)
+{
+	spgPickSplitIn *in = (spgPickSplitIn *) PG_GETARG_POINTER(0);
+	spgPickSplitOut *out = (spgPickSplitOut *) PG_GETARG_POINTER(1);
+
+	quadPickSplit(in, out, in->datums);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * Return the bitmask of quadrants around the centroid that may hold points
+ * satisfying all the scan keys.  Point <@ circle keys are not checked here;
+ * the caller tests them against the areas of the quadrants.
+ */
+static int
+getQuadrantMask(Point *centroid, ScanKey scankeys, int nkeys)
+{
+	int			which;
+	int			i;
 
-	/* "which" is a bitmask of quadrants that satisfy all constraints */
 	which = (1 << 1) | (1 << 2) | (1 << 3) | (1 << 4);
 
-	for (i = 0; i < in->nkeys; i++)
+	for (i = 0; i < nkeys; i++)
 	{
-		Point	   *query = DatumGetPointP(in->scankeys[i].sk_argument);
+		Point	   *query = DatumGetPointP(scankeys[i].sk_argument);
 		BOX		   *boxQuery;
 
-		switch (in->scankeys[i].sk_strategy)
+		switch (scankeys[i].sk_strategy)
 		{
 			case RTLeftStrategyNumber:
 				if (SPTEST(point_right, centroid, query))
@@ -326,12 +527,16 @@ spg_quad_inner_consistent(PG_FUNCTION_ARGS)
 				break;
 			case RTContainedByStrategyNumber:
 
+				/* Circles are checked against the quadrants' areas */
+				if (scankeys[i].sk_subtype == CIRCLEOID)
+					break;
+
 				/*
 				 * For this operator, the query is a box not a point.  We
 				 * cheat to the extent of assuming that DatumGetPointP won't
 				 * do anything that would be bad for a pointer-to-box.
 				 */
-				boxQuery = DatumGetBoxP(in->scankeys[i].sk_argument);
+				boxQuery = DatumGetBoxP(scankeys[i].sk_argument);
 
 				if (DatumGetBool(DirectFunctionCall2(box_contain_pt,
 													 PointerGetDatum(boxQuery),
@@ -359,7 +564,7 @@ spg_quad_inner_consistent(PG_FUNCTION_ARGS)
 				break;
 			default:
 				elog(ERROR, "unrecognized strategy number: %d",
-					 in->scankeys[i].sk_strategy);
+					 scankeys[i].sk_strategy);
 				break;
 		}
 
@@ -367,6 +572,126 @@ spg_quad_inner_consistent(PG_FUNCTION_ARGS)
 			break;				/* no need to consider remaining conditions */
 	}
 
+	return which;
+}
+
+/*
+ * Common code of the inner_consistent methods.
+ *
+ * If slackX and slackY are not zero, every quadrant is taken to extend that
+ * far beyond the centroid into its neighbors.  That is done by checking each
+ * quadrant against its own copy of the centroid, moved away from it.
+ */
+static void
+quadInnerConsistent(spgInnerConsistentIn *in, spgInnerConsistentOut *out,
+					float8 slackX, float8 slackY)
+{
+	Point	   *centroid;
+	Point		centroids[4];
+	BOX			infbbox;
+	BOX		   *bbox = NULL;
+	bool		needBoxes;
+	int			which;
+	int			i;
+
+	Assert(in->hasPrefix);
+	centroid = DatumGetPointP(in->prefixDatum);
+
+	/*
+	 * When ordering scan keys are specified, we've to calculate distance for
+	 * them.  In order to do that, we need calculate bounding boxes for all
+	 * children nodes.  Calculation of those bounding boxes on non-zero level
+	 * require knowledge of bounding box of upper node.  So, we save bounding
+	 * boxes to traversalValues.  Point <@ circle conditions need the boxes
+	 * too, to skip the quadrants that are too far from the center.
+	 */
+	needBoxes = (in->norderbys > 0);
+	for (i = 0; i < in->nkeys; i++)
+	{
+		if (in->scankeys[i].sk_subtype == CIRCLEOID)
+			needBoxes = true;
+	}
+
+	if (needBoxes)
+	{
+		out->traversalValues = (void **) palloc(sizeof(void *) * in->nNodes);
+
+		if (in->level == 0)
+		{
+			double		inf = get_float8_infinity();
+
+			infbbox.high.x = inf;
+			infbbox.high.y = inf;
+			infbbox.low.x = -inf;
+			infbbox.low.y = -inf;
+			bbox = &infbbox;
+		}
+		else
+		{
+			bbox = in->traversalValue;
+			Assert(bbox);
+		}
+	}
+
+	if (in->allTheSame)
+	{
+		/* All nodes cover the parent's quadrant, so check that instead */
+		if (needBoxes && !spg_box_overlaps_circles(bbox, in->scankeys, in->nkeys))
+		{
+			out->nNodes = 0;
+			return;
+		}
+
+		/* Report that all nodes should be visited */
+		out->nNodes = in->nNodes;
+		out->nodeNumbers = (int *) palloc(sizeof(int) * in->nNodes);
+		for (i = 0; i < in->nNodes; i++)
+		{
+			out->nodeNumbers[i] = i;
+
+			if (needBoxes)
+			{
+				MemoryContext oldCtx = MemoryContextSwitchTo(in->traversalMemoryContext);
+
+				/* Use parent quadrant box as traversalValue */
+				BOX		   *quadrant = box_copy(bbox);
+
+				MemoryContextSwitchTo(oldCtx);
+
+				out->traversalValues[i] = quadrant;
+			}
+		}
+
+		if (in->norderbys > 0)
+			out->distances =
+				spg_boxes_orderbys_distances((BOX **) out->traversalValues,
+											 out->nNodes,
+											 in->orderbys, in->norderbys);
+		return;
+	}
+
+	Assert(in->nNodes == 4);
+
+	/* Quadrants 1 and 2 lie to the right of the centroid, 1 and 4 above it */
+	for (i = 1; i <= 4; i++)
+	{
+		centroids[i - 1].x = (i == 1 || i == 2) ?
+			centroid->x - slackX : centroid->x + slackX;
+		centroids[i - 1].y = (i == 1 || i == 4) ?
+			centroid->y - slackY : centroid->y + slackY;
+	}
+
+	/* "which" is a bitmask of quadrants that satisfy all constraints */
+	if (slackX == 0.0 && slackY == 0.0)
+		which = getQuadrantMask(centroid, in->scankeys, in->nkeys);
+	else
+	{
+		which = 0;
+		for (i = 1; i <= 4; i++)
+			which |= getQuadrantMask(&centroids[i - 1],
+									 in->scankeys, in->nkeys) & (1 << i);
+	}
+
 	out->levelAdds = palloc(sizeof(int) * 4);
 	for (i = 0; i < 4; ++i)
 		out->levelAdds[i] = 1;
@@ -379,25 +704,43 @@ spg_quad_inner_consistent(PG_FUNCTION_ARGS)
 	{
 		if (which & (1 << i))
 		{
-			out->nodeNumbers[out->nNodes] = i - 1;
-
-			if (in->norderbys > 0)
+			if (needBoxes)
 			{
 				MemoryContext oldCtx = MemoryContextSwitchTo(in->traversalMemoryContext);
-				BOX		   *quadrant = getQuadrantArea(bbox, centroid, i);
+				BOX		   *quadrant = getQuadrantArea(bbox, &centroids[i - 1], i);
 
 				MemoryContextSwitchTo(oldCtx);
 
-				out->traversalValues[out->nNodes] = quadrant;
+				if (!spg_box_overlaps_circles(quadrant, in->scankeys, in->nkeys))
+				{
+					pfree(quadrant);
+					continue;
+				}
 
-				out->distances[out->nNodes] = spg_key_orderbys_distances(BoxPGetDatum(quadrant), false,
-																		 in->orderbys, in->norderbys);
+				out->traversalValues[out->nNodes] = quadrant;
 			}
 
+			out->nodeNumbers[out->nNodes] = i - 1;
 			out->nNodes++;
 		}
 	}
 
+	/* Compute the distances to all the chosen quadrants in one go */
+	if (in->norderbys > 0)
+		out->distances =
+			spg_boxes_orderbys_distances((BOX **) out->traversalValues,
+										 out->nNodes,
+										 in->orderbys, in->norderbys);
+}
+
+Datum
+spg_quad_inner_consistent(PG_FUNCTION_ARGS)
+{
+	spgInnerConsistentIn *in = (spgInnerConsistentIn *) PG_GETARG_POINTER(0);
+	spgInnerConsistentOut *out = (spgInnerConsistentOut *) PG_GETARG_POINTER(1);
+
+	quadInnerConsistent(in, out, 0.0, 0.0);
+
 	PG_RETURN_VOID();
 }
 
@@ -443,11 +786,15 @@ spg_quad_leaf_consistent(PG_FUNCTION_ARGS)
 			case RTContainedByStrategyNumber:
 
 				/*
-				 * For this operator, the query is a box not a point.  We
-				 * cheat to the extent of assuming that DatumGetPointP won't
-				 * do anything that would be bad for a pointer-to-box.
+				 * For this operator, the query is a box or a circle, not a
+				 * point.  We cheat to the extent of assuming that
+				 * DatumGetPointP won't do anything that would be bad for a
+				 * pointer-to-box or pointer-to-circle.
 				 */
-				res = SPTEST(box_contain_pt, query, datum);
+				if (in->scankeys[i].sk_subtype == CIRCLEOID)
+					res = SPTEST(circle_contain_pt, query, datum);
+				else
+					res = SPTEST(box_contain_pt, query, datum);
 				break;
 			default:
 				elog(ERROR, "unrecognized strategy number: %d",
@@ -466,3 +813,234 @@ spg_quad_leaf_consistent(PG_FUNCTION_ARGS)
 
 	PG_RETURN_BOOL(res);
 }
+
+
+/*
+ * quad_point_compact_ops
+ *
+ * A variant of the quad tree that stores the leaf points with float4
+ * coordinates.  The two coordinates are packed into an int8 leaf datum,
+ * which takes half the space of a point.  The inner tuples keep their exact
+ * centroids.
+ *
+ * A float4 coordinate is the float8 one rounded to the nearest float4, so
+ * the original value lies somewhere between the neighbors of the float4 value.
+ * All leaf tests are therefore lossy, and done against the box bounded by
+ * those neighbors.  Distances to that box are lower bounds of the true
+ * distances, so ordered scans recheck them as well.
+ *
+ * Leaves are placed in the tree by their rounded coordinates, consistently
+ * in choose and picksplit, because picksplit only ever sees the leaf datums.
+ * A point may thus be filed in the quadrant next to the one its original
+ * coordinates fall into.  The inner_consistent method makes up for that by
+ * letting every quadrant extend beyond the centroid by more than the rounding
+ * error of coordinates near it.
+ */
+
+/* Pack a point into a leaf datum, rounding the coordinates to float4 */
+static Datum
+compactPointGetDatum(Point *point)
+{
+	float4		coords[2];
+	int64		packed;
+
+	coords[0] = (float4) point->x;
+	check_float4_val(coords[0], isinf(point->x), true);
+	coords[1] = (float4) point->y;
+	check_float4_val(coords[1], isinf(point->y), true);
+
+	memcpy(&packed, coords, sizeof(packed));
+
+	return Int64GetDatum(packed);
+}
+
+/* Unpack a leaf datum into a point with the rounded coordinates */
+static void
+compactPointFromDatum(Datum datum, Point *point)
+{
+	int64		packed = DatumGetInt64(datum);
+	float4		coords[2];
+
+	memcpy(coords, &packed, sizeof(coords));
+	point->x = coords[0];
+	point->y = coords[1];
+}
+
+/*
+ * How far beyond a centroid coordinate the quadrants must extend to cover
+ * the rounding error of the coordinates of the leaves near it.  The tolerance
+ * of the fuzzy comparisons is added, so that ~= queries near the centroid
+ * also look at both sides of it.
+ */
+static inline float8
+compactPointSlack(float8 coord)
+{
+#ifdef EPSILON
+	return EPSILON + (fabs(coord) + 1.0) * FLT_EPSILON;
+#else
+	return (fabs(coord) + 1.0) * FLT_EPSILON;
+#endif
+}
+
+Datum
+spg_quad_compact_config(PG_FUNCTION_ARGS)
+{
+	/* spgConfigIn *cfgin = (spgConfigIn *) PG_GETARG_POINTER(0); */
+	spgConfigOut *cfg = (spgConfigOut *) PG_GETARG_POINTER(1);
+
+	cfg->prefixType = POINTOID;
+	cfg->labelType = VOIDOID;	/* we don't need node labels */
+	cfg->leafType = INT8OID;
+	cfg->canReturnData = false;
+	cfg->longValuesOK = false;
+	PG_RETURN_VOID();
+}
+
+Datum
+spg_quad_compact_compress(PG_FUNCTION_ARGS)
+{
+	Point	   *point = PG_GETARG_POINT_P(0);
+
+	PG_RETURN_DATUM(compactPointGetDatum(point));
+}
+
+Datum
+spg_quad_compact_choose(PG_FUNCTION_ARGS)
+{
+	spgChooseIn *in = (spgChooseIn *) PG_GETARG_POINTER(0);
+	spgChooseOut *out = (spgChooseOut *) PG_GETARG_POINTER(1);
+	Point		inPoint;
+
+	out->resultType = spgMatchNode;
+	out->result.matchNode.levelAdd = 0;
+	out->result.matchNode.restDatum = in->leafDatum;
+
+	/* nodeN will be set by core for allTheSame tuples */
+	if (!in->allTheSame)
+	{
+		Assert(in->hasPrefix);
+		Assert(in->nNodes == 4);
+
+		/* use the rounded coordinates, as picksplit does */
+		compactPointFromDatum(in->leafDatum, &inPoint);
+		out->result.matchNode.nodeN =
+			getQuadrant(DatumGetPointP(in->prefixDatum), &inPoint) - 1;
+	}
+
+	PG_RETURN_VOID();
+}
+
+Datum
+spg_quad_compact_picksplit(PG_FUNCTION_ARGS)
+{
+	spgPickSplitIn *in = (spgPickSplitIn *) PG_GETARG_POINTER(0);
+	spgPickSplitOut *out = (spgPickSplitOut *) PG_GETARG_POINTER(1);
+	Point	   *points = palloc(sizeof(Point) * in->nTuples);
+	Datum	   *pointDatums = palloc(sizeof(Datum) * in->nTuples);
+	int			i;
+
+	for (i = 0; i < in->nTuples; i++)
+	{
+		compactPointFromDatum(in->datums[i], &points[i]);
+		pointDatums[i] = PointPGetDatum(&points[i]);
+	}
+
+	quadPickSplit(in, out, pointDatums);
+
+	pfree(pointDatums);
+	pfree(points);
+
+	PG_RETURN_VOID();
+}
+
+Datum
+spg_quad_compact_inner_consistent(PG_FUNCTION_ARGS)
+{
+	spgInnerConsistentIn *in = (spgInnerConsistentIn *) PG_GETARG_POINTER(0);
+	spgInnerConsistentOut *out = (spgInnerConsistentOut *) PG_GETARG_POINTER(1);
+	Point	   *centroid = DatumGetPointP(in->prefixDatum);
+
+	quadInnerConsistent(in, out,
+						compactPointSlack(centroid->x),
+						compactPointSlack(centroid->y));
+
+	PG_RETURN_VOID();
+}
+
+Datum
+spg_quad_compact_leaf_consistent(PG_FUNCTION_ARGS)
+{
+	spgLeafConsistentIn *in = (spgLeafConsistentIn *) PG_GETARG_POINTER(0);
+	spgLeafConsistentOut *out = (spgLeafConsistentOut *) PG_GETARG_POINTER(1);
+	Point		datum;
+	BOX			area;
+	bool		res;
+	int			i;
+
+	/* all tests are lossy */
+	out->recheck = true;
+
+	compactPointFromDatum(in->leafDatum, &datum);
+
+	/* the original point lies between the neighbors of the rounded one */
+	area.low.x = nextafterf((float4) datum.x, -get_float4_infinity());
+	area.low.y = nextafterf((float4) datum.y, -get_float4_infinity());
+	area.high.x = nextafterf((float4) datum.x, get_float4_infinity());
+	area.high.y = nextafterf((float4) datum.y, get_float4_infinity());
+
+	/* Check whether any point in the area could satisfy the condition(s) */
+	res = true;
+	for (i = 0; i < in->nkeys; i++)
+	{
+		Point	   *query = DatumGetPointP(in->scankeys[i].sk_argument);
+		BOX			queryBox;
+
+		switch (in->scankeys[i].sk_strategy)
+		{
+			case RTLeftStrategyNumber:
+				res = SPTEST(point_left, &area.low, query);
+				break;
+			case RTRightStrategyNumber:
+				res = SPTEST(point_right, &area.high, query);
+				break;
+			case RTSameStrategyNumber:
+				queryBox.low = *query;
+				queryBox.high = *query;
+				res = DatumGetBool(DirectFunctionCall2(box_overlap,
+													   BoxPGetDatum(&area),
+													   BoxPGetDatum(&queryBox)));
+				break;
+			case RTBelowStrategyNumber:
+				res = SPTEST(point_below, &area.low, query);
+				break;
+			case RTAboveStrategyNumber:
+				res = SPTEST(point_above, &area.high, query);
+				break;
+			case RTContainedByStrategyNumber:
+				if (in->scankeys[i].sk_subtype == CIRCLEOID)
+					res = spg_box_overlaps_circles(&area, &in->scankeys[i], 1);
+				else
+					res = DatumGetBool(DirectFunctionCall2(box_overlap,
+														   BoxPGetDatum(&area),
+														   in->scankeys[i].sk_argument));
+				break;
+			default:
+				elog(ERROR, "unrecognized strategy number: %d",
+					 in->scankeys[i].sk_strategy);
+				break;
+		}
+
+		if (!res)
+			break;
+	}
+
+	if (res && in->norderbys > 0)
+	{
+		/* and so are the distances, which are to the area */
+		out->distances = spg_key_orderbys_distances(BoxPGetDatum(&area), false,
+													in->orderbys, in->norderbys);
+		out->recheckDistances = true;
+	}
+
+	PG_RETURN_BOOL(res);
+}
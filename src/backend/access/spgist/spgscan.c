@@ -19,7 +19,10 @@
 #include "access/relscan.h"
 #include "access/spgist_private.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/bufmgr.h"
+#include "storage/condition_variable.h"
+#include "storage/spin.h"
 #include "utils/datum.h"
 #include "utils/float.h"
 #include "utils/lsyscache.h"
@@ -30,6 +33,60 @@ typedef void (*storeRes_func) (SpGistScanOpaque so, ItemPointer heapPtr,
 							   Datum leafValue, bool isNull, bool recheck,
 							   bool recheckDistances, double *distances);
 
+static void spgKillItems(IndexScanDesc scan);
+
+/*
+ * Shared state of a parallel SP-GiST scan
+ *
+ * The participants divide the index between them by subtrees.  The first one
+ * to start expands the upper levels of the tree breadth-first, until there
+ * are enough items to go around, and records a copy of each inner tuple it
+ * expanded.  The others repeat the same expansion from those copies rather
+ * than from the index, so that everybody arrives at the same list of items,
+ * reconstructed values and traversal values included, even if the index is
+ * being modified concurrently.  The items are then claimed one at a time,
+ * and each participant walks the whole subtree below an item before
+ * claiming the next.
+ */
+typedef enum
+{
+	SPGPARALLEL_NOT_STARTED,	/* nobody has expanded the tree yet */
+	SPGPARALLEL_EXPANDING,		/* somebody is doing it; others must wait */
+	SPGPARALLEL_READY			/* items to scan are available */
+} SpGistParallelStatus;
+
+typedef struct SpGistParallelScanDescData
+{
+	slock_t		mutex;			/* protects status and nextItem */
+	ConditionVariable cv;		/* signaled when status becomes READY */
+	SpGistParallelStatus status;
+	int			nrecords;		/* number of records following the struct */
+	int			nextItem;		/* next item to be claimed */
+} SpGistParallelScanDescData;
+
+typedef SpGistParallelScanDescData *SpGistParallelScanDesc;
+
+/*
+ * Each record is a header followed by the copy of an inner tuple, or by
+ * nothing if the item led to a leaf page, which the expansion doesn't read.
+ */
+typedef struct SpGistParallelRecord
+{
+	uint32		size;			/* MAXALIGN'd size of the tuple, or 0 */
+} SpGistParallelRecord;
+
+#define SizeOfSpGistParallelRecord	MAXALIGN(sizeof(SpGistParallelRecord))
+
+/* Space for records, and the number of items the expansion aims for */
+#define SPGIST_PARALLEL_RECORDS_SIZE	(4 * BLCKSZ)
+#define SPGIST_PARALLEL_TARGET_ITEMS	256
+
+#define SpGistParallelRecords(pss) \
+	((char *) (pss) + MAXALIGN(sizeof(SpGistParallelScanDescData)))
+
+/* Number of search items allocated at a time by spgAllocSearchItem() */
+#define SPGIST_SEARCH_ITEM_CHUNK	64
+
 /*
  * Pairing heap comparison function for the SpGistSearchItem queue.
  * KNN-searches currently only support NULLS LAST.  So, preserve this logic
@@ -78,6 +135,10 @@ pairingheap_SpGistSearchItem_cmp(const pairingheap_node *a,
 	return 0;
 }
 
+/*
+ * Release a SpGistSearchItem.  The item itself is kept on the free list of
+ * the scan, for spgAllocSearchItem() to reuse.
+ */
 static void
 spgFreeSearchItem(SpGistScanOpaque so, SpGistSearchItem *item)
 {
@@ -88,7 +149,8 @@ spgFreeSearchItem(SpGistScanOpaque so, SpGistSearchItem *item)
 	if (item->traversalValue)
 		pfree(item->traversalValue);
 
-	pfree(item);
+	item->phNode.next_sibling = (pairingheap_node *) so->freeItems;
+	so->freeItems = item;
 }
 
 /*
@@ -100,14 +162,47 @@ static void
 spgAddSearchItemToQueue(SpGistScanOpaque so, SpGistSearchItem *item)
 {
 	pairingheap_add(so->scanQueue, &item->phNode);
+
+	so->queueLength++;
+	if (so->queueLength > so->instrument->queue_peak)
+		so->instrument->queue_peak = so->queueLength;
 }
 
+/*
+ * Get a SpGistSearchItem from the free list of the scan.
+ *
+ * An ordered scan creates and destroys an item for every child of every inner
+ * tuple it visits, and for every leaf tuple it puts in the queue, so we don't
+ * want to go through palloc and pfree for each of them.  All items have room
+ * for the distances of non-NULL items, whether they need it or not, and are
+ * allocated SPGIST_SEARCH_ITEM_CHUNK at a time in the traversal context.
+ * Resetting that context releases them all, along with the free list.
+ */
 static SpGistSearchItem *
 spgAllocSearchItem(SpGistScanOpaque so, bool isnull, double *distances)
 {
-	/* allocate distance array only for non-NULL items */
-	SpGistSearchItem *item =
-	palloc(SizeOfSpGistSearchItem(isnull ? 0 : so->numberOfNonNullOrderBys));
+	SpGistSearchItem *item;
+
+	if (so->freeItems == NULL)
+	{
+		Size		itemSize;
+		char	   *chunk;
+		int			i;
+
+		itemSize = MAXALIGN(SizeOfSpGistSearchItem(so->numberOfNonNullOrderBys));
+		chunk = MemoryContextAlloc(so->traversalCxt,
+								   itemSize * SPGIST_SEARCH_ITEM_CHUNK);
+
+		for (i = SPGIST_SEARCH_ITEM_CHUNK - 1; i >= 0; i--)
+		{
+			item = (SpGistSearchItem *) (chunk + i * itemSize);
+			item->phNode.next_sibling = (pairingheap_node *) so->freeItems;
+			so->freeItems = item;
+		}
+	}
+
+	item = so->freeItems;
+	so->freeItems = (SpGistSearchItem *) item->phNode.next_sibling;
 
 	item->isNull = isnull;
 
@@ -118,8 +213,8 @@ spgAllocSearchItem(SpGistScanOpaque so, bool isnull, double *distances)
 	return item;
 }
 
-static void
-spgAddStartItem(SpGistScanOpaque so, bool isnull)
+static SpGistSearchItem *
+spgMakeStartItem(SpGistScanOpaque so, bool isnull)
 {
 	SpGistSearchItem *startEntry =
 	spgAllocSearchItem(so, isnull, so->zeroDistances);
@@ -134,7 +229,13 @@ spgAddStartItem(SpGistScanOpaque so, bool isnull)
 	startEntry->recheck = false;
 	startEntry->recheckDistances = false;
 
-	spgAddSearchItemToQueue(so, startEntry);
+	return startEntry;
+}
+
+static void
+spgAddStartItem(SpGistScanOpaque so, bool isnull)
+{
+	spgAddSearchItemToQueue(so, spgMakeStartItem(so, isnull));
 }
 
 /*
@@ -147,17 +248,23 @@ resetSpGistScanOpaque(SpGistScanOpaque so)
 	MemoryContext oldCtx;
 
 	MemoryContextReset(so->traversalCxt);
+	so->freeItems = NULL;
 
 	oldCtx = MemoryContextSwitchTo(so->traversalCxt);
 
 	/* initialize queue only for distance-ordered scans */
 	so->scanQueue = pairingheap_allocate(pairingheap_SpGistSearchItem_cmp, so);
+	so->queueLength = 0;
 
-	if (so->searchNulls)
+	/* A parallel scan starts from the items shared out by spgParallelNextItem */
+	so->parallelItems = NULL;
+	so->nParallelItems = -1;
+
+	if (so->searchNulls && !so->parallelScan)
 		/* Add a work item to scan the null index entries */
 		spgAddStartItem(so, true);
 
-	if (so->searchNonNulls)
+	if (so->searchNonNulls && !so->parallelScan)
 		/* Add a work item to scan the non-null index entries */
 		spgAddStartItem(so, false);
 
@@ -356,6 +463,9 @@ spgbeginscan(Relation rel, int keysz, int orderbysz)
 
 	so->indexCollation = rel->rd_indcollation[0];
 
+	so->ignoreKilledTuples = scan->ignore_killed_tuples;
+	so->instrument = &scan->instrument;
+
 	scan->opaque = so;
 
 	return scan;
@@ -367,6 +477,10 @@ spgrescan(IndexScanDesc scan, ScanKey scankey, int nscankeys,
 {
 	SpGistScanOpaque so = (SpGistScanOpaque) scan->opaque;
 
+	/* Before leaving the current batch, mark any killed items */
+	if (so->numKilled > 0)
+		spgKillItems(scan);
+
 	/* copy scankeys into local storage */
 	if (scankey && scan->numberOfKeys > 0)
 		memmove(scan->keyData, scankey,
@@ -403,6 +517,16 @@ spgrescan(IndexScanDesc scan, ScanKey scankey, int nscankeys,
 	/* preprocess scankeys, set up the representation in *so */
 	spgPrepareScanKeys(scan);
 
+	if (scan->parallel_scan)
+	{
+		ParallelIndexScanDesc parallel_scan = scan->parallel_scan;
+
+		/* The planner doesn't consider parallel distance-ordered scans */
+		Assert(so->numberOfNonNullOrderBys == 0);
+		so->parallelScan = (SpGistParallelScanDesc)
+			OffsetToPointer((void *) parallel_scan, parallel_scan->ps_offset);
+	}
+
 	/* set up starting queue entries */
 	resetSpGistScanOpaque(so);
 }
@@ -412,6 +536,10 @@ spgendscan(IndexScanDesc scan)
 {
 	SpGistScanOpaque so = (SpGistScanOpaque) scan->opaque;
 
+	/* Before leaving the current batch, mark any killed items */
+	if (so->numKilled > 0)
+		spgKillItems(scan);
+
 	MemoryContextDelete(so->tempCxt);
 	MemoryContextDelete(so->traversalCxt);
 
@@ -518,6 +646,12 @@ spgLeafTest(SpGistScanOpaque so, SpGistSearchItem *item,
 		distances = out.distances;
 
 		MemoryContextSwitchTo(oldCxt);
+
+		so->instrument->leaf_tested++;
+		if (!result)
+			so->instrument->consistent_rejected++;
+		else if (recheck)
+			so->instrument->leaf_rechecked++;
 	}
 
 	if (result)
@@ -568,6 +702,7 @@ spgInitInnerConsistentIn(spgInnerConsistentIn *in,
 	in->traversalValue = item->traversalValue;
 	in->level = item->level;
 	in->returnData = so->want_itup;
+	in->looseness = so->state.looseness;
 	in->allTheSame = innerTuple->allTheSame;
 	in->hasPrefix = (innerTuple->prefixSize > 0);
 	in->prefixDatum = SGITDATUM(innerTuple, &so->state);
@@ -610,9 +745,14 @@ spgMakeInnerItem(SpGistScanOpaque so,
 	return item;
 }
 
+/*
+ * Apply the inner_consistent method to an inner tuple, and create items for
+ * the child nodes that have to be visited.  They are added to the queue, or
+ * appended to *children if that isn't NULL.
+ */
 static void
 spgInnerTest(SpGistScanOpaque so, SpGistSearchItem *item,
-			 SpGistInnerTuple innerTuple, bool isnull)
+			 SpGistInnerTuple innerTuple, bool isnull, List **children)
 {
 	MemoryContext oldCxt = MemoryContextSwitchTo(so->tempCxt);
 	spgInnerConsistentOut out;
@@ -632,6 +772,9 @@ spgInnerTest(SpGistScanOpaque so, SpGistSearchItem *item,
 						  so->indexCollation,
 						  PointerGetDatum(&in),
 						  PointerGetDatum(&out));
+
+		so->instrument->inner_visited++;
+		so->instrument->consistent_rejected += nNodes - out.nNodes;
 	}
 	else
 	{
@@ -682,13 +825,213 @@ spgInnerTest(SpGistScanOpaque so, SpGistSearchItem *item,
 			innerItem = spgMakeInnerItem(so, item, node, &out, i, isnull,
 										 distances);
 
-			spgAddSearchItemToQueue(so, innerItem);
+			if (children)
+				*children = lappend(*children, innerItem);
+			else
+				spgAddSearchItemToQueue(so, innerItem);
 		}
 	}
 
 	MemoryContextSwitchTo(oldCxt);
 }
 
+/*
+ * Read the inner tuple an item points to, following any redirections, and
+ * return a palloc'd copy of it.  Returns NULL if the item leads to a leaf
+ * page instead.
+ */
+static SpGistInnerTuple
+spgParallelReadInner(Relation index, SpGistSearchItem *item,
+					 Snapshot snapshot)
+{
+	ItemPointerData ptr = item->heapPtr;
+
+	for (;;)
+	{
+		Buffer		buffer;
+		Page		page;
+		SpGistInnerTuple innerTuple;
+
+		buffer = ReadBuffer(index, ItemPointerGetBlockNumber(&ptr));
+		LockBuffer(buffer, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buffer);
+		TestForOldSnapshot(snapshot, index, page);
+
+		if (SpGistPageIsLeaf(page))
+		{
+			/* leave that to whoever walks the item */
+			UnlockReleaseBuffer(buffer);
+			return NULL;
+		}
+
+		innerTuple = (SpGistInnerTuple)
+			PageGetItem(page, PageGetItemId(page, ItemPointerGetOffsetNumber(&ptr)));
+
+		if (innerTuple->tupstate == SPGIST_LIVE)
+		{
+			SpGistInnerTuple copy = palloc(innerTuple->size);
+
+			memcpy(copy, innerTuple, innerTuple->size);
+			UnlockReleaseBuffer(buffer);
+			return copy;
+		}
+
+		if (innerTuple->tupstate != SPGIST_REDIRECT)
+			elog(ERROR, "unexpected SPGiST tuple state: %d",
+				 innerTuple->tupstate);
+
+		/* transfer attention to redirect point */
+		ptr = ((SpGistDeadTuple) innerTuple)->pointer;
+		Assert(ItemPointerGetBlockNumber(&ptr) != SPGIST_METAPAGE_BLKNO);
+		UnlockReleaseBuffer(buffer);
+	}
+}
+
+/*
+ * Work out the items a parallel scan divides between its participants, see
+ * SpGistParallelScanDescData.  If "expand" is true we are the participant
+ * that reads the index and records what it found, otherwise we replay those
+ * records.
+ */
+static void
+spgParallelExpand(Relation index, SpGistScanOpaque so, bool expand,
+				  Snapshot snapshot)
+{
+	SpGistParallelScanDesc pss = so->parallelScan;
+	char	   *records = SpGistParallelRecords(pss);
+	Size		used = 0;
+	int			nrecords = 0;
+	List	   *done = NIL;
+	List	   *pending = NIL;
+	MemoryContext oldCxt;
+	ListCell   *lc;
+	int			i;
+
+	oldCxt = MemoryContextSwitchTo(so->traversalCxt);
+
+	if (so->searchNulls)
+		pending = lappend(pending, spgMakeStartItem(so, true));
+	if (so->searchNonNulls)
+		pending = lappend(pending, spgMakeStartItem(so, false));
+
+	while (pending != NIL)
+	{
+		SpGistSearchItem *item = (SpGistSearchItem *) linitial(pending);
+		SpGistParallelRecord *rec = (SpGistParallelRecord *) (records + used);
+		SpGistInnerTuple innerTuple;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (expand)
+		{
+			Size		size;
+
+			if (list_length(done) + list_length(pending) >=
+				SPGIST_PARALLEL_TARGET_ITEMS)
+				break;
+
+			innerTuple = spgParallelReadInner(index, item, snapshot);
+			size = innerTuple ? MAXALIGN(innerTuple->size) : 0;
+			if (used + SizeOfSpGistParallelRecord + size >
+				SPGIST_PARALLEL_RECORDS_SIZE)
+				break;
+
+			rec->size = size;
+			if (innerTuple)
+			{
+				memcpy((char *) rec + SizeOfSpGistParallelRecord,
+					   innerTuple, innerTuple->size);
+				pfree(innerTuple);
+			}
+		}
+		else if (nrecords == pss->nrecords)
+			break;
+
+		innerTuple = rec->size > 0 ? (SpGistInnerTuple)
+			((char *) rec + SizeOfSpGistParallelRecord) : NULL;
+		used += SizeOfSpGistParallelRecord + rec->size;
+		nrecords++;
+
+		pending = list_delete_first(pending);
+		if (innerTuple == NULL)
+			done = lappend(done, item);
+		else
+		{
+			spgInnerTest(so, item, innerTuple, item->isNull, &pending);
+			spgFreeSearchItem(so, item);
+			MemoryContextReset(so->tempCxt);
+		}
+	}
+
+	/* Items leading to leaf pages go first, then the unexpanded ones */
+	done = list_concat(done, pending);
+
+	so->nParallelItems = list_length(done);
+	so->parallelItems = (SpGistSearchItem **)
+		palloc(sizeof(SpGistSearchItem *) * Max(so->nParallelItems, 1));
+	i = 0;
+	foreach(lc, done)
+		so->parallelItems[i++] = (SpGistSearchItem *) lfirst(lc);
+
+	MemoryContextSwitchTo(oldCxt);
+
+	if (expand)
+	{
+		SpinLockAcquire(&pss->mutex);
+		pss->nrecords = nrecords;
+		pss->status = SPGPARALLEL_READY;
+		SpinLockRelease(&pss->mutex);
+		ConditionVariableBroadcast(&pss->cv);
+	}
+}
+
+/*
+ * Within a parallel scan, claim the next subtree to be walked, and return
+ * the item for it.  Returns NULL if there are none left.
+ */
+static SpGistSearchItem *
+spgParallelNextItem(Relation index, SpGistScanOpaque so, Snapshot snapshot)
+{
+	SpGistParallelScanDesc pss = so->parallelScan;
+	SpGistSearchItem *item;
+	int			i;
+
+	if (so->nParallelItems < 0)
+	{
+		SpGistParallelStatus status;
+
+		for (;;)
+		{
+			SpinLockAcquire(&pss->mutex);
+			status = pss->status;
+			if (status == SPGPARALLEL_NOT_STARTED)
+				pss->status = SPGPARALLEL_EXPANDING;
+			SpinLockRelease(&pss->mutex);
+
+			if (status != SPGPARALLEL_EXPANDING)
+				break;
+			ConditionVariableSleep(&pss->cv, WAIT_EVENT_SPGIST_ROOT);
+		}
+		ConditionVariableCancelSleep();
+
+		spgParallelExpand(index, so, status == SPGPARALLEL_NOT_STARTED,
+						  snapshot);
+	}
+
+	SpinLockAcquire(&pss->mutex);
+	i = pss->nextItem++;
+	SpinLockRelease(&pss->mutex);
+
+	if (i >= so->nParallelItems)
+		return NULL;
+
+	/* spgWalk frees the item when done with it */
+	item = so->parallelItems[i];
+	so->parallelItems[i] = NULL;
+
+	return item;
+}
+
 /* Returns a next item in an (ordered) scan or null if the index is exhausted */
 static SpGistSearchItem *
 spgGetNextQueueItem(SpGistScanOpaque so)
@@ -696,7 +1039,9 @@ spgGetNextQueueItem(SpGistScanOpaque so)
 	if (pairingheap_is_empty(so->scanQueue))
 		return NULL;			/* Done when both heaps are empty */
 
-	/* Return item; caller is responsible to pfree it */
+	so->queueLength--;
+
+	/* Return item; caller is responsible to free it with spgFreeSearchItem */
 	return (SpGistSearchItem *) pairingheap_remove_first(so->scanQueue);
 }
 
@@ -749,11 +1094,117 @@ spgTestLeafTuple(SpGistScanOpaque so,
 
 	Assert(ItemPointerIsValid(&leafTuple->heapPtr));
 
+	/* Skip tuples that an earlier scan found to be dead to everyone */
+	if (so->ignoreKilledTuples && ItemIdIsDead(PageGetItemId(page, offset)))
+		return leafTuple->nextOffset;
+
+	ItemPointerSet(&so->curLeafTid,
+				   ItemPointerGetBlockNumber(&item->heapPtr), offset);
 	spgLeafTest(so, item, leafTuple, isnull, reportedSome, storeRes);
 
 	return leafTuple->nextOffset;
 }
 
+/*
+ * Visit the index page a non-leaf item points to.  The leaf tuples in the
+ * chain it leads to are passed to spgLeafTest, or the inner tuple to
+ * spgInnerTest, following any redirections on the way.
+ *
+ * "buffer" is the buffer the caller has locked, or InvalidBuffer; the buffer
+ * left locked is returned, so that consecutive items on the same page don't
+ * need to lock it again.
+ */
+static Buffer
+spgVisitItem(Relation index, SpGistScanOpaque so, SpGistSearchItem *item,
+			 Buffer buffer, bool *reportedSome, storeRes_func storeRes,
+			 Snapshot snapshot)
+{
+	BlockNumber blkno;
+	OffsetNumber offset;
+	Page		page;
+	bool		isnull;
+
+redirect:
+	/* Check for interrupts, just in case of infinite loop */
+	CHECK_FOR_INTERRUPTS();
+
+	blkno = ItemPointerGetBlockNumber(&item->heapPtr);
+	offset = ItemPointerGetOffsetNumber(&item->heapPtr);
+
+	if (buffer == InvalidBuffer)
+	{
+		buffer = ReadBuffer(index, blkno);
+		LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	}
+	else if (blkno != BufferGetBlockNumber(buffer))
+	{
+		UnlockReleaseBuffer(buffer);
+		buffer = ReadBuffer(index, blkno);
+		LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	}
+
+	/* else new pointer points to the same page, no work needed */
+
+	page = BufferGetPage(buffer);
+	TestForOldSnapshot(snapshot, index, page);
+
+	isnull = SpGistPageStoresNulls(page) ? true : false;
+
+	if (SpGistPageIsLeaf(page))
+	{
+		/* Page is a leaf - that is, all it's tuples are heap items */
+		OffsetNumber max = PageGetMaxOffsetNumber(page);
+
+		/* remember the page's LSN, so spgKillItems can tell if it changed */
+		so->curLeafLSN = BufferGetLSNAtomic(buffer);
+
+		if (SpGistBlockIsRoot(blkno))
+		{
+			/* When root is a leaf, examine all its tuples */
+			for (offset = FirstOffsetNumber; offset <= max; offset++)
+				(void) spgTestLeafTuple(so, item, page, offset,
+										isnull, true,
+										reportedSome, storeRes);
+		}
+		else
+		{
+			/* Normal case: just examine the chain we arrived at */
+			while (offset != InvalidOffsetNumber)
+			{
+				Assert(offset >= FirstOffsetNumber && offset <= max);
+				offset = spgTestLeafTuple(so, item, page, offset,
+										  isnull, false,
+										  reportedSome, storeRes);
+				if (offset == SpGistRedirectOffsetNumber)
+					goto redirect;
+			}
+		}
+	}
+	else						/* page is inner */
+	{
+		SpGistInnerTuple innerTuple = (SpGistInnerTuple)
+		PageGetItem(page, PageGetItemId(page, offset));
+
+		if (innerTuple->tupstate != SPGIST_LIVE)
+		{
+			if (innerTuple->tupstate == SPGIST_REDIRECT)
+			{
+				/* transfer attention to redirect point */
+				item->heapPtr = ((SpGistDeadTuple) innerTuple)->pointer;
+				Assert(ItemPointerGetBlockNumber(&item->heapPtr) !=
+					   SPGIST_METAPAGE_BLKNO);
+				goto redirect;
+			}
+			elog(ERROR, "unexpected SPGiST tuple state: %d",
+				 innerTuple->tupstate);
+		}
+
+		spgInnerTest(so, item, innerTuple, isnull, NULL);
+	}
+
+	return buffer;
+}
+
 /*
  * Walk the tree and report all tuples passing the scan quals to the storeRes
  * subroutine.
@@ -772,96 +1223,37 @@ spgWalk(Relation index, SpGistScanOpaque so, bool scanWholeIndex,
 	{
 		SpGistSearchItem *item = spgGetNextQueueItem(so);
 
+		/* In a parallel scan, move on to the next subtree */
+		if (item == NULL && so->parallelScan)
+		{
+			/* don't hold a page lock while perhaps waiting for the others */
+			if (buffer != InvalidBuffer)
+			{
+				UnlockReleaseBuffer(buffer);
+				buffer = InvalidBuffer;
+			}
+			item = spgParallelNextItem(index, so, snapshot);
+		}
+
 		if (item == NULL)
 			break;				/* No more items in queue -> done */
 
-redirect:
-		/* Check for interrupts, just in case of infinite loop */
+		/* Check for interrupts */
 		CHECK_FOR_INTERRUPTS();
 
 		if (item->isLeaf)
 		{
 			/* We store heap items in the queue only in case of ordered search */
 			Assert(so->numberOfNonNullOrderBys > 0);
+			/* the leaf page may have changed since, so forget where it was */
+			ItemPointerSetInvalid(&so->curLeafTid);
 			storeRes(so, &item->heapPtr, item->value, item->isNull,
 					 item->recheck, item->recheckDistances, item->distances);
 			reportedSome = true;
 		}
 		else
-		{
-			BlockNumber blkno = ItemPointerGetBlockNumber(&item->heapPtr);
-			OffsetNumber offset = ItemPointerGetOffsetNumber(&item->heapPtr);
-			Page		page;
-			bool		isnull;
-
-			if (buffer == InvalidBuffer)
-			{
-				buffer = ReadBuffer(index, blkno);
-				LockBuffer(buffer, BUFFER_LOCK_SHARE);
-			}
-			else if (blkno != BufferGetBlockNumber(buffer))
-			{
-				UnlockReleaseBuffer(buffer);
-				buffer = ReadBuffer(index, blkno);
-				LockBuffer(buffer, BUFFER_LOCK_SHARE);
-			}
-
-			/* else new pointer points to the same page, no work needed */
-
-			page = BufferGetPage(buffer);
-			TestForOldSnapshot(snapshot, index, page);
-
-			isnull = SpGistPageStoresNulls(page) ? true : false;
-
-			if (SpGistPageIsLeaf(page))
-			{
-				/* Page is a leaf - that is, all it's tuples are heap items */
-				OffsetNumber max = PageGetMaxOffsetNumber(page);
-
-				if (SpGistBlockIsRoot(blkno))
-				{
-					/* When root is a leaf, examine all its tuples */
-					for (offset = FirstOffsetNumber; offset <= max; offset++)
-						(void) spgTestLeafTuple(so, item, page, offset,
-												isnull, true,
-												&reportedSome, storeRes);
-				}
-				else
-				{
-					/* Normal case: just examine the chain we arrived at */
-					while (offset != InvalidOffsetNumber)
-					{
-						Assert(offset >= FirstOffsetNumber && offset <= max);
-						offset = spgTestLeafTuple(so, item, page, offset,
-												  isnull, false,
-												  &reportedSome, storeRes);
-						if (offset == SpGistRedirectOffsetNumber)
-							goto redirect;
-					}
-				}
-			}
-			else				/* page is inner */
-			{
-				SpGistInnerTuple innerTuple = (SpGistInnerTuple)
-				PageGetItem(page, PageGetItemId(page, offset));
-
-				if (innerTuple->tupstate != SPGIST_LIVE)
-				{
-					if (innerTuple->tupstate == SPGIST_REDIRECT)
-					{
-						/* transfer attention to redirect point */
-						item->heapPtr = ((SpGistDeadTuple) innerTuple)->pointer;
-						Assert(ItemPointerGetBlockNumber(&item->heapPtr) !=
-							   SPGIST_METAPAGE_BLKNO);
-						goto redirect;
-					}
-					elog(ERROR, "unexpected SPGiST tuple state: %d",
-						 innerTuple->tupstate);
-				}
-
-				spgInnerTest(so, item, innerTuple, isnull);
-			}
-		}
+			buffer = spgVisitItem(index, so, item, buffer, &reportedSome,
+								  storeRes, snapshot);
 
 		/* done with this scan item */
 		spgFreeSearchItem(so, item);
@@ -909,6 +1301,8 @@ storeGettuple(SpGistScanOpaque so, ItemPointer heapPtr,
 {
 	Assert(so->nPtrs < MaxIndexTuplesPerPage);
 	so->heapPtrs[so->nPtrs] = *heapPtr;
+	so->leafTids[so->nPtrs] = so->curLeafTid;
+	so->leafLSNs[so->nPtrs] = so->curLeafLSN;
 	so->recheck[so->nPtrs] = recheck;
 	so->recheckDistances[so->nPtrs] = recheckDistances;
 
@@ -957,6 +1351,90 @@ storeGettuple(SpGistScanOpaque so, ItemPointer heapPtr,
 	so->nPtrs++;
 }
 
+/*
+ * Mark the leaf tuples of the current batch that the executor found to
+ * point to heap tuples dead to everyone, by setting LP_DEAD on them.
+ *
+ * Like in nbtree, this is only a hint, so a share lock suffices.  We don't
+ * keep the leaf pages pinned between reading the tuples and getting here, so
+ * a leaf tuple may have been moved or replaced in the meantime, possibly by
+ * one with the same heap pointer.  As in nbtree's _bt_killitems, we therefore
+ * give up on a page whose LSN has changed since we read it.  Later scans skip
+ * the marked tuples, and insertions delete them when they need room on the
+ * page (see deleteKilledLeafTuples).
+ */
+static void
+spgKillItems(IndexScanDesc scan)
+{
+	SpGistScanOpaque so = (SpGistScanOpaque) scan->opaque;
+	Buffer		buffer = InvalidBuffer;
+	bool		killedSome = false;
+	int			i;
+
+	/*
+	 * Without WAL, the page LSN doesn't change when the page does, so we
+	 * couldn't tell whether the leaf tuples are still the ones we read.
+	 */
+	if (!RelationNeedsWAL(scan->indexRelation))
+	{
+		so->numKilled = 0;
+		return;
+	}
+
+	for (i = 0; i < so->numKilled; i++)
+	{
+		int			itemIndex = so->killedItems[i];
+		ItemPointer leafTid = &so->leafTids[itemIndex];
+		BlockNumber blkno = ItemPointerGetBlockNumber(leafTid);
+		OffsetNumber offset = ItemPointerGetOffsetNumber(leafTid);
+		Page		page;
+		ItemId		itemId;
+		SpGistLeafTuple leafTuple;
+
+		if (buffer == InvalidBuffer || BufferGetBlockNumber(buffer) != blkno)
+		{
+			if (buffer != InvalidBuffer)
+			{
+				if (killedSome)
+					MarkBufferDirtyHint(buffer, true);
+				UnlockReleaseBuffer(buffer);
+			}
+			buffer = ReadBuffer(scan->indexRelation, blkno);
+			LockBuffer(buffer, BUFFER_LOCK_SHARE);
+			killedSome = false;
+		}
+		page = BufferGetPage(buffer);
+
+		/* the page was modified since we read it, so don't trust the TID */
+		if (BufferGetLSNAtomic(buffer) != so->leafLSNs[itemIndex])
+			continue;
+
+		if (PageIsNew(page) || SpGistPageIsDeleted(page) ||
+			!SpGistPageIsLeaf(page) ||
+			offset > PageGetMaxOffsetNumber(page))
+			continue;
+
+		itemId = PageGetItemId(page, offset);
+		leafTuple = (SpGistLeafTuple) PageGetItem(page, itemId);
+		if (leafTuple->tupstate == SPGIST_LIVE &&
+			ItemPointerEquals(&leafTuple->heapPtr, &so->heapPtrs[itemIndex]) &&
+			!ItemIdIsDead(itemId))
+		{
+			ItemIdMarkDead(itemId);
+			killedSome = true;
+		}
+	}
+
+	if (buffer != InvalidBuffer)
+	{
+		if (killedSome)
+			MarkBufferDirtyHint(buffer, true);
+		UnlockReleaseBuffer(buffer);
+	}
+
+	so->numKilled = 0;
+}
+
 bool
 spggettuple(IndexScanDesc scan, ScanDirection dir)
 {
@@ -968,6 +1446,11 @@ spggettuple(IndexScanDesc scan, ScanDirection dir)
 	/* Copy want_itup to *so so we don't need to pass it around separately */
 	so->want_itup = scan->xs_want_itup;
 
+	/* Remember the previously returned tuple, if the caller found it dead */
+	if (scan->kill_prior_tuple && so->iPtr > 0 &&
+		ItemPointerIsValid(&so->leafTids[so->iPtr - 1]))
+		so->killedItems[so->numKilled++] = so->iPtr - 1;
+
 	for (;;)
 	{
 		if (so->iPtr < so->nPtrs)
@@ -1003,6 +1486,9 @@ spggettuple(IndexScanDesc scan, ScanDirection dir)
 			for (i = 0; i < so->nPtrs; i++)
 				pfree(so->reconTups[i]);
 		}
+
+		if (so->numKilled > 0)
+			spgKillItems(scan);
 		so->iPtr = so->nPtrs = 0;
 
 		spgWalk(scan->indexRelation, so, false, storeGettuple,
@@ -1015,6 +1501,118 @@ spggettuple(IndexScanDesc scan, ScanDirection dir)
 	return false;
 }
 
+/*
+ * Entry in the queue of a batched nearest-neighbour search
+ */
+typedef struct SpGistKnnBatchItem
+{
+	pairingheap_node phNode;
+	double		priority;		/* smallest distance to a query needing it */
+	SpGistSearchItem *item;		/* inner item to visit */
+} SpGistKnnBatchItem;
+
+static int
+pairingheap_SpGistKnnBatchItem_cmp(const pairingheap_node *a,
+								   const pairingheap_node *b, void *arg)
+{
+	const SpGistKnnBatchItem *sa = (const SpGistKnnBatchItem *) a;
+	const SpGistKnnBatchItem *sb = (const SpGistKnnBatchItem *) b;
+
+	/* Items with smaller priority value come first */
+	if (sa->priority < sb->priority)
+		return 1;
+	if (sa->priority > sb->priority)
+		return -1;
+	return 0;
+}
+
+/*
+ * spgknnbatch() -- find the nearest neighbours of all ORDER BY arguments
+ *
+ * This works like an ordered spgWalk, except that whatever spgVisitItem
+ * puts in so->scanQueue is sorted out right away: heap tuples are handed to
+ * the batch, and inner items that could still improve the result of some
+ * query move to our own queue, which is ordered by the smallest distance to
+ * any query that needs the item.  Null index entries have no distance to
+ * anything, and are not returned.
+ */
+void
+spgknnbatch(IndexScanDesc scan, IndexKnnBatch batch)
+{
+	SpGistScanOpaque so = (SpGistScanOpaque) scan->opaque;
+	Relation	index = scan->indexRelation;
+	Buffer		buffer = InvalidBuffer;
+	bool		reportedSome = false;
+	pairingheap *queue;
+	SpGistKnnBatchItem *next;
+
+	/* spgrescan threw away any ORDER BY keys with null arguments */
+	Assert(so->numberOfNonNullOrderBys == scan->numberOfOrderBys);
+
+	so->want_itup = false;
+	queue = pairingheap_allocate(pairingheap_SpGistKnnBatchItem_cmp, NULL);
+
+	for (;;)
+	{
+		SpGistSearchItem *item;
+		double		priority;
+
+		/* Sort out the start items, or what the last inner tuple gave us */
+		while ((item = spgGetNextQueueItem(so)) != NULL)
+		{
+			if (item->isNull)
+			{
+				/* nothing to do */
+			}
+			else if (item->isLeaf)
+			{
+				if (item->recheckDistances)
+					ereport(ERROR,
+							(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							 errmsg("batched nearest-neighbor search requires exact distances")));
+
+				/* don't hold the index page lock while visiting the heap */
+				if (buffer != InvalidBuffer)
+				{
+					UnlockReleaseBuffer(buffer);
+					buffer = InvalidBuffer;
+				}
+				index_knn_batch_add(batch, &item->heapPtr, item->distances);
+			}
+			else if (index_knn_batch_useful(batch, item->distances, &priority))
+			{
+				next = (SpGistKnnBatchItem *) palloc(sizeof(SpGistKnnBatchItem));
+				next->priority = priority;
+				next->item = item;
+				pairingheap_add(queue, &next->phNode);
+				continue;
+			}
+			spgFreeSearchItem(so, item);
+		}
+
+		if (pairingheap_is_empty(queue))
+			break;
+
+		next = (SpGistKnnBatchItem *) pairingheap_remove_first(queue);
+		item = next->item;
+		pfree(next);
+
+		/* The results may have improved since the item was queued */
+		if (index_knn_batch_useful(batch, item->distances, &priority))
+			buffer = spgVisitItem(index, so, item, buffer, &reportedSome,
+								  NULL, scan->xs_snapshot);
+
+		spgFreeSearchItem(so, item);
+		/* clear temp context before proceeding to the next one */
+		MemoryContextReset(so->tempCxt);
+	}
+
+	if (buffer != InvalidBuffer)
+		UnlockReleaseBuffer(buffer);
+
+	pairingheap_free(queue);
+}
+
 bool
 spgcanreturn(Relation index, int attno)
 {
@@ -1025,3 +1623,54 @@ spgcanreturn(Relation index, int attno)
 
 	return cache->config.canReturnData;
 }
+
+/*
+ * spgestimateparallelscan -- estimate storage for SpGistParallelScanDescData
+ */
+Size
+spgestimateparallelscan(void)
+{
+	return MAXALIGN(sizeof(SpGistParallelScanDescData)) +
+		SPGIST_PARALLEL_RECORDS_SIZE;
+}
+
+/*
+ * spginitparallelscan -- initialize SpGistParallelScanDesc for parallel scan
+ */
+void
+spginitparallelscan(void *target)
+{
+	SpGistParallelScanDesc pss = (SpGistParallelScanDesc) target;
+
+	SpinLockInit(&pss->mutex);
+	ConditionVariableInit(&pss->cv);
+	pss->status = SPGPARALLEL_NOT_STARTED;
+	pss->nrecords = 0;
+	pss->nextItem = 0;
+}
+
+/*
+ * spgparallelrescan() -- reset parallel scan
+ */
+void
+spgparallelrescan(IndexScanDesc scan)
+{
+	SpGistParallelScanDesc pss;
+	ParallelIndexScanDesc parallel_scan = scan->parallel_scan;
+
+	Assert(parallel_scan);
+
+	pss = (SpGistParallelScanDesc) OffsetToPointer((void *) parallel_scan,
+												   parallel_scan->ps_offset);
+
+	/*
+	 * In theory, we don't need to acquire the spinlock here, because there
+	 * shouldn't be any other workers running at this point, but we do so for
+	 * consistency.
+	 */
+	SpinLockAcquire(&pss->mutex);
+	pss->status = SPGPARALLEL_NOT_STARTED;
+	pss->nrecords = 0;
+	pss->nextItem = 0;
+	SpinLockRelease(&pss->mutex);
+}
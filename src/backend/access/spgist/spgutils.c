@@ -22,6 +22,7 @@
 #include "access/transam.h"
 #include "access/xact.h"
 #include "catalog/pg_amop.h"
+#include "commands/progress.h"
 #include "storage/bufmgr.h"
 #include "storage/indexfsm.h"
 #include "storage/lmgr.h"
@@ -54,7 +55,8 @@ spghandler(PG_FUNCTION_ARGS)
 	amroutine->amstorage = false;
 	amroutine->amclusterable = false;
 	amroutine->ampredlocks = false;
-	amroutine->amcanparallel = false;
+	amroutine->amcanparallel = true;
+	amroutine->amcanbuildparallel = true;
 	amroutine->amcaninclude = false;
 	amroutine->amkeytype = InvalidOid;
 
@@ -67,7 +69,7 @@ spghandler(PG_FUNCTION_ARGS)
 	amroutine->amcostestimate = spgcostestimate;
 	amroutine->amoptions = spgoptions;
 	amroutine->amproperty = spgproperty;
-	amroutine->ambuildphasename = NULL;
+	amroutine->ambuildphasename = spgbuildphasename;
 	amroutine->amvalidate = spgvalidate;
 	amroutine->ambeginscan = spgbeginscan;
 	amroutine->amrescan = spgrescan;
@@ -76,9 +78,10 @@ spghandler(PG_FUNCTION_ARGS)
 	amroutine->amendscan = spgendscan;
 	amroutine->ammarkpos = NULL;
 	amroutine->amrestrpos = NULL;
-	amroutine->amestimateparallelscan = NULL;
-	amroutine->aminitparallelscan = NULL;
-	amroutine->amparallelrescan = NULL;
+	amroutine->amestimateparallelscan = spgestimateparallelscan;
+	amroutine->aminitparallelscan = spginitparallelscan;
+	amroutine->amparallelrescan = spgparallelrescan;
+	amroutine->amknnbatch = spgknnbatch;
 
 	PG_RETURN_POINTER(amroutine);
 }
@@ -163,6 +166,13 @@ spgGetCache(Relation index)
 
 		cache->lastUsedPages = metadata->lastUsedPages;
 
+		/*
+		 * Indexes built before the looseness was recorded in the metapage
+		 * have zero there; those can only contain opclasses that ignore it.
+		 */
+		cache->looseness = metadata->looseness >= SPGIST_MIN_LOOSENESS ?
+			metadata->looseness : SPGIST_DEFAULT_LOOSENESS;
+
 		UnlockReleaseBuffer(metabuffer);
 
 		index->rd_amcache = (void *) cache;
@@ -190,6 +200,8 @@ initSpGistState(SpGistState *state, Relation index)
 	state->attLeafType = cache->attLeafType;
 	state->attPrefixType = cache->attPrefixType;
 	state->attLabelType = cache->attLabelType;
+	state->looseness = cache->looseness;
+	state->splitStrategy = SpGistGetSplitStrategy(index);
 
 	/* Make workspace for constructing dead tuples */
 	state->deadTupleStorage = palloc0(SGDTSIZE);
@@ -199,6 +211,9 @@ initSpGistState(SpGistState *state, Relation index)
 
 	/* Assume we're not in an index build (spgbuild will override) */
 	state->isBuild = false;
+
+	/* spginsert will set this */
+	state->heapRel = NULL;
 }
 
 /*
@@ -555,9 +570,12 @@ SpGistInitBuffer(Buffer b, uint16 f)
 
 /*
  * Initialize metadata page
+ *
+ * The looseness is fixed for the lifetime of the index, because the shape
+ * of the tree depends on it; so we record the value in effect at build time.
  */
 void
-SpGistInitMetapage(Page page)
+SpGistInitMetapage(Page page, double looseness)
 {
 	SpGistMetaPageData *metadata;
 	int			i;
@@ -566,6 +584,7 @@ SpGistInitMetapage(Page page)
 	metadata = SpGistPageGetMeta(page);
 	memset(metadata, 0, sizeof(SpGistMetaPageData));
 	metadata->magicNumber = SPGIST_MAGIC_NUMBER;
+	metadata->looseness = looseness;
 
 	/* initialize last-used-page cache to empty */
 	for (i = 0; i < SPGIST_CACHED_PAGES; i++)
@@ -586,7 +605,31 @@ SpGistInitMetapage(Page page)
 bytea *
 spgoptions(Datum reloptions, bool validate)
 {
-	return default_reloptions(reloptions, validate, RELOPT_KIND_SPGIST);
+	relopt_value *options;
+	SpGistOptions *rdopts;
+	int			numoptions;
+	static const relopt_parse_elt tab[] = {
+		{"fillfactor", RELOPT_TYPE_INT, offsetof(SpGistOptions, fillfactor)},
+		{"looseness", RELOPT_TYPE_REAL, offsetof(SpGistOptions, looseness)},
+		{"split_strategy", RELOPT_TYPE_ENUM,
+		offsetof(SpGistOptions, split_strategy)}
+	};
+
+	options = parseRelOptions(reloptions, validate, RELOPT_KIND_SPGIST,
+							  &numoptions);
+
+	/* if none set, we're done */
+	if (numoptions == 0)
+		return NULL;
+
+	rdopts = allocateReloptStruct(sizeof(SpGistOptions), options, numoptions);
+
+	fillRelOptions((void *) rdopts, sizeof(SpGistOptions), options, numoptions,
+				   validate, tab, lengthof(tab));
+
+	pfree(options);
+
+	return (bytea *) rdopts;
 }
 
 /*
@@ -1034,3 +1077,26 @@ spgproperty(Oid index_oid, int attno,
 
 	return true;
 }
+
+/*
+ *	spgbuildphasename() -- Return name of index build phase.
+ */
+char *
+spgbuildphasename(int64 phasenum)
+{
+	switch (phasenum)
+	{
+		case PROGRESS_CREATEIDX_SUBPHASE_INITIALIZE:
+			return "initializing";
+		case PROGRESS_SPGIST_PHASE_INDEXBUILD_TABLESCAN:
+			return "scanning table";
+		case PROGRESS_SPGIST_PHASE_PARTITION:
+			return "partitioning items";
+		case PROGRESS_SPGIST_PHASE_LOAD:
+			return "loading tree";
+		case PROGRESS_SPGIST_PHASE_LEFTOVERS:
+			return "inserting set-aside items";
+		default:
+			return NULL;
+	}
+}
@@ -127,20 +127,11 @@ vacuumLeafPage(spgBulkDeleteState *bds, Relation index, Buffer buffer,
 			   bool forPending)
 {
 	Page		page = BufferGetPage(buffer);
-	spgxlogVacuumLeaf xlrec;
-	OffsetNumber toDead[MaxIndexTuplesPerPage];
-	OffsetNumber toPlaceholder[MaxIndexTuplesPerPage];
-	OffsetNumber moveSrc[MaxIndexTuplesPerPage];
-	OffsetNumber moveDest[MaxIndexTuplesPerPage];
-	OffsetNumber chainSrc[MaxIndexTuplesPerPage];
-	OffsetNumber chainDest[MaxIndexTuplesPerPage];
-	OffsetNumber predecessor[MaxIndexTuplesPerPage + 1];
 	bool		deletable[MaxIndexTuplesPerPage + 1];
 	int			nDeletable;
 	OffsetNumber i,
 				max = PageGetMaxOffsetNumber(page);
 
-	memset(predecessor, 0, sizeof(predecessor));
 	memset(deletable, 0, sizeof(deletable));
 	nDeletable = 0;
 
@@ -166,19 +157,6 @@ vacuumLeafPage(spgBulkDeleteState *bds, Relation index, Buffer buffer,
 				if (!forPending)
 					bds->stats->num_index_tuples += 1;
 			}
-
-			/* Form predecessor map, too */
-			if (lt->nextOffset != InvalidOffsetNumber)
-			{
-				/* paranoia about corrupted chain links */
-				if (lt->nextOffset < FirstOffsetNumber ||
-					lt->nextOffset > max ||
-					predecessor[lt->nextOffset] != InvalidOffsetNumber)
-					elog(ERROR, "inconsistent tuple chain links in page %u of index \"%s\"",
-						 BufferGetBlockNumber(buffer),
-						 RelationGetRelationName(index));
-				predecessor[lt->nextOffset] = i;
-			}
 		}
 		else if (lt->tupstate == SPGIST_REDIRECT)
 		{
@@ -208,6 +186,67 @@ vacuumLeafPage(spgBulkDeleteState *bds, Relation index, Buffer buffer,
 	if (nDeletable == 0)
 		return;					/* nothing more to do */
 
+	spgDeleteLeafTuples(index, &bds->spgstate, buffer, deletable, nDeletable,
+						InvalidTransactionId);
+}
+
+/*
+ * Delete tuples from a regular (non-root) leaf page
+ *
+ * deletable[] flags the live tuples to delete, by offset number, and
+ * nDeletable is the number of them.  Chains are kept intact: a chain head,
+ * which is referenced from the parent, stays in place, either replaced by
+ * the chain's first surviving tuple or, if none survives, by a DEAD tuple.
+ * Other deleted tuples become placeholders.
+ *
+ * This is used by VACUUM, and by insertions to make room on a leaf page by
+ * removing tuples that scans have found to be dead to everyone.  In the
+ * latter case, latestRemovedXid is the newest XID of the removed heap
+ * tuples, which hot standby servers need to resolve conflicts with their
+ * queries; VACUUM passes InvalidTransactionId, since the heap vacuuming
+ * already took care of that.
+ *
+ * The caller must hold an exclusive lock on the buffer.
+ */
+void
+spgDeleteLeafTuples(Relation index, SpGistState *state, Buffer buffer,
+					bool *deletable, int nDeletable,
+					TransactionId latestRemovedXid)
+{
+	Page		page = BufferGetPage(buffer);
+	spgxlogVacuumLeaf xlrec;
+	OffsetNumber toDead[MaxIndexTuplesPerPage];
+	OffsetNumber toPlaceholder[MaxIndexTuplesPerPage];
+	OffsetNumber moveSrc[MaxIndexTuplesPerPage];
+	OffsetNumber moveDest[MaxIndexTuplesPerPage];
+	OffsetNumber chainSrc[MaxIndexTuplesPerPage];
+	OffsetNumber chainDest[MaxIndexTuplesPerPage];
+	OffsetNumber predecessor[MaxIndexTuplesPerPage + 1];
+	OffsetNumber i,
+				max = PageGetMaxOffsetNumber(page);
+
+	/* Form predecessor map of the tuple chains */
+	memset(predecessor, 0, sizeof(predecessor));
+	for (i = FirstOffsetNumber; i <= max; i++)
+	{
+		SpGistLeafTuple lt;
+
+		lt = (SpGistLeafTuple) PageGetItem(page,
+										   PageGetItemId(page, i));
+		if (lt->tupstate == SPGIST_LIVE &&
+			lt->nextOffset != InvalidOffsetNumber)
+		{
+			/* paranoia about corrupted chain links */
+			if (lt->nextOffset < FirstOffsetNumber ||
+				lt->nextOffset > max ||
+				predecessor[lt->nextOffset] != InvalidOffsetNumber)
+				elog(ERROR, "inconsistent tuple chain links in page %u of index \"%s\"",
+					 BufferGetBlockNumber(buffer),
+					 RelationGetRelationName(index));
+			predecessor[lt->nextOffset] = i;
+		}
+	}
+
 	/*----------
 	 * Figure out exactly what we have to do.  We do this separately from
 	 * actually modifying the page, mainly so that we have a representation
@@ -230,6 +269,7 @@ vacuumLeafPage(spgBulkDeleteState *bds, Relation index, Buffer buffer,
 	 *----------
 	 */
 	xlrec.nDead = xlrec.nPlaceholder = xlrec.nMove = xlrec.nChain = 0;
+	xlrec.latestRemovedXid = latestRemovedXid;
 
 	for (i = FirstOffsetNumber; i <= max; i++)
 	{
@@ -326,12 +366,12 @@ vacuumLeafPage(spgBulkDeleteState *bds, Relation index, Buffer buffer,
 	/* Do the updates */
 	START_CRIT_SECTION();
 
-	spgPageIndexMultiDelete(&bds->spgstate, page,
+	spgPageIndexMultiDelete(state, page,
 							toDead, xlrec.nDead,
 							SPGIST_DEAD, SPGIST_DEAD,
 							InvalidBlockNumber, InvalidOffsetNumber);
 
-	spgPageIndexMultiDelete(&bds->spgstate, page,
+	spgPageIndexMultiDelete(state, page,
 							toPlaceholder, xlrec.nPlaceholder,
 							SPGIST_PLACEHOLDER, SPGIST_PLACEHOLDER,
 							InvalidBlockNumber, InvalidOffsetNumber);
@@ -354,7 +394,7 @@ vacuumLeafPage(spgBulkDeleteState *bds, Relation index, Buffer buffer,
 		*idDest = tmp;
 	}
 
-	spgPageIndexMultiDelete(&bds->spgstate, page,
+	spgPageIndexMultiDelete(state, page,
 							moveSrc, xlrec.nMove,
 							SPGIST_PLACEHOLDER, SPGIST_PLACEHOLDER,
 							InvalidBlockNumber, InvalidOffsetNumber);
@@ -377,7 +417,7 @@ vacuumLeafPage(spgBulkDeleteState *bds, Relation index, Buffer buffer,
 
 		XLogBeginInsert();
 
-		STORE_STATE(&bds->spgstate, xlrec.stateSrc);
+		STORE_STATE(state, xlrec.stateSrc);
 
 		XLogRegisterData((char *) &xlrec, SizeOfSpgxlogVacuumLeaf);
 		/* sizeof(xlrec) should be a multiple of sizeof(OffsetNumber) */
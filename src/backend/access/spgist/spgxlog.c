@@ -781,6 +781,19 @@ spgRedoVacuumLeaf(XLogReaderState *record)
 	ptr += sizeof(OffsetNumber) * xldata->nChain;
 	chainDest = (OffsetNumber *) ptr;
 
+	/*
+	 * If the tuples were removed by an insertion rather than by VACUUM, make
+	 * sure there are no Hot Standby queries that might still see the heap
+	 * tuples they point to.
+	 */
+	if (InHotStandby && TransactionIdIsValid(xldata->latestRemovedXid))
+	{
+		RelFileNode node;
+
+		XLogRecGetBlockTag(record, 0, &node, NULL, NULL);
+		ResolveRecoveryConflictWithSnapshot(xldata->latestRemovedXid, node);
+	}
+
 	if (XLogReadBufferForRedo(record, 0, &buffer) == BLK_NEEDS_REDO)
 	{
 		page = BufferGetPage(buffer);
@@ -797,7 +810,7 @@ spgRedoVacuumLeaf(XLogReaderState *record)
 								InvalidBlockNumber,
 								InvalidOffsetNumber);
 
-		/* see comments in vacuumLeafPage() */
+		/* see comments in spgDeleteLeafTuples() */
 		for (i = 0; i < xldata->nMove; i++)
 		{
 			ItemId		idSrc = PageGetItemId(page, moveSrc[i]);
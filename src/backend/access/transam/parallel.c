@@ -14,9 +14,11 @@
 
 #include "postgres.h"
 
+#include "access/gist_private.h"
 #include "access/nbtree.h"
 #include "access/parallel.h"
 #include "access/session.h"
+#include "access/spgist.h"
 #include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/pg_enum.h"
@@ -140,6 +142,12 @@ static const struct
 	},
 	{
 		"_bt_parallel_build_main", _bt_parallel_build_main
+	},
+	{
+		"_spg_parallel_build_main", _spg_parallel_build_main
+	},
+	{
+		"_gist_parallel_build_main", _gist_parallel_build_main
 	}
 };
 
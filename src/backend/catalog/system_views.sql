@@ -664,7 +664,11 @@ CREATE VIEW pg_stat_all_indexes AS
             I.relname AS indexrelname,
             pg_stat_get_numscans(I.oid) AS idx_scan,
             pg_stat_get_tuples_returned(I.oid) AS idx_tup_read,
-            pg_stat_get_tuples_fetched(I.oid) AS idx_tup_fetch
+            pg_stat_get_tuples_fetched(I.oid) AS idx_tup_fetch,
+            pg_stat_get_inner_visited(I.oid) AS idx_inner_visited,
+            pg_stat_get_leaf_tested(I.oid) AS idx_leaf_tested,
+            pg_stat_get_consistent_rejected(I.oid) AS idx_consistent_rejected,
+            pg_stat_get_leaf_rechecked(I.oid) AS idx_leaf_rechecked
     FROM pg_class C JOIN
             pg_index X ON C.oid = X.indrelid JOIN
             pg_class I ON I.oid = X.indexrelid
@@ -18,6 +18,8 @@
 #include "postgres.h"
 
 #include "access/amapi.h"
+#include "access/genam.h"
+#include "access/gist.h"
 #include "access/heapam.h"
 #include "access/multixact.h"
 #include "access/relscan.h"
@@ -39,6 +41,7 @@
 #include "commands/tablecmds.h"
 #include "commands/vacuum.h"
 #include "miscadmin.h"
+#include "optimizer/cost.h"
 #include "optimizer/optimizer.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
@@ -73,6 +76,7 @@ static void copy_table_data(Oid OIDNewHeap, Oid OIDOldHeap, Oid OIDOldIndex,
 							bool verbose, bool *pSwapToastByContent,
 							TransactionId *pFreezeXid, MultiXactId *pCutoffMulti);
 static List *get_tables_to_cluster(MemoryContext cluster_context);
+static bool gist_index_has_sortsupport(Relation index);
 
 
 /*---------------------------------------------------------------------------
@@ -885,11 +889,17 @@ copy_table_data(Oid OIDNewHeap, Oid OIDOldHeap, Oid OIDOldIndex, bool verbose,
 	 * Decide whether to use an indexscan or seqscan-and-optional-sort to scan
 	 * the OldHeap.  We know how to use a sort to duplicate the ordering of a
 	 * btree index, and will use seqscan-and-sort for that case if the planner
-	 * tells us it's cheaper.  Otherwise, always indexscan if an index is
+	 * tells us it's cheaper.  A GiST index has no ordering to duplicate, but
+	 * if its operator classes have sort support functions, we sort by them
+	 * unless sorting is disabled, to lay out the table in the same
+	 * space-filling curve order (such as Hilbert order) that a sorted build
+	 * of the index uses.  Otherwise, always indexscan if an index is
 	 * provided, else plain seqscan.
 	 */
 	if (OldIndex != NULL && OldIndex->rd_rel->relam == BTREE_AM_OID)
 		use_sort = plan_cluster_use_sort(OIDOldHeap, OIDOldIndex);
+	else if (OldIndex != NULL && OldIndex->rd_rel->relam == GIST_AM_OID)
+		use_sort = enable_sort && gist_index_has_sortsupport(OldIndex);
 	else
 		use_sort = false;
 
@@ -1520,6 +1530,22 @@ finish_heap_swap(Oid OIDOldHeap, Oid OIDNewHeap,
 }
 
 
+/*
+ * Does every key column of a GiST index have a sort support function?
+ */
+static bool
+gist_index_has_sortsupport(Relation index)
+{
+	int			i;
+
+	for (i = 0; i < IndexRelationGetNumberOfKeyAttributes(index); i++)
+	{
+		if (!OidIsValid(index_getprocid(index, i + 1, GIST_SORTSUPPORT_PROC)))
+			return false;
+	}
+	return true;
+}
+
 /*
  * Get a list of tables that the current user owns and
  * have indisclustered set.  Return the list in a List * of RelToCluster
@@ -13,6 +13,8 @@
  */
 #include "postgres.h"
 
+#include "access/genam.h"
+#include "access/relscan.h"
 #include "access/xact.h"
 #include "catalog/pg_type.h"
 #include "commands/createas.h"
@@ -80,6 +82,8 @@ static void show_upper_qual(List *qual, const char *qlabel,
 							ExplainState *es);
 static void show_sort_keys(SortState *sortstate, List *ancestors,
 						   ExplainState *es);
+static void show_incremental_sort_keys(IncrementalSortState *incrsortstate,
+									   List *ancestors, ExplainState *es);
 static void show_merge_append_keys(MergeAppendState *mstate, List *ancestors,
 								   ExplainState *es);
 static void show_agg_keys(AggState *astate, List *ancestors,
@@ -101,7 +105,13 @@ static void show_sortorder_options(StringInfo buf, Node *sortexpr,
 static void show_tablesample(TableSampleClause *tsc, PlanState *planstate,
 							 List *ancestors, ExplainState *es);
 static void show_sort_info(SortState *sortstate, ExplainState *es);
+static void show_incremental_sort_info(IncrementalSortState *incrsortstate,
+									   ExplainState *es);
 static void show_hash_info(HashState *hashstate, ExplainState *es);
+static void show_hashagg_info(AggState *aggstate, ExplainState *es);
+static void show_resultcache_info(ResultCacheState *rcstate, List *ancestors,
+								  ExplainState *es);
+static void show_index_traversal(IndexScanDesc scandesc, ExplainState *es);
 static void show_tidbitmap_info(BitmapHeapScanState *planstate,
 								ExplainState *es);
 static void show_instrumentation_count(const char *qlabel, int which,
@@ -1128,6 +1138,10 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			pname = "Hash";		/* "Join" gets added by jointype switch */
 			sname = "Hash Join";
 			break;
+		case T_SpatialJoin:
+			pname = "Spatial";	/* "Join" gets added by jointype switch */
+			sname = "Spatial Join";
+			break;
 		case T_SeqScan:
 			pname = sname = "Seq Scan";
 			break;
@@ -1212,9 +1226,15 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Material:
 			pname = sname = "Materialize";
 			break;
+		case T_ResultCache:
+			pname = sname = "Result Cache";
+			break;
 		case T_Sort:
 			pname = sname = "Sort";
 			break;
+		case T_IncrementalSort:
+			pname = sname = "Incremental Sort";
+			break;
 		case T_Group:
 			pname = sname = "Group";
 			break;
@@ -1397,6 +1417,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_NestLoop:
 		case T_MergeJoin:
 		case T_HashJoin:
+		case T_SpatialJoin:
 			{
 				const char *jointype;
 
@@ -1567,6 +1588,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_NestLoop:
 		case T_MergeJoin:
 		case T_HashJoin:
+		case T_SpatialJoin:
 			/* try not to be too chatty about this in text mode */
 			if (es->format != EXPLAIN_FORMAT_TEXT ||
 				(es->verbose && ((Join *) plan)->inner_unique))
@@ -1593,6 +1615,9 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			if (es->analyze)
+				show_index_traversal(((IndexScanState *) planstate)->iss_ScanDesc,
+									 es);
 			break;
 		case T_IndexOnlyScan:
 			show_scan_qual(((IndexOnlyScan *) plan)->indexqual,
@@ -1607,12 +1632,19 @@ ExplainNode(PlanState *planstate, List *ancestors,
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
 			if (es->analyze)
+			{
 				ExplainPropertyFloat("Heap Fetches", NULL,
 									 planstate->instrument->ntuples2, 0, es);
+				show_index_traversal(((IndexOnlyScanState *) planstate)->ioss_ScanDesc,
+									 es);
+			}
 			break;
 		case T_BitmapIndexScan:
 			show_scan_qual(((BitmapIndexScan *) plan)->indexqualorig,
 						   "Index Cond", planstate, ancestors, es);
+			if (es->analyze)
+				show_index_traversal(((BitmapIndexScanState *) planstate)->biss_ScanDesc,
+									 es);
 			break;
 		case T_BitmapHeapScan:
 			show_scan_qual(((BitmapHeapScan *) plan)->bitmapqualorig,
@@ -1642,6 +1674,10 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			if (IsA(planstate, SeqScanState) &&
+				((SeqScanState *) planstate)->runtime_filter != NULL)
+				show_instrumentation_count("Rows Removed by Bloom Filter", 3,
+										   planstate, es);
 			break;
 		case T_Gather:
 			{
@@ -1823,12 +1859,28 @@ ExplainNode(PlanState *planstate, List *ancestors,
 				show_instrumentation_count("Rows Removed by Filter", 2,
 										   planstate, es);
 			break;
+		case T_SpatialJoin:
+			show_upper_qual(((SpatialJoin *) plan)->spatialclauses,
+							"Spatial Cond", planstate, ancestors, es);
+			show_upper_qual(((SpatialJoin *) plan)->join.joinqual,
+							"Join Filter", planstate, ancestors, es);
+			if (((SpatialJoin *) plan)->join.joinqual)
+				show_instrumentation_count("Rows Removed by Join Filter", 1,
+										   planstate, es);
+			show_upper_qual(plan->qual, "Filter", planstate, ancestors, es);
+			if (plan->qual)
+				show_instrumentation_count("Rows Removed by Filter", 2,
+										   planstate, es);
+			break;
 		case T_Agg:
 			show_agg_keys(castNode(AggState, planstate), ancestors, es);
 			show_upper_qual(plan->qual, "Filter", planstate, ancestors, es);
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			show_hashagg_info(castNode(AggState, planstate), es);
+			if (castNode(AggState, planstate)->batch != NULL)
+				ExplainPropertyBool("Batch Mode", true, es);
 			break;
 		case T_Group:
 			show_group_keys(castNode(GroupState, planstate), ancestors, es);
@@ -1841,6 +1893,16 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			show_sort_keys(castNode(SortState, planstate), ancestors, es);
 			show_sort_info(castNode(SortState, planstate), es);
 			break;
+		case T_IncrementalSort:
+			show_incremental_sort_keys(castNode(IncrementalSortState, planstate),
+									   ancestors, es);
+			show_incremental_sort_info(castNode(IncrementalSortState, planstate),
+									   es);
+			break;
+		case T_ResultCache:
+			show_resultcache_info(castNode(ResultCacheState, planstate),
+								  ancestors, es);
+			break;
 		case T_MergeAppend:
 			show_merge_append_keys(castNode(MergeAppendState, planstate),
 								   ancestors, es);
@@ -2181,6 +2243,28 @@ show_sort_keys(SortState *sortstate, List *ancestors, ExplainState *es)
 						 ancestors, es);
 }
 
+/*
+ * Show the sort keys for an IncrementalSort node, and which of them the
+ * input is already sorted by.
+ */
+static void
+show_incremental_sort_keys(IncrementalSortState *incrsortstate,
+						   List *ancestors, ExplainState *es)
+{
+	IncrementalSort *plan = (IncrementalSort *) incrsortstate->ss.ps.plan;
+
+	show_sort_group_keys((PlanState *) incrsortstate, "Sort Key",
+						 plan->sort.numCols, plan->sort.sortColIdx,
+						 plan->sort.sortOperators, plan->sort.collations,
+						 plan->sort.nullsFirst,
+						 ancestors, es);
+	show_sort_group_keys((PlanState *) incrsortstate, "Presorted Key",
+						 plan->nPresortedCols, plan->sort.sortColIdx,
+						 plan->sort.sortOperators, plan->sort.collations,
+						 plan->sort.nullsFirst,
+						 ancestors, es);
+}
+
 /*
  * Likewise, for a MergeAppend node.
  */
@@ -2612,6 +2696,95 @@ show_sort_info(SortState *sortstate, ExplainState *es)
 	}
 }
 
+/*
+ * Show the statistics of one kind of batch sorted by an incremental sort.
+ */
+static void
+show_incremental_sort_group_info(IncrementalSortGroupInfo *groupInfo,
+								 const char *groupLabel, ExplainState *es)
+{
+	List	   *methodNames = NIL;
+	ListCell   *lc;
+	int			m;
+
+	for (m = SORT_TYPE_TOP_N_HEAPSORT; m <= SORT_TYPE_EXTERNAL_MERGE; m++)
+	{
+		if (groupInfo->sortMethods & (1 << m))
+			methodNames = lappend(methodNames,
+								  pstrdup(tuplesort_method_name((TuplesortMethod) m)));
+	}
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "%s Groups: " INT64_FORMAT "  Sort Method%s:",
+						 groupLabel, groupInfo->groupCount,
+						 list_length(methodNames) > 1 ? "s" : "");
+		foreach(lc, methodNames)
+		{
+			appendStringInfo(es->str, " %s", (char *) lfirst(lc));
+			if (lnext(methodNames, lc) != NULL)
+				appendStringInfoChar(es->str, ',');
+		}
+		if (groupInfo->maxMemorySpaceUsed > 0)
+			appendStringInfo(es->str, "  Average Memory: %ldkB  Peak Memory: %ldkB",
+							 groupInfo->totalMemorySpaceUsed / groupInfo->groupCount,
+							 groupInfo->maxMemorySpaceUsed);
+		if (groupInfo->maxDiskSpaceUsed > 0)
+			appendStringInfo(es->str, "  Average Disk: %ldkB  Peak Disk: %ldkB",
+							 groupInfo->totalDiskSpaceUsed / groupInfo->groupCount,
+							 groupInfo->maxDiskSpaceUsed);
+		appendStringInfoChar(es->str, '\n');
+	}
+	else
+	{
+		char	   *groupName = psprintf("%s Groups", groupLabel);
+
+		ExplainOpenGroup(groupName, groupName, true, es);
+		ExplainPropertyInteger("Group Count", NULL, groupInfo->groupCount, es);
+		ExplainPropertyList("Sort Methods Used", methodNames, es);
+		if (groupInfo->maxMemorySpaceUsed > 0)
+		{
+			ExplainPropertyInteger("Average Sort Space Used (Memory)", "kB",
+								   groupInfo->totalMemorySpaceUsed / groupInfo->groupCount,
+								   es);
+			ExplainPropertyInteger("Peak Sort Space Used (Memory)", "kB",
+								   groupInfo->maxMemorySpaceUsed, es);
+		}
+		if (groupInfo->maxDiskSpaceUsed > 0)
+		{
+			ExplainPropertyInteger("Average Sort Space Used (Disk)", "kB",
+								   groupInfo->totalDiskSpaceUsed / groupInfo->groupCount,
+								   es);
+			ExplainPropertyInteger("Peak Sort Space Used (Disk)", "kB",
+								   groupInfo->maxDiskSpaceUsed, es);
+		}
+		ExplainCloseGroup(groupName, groupName, true, es);
+	}
+}
+
+/*
+ * If it's EXPLAIN ANALYZE, show tuplesort stats for an incremental sort node
+ *
+ * As for other nodes gathering statistics in backend-local memory, only the
+ * process running the node reports here; parallel workers' batches aren't
+ * included.
+ */
+static void
+show_incremental_sort_info(IncrementalSortState *incrsortstate,
+						   ExplainState *es)
+{
+	if (!es->analyze)
+		return;
+
+	if (incrsortstate->fullsort_info.groupCount > 0)
+		show_incremental_sort_group_info(&incrsortstate->fullsort_info,
+										 "Full-sort", es);
+	if (incrsortstate->prefixsort_info.groupCount > 0)
+		show_incremental_sort_group_info(&incrsortstate->prefixsort_info,
+										 "Pre-sorted", es);
+}
+
 /*
  * Show information on hash buckets/batches.
  */
@@ -2715,6 +2888,172 @@ show_hash_info(HashState *hashstate, ExplainState *es)
 	}
 }
 
+/*
+ * If it's EXPLAIN ANALYZE, show the memory used by a hashed aggregation, and
+ * the batches and disk space used if it spilled to disk.
+ *
+ * In a parallel query, only the leader's share of the work is shown.
+ */
+static void
+show_hashagg_info(AggState *aggstate, ExplainState *es)
+{
+	long		memPeakKb = (aggstate->hash_mem_peak + 1023) / 1024;
+	long		diskKb = (aggstate->hash_disk_used + 1023) / 1024;
+	int			batches = aggstate->hash_batches_used + 1;
+
+	if (!es->analyze)
+		return;
+
+	if (aggstate->aggstrategy != AGG_HASHED &&
+		aggstate->aggstrategy != AGG_MIXED)
+		return;
+
+	/* nothing to show if the leader never filled the hash table */
+	if (aggstate->hash_mem_peak == 0)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyInteger("HashAgg Batches", NULL, batches, es);
+		ExplainPropertyInteger("Peak Memory Usage", "kB", memPeakKb, es);
+		ExplainPropertyInteger("Disk Usage", "kB", diskKb, es);
+	}
+	else
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "Batches: %d  Memory Usage: %ldkB",
+						 batches, memPeakKb);
+		if (aggstate->hash_batches_used > 0)
+			appendStringInfo(es->str, "  Disk Usage: %ldkB", diskKb);
+		appendStringInfoChar(es->str, '\n');
+	}
+}
+
+/*
+ * Show the cache key of a Result Cache node and, for EXPLAIN ANALYZE, how
+ * well the cache worked out.
+ *
+ * In a parallel query, only the leader's share of the work is shown.
+ */
+static void
+show_resultcache_info(ResultCacheState *rcstate, List *ancestors,
+					  ExplainState *es)
+{
+	ResultCache *plan = (ResultCache *) rcstate->ss.ps.plan;
+	List	   *context;
+	List	   *result = NIL;
+	bool		useprefix;
+	ListCell   *lc;
+	long		memPeakKb;
+
+	/* Set up deparsing context */
+	context = set_deparse_context_planstate(es->deparse_cxt,
+											(Node *) rcstate,
+											ancestors);
+	useprefix = (list_length(es->rtable) > 1 || es->verbose);
+
+	foreach(lc, plan->param_exprs)
+	{
+		Node	   *expr = (Node *) lfirst(lc);
+
+		result = lappend(result,
+						 deparse_expression(expr, context, useprefix, false));
+	}
+
+	ExplainPropertyList("Cache Key", result, es);
+
+	if (!es->analyze)
+		return;
+
+	/* nothing to show if the cache was never used in this process */
+	if (rcstate->stats.cache_misses == 0)
+		return;
+
+	memPeakKb = (rcstate->stats.mem_peak + 1023) / 1024;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyInteger("Cache Hits", NULL,
+							   rcstate->stats.cache_hits, es);
+		ExplainPropertyInteger("Cache Misses", NULL,
+							   rcstate->stats.cache_misses, es);
+		ExplainPropertyInteger("Cache Evictions", NULL,
+							   rcstate->stats.cache_evictions, es);
+		ExplainPropertyInteger("Cache Overflows", NULL,
+							   rcstate->stats.cache_overflows, es);
+		ExplainPropertyInteger("Peak Memory Usage", "kB", memPeakKb, es);
+	}
+	else
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str,
+						 "Hits: " UINT64_FORMAT "  Misses: " UINT64_FORMAT
+						 "  Evictions: " UINT64_FORMAT
+						 "  Overflows: " UINT64_FORMAT
+						 "  Memory Usage: %ldkB\n",
+						 rcstate->stats.cache_hits,
+						 rcstate->stats.cache_misses,
+						 rcstate->stats.cache_evictions,
+						 rcstate->stats.cache_overflows,
+						 memPeakKb);
+	}
+}
+
+/*
+ * If it's EXPLAIN ANALYZE, show how much of the index an index scan node
+ * traversed, for index AMs that keep track of it.
+ *
+ * In a parallel scan, only the leader's share of the work is shown.
+ */
+static void
+show_index_traversal(IndexScanDesc scandesc, ExplainState *es)
+{
+	IndexScanInstrumentation *instr;
+
+	if (scandesc == NULL)
+		return;
+	instr = &scandesc->instrument;
+
+	/* Nothing to show if the AM doesn't count, or the scan did nothing */
+	if (instr->inner_visited == 0 && instr->leaf_tested == 0)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyInteger("Inner Visited", NULL,
+							   (int64) instr->inner_visited, es);
+		ExplainPropertyInteger("Leaf Tested", NULL,
+							   (int64) instr->leaf_tested, es);
+		ExplainPropertyInteger("Consistent Rejected", NULL,
+							   (int64) instr->consistent_rejected, es);
+		ExplainPropertyInteger("Leaf Rechecked", NULL,
+							   (int64) instr->leaf_rechecked, es);
+		ExplainPropertyInteger("Queue Peak", NULL, instr->queue_peak, es);
+	}
+	else
+	{
+		/* Show only positive counter values, like show_buffer_usage */
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfoString(es->str, "Index Traversal:");
+		if (instr->inner_visited > 0)
+			appendStringInfo(es->str, " inner visited=" UINT64_FORMAT,
+							 instr->inner_visited);
+		if (instr->leaf_tested > 0)
+			appendStringInfo(es->str, " leaf tested=" UINT64_FORMAT,
+							 instr->leaf_tested);
+		if (instr->consistent_rejected > 0)
+			appendStringInfo(es->str, " rejected=" UINT64_FORMAT,
+							 instr->consistent_rejected);
+		if (instr->leaf_rechecked > 0)
+			appendStringInfo(es->str, " rechecked=" UINT64_FORMAT,
+							 instr->leaf_rechecked);
+		if (instr->queue_peak > 0)
+			appendStringInfo(es->str, " queue peak=" INT64_FORMAT,
+							 instr->queue_peak);
+		appendStringInfoChar(es->str, '\n');
+	}
+}
+
 /*
  * If it's EXPLAIN ANALYZE, show exact/lossy pages for a BitmapHeapScan node
  */
@@ -2758,7 +3097,9 @@ show_instrumentation_count(const char *qlabel, int which,
 	if (!es->analyze || !planstate->instrument)
 		return;
 
-	if (which == 2)
+	if (which == 3)
+		nfiltered = planstate->instrument->nfiltered3;
+	else if (which == 2)
 		nfiltered = planstate->instrument->nfiltered2;
 	else
 		nfiltered = planstate->instrument->nfiltered1;
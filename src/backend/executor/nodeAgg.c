@@ -194,6 +194,30 @@
  *	  transition values.  hashcontext is the single context created to support
  *	  all hash tables.
  *
+ *	  Spilling to disk:
+ *
+ *	  When performing hash aggregation, if the hash tables grow beyond
+ *	  work_mem, we enter "spill mode".  In spill mode, we continue to advance
+ *	  the transition states only for groups that already exist in the hash
+ *	  tables.  A tuple that would otherwise create a new group is instead
+ *	  written to a temporary file for that grouping set, partitioned on the
+ *	  next few bits of its hash value, using the same on-disk format as the
+ *	  batch files of a hash join.
+ *
+ *	  Once the input is exhausted, the groups that stayed in memory are
+ *	  finalized and emitted.  Then each spill file becomes a "batch": the
+ *	  hash tables are reset and the batch's tuples are aggregated as if they
+ *	  were new input.  A batch can itself enter spill mode, in which case
+ *	  its overflow tuples are repartitioned using further bits of the hash
+ *	  value and processed later.  Because each pass emits at least one
+ *	  group, this always terminates, and memory stays close to work_mem no
+ *	  matter how badly the planner misestimated the number of groups.
+ *
+ *	  Memory used by the hash tables is measured with the memory context
+ *	  accounting in mcxt.c, which covers both the table's own storage
+ *	  (hash_metacxt) and the group keys and transition values
+ *	  (hashcontext).
+ *
  *    Transition / Combine function invocation:
  *
  *    For performance reasons transition functions, including combine
@@ -205,6 +229,18 @@
  *    to filter expressions having to be evaluated early, and allows to JIT
  *    the entire expression into one native function.
  *
+ *	  Batch mode:
+ *
+ *	  When enable_batch_execution is on, a plain aggregate (no grouping, no
+ *	  DISTINCT, ORDER BY or FILTER) directly over a sequential scan may bypass
+ *	  the above: if the scan's qual and all aggregate arguments can be
+ *	  compiled by execBatch.c, we pull batches of up to EXEC_BATCH_SIZE rows
+ *	  from the scan in columnar form, and advance each transition state once
+ *	  per batch.  count(), sum(int4), sum(float8) and avg(int4) have
+ *	  specialized loops that keep the state in a local variable; any other
+ *	  transition function is called through fmgr for each selected row,
+ *	  which still saves the per-row overhead of the scan and its qual.
+ *
  * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -221,23 +257,104 @@
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "common/int.h"
+#include "executor/execBatch.h"
+#include "executor/execExpr.h"
 #include "executor/executor.h"
 #include "executor/nodeAgg.h"
+#include "executor/nodeSeqscan.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/optimizer.h"
 #include "parser/parse_agg.h"
 #include "parser/parse_coerce.h"
+#include "storage/buffile.h"
 #include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/dynahash.h"
 #include "utils/expandeddatum.h"
+#include "utils/float.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
 #include "utils/tuplesort.h"
 #include "utils/datum.h"
 
+/*
+ * Parameters for choosing the number of partitions when spilling.  We make
+ * enough partitions that each is expected to fit in work_mem (with some
+ * slack, as given by the factor), within the bounds below.  Each open
+ * partition costs a BufFile buffer.
+ */
+#define HASHAGG_PARTITION_FACTOR 1.50
+#define HASHAGG_MIN_PARTITIONS 4
+#define HASHAGG_MAX_PARTITIONS 256
+
+/*
+ * HashAggSpill - the partition files that tuples of one grouping set are
+ * spilled into during one pass.
+ */
+typedef struct HashAggSpill
+{
+	int			npartitions;	/* number of partitions */
+	BufFile   **partitions;		/* spill file for each partition, or NULL */
+	int64	   *ntuples;		/* number of tuples in each partition */
+	uint32		mask;			/* mask to find partition from hash value */
+	int			shift;			/* after masking, shift by this amount */
+} HashAggSpill;
+
+/*
+ * HashAggBatch - a spill file waiting to be aggregated in a later pass.
+ *
+ * The tuples in a batch all belong to the same grouping set, and agree on
+ * the high used_bits bits of their hash values.
+ */
+typedef struct HashAggBatch
+{
+	int			setno;			/* grouping set */
+	int			used_bits;		/* number of hash bits already used */
+	BufFile    *input_file;		/* input partition */
+	int64		input_tuples;	/* number of tuples in this batch */
+} HashAggBatch;
+
+/*
+ * How batch mode advances one transition state.  The specialized kinds
+ * reproduce exactly what the named transition function would do.
+ */
+typedef enum AggBatchTransKind
+{
+	AGG_BATCH_COUNT,			/* int8inc, int8inc_any */
+	AGG_BATCH_INT4_SUM,			/* int4_sum */
+	AGG_BATCH_FLOAT8_SUM,		/* float8pl */
+	AGG_BATCH_INT4_AVG,			/* int4_avg_accum */
+	AGG_BATCH_GENERIC			/* call the transition function per row */
+} AggBatchTransKind;
+
+typedef struct AggBatchTrans
+{
+	AggBatchTransKind kind;
+	BatchExprState *arg;		/* the argument, or NULL if there is none */
+} AggBatchTrans;
+
+/* Layout of the int8[] transition state of avg(int4), cf. numeric.c */
+typedef struct AggBatchInt8TransData
+{
+	int64		count;
+	int64		sum;
+} AggBatchInt8TransData;
+
+/*
+ * AggBatchData - state for batch mode, see agg_batch_init()
+ */
+typedef struct AggBatchData
+{
+	TupleBatch *batch;			/* batch filled by the SeqScan below us */
+	AggBatchTrans *trans;		/* one entry per pertrans */
+} AggBatchData;
+
 
 static void select_current_set(AggState *aggstate, int setno, bool is_hash);
 static void initialize_phase(AggState *aggstate, int newphase);
@@ -273,11 +390,39 @@ static TupleTableSlot *project_aggregates(AggState *aggstate);
 static Bitmapset *find_unaggregated_cols(AggState *aggstate);
 static bool find_unaggregated_cols_walker(Node *node, Bitmapset **colnos);
 static void build_hash_table(AggState *aggstate);
-static TupleHashEntryData *lookup_hash_entry(AggState *aggstate);
+static long hash_choose_num_buckets(double hashentrysize, long ngroups,
+									Size memory);
+static int	hash_choose_num_partitions(double input_groups,
+									   double hashentrysize, int used_bits,
+									   int *log2_npartitions);
+static void hash_agg_check_limits(AggState *aggstate);
+static void hash_agg_enter_spill_mode(AggState *aggstate);
+static void hash_agg_update_metrics(AggState *aggstate);
+static void prepare_hash_slot(AggState *aggstate);
+static AggStatePerGroup lookup_hash_entry(AggState *aggstate, uint32 hash);
 static void lookup_hash_entries(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_direct(AggState *aggstate);
 static void agg_fill_hash_table(AggState *aggstate);
+static bool agg_refill_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
+static TupleTableSlot *agg_retrieve_hash_table_in_memory(AggState *aggstate);
+static void hashagg_spill_init(HashAggSpill *spill, int used_bits,
+							   double input_groups, double hashentrysize);
+static void hashagg_spill_tuple(AggState *aggstate, HashAggSpill *spill,
+								TupleTableSlot *inputslot, uint32 hash);
+static void hashagg_spill_finish(AggState *aggstate, HashAggSpill *spill,
+								 int setno);
+static void hashagg_finish_initial_spills(AggState *aggstate);
+static bool hashagg_batch_read(HashAggBatch *batch, TupleTableSlot *slot,
+							   uint32 *hashp);
+static void hashagg_reset_spill_state(AggState *aggstate);
+static void agg_batch_init(AggState *aggstate);
+static void agg_batch_advance(AggState *aggstate, AggStatePerGroup pergroup);
+static void agg_batch_advance_trans(AggState *aggstate,
+									AggStatePerTrans pertrans,
+									AggBatchTrans *btrans,
+									AggStatePerGroup pergroup,
+									TupleBatch *batch);
 static Datum GetAggInitVal(Datum textInitVal, Oid transtype);
 static void build_pertrans_for_aggref(AggStatePerTrans pertrans,
 									  AggState *aggstate, EState *estate,
@@ -1259,44 +1404,81 @@ find_unaggregated_cols_walker(Node *node, Bitmapset **colnos)
  *
  * The contents of the hash tables always live in the hashcontext's per-tuple
  * memory context (there is only one of these for all tables together, since
- * they are all reset at the same time).
+ * they are all reset at the same time).  The tables themselves live in
+ * hash_metacxt, so that their memory is accounted for as well.
  */
 static void
 build_hash_table(AggState *aggstate)
 {
 	MemoryContext tmpmem = aggstate->tmpcontext->ecxt_per_tuple_memory;
 	Size		additionalsize;
+	Size		memory;
 	int			i;
 
 	Assert(aggstate->aggstrategy == AGG_HASHED || aggstate->aggstrategy == AGG_MIXED);
 
 	additionalsize = aggstate->numtrans * sizeof(AggStatePerGroupData);
 
+	/* divide the memory limit evenly among the hash tables */
+	memory = aggstate->hash_mem_limit / aggstate->num_hashes;
+
 	for (i = 0; i < aggstate->num_hashes; ++i)
 	{
 		AggStatePerHash perhash = &aggstate->perhash[i];
+		long		nbuckets;
 
 		Assert(perhash->aggnode->numGroups > 0);
 
 		if (perhash->hashtable)
+		{
 			ResetTupleHashTable(perhash->hashtable);
-		else
-			perhash->hashtable = BuildTupleHashTableExt(&aggstate->ss.ps,
-														perhash->hashslot->tts_tupleDescriptor,
-														perhash->numCols,
-														perhash->hashGrpColIdxHash,
-														perhash->eqfuncoids,
-														perhash->hashfunctions,
-														perhash->aggnode->grpCollations,
-														perhash->aggnode->numGroups,
-														additionalsize,
-														aggstate->ss.ps.state->es_query_cxt,
-														aggstate->hashcontext->ecxt_per_tuple_memory,
-														tmpmem,
-														DO_AGGSPLIT_SKIPFINAL(aggstate->aggsplit));
+			continue;
+		}
+
+		nbuckets = hash_choose_num_buckets(aggstate->hashentrysize,
+										   perhash->aggnode->numGroups,
+										   memory);
+
+		perhash->hashtable = BuildTupleHashTableExt(&aggstate->ss.ps,
+													perhash->hashslot->tts_tupleDescriptor,
+													perhash->numCols,
+													perhash->hashGrpColIdxHash,
+													perhash->eqfuncoids,
+													perhash->hashfunctions,
+													perhash->aggnode->grpCollations,
+													nbuckets,
+													additionalsize,
+													aggstate->hash_metacxt,
+													aggstate->hashcontext->ecxt_per_tuple_memory,
+													tmpmem,
+													DO_AGGSPLIT_SKIPFINAL(aggstate->aggsplit));
 	}
 }
 
+/*
+ * Choose a reasonable number of buckets for the initial hash table size.
+ *
+ * A bucket array sized for a badly overestimated number of groups would
+ * crowd out the group keys and transition values within the memory limit,
+ * so we err on the low side; the table grows as needed.
+ */
+static long
+hash_choose_num_buckets(double hashentrysize, long ngroups, Size memory)
+{
+	long		max_nbuckets;
+	long		nbuckets = ngroups;
+
+	max_nbuckets = memory / hashentrysize;
+
+	/* leave room for the entries themselves */
+	max_nbuckets >>= 1;
+
+	if (nbuckets > max_nbuckets)
+		nbuckets = max_nbuckets;
+
+	return Max(nbuckets, 1);
+}
+
 /*
  * Compute columns that actually need to be stored in hashtable entries.  The
  * incoming tuples from the child plan node will contain grouping columns,
@@ -1456,21 +1638,178 @@ hash_agg_entry_size(int numAggs)
 }
 
 /*
- * Find or create a hashtable entry for the tuple group containing the current
- * tuple (already set in tmpcontext's outertuple slot), in the current grouping
- * set (which the caller must have selected - note that initialize_aggregate
- * depends on this).
+ * Set the memory limit for the hash tables, and the number of partitions to
+ * use if they overflow, for an aggregation expected to see input_groups
+ * groups.  Used by the executor for each pass, and by the planner to cost
+ * a hashed aggregation.
  *
- * When called, CurrentMemoryContext should be the per-query context.
+ * used_bits is the number of hash bits already consumed by partitioning in
+ * earlier passes.  *num_partitions is set to 0 if we don't expect to spill.
  */
-static TupleHashEntryData *
-lookup_hash_entry(AggState *aggstate)
+void
+hash_agg_set_limits(double hashentrysize, double input_groups, int used_bits,
+					Size *mem_limit, int *num_partitions)
+{
+	int			npartitions;
+	Size		partition_mem;
+
+	/* if not expected to spill, use all of work_mem */
+	if (input_groups * hashentrysize < work_mem * 1024L)
+	{
+		if (num_partitions != NULL)
+			*num_partitions = 0;
+		*mem_limit = work_mem * 1024L;
+		return;
+	}
+
+	/*
+	 * Calculate the memory needed for the buffers of all the partition files
+	 * that will be open at once, and leave room for them.
+	 */
+	npartitions = hash_choose_num_partitions(input_groups, hashentrysize,
+											 used_bits, NULL);
+	if (num_partitions != NULL)
+		*num_partitions = npartitions;
+
+	partition_mem = BLCKSZ * (npartitions + 1);
+
+	/*
+	 * Don't set the limit below 3/4 of work_mem.  In that case, we are at the
+	 * minimum number of partitions, so we aren't going to dramatically exceed
+	 * work_mem anyway.
+	 */
+	if (work_mem * 1024L > 4 * partition_mem)
+		*mem_limit = work_mem * 1024L - partition_mem;
+	else
+		*mem_limit = work_mem * 1024L * 0.75;
+}
+
+/*
+ * Choose the number of partitions to spill to, as a power of two.  If
+ * log2_npartitions isn't NULL, the number of bits needed to select a
+ * partition is stored there.
+ */
+static int
+hash_choose_num_partitions(double input_groups, double hashentrysize,
+						   int used_bits, int *log2_npartitions)
+{
+	double		mem_wanted;
+	long		partition_limit;
+	long		npartitions;
+	int			partition_bits;
+
+	/*
+	 * Avoid creating so many partitions that the buffers of the open
+	 * partition files use more than 1/4 of work_mem.
+	 */
+	partition_limit = (work_mem * 1024L * 0.25) / BLCKSZ - 1;
+
+	mem_wanted = HASHAGG_PARTITION_FACTOR * input_groups * hashentrysize;
+
+	/* make enough partitions so that each one is likely to fit in memory */
+	npartitions = 1 + (long) (mem_wanted / (work_mem * 1024L));
+
+	if (npartitions > partition_limit)
+		npartitions = partition_limit;
+
+	if (npartitions < HASHAGG_MIN_PARTITIONS)
+		npartitions = HASHAGG_MIN_PARTITIONS;
+	if (npartitions > HASHAGG_MAX_PARTITIONS)
+		npartitions = HASHAGG_MAX_PARTITIONS;
+
+	/* ceil(log2(npartitions)) */
+	partition_bits = my_log2(npartitions);
+
+	/* make sure that we don't exhaust the hash bits */
+	if (partition_bits + used_bits >= 32)
+		partition_bits = 32 - used_bits;
+
+	if (log2_npartitions != NULL)
+		*log2_npartitions = partition_bits;
+
+	return 1 << partition_bits;
+}
+
+/*
+ * After adding a new group to a hash table, check whether we need to enter
+ * spill mode.
+ *
+ * There is always at least one group in memory when we get here, so every
+ * pass makes progress even if the limit is absurdly low.
+ */
+static void
+hash_agg_check_limits(AggState *aggstate)
+{
+	Size		meta_mem = MemoryContextMemAllocated(aggstate->hash_metacxt,
+													 true);
+	Size		hash_mem = MemoryContextMemAllocated(aggstate->hashcontext->ecxt_per_tuple_memory,
+													 true);
+
+	if (aggstate->hash_ngroups_current > 0 &&
+		meta_mem + hash_mem > aggstate->hash_mem_limit)
+		hash_agg_enter_spill_mode(aggstate);
+}
+
+/*
+ * Enter spill mode: from now on, tuples that don't belong to a group that is
+ * already in memory are spilled to disk.
+ */
+static void
+hash_agg_enter_spill_mode(AggState *aggstate)
+{
+	aggstate->hash_spill_mode = true;
+	aggstate->hash_ever_spilled = true;
+
+	/* use what we have seen so far to size the partitions */
+	hash_agg_update_metrics(aggstate);
+
+	/*
+	 * The spill state of the first pass lives in the AggState, since input
+	 * can arrive through several code paths; later passes keep their own.
+	 */
+	if (!aggstate->table_filled && aggstate->hash_spills == NULL)
+		aggstate->hash_spills = (HashAggSpill *)
+			MemoryContextAllocZero(aggstate->ss.ps.state->es_query_cxt,
+								   sizeof(HashAggSpill) * aggstate->num_hashes);
+}
+
+/*
+ * Update the peak memory usage, and revise the estimated size of a hash
+ * table entry using the groups currently in memory.
+ */
+static void
+hash_agg_update_metrics(AggState *aggstate)
+{
+	Size		meta_mem;
+	Size		hash_mem;
+
+	if (aggstate->aggstrategy != AGG_HASHED &&
+		aggstate->aggstrategy != AGG_MIXED)
+		return;
+
+	meta_mem = MemoryContextMemAllocated(aggstate->hash_metacxt, true);
+	hash_mem = MemoryContextMemAllocated(aggstate->hashcontext->ecxt_per_tuple_memory,
+										 true);
+
+	if (meta_mem + hash_mem > aggstate->hash_mem_peak)
+		aggstate->hash_mem_peak = meta_mem + hash_mem;
+
+	if (aggstate->hash_ngroups_current > 0)
+		aggstate->hashentrysize = sizeof(TupleHashEntryData) +
+			(hash_mem / (double) aggstate->hash_ngroups_current);
+}
+
+/*
+ * Extract the columns of the current tuple (already set in tmpcontext's
+ * outertuple slot) that are needed by the current grouping set's hash
+ * table into its hashslot.
+ */
+static void
+prepare_hash_slot(AggState *aggstate)
 {
 	TupleTableSlot *inputslot = aggstate->tmpcontext->ecxt_outertuple;
 	AggStatePerHash perhash = &aggstate->perhash[aggstate->current_set];
 	TupleTableSlot *hashslot = perhash->hashslot;
-	TupleHashEntryData *entry;
-	bool		isnew;
 	int			i;
 
 	/* transfer just the needed columns into hashslot */
@@ -1485,9 +1824,37 @@ lookup_hash_entry(AggState *aggstate)
 		hashslot->tts_isnull[i] = inputslot->tts_isnull[varNumber];
 	}
 	ExecStoreVirtualTuple(hashslot);
+}
+
+/*
+ * Find or create a hashtable entry for the tuple group containing the current
+ * tuple, whose grouping columns prepare_hash_slot() has already extracted, in
+ * the current grouping set (which the caller must have selected - note that
+ * initialize_aggregate depends on this).  hash is the tuple's hash value.
+ *
+ * Returns the entry's per-group states, or NULL if we are in spill mode and
+ * the group isn't in memory, in which case the caller must spill the tuple.
+ *
+ * When called, CurrentMemoryContext should be the per-query context.
+ */
+static AggStatePerGroup
+lookup_hash_entry(AggState *aggstate, uint32 hash)
+{
+	AggStatePerHash perhash = &aggstate->perhash[aggstate->current_set];
+	TupleTableSlot *hashslot = perhash->hashslot;
+	TupleHashEntryData *entry;
+	bool		isnew = false;
+	bool	   *p_isnew;
+
+	/* in spill mode, don't create new entries */
+	p_isnew = aggstate->hash_spill_mode ? NULL : &isnew;
 
 	/* find or create the hashtable entry using the filtered tuple */
-	entry = LookupTupleHashEntry(perhash->hashtable, hashslot, &isnew);
+	entry = LookupTupleHashEntryHash(perhash->hashtable, hashslot, p_isnew,
+									 hash);
+
+	if (entry == NULL)
+		return NULL;
 
 	if (isnew)
 	{
@@ -1510,14 +1877,19 @@ lookup_hash_entry(AggState *aggstate)
 
 			initialize_aggregate(aggstate, pertrans, pergroupstate);
 		}
+
+		aggstate->hash_ngroups_current++;
+		hash_agg_check_limits(aggstate);
 	}
 
-	return entry;
+	return entry->additional;
 }
 
 /*
  * Look up hash entries for the current tuple in all hashed grouping sets,
  * returning an array of pergroup pointers suitable for advance_aggregates.
+ * For grouping sets whose group isn't in memory, the tuple is spilled and the
+ * pergroup pointer is set to NULL, so that advance_aggregates skips them.
  *
  * Be aware that lookup_hash_entry can reset the tmpcontext.
  */
@@ -1530,8 +1902,26 @@ lookup_hash_entries(AggState *aggstate)
 
 	for (setno = 0; setno < numHashes; setno++)
 	{
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+		uint32		hash;
+
 		select_current_set(aggstate, setno, true);
-		pergroup[setno] = lookup_hash_entry(aggstate)->additional;
+		prepare_hash_slot(aggstate);
+		hash = TupleHashTableHash(perhash->hashtable, perhash->hashslot);
+		pergroup[setno] = lookup_hash_entry(aggstate, hash);
+
+		/* the group isn't in memory, so spill the tuple for later */
+		if (pergroup[setno] == NULL)
+		{
+			HashAggSpill *spill = &aggstate->hash_spills[setno];
+
+			if (spill->partitions == NULL)
+				hashagg_spill_init(spill, 0, perhash->aggnode->numGroups,
+								   aggstate->hashentrysize);
+
+			hashagg_spill_tuple(aggstate, spill,
+								aggstate->tmpcontext->ecxt_outertuple, hash);
+		}
 	}
 }
 
@@ -1685,6 +2075,7 @@ agg_retrieve_direct(AggState *aggstate)
 				 * full hashtables, so switch to outputting those.
 				 */
 				initialize_phase(aggstate, 0);
+				hashagg_finish_initial_spills(aggstate);
 				aggstate->table_filled = true;
 				ResetTupleHashIterator(aggstate->perhash[0].hashtable,
 									   &aggstate->perhash[0].hashiter);
@@ -1740,6 +2131,19 @@ agg_retrieve_direct(AggState *aggstate)
 			Assert(aggstate->projected_set < numGroupingSets);
 			Assert(nextSetSize > 0 || aggstate->input_done);
 		}
+		else if (aggstate->batch != NULL)
+		{
+			/*
+			 * Batch mode: there's only one group, so consume the whole input
+			 * at once.  As in the regular path below, firstSlot stays empty
+			 * because a plain aggregate can't reference ungrouped columns.
+			 */
+			aggstate->projected_set = 0;
+			initialize_aggregates(aggstate, pergroups, numReset);
+			agg_batch_advance(aggstate, pergroups[0]);
+			aggstate->agg_done = true;
+			econtext->ecxt_outertuple = firstSlot;
+		}
 		else
 		{
 			/*
@@ -1956,6 +2360,9 @@ agg_fill_hash_table(AggState *aggstate)
 		ResetExprContext(aggstate->tmpcontext);
 	}
 
+	/* finalize spills, if any */
+	hashagg_finish_initial_spills(aggstate);
+
 	aggstate->table_filled = true;
 	/* Initialize to walk the first hash table */
 	select_current_set(aggstate, 0, true);
@@ -1963,11 +2370,145 @@ agg_fill_hash_table(AggState *aggstate)
 						   &aggstate->perhash[0].hashiter);
 }
 
+/*
+ * If any data was spilled during hash aggregation, reset the hash tables and
+ * reprocess one batch of spilled data.  After this returns, the hash tables
+ * hold the groups of that batch, ready to be emitted.
+ *
+ * Returns false if there are no batches left to process.
+ */
+static bool
+agg_refill_hash_table(AggState *aggstate)
+{
+	HashAggBatch *batch;
+	HashAggSpill spill;
+	bool		spill_initialized = false;
+	TupleTableSlot *slot = aggstate->hash_spill_slot;
+	ExprContext *tmpcontext = aggstate->tmpcontext;
+	int			setno;
+
+	if (aggstate->hash_batches == NIL)
+		return false;
+
+	batch = linitial(aggstate->hash_batches);
+	aggstate->hash_batches = list_delete_first(aggstate->hash_batches);
+
+	hash_agg_set_limits(aggstate->hashentrysize, batch->input_tuples,
+						batch->used_bits, &aggstate->hash_mem_limit, NULL);
+
+	/*
+	 * Each batch only processes one grouping set; set the rest to NULL so
+	 * that the transition expression skips them.  We don't touch pergroups
+	 * for sorted grouping sets here, because they will be needed if we
+	 * rescan later.
+	 */
+	MemSet(aggstate->hash_pergroup, 0,
+		   sizeof(AggStatePerGroup) * aggstate->num_hashes);
+
+	/* free memory and reset hash tables */
+	ReScanExprContext(aggstate->hashcontext);
+	for (setno = 0; setno < aggstate->num_hashes; setno++)
+		ResetTupleHashTable(aggstate->perhash[setno].hashtable);
+
+	aggstate->hash_ngroups_current = 0;
+	aggstate->hash_spill_mode = false;
+
+	select_current_set(aggstate, batch->setno, true);
+
+	/*
+	 * Aggregate the spilled tuples.  They are read back as minimal tuples,
+	 * so use the transition expression built for that slot type.
+	 */
+	for (;;)
+	{
+		AggStatePerGroup pergroup;
+		uint32		hash;
+		bool		dummynull;
+
+		if (!hashagg_batch_read(batch, slot, &hash))
+			break;
+
+		tmpcontext->ecxt_outertuple = slot;
+
+		prepare_hash_slot(aggstate);
+		pergroup = lookup_hash_entry(aggstate, hash);
+
+		if (pergroup != NULL)
+		{
+			/* advance the aggregates (or combine functions) */
+			aggstate->hash_pergroup[batch->setno] = pergroup;
+			ExecEvalExprSwitchContext(aggstate->phases[0].evaltrans_spill,
+									  tmpcontext,
+									  &dummynull);
+		}
+		else
+		{
+			/* the group isn't in memory, so spill again */
+			if (!spill_initialized)
+			{
+				spill_initialized = true;
+				hashagg_spill_init(&spill, batch->used_bits,
+								   batch->input_tuples,
+								   aggstate->hashentrysize);
+			}
+			hashagg_spill_tuple(aggstate, &spill, slot, hash);
+		}
+
+		/* reset per-input-tuple context after each tuple */
+		ResetExprContext(tmpcontext);
+	}
+
+	BufFileClose(batch->input_file);
+
+	hash_agg_update_metrics(aggstate);
+
+	/* turn the overflow of this batch into new batches */
+	if (spill_initialized)
+		hashagg_spill_finish(aggstate, &spill, batch->setno);
+
+	/* initialize to walk the hash table of this batch */
+	ResetTupleHashIterator(aggstate->perhash[batch->setno].hashtable,
+						   &aggstate->perhash[batch->setno].hashiter);
+
+	pfree(batch);
+
+	return true;
+}
+
 /*
  * ExecAgg for hashed case: retrieving groups from hash table
+ *
+ * After exhausting in-memory tuples, also try refilling the hash table using
+ * previously-spilled tuples.  Only returns NULL after all in-memory and
+ * spilled tuples are exhausted.
  */
 static TupleTableSlot *
 agg_retrieve_hash_table(AggState *aggstate)
+{
+	TupleTableSlot *result = NULL;
+
+	while (result == NULL)
+	{
+		result = agg_retrieve_hash_table_in_memory(aggstate);
+		if (result == NULL)
+		{
+			if (!agg_refill_hash_table(aggstate))
+			{
+				aggstate->agg_done = true;
+				break;
+			}
+		}
+	}
+
+	return result;
+}
+
+/*
+ * Retrieve the groups from the in-memory hash tables without considering any
+ * spilled tuples.
+ */
+static TupleTableSlot *
+agg_retrieve_hash_table_in_memory(AggState *aggstate)
 {
 	ExprContext *econtext;
 	AggStatePerAgg peragg;
@@ -2027,8 +2568,7 @@ agg_retrieve_hash_table(AggState *aggstate)
 			}
 			else
 			{
-				/* No more hashtables, so done */
-				aggstate->agg_done = true;
+				/* No more hashtables in memory */
 				return NULL;
 			}
 		}
@@ -2085,6 +2625,561 @@ agg_retrieve_hash_table(AggState *aggstate)
 	return NULL;
 }
 
+/*
+ * hashagg_spill_init
+ *
+ * Called after we determined that spilling is necessary.  Chooses the number
+ * of partitions to create, and initializes them.  The partition files
+ * themselves are only created once a tuple is written to them.
+ */
+static void
+hashagg_spill_init(HashAggSpill *spill, int used_bits, double input_groups,
+				   double hashentrysize)
+{
+	int			npartitions;
+	int			partition_bits;
+
+	npartitions = hash_choose_num_partitions(input_groups, hashentrysize,
+											 used_bits, &partition_bits);
+
+	spill->partitions = palloc0(sizeof(BufFile *) * npartitions);
+	spill->ntuples = palloc0(sizeof(int64) * npartitions);
+	spill->npartitions = npartitions;
+	spill->shift = 32 - used_bits - partition_bits;
+	spill->mask = ((uint32) npartitions - 1) << spill->shift;
+}
+
+/*
+ * hashagg_spill_tuple
+ *
+ * Write the input tuple, preceded by its hash value, to the partition chosen
+ * by the next bits of the hash value.
+ */
+static void
+hashagg_spill_tuple(AggState *aggstate, HashAggSpill *spill,
+					TupleTableSlot *inputslot, uint32 hash)
+{
+	MinimalTuple tuple;
+	bool		shouldFree;
+	int			partition;
+	BufFile    *file;
+	size_t		written;
+
+	tuple = ExecFetchSlotMinimalTuple(inputslot, &shouldFree);
+
+	partition = (hash & spill->mask) >> spill->shift;
+	spill->ntuples[partition]++;
+
+	file = spill->partitions[partition];
+	if (file == NULL)
+	{
+		/* First write to this partition, so open it. */
+		file = BufFileCreateTemp(false);
+		spill->partitions[partition] = file;
+	}
+
+	written = BufFileWrite(file, (void *) &hash, sizeof(uint32));
+	if (written != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to hash-aggregate temporary file: %m")));
+
+	written = BufFileWrite(file, (void *) tuple, tuple->t_len);
+	if (written != tuple->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to hash-aggregate temporary file: %m")));
+
+	aggstate->hash_disk_used += sizeof(uint32) + tuple->t_len;
+
+	if (shouldFree)
+		pfree(tuple);
+}
+
+/*
+ * hashagg_spill_finish
+ *
+ * Transform spill partitions into new batches, to be processed after the
+ * groups now in memory have been emitted.
+ */
+static void
+hashagg_spill_finish(AggState *aggstate, HashAggSpill *spill, int setno)
+{
+	int			i;
+	int			used_bits = 32 - spill->shift;
+
+	for (i = 0; i < spill->npartitions; i++)
+	{
+		BufFile    *file = spill->partitions[i];
+		HashAggBatch *batch;
+
+		/* partition is empty */
+		if (file == NULL)
+			continue;
+
+		if (BufFileSeek(file, 0, 0L, SEEK_SET))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not rewind hash-aggregate temporary file: %m")));
+
+		batch = (HashAggBatch *)
+			MemoryContextAlloc(aggstate->ss.ps.state->es_query_cxt,
+							   sizeof(HashAggBatch));
+		batch->setno = setno;
+		batch->used_bits = used_bits;
+		batch->input_file = file;
+		batch->input_tuples = spill->ntuples[i];
+
+		aggstate->hash_batches = lcons(batch, aggstate->hash_batches);
+		aggstate->hash_batches_used++;
+	}
+
+	pfree(spill->ntuples);
+	pfree(spill->partitions);
+	spill->partitions = NULL;
+	spill->ntuples = NULL;
+}
+
+/*
+ * hashagg_finish_initial_spills
+ *
+ * At the end of the first pass over the input, turn the spilled tuples of
+ * every grouping set into batches.
+ */
+static void
+hashagg_finish_initial_spills(AggState *aggstate)
+{
+	int			setno;
+
+	if (aggstate->hash_spills != NULL)
+	{
+		for (setno = 0; setno < aggstate->num_hashes; setno++)
+		{
+			HashAggSpill *spill = &aggstate->hash_spills[setno];
+
+			if (spill->partitions != NULL)
+				hashagg_spill_finish(aggstate, spill, setno);
+		}
+
+		pfree(aggstate->hash_spills);
+		aggstate->hash_spills = NULL;
+	}
+
+	hash_agg_update_metrics(aggstate);
+}
+
+/*
+ * hashagg_batch_read
+ *
+ * Read the next tuple of a batch into slot, and its hash value into *hashp.
+ * Returns false at the end of the batch.
+ */
+static bool
+hashagg_batch_read(HashAggBatch *batch, TupleTableSlot *slot, uint32 *hashp)
+{
+	uint32		header[2];
+	size_t		nread;
+	MinimalTuple tuple;
+
+	CHECK_FOR_INTERRUPTS();
+
+	/*
+	 * Since both the hash value and the MinimalTuple length word are uint32,
+	 * we can read them both in one BufFileRead() call without any type
+	 * cheating.
+	 */
+	nread = BufFileRead(batch->input_file, (void *) header, sizeof(header));
+	if (nread == 0)				/* end of file */
+	{
+		ExecClearTuple(slot);
+		return false;
+	}
+	if (nread != sizeof(header))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from hash-aggregate temporary file: %m")));
+	*hashp = header[0];
+	tuple = (MinimalTuple) palloc(header[1]);
+	tuple->t_len = header[1];
+	nread = BufFileRead(batch->input_file,
+						(void *) ((char *) tuple + sizeof(uint32)),
+						header[1] - sizeof(uint32));
+	if (nread != header[1] - sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from hash-aggregate temporary file: %m")));
+	ExecForceStoreMinimalTuple(tuple, slot, true);
+	return true;
+}
+
+/*
+ * hashagg_reset_spill_state
+ *
+ * Close all spill files and forget any batches that haven't been processed,
+ * at rescan or shutdown.
+ */
+static void
+hashagg_reset_spill_state(AggState *aggstate)
+{
+	ListCell   *lc;
+
+	/* free spills from initial pass */
+	if (aggstate->hash_spills != NULL)
+	{
+		int			setno;
+
+		for (setno = 0; setno < aggstate->num_hashes; setno++)
+		{
+			HashAggSpill *spill = &aggstate->hash_spills[setno];
+			int			i;
+
+			if (spill->partitions == NULL)
+				continue;
+
+			for (i = 0; i < spill->npartitions; i++)
+			{
+				if (spill->partitions[i] != NULL)
+					BufFileClose(spill->partitions[i]);
+			}
+			pfree(spill->ntuples);
+			pfree(spill->partitions);
+		}
+		pfree(aggstate->hash_spills);
+		aggstate->hash_spills = NULL;
+	}
+
+	/* free batches */
+	foreach(lc, aggstate->hash_batches)
+	{
+		HashAggBatch *batch = (HashAggBatch *) lfirst(lc);
+
+		BufFileClose(batch->input_file);
+		pfree(batch);
+	}
+	list_free(aggstate->hash_batches);
+	aggstate->hash_batches = NIL;
+}
+
+/*
+ * agg_batch_init
+ *
+ * Set up batch mode, if this node qualifies: it must compute plain
+ * aggregates without grouping sets directly over a SeqScan, every
+ * transition must take at most one argument that execBatch.c can compile,
+ * and the scan must accept batch mode too.  If so, aggstate->batch is set.
+ */
+static void
+agg_batch_init(AggState *aggstate)
+{
+	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	PlanState  *outerstate = outerPlanState(aggstate);
+	Index		scanrelid;
+	List	   *outer_tlist;
+	TupleBatch *batch;
+	AggBatchTrans *trans;
+	int			transno;
+
+	/* the specialized transitions assume by-value int8 and float8 */
+	if (!FLOAT8PASSBYVAL)
+		return;
+
+	if (node->aggstrategy != AGG_PLAIN || node->groupingSets != NIL ||
+		DO_AGGSPLIT_COMBINE(aggstate->aggsplit) ||
+		aggstate->numtrans == 0 ||
+		!IsA(outerstate, SeqScanState))
+		return;
+
+	scanrelid = ((Scan *) outerstate->plan)->scanrelid;
+	outer_tlist = outerstate->plan->targetlist;
+
+	batch = ExecCreateTupleBatch();
+	trans = (AggBatchTrans *) palloc0(sizeof(AggBatchTrans) * aggstate->numtrans);
+
+	for (transno = 0; transno < aggstate->numtrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+		Aggref	   *aggref = pertrans->aggref;
+		AggBatchTrans *btrans = &trans[transno];
+
+		if (pertrans->numSortCols > 0 || aggref->aggfilter != NULL ||
+			pertrans->numTransInputs > 1 ||
+			pertrans->numInputs != pertrans->numTransInputs)
+			return;
+
+		if (pertrans->numTransInputs == 1)
+		{
+			TargetEntry *tle = linitial_node(TargetEntry, aggref->args);
+
+			btrans->arg = ExecInitBatchExpr(tle->expr, batch, scanrelid,
+											outer_tlist);
+			if (btrans->arg == NULL)
+				return;
+		}
+
+		switch (pertrans->transfn_oid)
+		{
+			case F_INT8INC:
+			case F_INT8INC_ANY:
+				btrans->kind = pertrans->initValueIsNull ?
+					AGG_BATCH_GENERIC : AGG_BATCH_COUNT;
+				break;
+			case F_INT4_SUM:
+				btrans->kind = AGG_BATCH_INT4_SUM;
+				break;
+			case F_FLOAT8PL:
+				btrans->kind = AGG_BATCH_FLOAT8_SUM;
+				break;
+			case F_INT4_AVG_ACCUM:
+				btrans->kind = pertrans->initValueIsNull ?
+					AGG_BATCH_GENERIC : AGG_BATCH_INT4_AVG;
+				break;
+			default:
+				btrans->kind = AGG_BATCH_GENERIC;
+				break;
+		}
+	}
+
+	if (!ExecSeqScanInitBatch((SeqScanState *) outerstate, batch))
+		return;
+
+	aggstate->batch = (AggBatchData *) palloc(sizeof(AggBatchData));
+	aggstate->batch->batch = batch;
+	aggstate->batch->trans = trans;
+}
+
+/*
+ * agg_batch_advance
+ *
+ * Consume all input from the SeqScan below us in batch mode, advancing the
+ * transition states of the single group.
+ */
+static void
+agg_batch_advance(AggState *aggstate, AggStatePerGroup pergroup)
+{
+	SeqScanState *scan = (SeqScanState *) outerPlanState(aggstate);
+	TupleBatch *batch = aggstate->batch->batch;
+	int			transno;
+
+	select_current_set(aggstate, 0, false);
+
+	for (;;)
+	{
+		int			nrows = ExecSeqScanBatch(scan, batch);
+
+		for (transno = 0; batch->nselected > 0 && transno < aggstate->numtrans;
+			 transno++)
+		{
+			AggBatchTrans *btrans = &aggstate->batch->trans[transno];
+
+			if (btrans->arg != NULL)
+				ExecEvalBatchExpr(btrans->arg, batch);
+
+			agg_batch_advance_trans(aggstate, &aggstate->pertrans[transno],
+									btrans, &pergroup[transno], batch);
+		}
+
+		/* Reset per-input-tuple context after each batch */
+		ResetExprContext(aggstate->tmpcontext);
+
+		/* a short batch was the last one */
+		if (nrows < EXEC_BATCH_SIZE)
+			break;
+	}
+}
+
+/*
+ * agg_batch_advance_trans
+ *
+ * Advance one transition state with the selected rows of a batch.
+ */
+static void
+agg_batch_advance_trans(AggState *aggstate, AggStatePerTrans pertrans,
+						AggBatchTrans *btrans, AggStatePerGroup pergroup,
+						TupleBatch *batch)
+{
+	BatchExprState *arg = btrans->arg;
+	bool		strict = pertrans->transfn.fn_strict;
+	int		   *sel = batch->selection;
+	int			nsel = batch->nselected;
+	int			i;
+
+	switch (btrans->kind)
+	{
+		case AGG_BATCH_COUNT:
+			{
+				int64		count = 0;
+				int64		result;
+
+				if (arg == NULL || !strict)
+					count = nsel;
+				else
+				{
+					for (i = 0; i < nsel; i++)
+						count += !arg->nulls[sel[i]];
+				}
+
+				if (unlikely(pg_add_s64_overflow(DatumGetInt64(pergroup->transValue),
+												 count, &result)))
+					ereport(ERROR,
+							(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+							 errmsg("bigint out of range")));
+				pergroup->transValue = Int64GetDatum(result);
+				break;
+			}
+
+		case AGG_BATCH_INT4_SUM:
+			{
+				/* int4_sum isn't strict; it skips nulls itself */
+				bool		havesum = !pergroup->transValueIsNull;
+				int64		sum = havesum ? DatumGetInt64(pergroup->transValue) : 0;
+
+				for (i = 0; i < nsel; i++)
+				{
+					int			row = sel[i];
+
+					if (arg->nulls[row])
+						continue;
+					sum += arg->ivalues[row];
+					havesum = true;
+				}
+
+				if (havesum)
+				{
+					pergroup->transValue = Int64GetDatum(sum);
+					pergroup->transValueIsNull = false;
+				}
+				break;
+			}
+
+		case AGG_BATCH_FLOAT8_SUM:
+			{
+				/*
+				 * float8pl is strict; with a null initial value, the first
+				 * input becomes the state.  Add the values in input order,
+				 * so that the result is the same as in the regular path.
+				 */
+				bool		havesum = !pergroup->noTransValue;
+				double		sum = 0.0;
+
+				if (havesum)
+				{
+					/* a strict transfn never recovers from a null state */
+					if (pergroup->transValueIsNull)
+						break;
+					sum = DatumGetFloat8(pergroup->transValue);
+				}
+
+				for (i = 0; i < nsel; i++)
+				{
+					int			row = sel[i];
+
+					if (arg->nulls[row])
+						continue;
+					if (havesum)
+						sum = float8_pl(sum, arg->fvalues[row]);
+					else
+					{
+						sum = arg->fvalues[row];
+						havesum = true;
+					}
+				}
+
+				if (havesum)
+				{
+					pergroup->transValue = Float8GetDatum(sum);
+					pergroup->transValueIsNull = false;
+					pergroup->noTransValue = false;
+				}
+				break;
+			}
+
+		case AGG_BATCH_INT4_AVG:
+			{
+				/*
+				 * Like int4_avg_accum, update the {count, sum} array in
+				 * place.  The state lives in the aggregate context, so it's
+				 * never toasted.
+				 */
+				ArrayType  *transarray = DatumGetArrayTypeP(pergroup->transValue);
+				AggBatchInt8TransData *transdata;
+
+				Assert(transarray == (ArrayType *) DatumGetPointer(pergroup->transValue));
+				if (ARR_HASNULL(transarray) ||
+					ARR_SIZE(transarray) != ARR_OVERHEAD_NONULLS(1) + sizeof(AggBatchInt8TransData))
+					elog(ERROR, "expected 2-element int8 array");
+
+				transdata = (AggBatchInt8TransData *) ARR_DATA_PTR(transarray);
+				for (i = 0; i < nsel; i++)
+				{
+					int			row = sel[i];
+
+					if (arg->nulls[row])
+						continue;
+					transdata->count++;
+					transdata->sum += arg->ivalues[row];
+				}
+				break;
+			}
+
+		case AGG_BATCH_GENERIC:
+			{
+				/* cf. the EEOP_AGG_* steps in execExprInterp.c */
+				FunctionCallInfo fcinfo = pertrans->transfn_fcinfo;
+				MemoryContext oldContext;
+				Datum		newVal;
+
+				aggstate->curpertrans = pertrans;
+
+				for (i = 0; i < nsel; i++)
+				{
+					int			row = sel[i];
+
+					if (arg != NULL)
+					{
+						fcinfo->args[1].value =
+							ExecBatchGetDatum(arg, row, &fcinfo->args[1].isnull);
+
+						if (strict && fcinfo->args[1].isnull)
+							continue;
+					}
+
+					if (strict)
+					{
+						if (pergroup->noTransValue)
+						{
+							/* the first input becomes the state */
+							ExecAggInitGroup(aggstate, pertrans, pergroup);
+							continue;
+						}
+						if (pergroup->transValueIsNull)
+							break;
+					}
+
+					oldContext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
+
+					fcinfo->args[0].value = pergroup->transValue;
+					fcinfo->args[0].isnull = pergroup->transValueIsNull;
+					fcinfo->isnull = false; /* just in case transfn doesn't set it */
+
+					newVal = FunctionCallInvoke(fcinfo);
+
+					if (!pertrans->transtypeByVal &&
+						DatumGetPointer(newVal) != DatumGetPointer(pergroup->transValue))
+						newVal = ExecAggTransReparent(aggstate, pertrans,
+													  newVal, fcinfo->isnull,
+													  pergroup->transValue,
+													  pergroup->transValueIsNull);
+
+					pergroup->transValue = newVal;
+					pergroup->transValueIsNull = fcinfo->isnull;
+
+					MemoryContextSwitchTo(oldContext);
+				}
+				break;
+			}
+	}
+}
+
 /* -----------------
  * ExecInitAgg
  *
@@ -2494,9 +3589,32 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	 */
 	if (use_hashing)
 	{
+		double		totalGroups = 0;
+
 		/* this is an array of pointers, not structures */
 		aggstate->hash_pergroup = pergroups;
 
+		aggstate->hash_metacxt = AllocSetContextCreate(estate->es_query_cxt,
+													   "HashAgg meta context",
+													   ALLOCSET_DEFAULT_SIZES);
+		aggstate->hash_spill_slot = ExecInitExtraTupleSlot(estate, scanDesc,
+														   &TTSOpsMinimalTuple);
+
+		/*
+		 * Initially, estimate the size of a hash table entry the same way
+		 * the planner did, and set the memory limit for the first pass.
+		 */
+		aggstate->hashentrysize =
+			MAXALIGN(outerPlan->plan_width) +
+			MAXALIGN(SizeofMinimalTupleHeader) +
+			hash_agg_entry_size(numaggs);
+
+		for (i = 0; i < numHashes; i++)
+			totalGroups += aggstate->perhash[i].aggnode->numGroups;
+
+		hash_agg_set_limits(aggstate->hashentrysize, totalGroups, 0,
+							&aggstate->hash_mem_limit, NULL);
+
 		find_hash_columns(aggstate);
 		build_hash_table(aggstate);
 		aggstate->table_filled = false;
@@ -2908,6 +4026,32 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 
 	}
 
+	/*
+	 * Tuples read back from spill files are always minimal tuples, which the
+	 * transition expressions above may not be prepared for.  So build a
+	 * separate expression for them, covering just the hashed grouping sets.
+	 */
+	if (use_hashing)
+	{
+		const TupleTableSlotOps *outerops = aggstate->ss.ps.outerops;
+		bool		outeropsfixed = aggstate->ss.ps.outeropsfixed;
+
+		aggstate->ss.ps.outerops = &TTSOpsMinimalTuple;
+		aggstate->ss.ps.outeropsfixed = true;
+
+		aggstate->phases[0].evaltrans_spill =
+			ExecBuildAggTrans(aggstate, &aggstate->phases[0], false, true);
+
+		aggstate->ss.ps.outerops = outerops;
+		aggstate->ss.ps.outeropsfixed = outeropsfixed;
+	}
+
+	/*
+	 * Finally, see whether we can run in batch mode.
+	 */
+	if (enable_batch_execution)
+		agg_batch_init(aggstate);
+
 	return aggstate;
 }
 
@@ -3416,6 +4560,14 @@ ExecEndAgg(AggState *node)
 	if (node->hashcontext)
 		ReScanExprContext(node->hashcontext);
 
+	/* Close any spill files, and release the hash tables */
+	if (node->aggstrategy == AGG_HASHED || node->aggstrategy == AGG_MIXED)
+	{
+		hashagg_reset_spill_state(node);
+		MemoryContextDelete(node->hash_metacxt);
+		node->hash_metacxt = NULL;
+	}
+
 	/*
 	 * We don't actually free any ExprContexts here (see comment in
 	 * ExecFreeExprContext), just unlinking the output one from the plan node
@@ -3457,9 +4609,11 @@ ExecReScanAgg(AggState *node)
 		 * If we do have the hash table, and the subplan does not have any
 		 * parameter changes, and none of our own parameter changes affect
 		 * input expressions of the aggregated functions, then we can just
-		 * rescan the existing hash table; no need to build it again.
+		 * rescan the existing hash table; no need to build it again.  That
+		 * doesn't work if we spilled, since the hash table then holds only
+		 * the groups of the last batch.
 		 */
-		if (outerPlan->chgParam == NULL &&
+		if (outerPlan->chgParam == NULL && !node->hash_ever_spilled &&
 			!bms_overlap(node->ss.ps.chgParam, aggnode->aggParams))
 		{
 			ResetTupleHashIterator(node->perhash[0].hashtable,
@@ -3516,6 +4670,20 @@ ExecReScanAgg(AggState *node)
 	 */
 	if (node->aggstrategy == AGG_HASHED || node->aggstrategy == AGG_MIXED)
 	{
+		double		totalGroups = 0;
+
+		hashagg_reset_spill_state(node);
+
+		node->hash_ever_spilled = false;
+		node->hash_spill_mode = false;
+		node->hash_ngroups_current = 0;
+
+		/* later passes may have lowered the limit; start over */
+		for (setno = 0; setno < node->num_hashes; setno++)
+			totalGroups += node->perhash[setno].aggnode->numGroups;
+		hash_agg_set_limits(node->hashentrysize, totalGroups, 0,
+							&node->hash_mem_limit, NULL);
+
 		ReScanExprContext(node->hashcontext);
 		/* Rebuild an empty hash table */
 		build_hash_table(node);
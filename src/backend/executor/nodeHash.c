@@ -38,6 +38,7 @@
 #include "pgstat.h"
 #include "port/atomics.h"
 #include "utils/dynahash.h"
+#include "utils/hashutils.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
@@ -79,6 +80,14 @@ static bool ExecParallelHashTuplePrealloc(HashJoinTable hashtable,
 										  size_t size);
 static void ExecParallelHashMergeCounters(HashJoinTable hashtable);
 static void ExecParallelHashCloseBatchAccessors(HashJoinTable hashtable);
+static uint64 ExecHashBloomChooseSize(double ntuples, size_t space_allowed,
+									  int *nhashes);
+static void ExecHashBloomInit(HashBloomFilter *bloom, uint64 nbits,
+							  int nhashes);
+static inline void ExecHashBloomAdd(HashBloomFilter *bloom, uint32 hashvalue,
+									bool shared);
+static inline bool ExecHashBloomLacks(HashBloomFilter *bloom,
+									  uint32 hashvalue);
 
 
 /* ----------------------------------------------------------------
@@ -117,6 +126,13 @@ MultiExecHash(HashState *node)
 	if (node->ps.instrument)
 		InstrStopNode(node->ps.instrument, node->hashtable->partialTuples);
 
+	/*
+	 * Every inner tuple is in the Bloom filter now, so the scan on the other
+	 * side of the join can start using it.
+	 */
+	if (node->runtime_filter != NULL && node->hashtable->bloom != NULL)
+		node->runtime_filter->hashtable = node->hashtable;
+
 	/*
 	 * We do not return the hash table directly because it's not a subtype of
 	 * Node, and so would violate the MultiExecProcNode API.  Instead, our
@@ -173,6 +189,9 @@ MultiExecPrivateHash(HashState *node)
 		{
 			int			bucketNumber;
 
+			if (hashtable->bloom != NULL)
+				ExecHashBloomAdd(hashtable->bloom, hashvalue, false);
+
 			bucketNumber = ExecHashGetSkewBucket(hashtable, hashvalue);
 			if (bucketNumber != INVALID_SKEW_BUCKET_NO)
 			{
@@ -277,6 +296,9 @@ MultiExecParallelHash(HashState *node)
 				ExecParallelHashIncreaseNumBuckets(hashtable);
 			ExecParallelHashEnsureBatchAccessors(hashtable);
 			ExecParallelHashTableSetCurrentBatch(hashtable, 0);
+			if (DsaPointerIsValid(pstate->bloom))
+				hashtable->bloom = dsa_get_address(hashtable->area,
+												   pstate->bloom);
 			for (;;)
 			{
 				slot = ExecProcNode(outerNode);
@@ -286,7 +308,11 @@ MultiExecParallelHash(HashState *node)
 				if (ExecHashGetHashValue(hashtable, econtext, hashkeys,
 										 false, hashtable->keepNulls,
 										 &hashvalue))
+				{
+					if (hashtable->bloom != NULL)
+						ExecHashBloomAdd(hashtable->bloom, hashvalue, true);
 					ExecParallelHashTableInsert(hashtable, slot, hashvalue);
+				}
 				hashtable->partialTuples++;
 			}
 
@@ -334,6 +360,10 @@ MultiExecParallelHash(HashState *node)
 	hashtable->totalTuples = pstate->total_tuples;
 	ExecParallelHashEnsureBatchAccessors(hashtable);
 
+	/* We may have arrived too late to help build the Bloom filter. */
+	if (DsaPointerIsValid(pstate->bloom))
+		hashtable->bloom = dsa_get_address(hashtable->area, pstate->bloom);
+
 	/*
 	 * The next synchronization point is in ExecHashJoin's HJ_BUILD_HASHTABLE
 	 * case, which will bring the build phase to PHJ_BUILD_DONE (if it isn't
@@ -512,6 +542,8 @@ ExecHashTableCreate(HashState *state, List *hashOperators, List *hashCollations,
 	hashtable->parallel_state = state->parallel_state;
 	hashtable->area = state->ps.state->es_query_dsa;
 	hashtable->batches = NULL;
+	hashtable->bloom = NULL;
+	hashtable->runtime_filter = state->runtime_filter;
 
 #ifdef HJDEBUG
 	printf("Hashjoin %p: initial nbatch = %d, nbuckets = %d\n",
@@ -618,6 +650,26 @@ ExecHashTableCreate(HashState *state, List *hashOperators, List *hashCollations,
 			 */
 			pstate->nbuckets = nbuckets;
 			ExecParallelHashTableAlloc(hashtable, 0);
+
+			/* Likewise the Bloom filter, if there's a scan to push it to. */
+			pstate->bloom = InvalidDsaPointer;
+			if (state->runtime_filter != NULL)
+			{
+				uint64		nbits;
+				int			nhashes;
+
+				nbits = ExecHashBloomChooseSize(rows, space_allowed, &nhashes);
+				if (nbits > 0)
+				{
+					pstate->bloom =
+						dsa_allocate(hashtable->area,
+									 offsetof(HashBloomFilter, words) +
+									 nbits / 32 * sizeof(pg_atomic_uint32));
+					ExecHashBloomInit(dsa_get_address(hashtable->area,
+													  pstate->bloom),
+									  nbits, nhashes);
+				}
+			}
 		}
 
 		/*
@@ -647,6 +699,26 @@ ExecHashTableCreate(HashState *state, List *hashOperators, List *hashCollations,
 			ExecHashBuildSkewHash(hashtable, node, num_skew_mcvs);
 
 		MemoryContextSwitchTo(oldcxt);
+
+		/*
+		 * Set up the Bloom filter, if there's a scan to push it to.  It must
+		 * cover all batches, so it lives in hashCxt.
+		 */
+		if (state->runtime_filter != NULL)
+		{
+			uint64		nbits;
+			int			nhashes;
+
+			nbits = ExecHashBloomChooseSize(rows, space_allowed, &nhashes);
+			if (nbits > 0)
+			{
+				hashtable->bloom = (HashBloomFilter *)
+					MemoryContextAlloc(hashtable->hashCxt,
+									   offsetof(HashBloomFilter, words) +
+									   nbits / 32 * sizeof(pg_atomic_uint32));
+				ExecHashBloomInit(hashtable->bloom, nbits, nhashes);
+			}
+		}
 	}
 
 	return hashtable;
@@ -855,6 +927,10 @@ ExecHashTableDestroy(HashJoinTable hashtable)
 {
 	int			i;
 
+	/* The outer scan must stop consulting our Bloom filter */
+	if (hashtable->runtime_filter != NULL)
+		hashtable->runtime_filter->hashtable = NULL;
+
 	/*
 	 * Make sure all the temp files are closed.  We skip batch 0, since it
 	 * can't have any temp files (and the arrays might not even exist if
@@ -1869,6 +1945,177 @@ ExecHashGetHashValue(HashJoinTable hashtable,
 	return true;
 }
 
+/*
+ * ExecHashRuntimeFilterRejects
+ *		Check a tuple of the outer-side scan against the Bloom filter.
+ *
+ * Returns true if the tuple certainly has no match in the hash table, in
+ * which case the scan can drop it.  The hash value is computed exactly as
+ * ExecHashGetHashValue() would compute it for the outer tuple, except that
+ * the keys are plain columns of the scan tuple.  The caller guarantees that
+ * the join doesn't need to return unmatched outer tuples, so tuples with a
+ * NULL key for a strict operator can be rejected too.
+ */
+bool
+ExecHashRuntimeFilterRejects(HashRuntimeFilter *filter, TupleTableSlot *slot,
+							 ExprContext *econtext)
+{
+	HashJoinTable hashtable = filter->hashtable;
+	uint32		hashkey = 0;
+	MemoryContext oldContext;
+	int			i;
+
+	/* Let everything through until the filter has been built */
+	if (hashtable == NULL)
+		return false;
+
+	/* Hash functions might leak, e.g. when detoasting the key */
+	ResetExprContext(econtext);
+
+	oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+	for (i = 0; i < filter->nkeys; i++)
+	{
+		Datum		keyval;
+		bool		isNull;
+
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		keyval = slot_getattr(slot, filter->keyattnos[i], &isNull);
+
+		if (isNull)
+		{
+			if (hashtable->hashStrict[i])
+			{
+				MemoryContextSwitchTo(oldContext);
+				return true;	/* cannot match */
+			}
+			/* else, leave hashkey unmodified, equivalent to hashcode 0 */
+		}
+		else
+		{
+			uint32		hkey;
+
+			hkey = DatumGetUInt32(FunctionCall1Coll(&hashtable->outer_hashfunctions[i],
+													hashtable->collations[i],
+													keyval));
+			hashkey ^= hkey;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return ExecHashBloomLacks(hashtable->bloom, hashkey);
+}
+
+/*
+ * Choose the number of bits and hash functions for a Bloom filter over
+ * ntuples inner tuples.  We aim for BLOOM_BITS_PER_TUPLE bits per tuple,
+ * which gives a false positive rate of about 2%, but spend no more than
+ * BLOOM_WORK_MEM_PERCENT of the hash table's memory budget on it.  Returns 0
+ * if the filter we can afford would be too crowded to be worth probing.
+ */
+static uint64
+ExecHashBloomChooseSize(double ntuples, size_t space_allowed, int *nhashes)
+{
+	uint64		max_bits;
+	uint64		nbits;
+	int			k;
+
+	ntuples = Max(ntuples, 1.0);
+
+	/* mask is a uint32, so we can't go beyond 2^32 bits */
+	max_bits = (uint64) space_allowed * BLOOM_WORK_MEM_PERCENT / 100 *
+		BITS_PER_BYTE;
+	max_bits = Min(max_bits, UINT64CONST(1) << 32);
+
+	nbits = BLOOM_MIN_BITS;
+	while (nbits < ntuples * BLOOM_BITS_PER_TUPLE && nbits * 2 <= max_bits)
+		nbits *= 2;
+
+	/* With fewer than two bits per tuple, nearly everything would pass */
+	if (nbits < ntuples * 2)
+		return 0;
+
+	k = (int) rint(log(2.0) * nbits / ntuples);
+	*nhashes = Max(1, Min(k, BLOOM_MAX_HASHES));
+
+	return nbits;
+}
+
+/*
+ * Initialize an empty Bloom filter in memory the caller has allocated.
+ */
+static void
+ExecHashBloomInit(HashBloomFilter *bloom, uint64 nbits, int nhashes)
+{
+	uint64		nwords = nbits / 32;
+	uint64		i;
+
+	Assert(nbits >= 32 && (nbits & (nbits - 1)) == 0);
+
+	bloom->mask = (uint32) (nbits - 1);
+	bloom->nhashes = nhashes;
+	for (i = 0; i < nwords; i++)
+		pg_atomic_init_u32(&bloom->words[i], 0);
+}
+
+/*
+ * Add a hash value to the Bloom filter.  The bit positions are derived from
+ * the join hash value by double hashing, with a second hash mixed from the
+ * first; the step is forced odd so that the positions don't cycle early in
+ * a power of two sized bitset.  Parallel builders set bits with atomic ORs,
+ * skipping those that are already set to keep contention down.
+ */
+static inline void
+ExecHashBloomAdd(HashBloomFilter *bloom, uint32 hashvalue, bool shared)
+{
+	uint32		h = hashvalue;
+	uint32		step = murmurhash32(hashvalue) | 1;
+	int			i;
+
+	for (i = 0; i < bloom->nhashes; i++)
+	{
+		uint32		bitno = h & bloom->mask;
+		pg_atomic_uint32 *word = &bloom->words[bitno / 32];
+		uint32		bit = (uint32) 1 << (bitno % 32);
+		uint32		oldval = pg_atomic_read_u32(word);
+
+		if ((oldval & bit) == 0)
+		{
+			if (shared)
+				pg_atomic_fetch_or_u32(word, bit);
+			else
+				pg_atomic_write_u32(word, oldval | bit);
+		}
+		h += step;
+	}
+}
+
+/*
+ * Does the Bloom filter certainly lack this hash value?
+ */
+static inline bool
+ExecHashBloomLacks(HashBloomFilter *bloom, uint32 hashvalue)
+{
+	uint32		h = hashvalue;
+	uint32		step = murmurhash32(hashvalue) | 1;
+	int			i;
+
+	for (i = 0; i < bloom->nhashes; i++)
+	{
+		uint32		bitno = h & bloom->mask;
+
+		if ((pg_atomic_read_u32(&bloom->words[bitno / 32]) &
+			 ((uint32) 1 << (bitno % 32))) == 0)
+			return true;
+		h += step;
+	}
+
+	return false;
+}
+
 /*
  * ExecHashGetBucketAndBatch
  *		Determine the bucket number and batch number for a hash value
@@ -3158,6 +3405,11 @@ ExecHashTableDetach(HashJoinTable hashtable)
 			}
 		}
 
+		/* The shared Bloom filter may be about to go away. */
+		if (hashtable->runtime_filter != NULL)
+			hashtable->runtime_filter->hashtable = NULL;
+		hashtable->bloom = NULL;
+
 		/* If we're last to detach, clean up shared memory. */
 		if (BarrierDetach(&pstate->build_barrier))
 		{
@@ -3166,6 +3418,11 @@ ExecHashTableDetach(HashJoinTable hashtable)
 				dsa_free(hashtable->area, pstate->batches);
 				pstate->batches = InvalidDsaPointer;
 			}
+			if (DsaPointerIsValid(pstate->bloom))
+			{
+				dsa_free(hashtable->area, pstate->bloom);
+				pstate->bloom = InvalidDsaPointer;
+			}
 		}
 
 		hashtable->parallel_state = NULL;
@@ -113,11 +113,16 @@
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
 #include "miscadmin.h"
+#include "optimizer/optimizer.h"
+#include "parser/parsetree.h"
 #include "pgstat.h"
 #include "utils/memutils.h"
 #include "utils/sharedtuplestore.h"
 
 
+/* GUC parameter */
+bool		enable_hashjoin_bloom_filter = true;
+
 /*
  * States of the ExecHashJoin state machine
  */
@@ -146,6 +151,8 @@ static TupleTableSlot *ExecHashJoinGetSavedTuple(HashJoinState *hjstate,
 static bool ExecHashJoinNewBatch(HashJoinState *hjstate);
 static bool ExecParallelHashJoinNewBatch(HashJoinState *hjstate);
 static void ExecParallelHashJoinPartitionOuter(HashJoinState *node);
+static HashRuntimeFilter *ExecHashJoinMakeRuntimeFilter(HashJoin *node,
+														SeqScanState *scanstate);
 
 
 /* ----------------------------------------------------------------
@@ -729,6 +736,26 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 	hjstate->hj_HashOperators = node->hashoperators;
 	hjstate->hj_Collations = node->hashcollations;
 
+	/*
+	 * If the outer input is a sequential scan and we never have to return
+	 * unmatched outer tuples, have the Hash node build a Bloom filter over
+	 * the inner join keys and let the scan use it to skip tuples that can't
+	 * find a match.
+	 */
+	if (enable_hashjoin_bloom_filter && !HJ_FILL_OUTER(hjstate) &&
+		IsA(outerPlanState(hjstate), SeqScanState))
+	{
+		SeqScanState *scanstate = (SeqScanState *) outerPlanState(hjstate);
+		HashRuntimeFilter *filter;
+
+		filter = ExecHashJoinMakeRuntimeFilter(node, scanstate);
+		if (filter != NULL)
+		{
+			scanstate->runtime_filter = filter;
+			((HashState *) innerPlanState(hjstate))->runtime_filter = filter;
+		}
+	}
+
 	hjstate->hj_JoinState = HJ_BUILD_HASHTABLE;
 	hjstate->hj_MatchedOuter = false;
 	hjstate->hj_OuterNotEmpty = false;
@@ -736,6 +763,73 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 	return hjstate;
 }
 
+/*
+ * ExecHashJoinMakeRuntimeFilter
+ *		Set up a Bloom filter pushdown into the outer sequential scan.
+ *
+ * The scan checks its tuples before projecting them, so it must be able to
+ * find each outer hash key as a plain column of the table.  That's the case
+ * when the key is a Var of the outer plan's output whose target list entry
+ * is itself a user column of the scanned relation; binary-compatible
+ * relabelings don't change the hash value and are ignored.  Returns NULL if
+ * some key doesn't qualify.
+ *
+ * Since the filter is checked before the scan's qual, it would also change
+ * how many times volatile functions in that qual get called, so we don't
+ * push it into such a scan.
+ */
+static HashRuntimeFilter *
+ExecHashJoinMakeRuntimeFilter(HashJoin *node, SeqScanState *scanstate)
+{
+	Scan	   *scan = (Scan *) scanstate->ss.ps.plan;
+	HashRuntimeFilter *filter;
+	AttrNumber *keyattnos;
+	ListCell   *lc;
+	int			i = 0;
+
+	if (contain_volatile_functions((Node *) scan->plan.qual))
+		return NULL;
+
+	keyattnos = (AttrNumber *) palloc(list_length(node->hashkeys) *
+									  sizeof(AttrNumber));
+
+	foreach(lc, node->hashkeys)
+	{
+		Expr	   *key = (Expr *) lfirst(lc);
+		TargetEntry *tle;
+		Var		   *var;
+
+		while (IsA(key, RelabelType))
+			key = ((RelabelType *) key)->arg;
+		if (!IsA(key, Var) || ((Var *) key)->varno != OUTER_VAR)
+			return NULL;
+
+		tle = get_tle_by_resno(scan->plan.targetlist,
+							   ((Var *) key)->varattno);
+		if (tle == NULL)
+			return NULL;
+
+		key = tle->expr;
+		while (IsA(key, RelabelType))
+			key = ((RelabelType *) key)->arg;
+		if (!IsA(key, Var))
+			return NULL;
+		var = (Var *) key;
+		if (var->varno != scan->scanrelid || var->varlevelsup != 0 ||
+			var->varattno <= 0)
+			return NULL;
+
+		keyattnos[i++] = var->varattno;
+	}
+
+	filter = (HashRuntimeFilter *) palloc(sizeof(HashRuntimeFilter));
+	filter->nkeys = i;
+	filter->keyattnos = keyattnos;
+	filter->hashtable = NULL;
+
+	return filter;
+}
+
 /* ----------------------------------------------------------------
  *		ExecEndHashJoin
  *
@@ -1450,6 +1544,7 @@ ExecHashJoinInitializeDSM(HashJoinState *state, ParallelContext *pcxt)
 	pstate->nbuckets = 0;
 	pstate->growth = PHJ_GROWTH_OK;
 	pstate->chunk_work_queue = InvalidDsaPointer;
+	pstate->bloom = InvalidDsaPointer;
 	pg_atomic_init_u32(&pstate->distributor, 0);
 	pstate->nparticipants = pcxt->nworkers + 1;
 	pstate->total_tuples = 0;
@@ -0,0 +1,559 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeIncrementalSort.c
+ *	  Routines to handle incremental sorting of relations.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeIncrementalSort.c
+ *
+ * DESCRIPTION
+ *
+ *	Incremental sort is an optimized variant of multikey sort for cases
+ *	when the input is already sorted by a prefix of the sort keys.  For
+ *	example when a sort by (key1, key2 ... keyN) is requested, and the
+ *	input is already sorted by (key1, key2 ... keyM), M < N, we can
+ *	divide the input into groups where keys (key1, ... keyM) are equal,
+ *	and only sort on the remaining columns.
+ *
+ *	Consider the following example.  We have input tuples consisting of
+ *	two integers (X, Y) already presorted by X, while it's required to
+ *	sort them by both X and Y.  Let input tuples be following.
+ *
+ *	(1, 5)
+ *	(1, 2)
+ *	(2, 9)
+ *	(2, 1)
+ *	(2, 5)
+ *	(3, 3)
+ *	(3, 7)
+ *
+ *	An incremental sort algorithm would split the input into the following
+ *	groups, which have equal X, and then sort them by Y individually:
+ *
+ *		(1, 5) (1, 2)
+ *		(2, 9) (2, 1) (2, 5)
+ *		(3, 3) (3, 7)
+ *
+ *	After sorting these groups and putting them altogether, we would get
+ *	the following result which is sorted by X and Y, as requested:
+ *
+ *	(1, 2)
+ *	(1, 5)
+ *	(2, 1)
+ *	(2, 5)
+ *	(2, 9)
+ *	(3, 3)
+ *	(3, 7)
+ *
+ *	Sorting every group separately would pay the tuplesort setup cost once
+ *	per group, which is a bad deal when groups are tiny.  So we normally
+ *	accumulate at least DEFAULT_MIN_GROUP_SIZE tuples, extended to the end
+ *	of the group the last of them belongs to, and sort that batch on all
+ *	keys (the "full sort").  When a single group turns out to be larger
+ *	than DEFAULT_MAX_FULL_SORT_GROUP_SIZE, we instead switch to sorting
+ *	just that group on the non-presorted keys (the "prefix sort"), which
+ *	avoids comparing the presorted keys over and over.  Both tuplesort
+ *	states are reused across batches by means of tuplesort_reset.
+ *
+ *	Since each batch is emitted as soon as it is sorted, a LIMIT above the
+ *	node only has to wait for the groups it actually returns, rather than
+ *	for the whole input to be sorted.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "executor/execdebug.h"
+#include "executor/nodeIncrementalSort.h"
+#include "miscadmin.h"
+#include "utils/lsyscache.h"
+#include "utils/tuplesort.h"
+
+/*
+ * Minimum number of tuples we accumulate into a full sort batch before we
+ * start looking for a group boundary, and the number of tuples of a single
+ * group beyond that after which we switch to sorting the group on its own.
+ */
+#define DEFAULT_MIN_GROUP_SIZE 32
+#define DEFAULT_MAX_FULL_SORT_GROUP_SIZE (2 * DEFAULT_MIN_GROUP_SIZE)
+
+/*
+ * Check whether a given tuple belongs to the current group, that is whether
+ * its presorted keys are equal to those of the group pivot tuple.
+ */
+static bool
+isCurrentGroup(IncrementalSortState *node, TupleTableSlot *tuple)
+{
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+
+	econtext->ecxt_innertuple = node->group_pivot;
+	econtext->ecxt_outertuple = tuple;
+
+	return ExecQualAndReset(node->presorted_eq, econtext);
+}
+
+/*
+ * Prepare one of the two tuplesort states for a new batch, creating it on
+ * first use.  The prefix sort only sorts on the columns following the
+ * presorted ones.
+ */
+static Tuplesortstate *
+beginSortBatch(IncrementalSortState *node, bool prefix)
+{
+	IncrementalSort *plannode = (IncrementalSort *) node->ss.ps.plan;
+	Tuplesortstate *state;
+
+	state = (Tuplesortstate *) (prefix ? node->prefixsort_state :
+								node->fullsort_state);
+
+	if (state == NULL)
+	{
+		int			skipCols = prefix ? plannode->nPresortedCols : 0;
+
+		state = tuplesort_begin_heap(ExecGetResultType(outerPlanState(node)),
+									 plannode->sort.numCols - skipCols,
+									 plannode->sort.sortColIdx + skipCols,
+									 plannode->sort.sortOperators + skipCols,
+									 plannode->sort.collations + skipCols,
+									 plannode->sort.nullsFirst + skipCols,
+									 work_mem,
+									 NULL,
+									 false);
+		if (prefix)
+			node->prefixsort_state = (void *) state;
+		else
+			node->fullsort_state = (void *) state;
+	}
+	else
+		tuplesort_reset(state);
+
+	/*
+	 * Only the tuples not yet returned can still be needed.  That's not true
+	 * of a full sort batch, though: if it ends in a large group, all of that
+	 * group's tuples must be moved over to the prefix sort, so a bounded sort
+	 * could drop tuples that belong to the output.  Full sort batches are
+	 * small anyway, so only bound the prefix sort, which holds one group.
+	 */
+	if (prefix && node->bounded)
+		tuplesort_set_bound(state, node->bound - node->bound_Done);
+
+	return state;
+}
+
+/*
+ * Finish a batch, and accumulate its statistics if we're being instrumented.
+ */
+static void
+performSortBatch(IncrementalSortState *node, Tuplesortstate *state,
+				 IncrementalSortGroupInfo *info)
+{
+	TuplesortInstrumentation stats;
+
+	tuplesort_performsort(state);
+
+	if (node->ss.ps.instrument == NULL)
+		return;
+
+	tuplesort_get_stats(state, &stats);
+
+	info->groupCount++;
+	info->sortMethods |= (1 << stats.sortMethod);
+	if (stats.spaceType == SORT_SPACE_TYPE_DISK)
+	{
+		info->totalDiskSpaceUsed += stats.spaceUsed;
+		info->maxDiskSpaceUsed = Max(info->maxDiskSpaceUsed, stats.spaceUsed);
+	}
+	else
+	{
+		info->totalMemorySpaceUsed += stats.spaceUsed;
+		info->maxMemorySpaceUsed = Max(info->maxMemorySpaceUsed,
+									   stats.spaceUsed);
+	}
+}
+
+/*
+ * Read the next batch of whole groups from the outer node into the full
+ * sort state, and sort it.
+ *
+ * On entry, a non-empty group_pivot is the first tuple of the batch, which
+ * was read by the previous batch but not yet sorted.
+ */
+static void
+loadFullSortBatch(IncrementalSortState *node)
+{
+	PlanState  *outerNode = outerPlanState(node);
+	Tuplesortstate *fullsort = beginSortBatch(node, false);
+	TupleTableSlot *slot;
+	int64		nTuples = 0;
+	bool		largeGroup = false;
+
+	if (!TupIsNull(node->group_pivot))
+	{
+		tuplesort_puttupleslot(fullsort, node->group_pivot);
+		ExecClearTuple(node->group_pivot);
+		nTuples++;
+	}
+
+	for (;;)
+	{
+		slot = ExecProcNode(outerNode);
+
+		if (TupIsNull(slot))
+		{
+			node->outerNodeDone = true;
+			ExecClearTuple(node->group_pivot);
+			break;
+		}
+
+		/*
+		 * The full sort orders on all keys, so there's no need to look at
+		 * group boundaries until we have collected enough tuples.  The last
+		 * of those determines the group the batch must be completed with.
+		 */
+		if (nTuples < DEFAULT_MIN_GROUP_SIZE)
+		{
+			tuplesort_puttupleslot(fullsort, slot);
+			if (++nTuples == DEFAULT_MIN_GROUP_SIZE)
+				ExecCopySlot(node->group_pivot, slot);
+			continue;
+		}
+
+		if (!isCurrentGroup(node, slot))
+		{
+			/* Keep the first tuple of the next group for the next batch */
+			ExecCopySlot(node->group_pivot, slot);
+			break;
+		}
+
+		tuplesort_puttupleslot(fullsort, slot);
+		nTuples++;
+
+		/*
+		 * If the group keeps going, sort what we have so far and let the
+		 * reader move the rest of the group over to the prefix sort, which
+		 * will collect the remainder of the group from the outer node.
+		 */
+		if (nTuples - DEFAULT_MIN_GROUP_SIZE > DEFAULT_MAX_FULL_SORT_GROUP_SIZE)
+		{
+			largeGroup = true;
+			break;
+		}
+	}
+
+	if (nTuples == 0)
+		return;
+
+	SO1_printf("ExecIncrementalSort: sorting batch of " INT64_FORMAT " tuples\n",
+			   nTuples);
+
+	performSortBatch(node, fullsort, &node->fullsort_info);
+	node->fullsort_has_large_group = largeGroup;
+	node->execution_status = INCSORT_READFULLSORT;
+}
+
+/*
+ * Move the large group found at the tail of the full sort's output into the
+ * prefix sort.  "slot" holds the first tuple of the group.
+ */
+static void
+transferLargeGroup(IncrementalSortState *node, TupleTableSlot *slot)
+{
+	Tuplesortstate *fullsort = (Tuplesortstate *) node->fullsort_state;
+	Tuplesortstate *prefixsort = beginSortBatch(node, true);
+
+	do
+	{
+		tuplesort_puttupleslot(prefixsort, slot);
+	} while (tuplesort_gettupleslot(fullsort, true, false, slot, NULL));
+
+	node->fullsort_has_large_group = false;
+	node->execution_status = INCSORT_LOADPREFIXSORT;
+}
+
+/*
+ * Read the remainder of the large group from the outer node into the prefix
+ * sort state, and sort it.
+ */
+static void
+loadPrefixSortBatch(IncrementalSortState *node)
+{
+	PlanState  *outerNode = outerPlanState(node);
+	Tuplesortstate *prefixsort = (Tuplesortstate *) node->prefixsort_state;
+	TupleTableSlot *slot;
+
+	for (;;)
+	{
+		slot = ExecProcNode(outerNode);
+
+		if (TupIsNull(slot))
+		{
+			node->outerNodeDone = true;
+			ExecClearTuple(node->group_pivot);
+			break;
+		}
+
+		if (!isCurrentGroup(node, slot))
+		{
+			/* Keep the first tuple of the next group for the next batch */
+			ExecCopySlot(node->group_pivot, slot);
+			break;
+		}
+
+		tuplesort_puttupleslot(prefixsort, slot);
+	}
+
+	performSortBatch(node, prefixsort, &node->prefixsort_info);
+	node->execution_status = INCSORT_READPREFIXSORT;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIncrementalSort
+ *
+ *		Assuming that the outer subtree returns tuples presorted by some
+ *		prefix of the target sort columns, sorts the outer tuples batch by
+ *		batch and returns them in the fully sorted order.
+ *
+ *		Conditions:
+ *		  -- none.
+ *
+ *		Initial States:
+ *		  -- the outer child is prepared to return the first tuple.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecIncrementalSort(PlanState *pstate)
+{
+	IncrementalSortState *node = castNode(IncrementalSortState, pstate);
+	TupleTableSlot *slot = node->ss.ps.ps_ResultTupleSlot;
+
+	CHECK_FOR_INTERRUPTS();
+
+	/* We only support forward scans; see ExecInitIncrementalSort */
+	Assert(ScanDirectionIsForward(node->ss.ps.state->es_direction));
+
+	for (;;)
+	{
+		switch (node->execution_status)
+		{
+			case INCSORT_LOADFULLSORT:
+				if (node->outerNodeDone ||
+					(node->bounded && node->bound_Done >= node->bound))
+					return ExecClearTuple(slot);
+				loadFullSortBatch(node);
+				break;
+
+			case INCSORT_LOADPREFIXSORT:
+				loadPrefixSortBatch(node);
+				break;
+
+			case INCSORT_READFULLSORT:
+				if (tuplesort_gettupleslot((Tuplesortstate *) node->fullsort_state,
+										   true, false, slot, NULL))
+				{
+					/*
+					 * A large group sorts after every other group of the
+					 * batch, so once we reach it the rest of the batch
+					 * belongs to it.
+					 */
+					if (node->fullsort_has_large_group &&
+						isCurrentGroup(node, slot))
+					{
+						transferLargeGroup(node, slot);
+						break;
+					}
+					node->bound_Done++;
+					return slot;
+				}
+				node->fullsort_has_large_group = false;
+				node->execution_status = INCSORT_LOADFULLSORT;
+				break;
+
+			case INCSORT_READPREFIXSORT:
+				if (tuplesort_gettupleslot((Tuplesortstate *) node->prefixsort_state,
+										   true, false, slot, NULL))
+				{
+					node->bound_Done++;
+					return slot;
+				}
+				node->execution_status = INCSORT_LOADFULLSORT;
+				break;
+		}
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitIncrementalSort
+ *
+ *		Creates the run-time state information for the incremental sort
+ *		node produced by the planner and initializes its outer subtree.
+ * ----------------------------------------------------------------
+ */
+IncrementalSortState *
+ExecInitIncrementalSort(IncrementalSort *node, EState *estate, int eflags)
+{
+	IncrementalSortState *incrsortstate;
+	TupleDesc	outerDesc;
+	Oid		   *eqOperators;
+	int			i;
+
+	SO1_printf("ExecInitIncrementalSort: %s\n",
+			   "initializing incremental sort node");
+
+	/*
+	 * Incremental sort can't be used with EXEC_FLAG_BACKWARD or
+	 * EXEC_FLAG_MARK, because the current sort state contains only one sort
+	 * batch rather than the full result set.
+	 */
+	Assert((eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)) == 0);
+
+	/*
+	 * create state structure
+	 */
+	incrsortstate = makeNode(IncrementalSortState);
+	incrsortstate->ss.ps.plan = (Plan *) node;
+	incrsortstate->ss.ps.state = estate;
+	incrsortstate->ss.ps.ExecProcNode = ExecIncrementalSort;
+
+	incrsortstate->bounded = false;
+	incrsortstate->outerNodeDone = false;
+	incrsortstate->bound_Done = 0;
+	incrsortstate->execution_status = INCSORT_LOADFULLSORT;
+	incrsortstate->fullsort_has_large_group = false;
+	incrsortstate->fullsort_state = NULL;
+	incrsortstate->prefixsort_state = NULL;
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * We need an ExprContext to evaluate the presorted keys comparison.
+	 */
+	ExecAssignExprContext(estate, &incrsortstate->ss.ps);
+
+	/*
+	 * initialize child nodes
+	 *
+	 * We shield the child node from the need to support REWIND, BACKWARD, or
+	 * MARK/RESTORE.
+	 */
+	eflags &= ~(EXEC_FLAG_REWIND | EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK);
+
+	outerPlanState(incrsortstate) = ExecInitNode(outerPlan(node), estate, eflags);
+	outerDesc = ExecGetResultType(outerPlanState(incrsortstate));
+
+	/*
+	 * Initialize scan slot and type.
+	 */
+	ExecCreateScanSlotFromOuterPlan(estate, &incrsortstate->ss, &TTSOpsVirtual);
+
+	/*
+	 * Initialize return slot and type. No need to initialize projection info
+	 * because this node doesn't do projections.
+	 */
+	ExecInitResultTupleSlotTL(&incrsortstate->ss.ps, &TTSOpsMinimalTuple);
+	incrsortstate->ss.ps.ps_ProjInfo = NULL;
+
+	incrsortstate->group_pivot = MakeSingleTupleTableSlot(outerDesc,
+														  &TTSOpsMinimalTuple);
+
+	/*
+	 * Precompute the equality test for the presorted columns.  The planner
+	 * only gives us the ordering operators, so look up the matching
+	 * equality operators.
+	 */
+	eqOperators = (Oid *) palloc(node->nPresortedCols * sizeof(Oid));
+	for (i = 0; i < node->nPresortedCols; i++)
+	{
+		Oid			sortop = node->sort.sortOperators[i];
+
+		eqOperators[i] = get_equality_op_for_ordering_op(sortop, NULL);
+		if (!OidIsValid(eqOperators[i]))
+			elog(ERROR, "missing equality operator for ordering operator %u",
+				 sortop);
+	}
+
+	incrsortstate->presorted_eq =
+		execTuplesMatchPrepare(outerDesc,
+							   node->nPresortedCols,
+							   node->sort.sortColIdx,
+							   eqOperators,
+							   node->sort.collations,
+							   &incrsortstate->ss.ps);
+
+	SO1_printf("ExecInitIncrementalSort: %s\n",
+			   "incremental sort node initialized");
+
+	return incrsortstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndIncrementalSort(node)
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndIncrementalSort(IncrementalSortState *node)
+{
+	SO1_printf("ExecEndIncrementalSort: %s\n",
+			   "shutting down incremental sort node");
+
+	/*
+	 * clean out the tuple table
+	 */
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+	/* must drop pointer to sort result tuple */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecDropSingleTupleTableSlot(node->group_pivot);
+
+	/*
+	 * Release tuplesort resources
+	 */
+	if (node->fullsort_state != NULL)
+		tuplesort_end((Tuplesortstate *) node->fullsort_state);
+	node->fullsort_state = NULL;
+	if (node->prefixsort_state != NULL)
+		tuplesort_end((Tuplesortstate *) node->prefixsort_state);
+	node->prefixsort_state = NULL;
+
+	/*
+	 * Free the exprcontext
+	 */
+	ExecFreeExprContext(&node->ss.ps);
+
+	/*
+	 * shut down the subplan
+	 */
+	ExecEndNode(outerPlanState(node));
+
+	SO1_printf("ExecEndIncrementalSort: %s\n",
+			   "incremental sort node shutdown");
+}
+
+void
+ExecReScanIncrementalSort(IncrementalSortState *node)
+{
+	PlanState  *outerPlan = outerPlanState(node);
+
+	/*
+	 * Unlike a plain sort we only ever hold the current batch, so there's
+	 * nothing to rewind: forget our state and re-read the subplan.  The
+	 * tuplesort states are kept, and reset when the next batch begins.
+	 */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->group_pivot);
+
+	node->outerNodeDone = false;
+	node->bound_Done = 0;
+	node->execution_status = INCSORT_LOADFULLSORT;
+	node->fullsort_has_large_group = false;
+
+	/*
+	 * if chgParam of subnode is not null then plan will be re-scanned by
+	 * first ExecProcNode.
+	 */
+	if (outerPlan->chgParam == NULL)
+		ExecReScan(outerPlan);
+}
@@ -20,6 +20,9 @@
  *		ExecEndSeqScan			releases any storage allocated.
  *		ExecReScanSeqScan		rescans the relation
  *
+ *		ExecSeqScanInitBatch	prepares the node for batch mode
+ *		ExecSeqScanBatch		fills a batch with qualifying tuples
+ *
  *		ExecSeqScanEstimate		estimates DSM space needed for parallel scan
  *		ExecSeqScanInitializeDSM initialize DSM for parallel scan
  *		ExecSeqScanReInitializeDSM reinitialize DSM for fresh parallel scan
@@ -29,8 +32,11 @@
 
 #include "access/relscan.h"
 #include "access/tableam.h"
+#include "executor/execBatch.h"
 #include "executor/execdebug.h"
+#include "executor/nodeHash.h"
 #include "executor/nodeSeqscan.h"
+#include "miscadmin.h"
 #include "utils/rel.h"
 
 static TupleTableSlot *SeqNext(SeqScanState *node);
@@ -75,10 +81,18 @@ SeqNext(SeqScanState *node)
 	}
 
 	/*
-	 * get the next tuple from the table
+	 * get the next tuple from the table, skipping any that a Hash Join above
+	 * us has told us can't find a join partner
 	 */
-	if (table_scan_getnextslot(scandesc, direction, slot))
-		return slot;
+	while (table_scan_getnextslot(scandesc, direction, slot))
+	{
+		if (node->runtime_filter == NULL ||
+			!ExecHashRuntimeFilterRejects(node->runtime_filter, slot,
+										  node->ss.ps.ps_ExprContext))
+			return slot;
+
+		InstrCountFiltered3(node, 1);
+	}
 	return NULL;
 }
 
@@ -234,6 +248,87 @@ ExecReScanSeqScan(SeqScanState *node)
 	ExecScanReScan((ScanState *) node);
 }
 
+/* ----------------------------------------------------------------
+ *						Batch Mode Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecSeqScanInitBatch
+ *
+ *		Check whether this scan can hand its tuples to the caller
+ *		in batches, and if so, compile its qual for the batch.
+ *		The caller has already added the columns it needs.
+ * ----------------------------------------------------------------
+ */
+bool
+ExecSeqScanInitBatch(SeqScanState *node, TupleBatch *batch)
+{
+	SeqScan    *plan = (SeqScan *) node->ss.ps.plan;
+
+	/*
+	 * EvalPlanQual rechecks go through ExecScan, which we bypass, so don't
+	 * bother in that case.
+	 */
+	if (node->ss.ps.state->es_epq_active != NULL)
+		return false;
+
+	return ExecInitBatchQual(plan->plan.qual, batch, plan->scanrelid,
+							 &node->batch_qual);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecSeqScanBatch
+ *
+ *		Fill the batch with the next tuples of the scan, and select
+ *		those that pass the qual.  Returns the number of tuples read;
+ *		a batch that isn't full means the scan is exhausted, and the
+ *		caller must not ask for more, as the table scan would start
+ *		over.  A nonzero result may still have no selected rows.
+ *
+ *		This replaces ExecProcNode for a scan in batch mode, so it
+ *		also has to take care of the instrumentation.  The projection
+ *		is skipped altogether: the batch holds scan columns.
+ * ----------------------------------------------------------------
+ */
+int
+ExecSeqScanBatch(SeqScanState *node, TupleBatch *batch)
+{
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	TupleTableSlot *slot;
+
+	if (node->ss.ps.instrument)
+		InstrStartNode(node->ss.ps.instrument);
+
+	batch->nrows = 0;
+	batch->nselected = 0;
+
+	while (batch->nrows < EXEC_BATCH_SIZE)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		slot = SeqNext(node);
+		if (slot == NULL)
+			break;
+
+		ExecBatchStoreSlot(batch, slot);
+	}
+
+	/* SeqNext may have used the per-tuple context for the runtime filter */
+	ResetExprContext(econtext);
+
+	if (batch->nrows > 0)
+	{
+		ExecBatchQual(node->batch_qual, batch);
+		InstrCountFiltered1(node, batch->nrows - batch->nselected);
+	}
+
+	if (node->ss.ps.instrument)
+		InstrStopNode(node->ss.ps.instrument, batch->nselected);
+
+	return batch->nrows;
+}
+
 /* ----------------------------------------------------------------
  *						Parallel Scan Support
  * ----------------------------------------------------------------
@@ -0,0 +1,1033 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeSpatialjoin.c
+ *	  Routines to handle spatial join nodes
+ *
+ * A spatial join matches tuples whose geometric join keys satisfy an overlap
+ * or containment operator.  Such operators can only hold for values whose
+ * bounding boxes overlap, so the join first finds all pairs of tuples with
+ * overlapping bounding boxes, and then rechecks the actual join clauses on
+ * those pairs only.
+ *
+ * The algorithm is the Partition Based Spatial-Merge join (Patel and DeWitt,
+ * SIGMOD '96).  Both inputs are read completely, computing the bounding box
+ * of each tuple's join key.  If everything fits in work_mem, the two sides
+ * are sorted by the lower x coordinate of their bounding boxes and merged
+ * with a plane sweep.  Otherwise the area where the two inputs overlap is
+ * divided into a regular grid of tiles.  Each tuple is written to a temporary
+ * file for every tile its bounding box touches, and the tiles are then joined
+ * one at a time with the same plane sweep.
+ *
+ * A pair of tuples whose bounding boxes both touch several tiles is found in
+ * each of those tiles.  To report every pair only once, a pair is reported
+ * only in the tile containing the lower left corner of the intersection of
+ * the two bounding boxes.
+ *
+ * Tiles at the edge of the grid extend to infinity, so every bounding box
+ * falls into some tile.  If the data is very unevenly distributed, a single
+ * tile can still exceed work_mem; we don't try to split tiles further.
+ *
+ * Only inner joins are supported.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeSpatialjoin.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/htup_details.h"
+#include "executor/executor.h"
+#include "executor/nodeSpatialjoin.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "storage/buffile.h"
+#include "utils/float.h"
+#include "utils/geo_decls.h"
+#include "utils/memutils.h"
+
+
+/*
+ * Maximum number of tiles along each axis.  The number of temporary files
+ * is twice the square of this.
+ */
+#define SPATIALJOIN_MAX_GRID	32
+
+/*
+ * An input tuple, with the bounding box of its join key.
+ */
+typedef struct SpatialJoinEntry
+{
+	BOX			box;
+	MinimalTuple tuple;
+} SpatialJoinEntry;
+
+/*
+ * Per-input state.  While the input is being read, its entries are
+ * collected in memory, and moved to spillFile if they don't fit.  During the
+ * join, the entries array holds the entries of the current tile.
+ */
+typedef struct SpatialJoinSide
+{
+	SpatialJoinEntry *entries;
+	int			nentries;
+	int			maxentries;
+	BufFile    *spillFile;		/* entries that didn't fit in memory */
+	double		ntuples;		/* total number of entries read */
+	double		nbytes;			/* total size of entries read */
+	bool		haveExtent;		/* is extent valid? */
+	BOX			extent;			/* bounding box of all finite entries */
+	BufFile   **tileFiles;		/* per-tile files, or NULL if one tile */
+} SpatialJoinSide;
+
+typedef struct SpatialJoinTableData
+{
+	MemoryContext tableCxt;		/* context holding all of the below */
+	MemoryContext tileCxt;		/* context for the entries of current tile */
+	Size		spaceUsed;		/* memory used by in-memory entries */
+	Size		spaceAllowed;	/* upper limit for spaceUsed */
+
+	SpatialJoinSide outer;
+	SpatialJoinSide inner;
+
+	int			gridsize;		/* number of tiles along each axis */
+	BOX			grid;			/* area divided into tiles */
+	int			curtile;		/* tile being joined */
+
+	/* State of the plane sweep within the current tile */
+	int			outerpos;		/* next outer entry to use as anchor */
+	int			innerpos;		/* next inner entry to use as anchor */
+	bool		scanning;		/* are we scanning for matches of an anchor? */
+	bool		anchorIsOuter;	/* is the anchor an outer entry? */
+	int			scanpos;		/* next entry of the other side to check */
+} SpatialJoinTableData;
+
+static SpatialJoinTable ExecSpatialJoinTableCreate(void);
+static void ExecSpatialJoinTableDestroy(SpatialJoinTable table);
+static void ExecSpatialJoinReadInput(SpatialJoinState *node,
+									 SpatialJoinTable table, bool outer);
+static void ExecSpatialJoinPartition(SpatialJoinTable table,
+									 SpatialJoinSide *side);
+static bool ExecSpatialJoinNextTile(SpatialJoinTable table);
+static bool ExecSpatialJoinNextPair(SpatialJoinTable table,
+									SpatialJoinEntry **outer,
+									SpatialJoinEntry **inner);
+static void ExecSpatialJoinSaveEntry(SpatialJoinEntry *entry,
+									 BufFile **fileptr);
+static bool ExecSpatialJoinGetSavedEntry(BufFile *file,
+										 SpatialJoinEntry *entry);
+static int	ExecSpatialJoinTileCell(float8 val, float8 low, float8 high,
+									int n);
+static int	spatial_entry_cmp(const void *a, const void *b);
+
+
+/* ----------------------------------------------------------------
+ *		ExecSpatialJoin
+ *
+ *		Return the next tuple of the join, or NULL when done.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecSpatialJoin(PlanState *pstate)
+{
+	SpatialJoinState *node = castNode(SpatialJoinState, pstate);
+	ExprState  *joinqual = node->js.joinqual;
+	ExprState  *otherqual = node->js.ps.qual;
+	ExprContext *econtext = node->js.ps.ps_ExprContext;
+	SpatialJoinTable table;
+	SpatialJoinEntry *outerEntry;
+	SpatialJoinEntry *innerEntry;
+
+	CHECK_FOR_INTERRUPTS();
+
+	/*
+	 * On the first call, read both inputs and prepare the first tile.
+	 */
+	if (node->sj_Table == NULL)
+	{
+		table = ExecSpatialJoinTableCreate();
+		node->sj_Table = table;
+
+		ExecSpatialJoinReadInput(node, table, false);
+
+		/*
+		 * If the inner relation is empty, there can be no matches, so don't
+		 * bother to run the outer plan.
+		 */
+		if (table->inner.ntuples > 0)
+			ExecSpatialJoinReadInput(node, table, true);
+
+		if (table->inner.ntuples == 0 || table->outer.ntuples == 0)
+			return NULL;
+
+		if (table->outer.spillFile == NULL && table->inner.spillFile == NULL)
+		{
+			/* Everything fits in memory, join it as a single tile */
+			table->gridsize = 1;
+			table->curtile = 0;
+			qsort(table->outer.entries, table->outer.nentries,
+				  sizeof(SpatialJoinEntry), spatial_entry_cmp);
+			qsort(table->inner.entries, table->inner.nentries,
+				  sizeof(SpatialJoinEntry), spatial_entry_cmp);
+		}
+		else
+		{
+			SpatialJoinSide *outer = &table->outer;
+			SpatialJoinSide *inner = &table->inner;
+			int			gridsize;
+
+			/*
+			 * Divide the area where the finite bounding boxes of the two
+			 * inputs overlap into tiles.  If there is no such area, the grid
+			 * degenerates and everything lands in the same tile, but then
+			 * there isn't going to be much to join anyway.
+			 */
+			gridsize = ExecChooseSpatialJoinGrid(outer->ntuples,
+												 (int) (outer->nbytes / outer->ntuples -
+														sizeof(SpatialJoinEntry)),
+												 inner->ntuples,
+												 (int) (inner->nbytes / inner->ntuples -
+														sizeof(SpatialJoinEntry)));
+			table->gridsize = Max(gridsize, 2);
+			if (outer->haveExtent && inner->haveExtent)
+			{
+				table->grid.low.x = Max(outer->extent.low.x, inner->extent.low.x);
+				table->grid.low.y = Max(outer->extent.low.y, inner->extent.low.y);
+				table->grid.high.x = Min(outer->extent.high.x, inner->extent.high.x);
+				table->grid.high.y = Min(outer->extent.high.y, inner->extent.high.y);
+			}
+			else
+			{
+				table->grid.low.x = table->grid.high.x = 0.0;
+				table->grid.low.y = table->grid.high.y = 0.0;
+			}
+
+			ExecSpatialJoinPartition(table, outer);
+			ExecSpatialJoinPartition(table, inner);
+
+			table->curtile = -1;
+			if (!ExecSpatialJoinNextTile(table))
+				return NULL;
+		}
+
+		table->outerpos = 0;
+		table->innerpos = 0;
+		table->scanning = false;
+	}
+
+	table = node->sj_Table;
+
+	for (;;)
+	{
+		/*
+		 * Find the next pair of tuples with overlapping bounding boxes,
+		 * moving on to the next tile when the current one is exhausted.
+		 */
+		if (!ExecSpatialJoinNextPair(table, &outerEntry, &innerEntry))
+		{
+			if (!ExecSpatialJoinNextTile(table))
+				return NULL;
+			continue;
+		}
+
+		ExecStoreMinimalTuple(outerEntry->tuple, node->sj_OuterTupleSlot,
+							  false);
+		ExecStoreMinimalTuple(innerEntry->tuple, node->sj_InnerTupleSlot,
+							  false);
+		econtext->ecxt_outertuple = node->sj_OuterTupleSlot;
+		econtext->ecxt_innertuple = node->sj_InnerTupleSlot;
+		ResetExprContext(econtext);
+
+		/*
+		 * Recheck the spatial clauses on the actual values, then test the
+		 * other join quals.
+		 *
+		 * If we pass the qual, then have ExecProject form the projection,
+		 * store it in the tuple table, and return the slot.
+		 */
+		if (!ExecQual(node->sj_SpatialClauses, econtext))
+			continue;
+
+		if (joinqual == NULL || ExecQual(joinqual, econtext))
+		{
+			if (otherqual == NULL || ExecQual(otherqual, econtext))
+				return ExecProject(node->js.ps.ps_ProjInfo);
+			else
+				InstrCountFiltered2(node, 1);
+		}
+		else
+			InstrCountFiltered1(node, 1);
+	}
+}
+
+/*
+ * ExecChooseSpatialJoinGrid
+ *		Compute the number of tiles along each axis needed to join
+ *		the given inputs within work_mem.
+ *
+ * This is exported so that the planner's costsize.c can use it.
+ */
+int
+ExecChooseSpatialJoinGrid(double outer_rows, int outer_width,
+						  double inner_rows, int inner_width)
+{
+	double		outer_bytes;
+	double		inner_bytes;
+	double		space_allowed = work_mem * 1024.0;
+	double		gridsize;
+
+	outer_bytes = outer_rows * (sizeof(SpatialJoinEntry) +
+								MAXALIGN(SizeofMinimalTupleHeader) +
+								MAXALIGN(outer_width));
+	inner_bytes = inner_rows * (sizeof(SpatialJoinEntry) +
+								MAXALIGN(SizeofMinimalTupleHeader) +
+								MAXALIGN(inner_width));
+
+	if (outer_bytes + inner_bytes <= space_allowed)
+		return 1;
+
+	/*
+	 * Bounding boxes that cross tile boundaries are copied to several tiles,
+	 * and the data is hardly ever evenly distributed, so aim for tiles that
+	 * are half full on average.
+	 */
+	gridsize = ceil(sqrt(2.0 * (outer_bytes + inner_bytes) / space_allowed));
+
+	return (int) Min(gridsize, SPATIALJOIN_MAX_GRID);
+}
+
+/*
+ * Create an empty table for the join.
+ */
+static SpatialJoinTable
+ExecSpatialJoinTableCreate(void)
+{
+	MemoryContext tableCxt;
+	SpatialJoinTable table;
+
+	tableCxt = AllocSetContextCreate(CurrentMemoryContext,
+									 "SpatialJoinTable",
+									 ALLOCSET_DEFAULT_SIZES);
+	table = (SpatialJoinTable) MemoryContextAllocZero(tableCxt,
+													  sizeof(SpatialJoinTableData));
+	table->tableCxt = tableCxt;
+	table->tileCxt = AllocSetContextCreate(tableCxt,
+										   "SpatialJoinTile",
+										   ALLOCSET_DEFAULT_SIZES);
+	table->spaceAllowed = work_mem * 1024L;
+	table->gridsize = 1;
+
+	return table;
+}
+
+/*
+ * Release all memory and temporary files of a table.
+ */
+static void
+ExecSpatialJoinTableDestroy(SpatialJoinTable table)
+{
+	SpatialJoinSide *sides[2] = {&table->outer, &table->inner};
+	int			ntiles = table->gridsize * table->gridsize;
+	int			i;
+	int			tile;
+
+	for (i = 0; i < 2; i++)
+	{
+		SpatialJoinSide *side = sides[i];
+
+		if (side->spillFile)
+			BufFileClose(side->spillFile);
+		if (side->tileFiles)
+		{
+			for (tile = 0; tile < ntiles; tile++)
+			{
+				if (side->tileFiles[tile])
+					BufFileClose(side->tileFiles[tile]);
+			}
+		}
+	}
+
+	MemoryContextDelete(table->tableCxt);
+}
+
+/*
+ * Read all tuples from the outer or inner input, and compute the bounding
+ * boxes of their join keys.
+ *
+ * Tuples with a null key can't match anything and are skipped.  A key with
+ * NaN coordinates has no meaningful bounding box, yet some operators still
+ * consider it to match, for example a polygon contains the NaN point
+ * according to @>.  Such keys are given a bounding box covering the whole
+ * plane, so that they are checked against everything.
+ */
+static void
+ExecSpatialJoinReadInput(SpatialJoinState *node, SpatialJoinTable table,
+						 bool outer)
+{
+	PlanState  *input = outer ? outerPlanState(node) : innerPlanState(node);
+	SpatialJoinSide *side = outer ? &table->outer : &table->inner;
+	ExprState  *keystate = outer ? node->sj_OuterKey : node->sj_InnerKey;
+	Oid			keytype = outer ? node->sj_OuterKeyType : node->sj_InnerKeyType;
+	ExprContext *econtext = node->js.ps.ps_ExprContext;
+	MemoryContext oldcxt;
+
+	side->maxentries = 1024;
+	side->entries = (SpatialJoinEntry *)
+		MemoryContextAlloc(table->tableCxt,
+						   side->maxentries * sizeof(SpatialJoinEntry));
+
+	for (;;)
+	{
+		TupleTableSlot *slot = ExecProcNode(input);
+		SpatialJoinEntry entry;
+		Datum		value;
+		bool		isnull;
+		Size		entrysize;
+
+		if (TupIsNull(slot))
+			break;
+
+		ResetExprContext(econtext);
+		if (outer)
+			econtext->ecxt_outertuple = slot;
+		else
+			econtext->ecxt_innertuple = slot;
+
+		oldcxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+		value = ExecEvalExpr(keystate, econtext, &isnull);
+		if (!isnull && !geo_datum_bbox(keytype, value, &entry.box))
+			elog(ERROR, "unexpected geometric type: %u", keytype);
+		MemoryContextSwitchTo(oldcxt);
+
+		if (isnull)
+			continue;
+
+		if (isnan(entry.box.low.x) || isnan(entry.box.low.y) ||
+			isnan(entry.box.high.x) || isnan(entry.box.high.y))
+		{
+			entry.box.low.x = entry.box.low.y = -get_float8_infinity();
+			entry.box.high.x = entry.box.high.y = get_float8_infinity();
+		}
+		else
+		{
+			/*
+			 * The geometric operators compare coordinates with a tolerance
+			 * of EPSILON, so widen the box to match.
+			 */
+			entry.box.low.x -= EPSILON;
+			entry.box.low.y -= EPSILON;
+			entry.box.high.x += EPSILON;
+			entry.box.high.y += EPSILON;
+		}
+
+		if (!isinf(entry.box.low.x) && !isinf(entry.box.low.y) &&
+			!isinf(entry.box.high.x) && !isinf(entry.box.high.y))
+		{
+			if (!side->haveExtent)
+			{
+				side->extent = entry.box;
+				side->haveExtent = true;
+			}
+			else
+			{
+				side->extent.low.x = Min(side->extent.low.x, entry.box.low.x);
+				side->extent.low.y = Min(side->extent.low.y, entry.box.low.y);
+				side->extent.high.x = Max(side->extent.high.x, entry.box.high.x);
+				side->extent.high.y = Max(side->extent.high.y, entry.box.high.y);
+			}
+		}
+
+		oldcxt = MemoryContextSwitchTo(table->tableCxt);
+		entry.tuple = ExecCopySlotMinimalTuple(slot);
+		MemoryContextSwitchTo(oldcxt);
+		entrysize = sizeof(SpatialJoinEntry) + entry.tuple->t_len;
+		side->ntuples += 1;
+		side->nbytes += entrysize;
+
+		if (side->spillFile)
+		{
+			/* Already spilling, so this goes to the file too */
+			ExecSpatialJoinSaveEntry(&entry, &side->spillFile);
+			heap_free_minimal_tuple(entry.tuple);
+			continue;
+		}
+
+		if (table->spaceUsed + entrysize > table->spaceAllowed)
+		{
+			int			i;
+
+			/*
+			 * Out of memory.  Move what we have of this side to its spill
+			 * file, and write the rest of it there as well.
+			 */
+			for (i = 0; i < side->nentries; i++)
+			{
+				ExecSpatialJoinSaveEntry(&side->entries[i], &side->spillFile);
+				table->spaceUsed -= sizeof(SpatialJoinEntry) +
+					side->entries[i].tuple->t_len;
+				heap_free_minimal_tuple(side->entries[i].tuple);
+			}
+			side->nentries = 0;
+
+			ExecSpatialJoinSaveEntry(&entry, &side->spillFile);
+			heap_free_minimal_tuple(entry.tuple);
+			continue;
+		}
+
+		if (side->nentries >= side->maxentries)
+		{
+			side->maxentries *= 2;
+			side->entries = (SpatialJoinEntry *)
+				repalloc_huge(side->entries,
+							  side->maxentries * sizeof(SpatialJoinEntry));
+		}
+
+		side->entries[side->nentries++] = entry;
+		table->spaceUsed += entrysize;
+	}
+}
+
+/*
+ * Distribute the entries of one input into the tile files.
+ */
+static void
+ExecSpatialJoinPartition(SpatialJoinTable table, SpatialJoinSide *side)
+{
+	int			ntiles = table->gridsize * table->gridsize;
+	int			i;
+
+	side->tileFiles = (BufFile **)
+		MemoryContextAllocZero(table->tableCxt, ntiles * sizeof(BufFile *));
+
+	for (i = 0;; i++)
+	{
+		SpatialJoinEntry entry;
+		int			lowx,
+					lowy,
+					highx,
+					highy;
+		int			x,
+					y;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (i < side->nentries)
+			entry = side->entries[i];
+		else if (side->spillFile == NULL)
+			break;
+		else
+		{
+			if (i == side->nentries &&
+				BufFileSeek(side->spillFile, 0, 0L, SEEK_SET))
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not rewind spatial join temporary file: %m")));
+			if (!ExecSpatialJoinGetSavedEntry(side->spillFile, &entry))
+				break;
+		}
+
+		lowx = ExecSpatialJoinTileCell(entry.box.low.x, table->grid.low.x,
+									   table->grid.high.x, table->gridsize);
+		lowy = ExecSpatialJoinTileCell(entry.box.low.y, table->grid.low.y,
+									   table->grid.high.y, table->gridsize);
+		highx = ExecSpatialJoinTileCell(entry.box.high.x, table->grid.low.x,
+										table->grid.high.x, table->gridsize);
+		highy = ExecSpatialJoinTileCell(entry.box.high.y, table->grid.low.y,
+										table->grid.high.y, table->gridsize);
+
+		for (y = lowy; y <= highy; y++)
+			for (x = lowx; x <= highx; x++)
+				ExecSpatialJoinSaveEntry(&entry,
+										 &side->tileFiles[y * table->gridsize + x]);
+
+		heap_free_minimal_tuple(entry.tuple);
+	}
+
+	if (side->spillFile)
+	{
+		BufFileClose(side->spillFile);
+		side->spillFile = NULL;
+	}
+	pfree(side->entries);
+	side->entries = NULL;
+	side->nentries = 0;
+	table->spaceUsed = 0;
+}
+
+/*
+ * Advance to the next tile that has entries on both sides, and load its
+ * entries into memory.  Returns false when there are no more tiles.
+ */
+static bool
+ExecSpatialJoinNextTile(SpatialJoinTable table)
+{
+	int			ntiles = table->gridsize * table->gridsize;
+
+	if (table->gridsize == 1)
+		return false;
+
+	while (++table->curtile < ntiles)
+	{
+		SpatialJoinSide *sides[2] = {&table->outer, &table->inner};
+		int			tile = table->curtile;
+		int			i;
+
+		MemoryContextReset(table->tileCxt);
+		table->outer.nentries = 0;
+		table->inner.nentries = 0;
+
+		/* A tile with entries on one side only can't produce any pairs */
+		if (table->outer.tileFiles[tile] == NULL ||
+			table->inner.tileFiles[tile] == NULL)
+		{
+			for (i = 0; i < 2; i++)
+			{
+				if (sides[i]->tileFiles[tile])
+				{
+					BufFileClose(sides[i]->tileFiles[tile]);
+					sides[i]->tileFiles[tile] = NULL;
+				}
+			}
+			continue;
+		}
+
+		for (i = 0; i < 2; i++)
+		{
+			SpatialJoinSide *side = sides[i];
+			BufFile    *file = side->tileFiles[tile];
+			MemoryContext oldcxt;
+
+			if (BufFileSeek(file, 0, 0L, SEEK_SET))
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not rewind spatial join temporary file: %m")));
+
+			oldcxt = MemoryContextSwitchTo(table->tileCxt);
+			side->maxentries = 1024;
+			side->entries = (SpatialJoinEntry *)
+				palloc(side->maxentries * sizeof(SpatialJoinEntry));
+			for (;;)
+			{
+				if (side->nentries >= side->maxentries)
+				{
+					side->maxentries *= 2;
+					side->entries = (SpatialJoinEntry *)
+						repalloc_huge(side->entries,
+									  side->maxentries * sizeof(SpatialJoinEntry));
+				}
+				if (!ExecSpatialJoinGetSavedEntry(file,
+												  &side->entries[side->nentries]))
+					break;
+				side->nentries++;
+			}
+			MemoryContextSwitchTo(oldcxt);
+
+			BufFileClose(file);
+			side->tileFiles[tile] = NULL;
+
+			qsort(side->entries, side->nentries, sizeof(SpatialJoinEntry),
+				  spatial_entry_cmp);
+		}
+
+		table->outerpos = 0;
+		table->innerpos = 0;
+		table->scanning = false;
+		return true;
+	}
+
+	/* Release the last tile */
+	MemoryContextReset(table->tileCxt);
+	table->outer.nentries = 0;
+	table->inner.nentries = 0;
+	return false;
+}
+
+/*
+ * Find the next pair of entries in the current tile whose bounding boxes
+ * overlap.  Returns false when the tile is exhausted.
+ *
+ * Both sides are sorted by the lower x coordinate.  We repeatedly take the
+ * entry with the smallest lower x coordinate that we haven't used yet as the
+ * anchor, and scan the other side from its current position for entries
+ * that start before the anchor ends.  Each of those overlaps with the anchor
+ * along the x axis, so only the y axis remains to be checked.
+ */
+static bool
+ExecSpatialJoinNextPair(SpatialJoinTable table,
+						SpatialJoinEntry **outer,
+						SpatialJoinEntry **inner)
+{
+	SpatialJoinSide *outerSide = &table->outer;
+	SpatialJoinSide *innerSide = &table->inner;
+
+	for (;;)
+	{
+		SpatialJoinEntry *anchor;
+		SpatialJoinEntry *other;
+		int			nother;
+
+		if (!table->scanning)
+		{
+			if (table->outerpos >= outerSide->nentries ||
+				table->innerpos >= innerSide->nentries)
+				return false;
+
+			table->anchorIsOuter =
+				(outerSide->entries[table->outerpos].box.low.x <=
+				 innerSide->entries[table->innerpos].box.low.x);
+			table->scanpos = table->anchorIsOuter ?
+				table->innerpos : table->outerpos;
+			table->scanning = true;
+		}
+
+		if (table->anchorIsOuter)
+		{
+			anchor = &outerSide->entries[table->outerpos];
+			other = innerSide->entries;
+			nother = innerSide->nentries;
+		}
+		else
+		{
+			anchor = &innerSide->entries[table->innerpos];
+			other = outerSide->entries;
+			nother = outerSide->nentries;
+		}
+
+		while (table->scanpos < nother &&
+			   other[table->scanpos].box.low.x <= anchor->box.high.x)
+		{
+			SpatialJoinEntry *candidate = &other[table->scanpos++];
+
+			if (candidate->box.low.y > anchor->box.high.y ||
+				anchor->box.low.y > candidate->box.high.y)
+				continue;
+
+			/*
+			 * If the boxes touch several tiles, report the pair only in the
+			 * tile containing the lower left corner of their intersection.
+			 */
+			if (table->gridsize > 1)
+			{
+				float8		refx = Max(anchor->box.low.x, candidate->box.low.x);
+				float8		refy = Max(anchor->box.low.y, candidate->box.low.y);
+				int			tile;
+
+				tile = ExecSpatialJoinTileCell(refy, table->grid.low.y,
+											   table->grid.high.y,
+											   table->gridsize) * table->gridsize +
+					ExecSpatialJoinTileCell(refx, table->grid.low.x,
+											table->grid.high.x,
+											table->gridsize);
+				if (tile != table->curtile)
+					continue;
+			}
+
+			if (table->anchorIsOuter)
+			{
+				*outer = anchor;
+				*inner = candidate;
+			}
+			else
+			{
+				*outer = candidate;
+				*inner = anchor;
+			}
+			return true;
+		}
+
+		/* No more matches for this anchor */
+		table->scanning = false;
+		if (table->anchorIsOuter)
+			table->outerpos++;
+		else
+			table->innerpos++;
+	}
+}
+
+/*
+ * ExecSpatialJoinSaveEntry
+ *		save an entry to a temporary file.
+ *
+ * The data recorded in the file for each entry is its bounding box, then
+ * the tuple in MinimalTuple format.
+ *
+ * Note: it is important always to call this in the regular executor
+ * context, not in a shorter-lived context; else the temp file buffers
+ * will get messed up.
+ */
+static void
+ExecSpatialJoinSaveEntry(SpatialJoinEntry *entry, BufFile **fileptr)
+{
+	BufFile    *file = *fileptr;
+	size_t		written;
+
+	if (file == NULL)
+	{
+		/* First write to this file, so open it. */
+		file = BufFileCreateTemp(false);
+		*fileptr = file;
+	}
+
+	written = BufFileWrite(file, (void *) &entry->box, sizeof(BOX));
+	if (written != sizeof(BOX))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to spatial join temporary file: %m")));
+
+	written = BufFileWrite(file, (void *) entry->tuple, entry->tuple->t_len);
+	if (written != entry->tuple->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to spatial join temporary file: %m")));
+}
+
+/*
+ * ExecSpatialJoinGetSavedEntry
+ *		read the next entry from a temporary file.  Return false if no more.
+ *
+ * The tuple is palloc'd in the current memory context.
+ */
+static bool
+ExecSpatialJoinGetSavedEntry(BufFile *file, SpatialJoinEntry *entry)
+{
+	size_t		nread;
+	uint32		t_len;
+	MinimalTuple tuple;
+
+	CHECK_FOR_INTERRUPTS();
+
+	nread = BufFileRead(file, (void *) &entry->box, sizeof(BOX));
+	if (nread == 0)				/* end of file */
+		return false;
+	if (nread != sizeof(BOX))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from spatial join temporary file: %m")));
+
+	nread = BufFileRead(file, (void *) &t_len, sizeof(uint32));
+	if (nread != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from spatial join temporary file: %m")));
+	tuple = (MinimalTuple) palloc(t_len);
+	tuple->t_len = t_len;
+	nread = BufFileRead(file,
+						(void *) ((char *) tuple + sizeof(uint32)),
+						t_len - sizeof(uint32));
+	if (nread != t_len - sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from spatial join temporary file: %m")));
+	entry->tuple = tuple;
+	return true;
+}
+
+/*
+ * Return the tile number along one axis of "val", in a grid of n tiles
+ * evenly dividing [low, high].  Values outside the range belong to the
+ * first or last tile.
+ */
+static int
+ExecSpatialJoinTileCell(float8 val, float8 low, float8 high, int n)
+{
+	float8		cell;
+
+	if (high <= low || val <= low)
+		return 0;
+	if (val >= high)
+		return n - 1;
+
+	cell = (val - low) / (high - low) * n;
+	return Min((int) cell, n - 1);
+}
+
+/*
+ * qsort comparator, to sort entries by the lower x coordinate of their
+ * bounding boxes
+ */
+static int
+spatial_entry_cmp(const void *a, const void *b)
+{
+	const SpatialJoinEntry *ea = (const SpatialJoinEntry *) a;
+	const SpatialJoinEntry *eb = (const SpatialJoinEntry *) b;
+
+	if (ea->box.low.x < eb->box.low.x)
+		return -1;
+	if (ea->box.low.x > eb->box.low.x)
+		return 1;
+	return 0;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitSpatialJoin
+ *
+ *		Init routine for SpatialJoin node.
+ * ----------------------------------------------------------------
+ */
+SpatialJoinState *
+ExecInitSpatialJoin(SpatialJoin *node, EState *estate, int eflags)
+{
+	SpatialJoinState *sjstate;
+	OpExpr	   *clause;
+	Expr	   *outerkey;
+	Expr	   *innerkey;
+	TupleDesc	outerDesc,
+				innerDesc;
+
+	/* check for unsupported flags */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	/*
+	 * create state structure
+	 */
+	sjstate = makeNode(SpatialJoinState);
+	sjstate->js.ps.plan = (Plan *) node;
+	sjstate->js.ps.state = estate;
+	sjstate->js.ps.ExecProcNode = ExecSpatialJoin;
+	sjstate->js.jointype = node->join.jointype;
+
+	if (node->join.jointype != JOIN_INNER)
+		elog(ERROR, "unsupported join type %d for spatial join",
+			 (int) node->join.jointype);
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * create expression context for node
+	 */
+	ExecAssignExprContext(estate, &sjstate->js.ps);
+
+	/*
+	 * initialize child nodes
+	 *
+	 * Both inputs are read only once per scan, so they don't need to support
+	 * rewinding.
+	 */
+	eflags &= ~EXEC_FLAG_REWIND;
+	outerPlanState(sjstate) = ExecInitNode(outerPlan(node), estate, eflags);
+	outerDesc = ExecGetResultType(outerPlanState(sjstate));
+	innerPlanState(sjstate) = ExecInitNode(innerPlan(node), estate, eflags);
+	innerDesc = ExecGetResultType(innerPlanState(sjstate));
+
+	/*
+	 * The bounding boxes are computed from the arguments of the first spatial
+	 * clause.  The planner has arranged for the outer one to be on the left.
+	 * These are evaluated on the tuples returned by the child nodes, so they
+	 * must be compiled before the slot types are overridden below.
+	 */
+	clause = linitial_node(OpExpr, node->spatialclauses);
+	outerkey = (Expr *) linitial(clause->args);
+	innerkey = (Expr *) lsecond(clause->args);
+	sjstate->sj_OuterKey = ExecInitExpr(outerkey, (PlanState *) sjstate);
+	sjstate->sj_InnerKey = ExecInitExpr(innerkey, (PlanState *) sjstate);
+	sjstate->sj_OuterKeyType = exprType((Node *) outerkey);
+	sjstate->sj_InnerKeyType = exprType((Node *) innerkey);
+
+	/*
+	 * Everything else is evaluated on copies of the input tuples, kept as
+	 * minimal tuples in the table.
+	 */
+	sjstate->js.ps.outerops = &TTSOpsMinimalTuple;
+	sjstate->js.ps.outeropsfixed = true;
+	sjstate->js.ps.outeropsset = true;
+	sjstate->js.ps.innerops = &TTSOpsMinimalTuple;
+	sjstate->js.ps.inneropsfixed = true;
+	sjstate->js.ps.inneropsset = true;
+
+	/*
+	 * Initialize result slot, type and projection.
+	 */
+	ExecInitResultTupleSlotTL(&sjstate->js.ps, &TTSOpsVirtual);
+	ExecAssignProjectionInfo(&sjstate->js.ps, NULL);
+
+	/*
+	 * tuple table initialization
+	 */
+	sjstate->sj_OuterTupleSlot = ExecInitExtraTupleSlot(estate, outerDesc,
+														&TTSOpsMinimalTuple);
+	sjstate->sj_InnerTupleSlot = ExecInitExtraTupleSlot(estate, innerDesc,
+														&TTSOpsMinimalTuple);
+
+	/*
+	 * initialize child expressions
+	 */
+	sjstate->js.ps.qual =
+		ExecInitQual(node->join.plan.qual, (PlanState *) sjstate);
+	sjstate->js.joinqual =
+		ExecInitQual(node->join.joinqual, (PlanState *) sjstate);
+	sjstate->sj_SpatialClauses =
+		ExecInitQual(node->spatialclauses, (PlanState *) sjstate);
+
+	sjstate->sj_Table = NULL;
+
+	return sjstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndSpatialJoin
+ *
+ *		clean up routine for SpatialJoin node
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndSpatialJoin(SpatialJoinState *node)
+{
+	/*
+	 * Free the table
+	 */
+	if (node->sj_Table)
+	{
+		ExecSpatialJoinTableDestroy(node->sj_Table);
+		node->sj_Table = NULL;
+	}
+
+	/*
+	 * Free the exprcontext
+	 */
+	ExecFreeExprContext(&node->js.ps);
+
+	/*
+	 * clean out the tuple table
+	 */
+	ExecClearTuple(node->js.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->sj_OuterTupleSlot);
+	ExecClearTuple(node->sj_InnerTupleSlot);
+
+	/*
+	 * clean up subtrees
+	 */
+	ExecEndNode(outerPlanState(node));
+	ExecEndNode(innerPlanState(node));
+}
+
+void
+ExecReScanSpatialJoin(SpatialJoinState *node)
+{
+	/*
+	 * The tile files are consumed as the join proceeds, so we always have to
+	 * start over.
+	 */
+	ExecClearTuple(node->sj_OuterTupleSlot);
+	ExecClearTuple(node->sj_InnerTupleSlot);
+	if (node->sj_Table)
+	{
+		ExecSpatialJoinTableDestroy(node->sj_Table);
+		node->sj_Table = NULL;
+	}
+
+	/*
+	 * if chgParam of subnode is not null then plan will be re-scanned by
+	 * first ExecProcNode.
+	 */
+	if (node->js.ps.lefttree->chgParam == NULL)
+		ExecReScan(node->js.ps.lefttree);
+	if (node->js.ps.righttree->chgParam == NULL)
+		ExecReScan(node->js.ps.righttree);
+}
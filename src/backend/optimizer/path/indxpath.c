@@ -1052,11 +1052,14 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 
 		/*
 		 * If appropriate, consider parallel index scan.  We don't allow
-		 * parallel index scan for bitmap index scans.
+		 * parallel index scan for bitmap index scans.  Nor do we allow it for
+		 * ordering operators: the participants of a parallel scan each see
+		 * only part of the index, so none of them could return tuples in
+		 * distance order.
 		 */
 		if (index->amcanparallel &&
 			rel->consider_parallel && outer_relids == NULL &&
-			scantype != ST_BITMAPSCAN)
+			scantype != ST_BITMAPSCAN && orderbyclauses == NIL)
 		{
 			ipath = create_index_path(root, index,
 									  index_clauses,
@@ -2073,6 +2076,7 @@ adjust_rowcount_for_semijoins(PlannerInfo *root,
 			nunique = estimate_num_groups(root,
 										  sjinfo->semi_rhs_exprs,
 										  nraw,
+										  NULL,
 										  NULL);
 			if (rowcount > nunique)
 				rowcount = nunique;
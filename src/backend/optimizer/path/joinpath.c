@@ -18,10 +18,15 @@
 
 #include "executor/executor.h"
 #include "foreign/fdwapi.h"
+#include "nodes/nodeFuncs.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
+#include "optimizer/optimizer.h"
 #include "optimizer/planmain.h"
+#include "utils/geo_decls.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
 
 /* Hook for plugins to get control in add_paths_to_joinrel() */
 set_join_pathlist_hook_type set_join_pathlist_hook = NULL;
@@ -71,6 +76,9 @@ static void consider_parallel_mergejoin(PlannerInfo *root,
 static void hash_inner_and_outer(PlannerInfo *root, RelOptInfo *joinrel,
 								 RelOptInfo *outerrel, RelOptInfo *innerrel,
 								 JoinType jointype, JoinPathExtraData *extra);
+static void spatial_inner_and_outer(PlannerInfo *root, RelOptInfo *joinrel,
+									RelOptInfo *outerrel, RelOptInfo *innerrel,
+									JoinType jointype, JoinPathExtraData *extra);
 static List *select_mergejoin_clauses(PlannerInfo *root,
 									  RelOptInfo *joinrel,
 									  RelOptInfo *outerrel,
@@ -308,7 +316,16 @@ add_paths_to_joinrel(PlannerInfo *root,
 							 jointype, &extra);
 
 	/*
-	 * 5. If inner and outer relations are foreign tables (or joins) belonging
+	 * 5. Consider paths where both outer and inner relations are partitioned
+	 * spatially and joined on overlapping bounding boxes.  Only inner joins
+	 * are supported.
+	 */
+	if (enable_spatialjoin && jointype == JOIN_INNER)
+		spatial_inner_and_outer(root, joinrel, outerrel, innerrel,
+								jointype, &extra);
+
+	/*
+	 * 6. If inner and outer relations are foreign tables (or joins) belonging
 	 * to the same server and assigned to the same user to check access
 	 * permissions as, give the FDW a chance to push down joins.
 	 */
@@ -319,7 +336,7 @@ add_paths_to_joinrel(PlannerInfo *root,
 												 jointype, &extra);
 
 	/*
-	 * 6. Finally, give extensions a chance to manipulate the path list.
+	 * 7. Finally, give extensions a chance to manipulate the path list.
 	 */
 	if (set_join_pathlist_hook)
 		set_join_pathlist_hook(root, joinrel, outerrel, innerrel,
@@ -866,6 +883,187 @@ clause_sides_match_join(RestrictInfo *rinfo, RelOptInfo *outerrel,
 	return false;				/* no good for these input relations */
 }
 
+/*
+ * paraminfo_get_equal_hashops
+ *		Determine if param_info and innerrel's lateral_vars can be hashed.
+ *		Returns true if hashing is possible, otherwise returns false.
+ *
+ * Additionally we also collect the outer exprs and the hash operators for
+ * each parameter to innerrel.  These are set in 'param_exprs' and
+ * 'operators' when we return true.
+ *
+ * The hash operator is the equality operator of the outer expression's own
+ * type, since the cache compares one set of outer values against another;
+ * the operator of the join clause itself may be a cross-type one.
+ *
+ * Values which the type's equality operator considers equal are not always
+ * interchangeable, e.g. numeric 1.0 and 1.00, or float8 0 and -0.  That does
+ * not matter when the parameter is only compared by a hashable equality
+ * operator, but a lateral Var or a non-hashjoinable join clause could see
+ * the difference.  In those cases we set '*binary_mode' so that the cache
+ * compares its keys by their binary images instead.
+ */
+static bool
+paraminfo_get_equal_hashops(PlannerInfo *root, ParamPathInfo *param_info,
+							RelOptInfo *outerrel, RelOptInfo *innerrel,
+							List **param_exprs, List **operators,
+							bool *binary_mode)
+{
+	List	   *exprs = NIL;
+	ListCell   *lc;
+
+	*param_exprs = NIL;
+	*operators = NIL;
+	*binary_mode = false;
+
+	if (param_info != NULL)
+	{
+		foreach(lc, param_info->ppi_clauses)
+		{
+			RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+			OpExpr	   *opexpr = (OpExpr *) rinfo->clause;
+
+			/* We only know how to find the outer side of binary operators */
+			if (!is_opclause(opexpr) || list_length(opexpr->args) != 2 ||
+				!clause_sides_match_join(rinfo, outerrel, innerrel))
+				return false;
+
+			/*
+			 * Anything other than a hashable equality could distinguish
+			 * between values that the cache's hash equality treats as equal.
+			 */
+			if (!OidIsValid(rinfo->hashjoinoperator))
+				*binary_mode = true;
+
+			if (rinfo->outer_is_left)
+				exprs = lappend(exprs, linitial(opexpr->args));
+			else
+				exprs = lappend(exprs, lsecond(opexpr->args));
+		}
+	}
+
+	/*
+	 * Now add any lateral vars to the cache key too.  These can be used in
+	 * arbitrary expressions, so we must compare them bit by bit.
+	 */
+	if (innerrel->lateral_vars != NIL)
+		*binary_mode = true;
+	exprs = list_concat(exprs, list_copy(innerrel->lateral_vars));
+
+	foreach(lc, exprs)
+	{
+		Node	   *expr = (Node *) lfirst(lc);
+		Oid			exprtype = exprType(expr);
+		TypeCacheEntry *typentry;
+
+		/* Reject if there are any volatile functions */
+		if (contain_volatile_functions(expr))
+			return false;
+
+		typentry = lookup_type_cache(exprtype,
+									 TYPECACHE_HASH_PROC | TYPECACHE_EQ_OPR);
+
+		/* can't use result cache without a valid hash equals operator */
+		if (!OidIsValid(typentry->hash_proc) ||
+			!OidIsValid(typentry->eq_opr) ||
+			!op_hashjoinable(typentry->eq_opr, exprtype))
+			return false;
+
+		*operators = lappend_oid(*operators, typentry->eq_opr);
+	}
+
+	/* We're okay to use result cache */
+	*param_exprs = exprs;
+	return true;
+}
+
+/*
+ * get_resultcache_path
+ *		If possible, make and return a Result Cache path atop of 'inner_path'.
+ *		Otherwise return NULL.
+ */
+static Path *
+get_resultcache_path(PlannerInfo *root, RelOptInfo *innerrel,
+					 RelOptInfo *outerrel, Path *inner_path,
+					 Path *outer_path, JoinType jointype,
+					 JoinPathExtraData *extra)
+{
+	List	   *param_exprs;
+	List	   *hash_operators;
+	bool		binary_mode;
+	ListCell   *lc;
+
+	/* Obviously not if it's disabled */
+	if (!enable_resultcache)
+		return NULL;
+
+	/*
+	 * We can safely not bother with all this unless we expect to perform
+	 * more than one inner scan.  The first scan is always going to be a cache
+	 * miss.  This would likely fail later anyway based on costs, so this is
+	 * really just to save some wasted effort.
+	 */
+	if (outer_path->parent->rows < 2)
+		return NULL;
+
+	/*
+	 * We can only have a result cache when there's some kind of cache key,
+	 * either parameterized path clauses or lateral Vars.  No cache key sounds
+	 * more like something a Materialize node might be more useful for.
+	 */
+	if ((inner_path->param_info == NULL ||
+		 inner_path->param_info->ppi_clauses == NIL) &&
+		innerrel->lateral_vars == NIL)
+		return NULL;
+
+	/*
+	 * Currently we don't do this for SEMI and ANTI joins unless they're
+	 * marked as inner_unique.  This is because nested loop SEMI/ANTI joins
+	 * don't scan the inner node to completion, which will mean result cache
+	 * cannot mark the cache entry as complete.
+	 */
+	if (!extra->inner_unique && (jointype == JOIN_SEMI ||
+								 jointype == JOIN_ANTI))
+		return NULL;
+
+	/*
+	 * We can't use a result cache if there are volatile functions in the
+	 * inner rel's target list or restrict list.  A cache hit could reduce the
+	 * number of calls to these functions.
+	 */
+	if (contain_volatile_functions((Node *) innerrel->reltarget->exprs))
+		return NULL;
+
+	foreach(lc, innerrel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		if (contain_volatile_functions((Node *) rinfo->clause))
+			return NULL;
+	}
+
+	/* Check if we have hash ops for each parameter to the path */
+	if (paraminfo_get_equal_hashops(root,
+									inner_path->param_info,
+									outerrel,
+									innerrel,
+									&param_exprs,
+									&hash_operators,
+									&binary_mode))
+	{
+		return (Path *) create_resultcache_path(root,
+												innerrel,
+												inner_path,
+												param_exprs,
+												hash_operators,
+												extra->inner_unique,
+												binary_mode,
+												outer_path->parent->rows);
+	}
+
+	return NULL;
+}
+
 /*
  * sort_inner_and_outer
  *	  Create mergejoin join paths by explicitly sorting both the outer and
@@ -1471,6 +1669,7 @@ match_unsorted_outer(PlannerInfo *root,
 			foreach(lc2, innerrel->cheapest_parameterized_paths)
 			{
 				Path	   *innerpath = (Path *) lfirst(lc2);
+				Path	   *rcpath;
 
 				try_nestloop_path(root,
 								  joinrel,
@@ -1479,6 +1678,22 @@ match_unsorted_outer(PlannerInfo *root,
 								  merge_pathkeys,
 								  jointype,
 								  extra);
+
+				/*
+				 * Try generating a result cache path and see if that makes
+				 * the nested loop any cheaper.
+				 */
+				rcpath = get_resultcache_path(root, innerrel, outerrel,
+											  innerpath, outerpath, jointype,
+											  extra);
+				if (rcpath != NULL)
+					try_nestloop_path(root,
+									  joinrel,
+									  outerpath,
+									  rcpath,
+									  merge_pathkeys,
+									  jointype,
+									  extra);
 			}
 
 			/* Also consider materialized form of the cheapest inner path */
@@ -1634,6 +1849,7 @@ consider_parallel_nestloop(PlannerInfo *root,
 		foreach(lc2, innerrel->cheapest_parameterized_paths)
 		{
 			Path	   *innerpath = (Path *) lfirst(lc2);
+			Path	   *rcpath;
 
 			/* Can't join to an inner path that is not parallel-safe */
 			if (!innerpath->parallel_safe)
@@ -1658,6 +1874,17 @@ consider_parallel_nestloop(PlannerInfo *root,
 
 			try_partial_nestloop_path(root, joinrel, outerpath, innerpath,
 									  pathkeys, jointype, extra);
+
+			/*
+			 * Try generating a result cache path and see if that makes the
+			 * nested loop any cheaper.
+			 */
+			rcpath = get_resultcache_path(root, innerrel, outerrel,
+										  innerpath, outerpath, jointype,
+										  extra);
+			if (rcpath != NULL)
+				try_partial_nestloop_path(root, joinrel, outerpath, rcpath,
+										  pathkeys, jointype, extra);
 		}
 	}
 }
@@ -1906,6 +2133,105 @@ hash_inner_and_outer(PlannerInfo *root,
 	}
 }
 
+/*
+ * spatial_inner_and_outer
+ *	  Create a spatial join path, if there are join clauses comparing
+ *	  geometric values of the outer and inner relations with an overlap or
+ *	  containment operator.
+ *
+ * 'joinrel' is the join relation
+ * 'outerrel' is the outer join relation
+ * 'innerrel' is the inner join relation
+ * 'jointype' is the type of join to do
+ * 'extra' contains additional input values
+ */
+static void
+spatial_inner_and_outer(PlannerInfo *root,
+						RelOptInfo *joinrel,
+						RelOptInfo *outerrel,
+						RelOptInfo *innerrel,
+						JoinType jointype,
+						JoinPathExtraData *extra)
+{
+	Path	   *cheapest_total_outer = outerrel->cheapest_total_path;
+	Path	   *cheapest_total_inner = innerrel->cheapest_total_path;
+	List	   *spatialclauses;
+	ListCell   *l;
+	JoinCostWorkspace workspace;
+
+	Assert(jointype == JOIN_INNER);
+
+	/*
+	 * Scan the join's restrictinfo list to find clauses that only hold for
+	 * values with overlapping bounding boxes, and are usable with this pair
+	 * of sub-relations.
+	 */
+	spatialclauses = NIL;
+	foreach(l, extra->restrictlist)
+	{
+		RestrictInfo *restrictinfo = (RestrictInfo *) lfirst(l);
+		OpExpr	   *clause = (OpExpr *) restrictinfo->clause;
+
+		if (!restrictinfo->can_join ||
+			!is_opclause(clause) ||
+			list_length(clause->args) != 2)
+			continue;
+
+		/*
+		 * Check if clause has the form "outer op inner" or "inner op outer".
+		 */
+		if (!clause_sides_match_join(restrictinfo, outerrel, innerrel))
+			continue;			/* no good for these input relations */
+
+		if (!geo_operator_implies_overlap(clause->opno))
+			continue;
+
+		/* The executor needs the outer value on the left */
+		if (!restrictinfo->outer_is_left &&
+			!OidIsValid(get_commutator(clause->opno)))
+			continue;
+
+		spatialclauses = lappend(spatialclauses, restrictinfo);
+	}
+
+	if (spatialclauses == NIL)
+		return;
+
+	/*
+	 * Only the cheapest-total-cost paths are of interest, since nothing is
+	 * returned before both inputs have been read completely.  If either is
+	 * parameterized at all, give up; a spatial join can't supply parameters.
+	 */
+	if (cheapest_total_outer->param_info != NULL ||
+		cheapest_total_inner->param_info != NULL)
+		return;
+
+	/*
+	 * See comments in try_nestloop_path().  Spatial join paths never have
+	 * any output pathkeys.
+	 */
+	initial_cost_spatialjoin(root, &workspace, jointype, spatialclauses,
+							 cheapest_total_outer, cheapest_total_inner,
+							 extra);
+
+	if (add_path_precheck(joinrel,
+						  workspace.startup_cost, workspace.total_cost,
+						  NIL, NULL))
+	{
+		add_path(joinrel, (Path *)
+				 create_spatialjoin_path(root,
+										 joinrel,
+										 jointype,
+										 &workspace,
+										 extra,
+										 cheapest_total_outer,
+										 cheapest_total_inner,
+										 extra->restrictlist,
+										 NULL,
+										 spatialclauses));
+	}
+}
+
 /*
  * select_mergejoin_clauses
  *	  Select mergejoin clauses that are usable for a particular join.
@@ -635,6 +635,7 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 		case T_NestLoop:
 		case T_MergeJoin:
 		case T_HashJoin:
+		case T_SpatialJoin:
 			set_join_references(root, (Join *) plan, rtoffset);
 			break;
 
@@ -650,8 +651,24 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 			set_hash_references(root, plan, rtoffset);
 			break;
 
+		case T_ResultCache:
+			{
+				ResultCache *rcplan = (ResultCache *) plan;
+
+				/*
+				 * Result Cache does not evaluate its targetlist.  It just
+				 * uses the same targetlist from its outer subnode.
+				 */
+				set_dummy_tlist_references(plan, rtoffset);
+
+				rcplan->param_exprs = fix_scan_list(root, rcplan->param_exprs,
+													rtoffset);
+				break;
+			}
+
 		case T_Material:
 		case T_Sort:
+		case T_IncrementalSort:
 		case T_Unique:
 		case T_SetOp:
 
@@ -1799,6 +1816,17 @@ set_join_references(PlannerInfo *root, Join *join, int rtoffset)
 											   OUTER_VAR,
 											   rtoffset);
 	}
+	else if (IsA(join, SpatialJoin))
+	{
+		SpatialJoin *sj = (SpatialJoin *) join;
+
+		sj->spatialclauses = fix_join_expr(root,
+										   sj->spatialclauses,
+										   outer_itlist,
+										   inner_itlist,
+										   (Index) 0,
+										   rtoffset);
+	}
 
 	/*
 	 * Now we need to fix up the targetlist and qpqual, which are logically
@@ -3765,6 +3765,9 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 		case WAIT_EVENT_EXECUTE_GATHER:
 			event_name = "ExecuteGather";
 			break;
+		case WAIT_EVENT_GIST_ROOT:
+			event_name = "GistRoot";
+			break;
 		case WAIT_EVENT_HASH_BATCH_ALLOCATING:
 			event_name = "Hash/Batch/Allocating";
 			break;
@@ -3834,6 +3837,9 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 		case WAIT_EVENT_PARALLEL_CREATE_INDEX_SCAN:
 			event_name = "ParallelCreateIndexScan";
 			break;
+		case WAIT_EVENT_PARALLEL_CREATE_INDEX_BUILD:
+			event_name = "ParallelCreateIndexBuild";
+			break;
 		case WAIT_EVENT_PARALLEL_FINISH:
 			event_name = "ParallelFinish";
 			break;
@@ -3852,6 +3858,9 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 		case WAIT_EVENT_SAFE_SNAPSHOT:
 			event_name = "SafeSnapshot";
 			break;
+		case WAIT_EVENT_SPGIST_ROOT:
+			event_name = "SpGistRoot";
+			break;
 		case WAIT_EVENT_SYNC_REP:
 			event_name = "SyncRep";
 			break;
@@ -4814,6 +4823,10 @@ pgstat_get_tab_entry(PgStat_StatDBEntry *dbentry, Oid tableoid, bool create)
 		result->numscans = 0;
 		result->tuples_returned = 0;
 		result->tuples_fetched = 0;
+		result->inner_visited = 0;
+		result->leaf_tested = 0;
+		result->consistent_rejected = 0;
+		result->leaf_rechecked = 0;
 		result->tuples_inserted = 0;
 		result->tuples_updated = 0;
 		result->tuples_deleted = 0;
@@ -5944,6 +5957,10 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 			tabentry->numscans = tabmsg->t_counts.t_numscans;
 			tabentry->tuples_returned = tabmsg->t_counts.t_tuples_returned;
 			tabentry->tuples_fetched = tabmsg->t_counts.t_tuples_fetched;
+			tabentry->inner_visited = tabmsg->t_counts.t_inner_visited;
+			tabentry->leaf_tested = tabmsg->t_counts.t_leaf_tested;
+			tabentry->consistent_rejected = tabmsg->t_counts.t_consistent_rejected;
+			tabentry->leaf_rechecked = tabmsg->t_counts.t_leaf_rechecked;
 			tabentry->tuples_inserted = tabmsg->t_counts.t_tuples_inserted;
 			tabentry->tuples_updated = tabmsg->t_counts.t_tuples_updated;
 			tabentry->tuples_deleted = tabmsg->t_counts.t_tuples_deleted;
@@ -5971,6 +5988,10 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 			tabentry->numscans += tabmsg->t_counts.t_numscans;
 			tabentry->tuples_returned += tabmsg->t_counts.t_tuples_returned;
 			tabentry->tuples_fetched += tabmsg->t_counts.t_tuples_fetched;
+			tabentry->inner_visited += tabmsg->t_counts.t_inner_visited;
+			tabentry->leaf_tested += tabmsg->t_counts.t_leaf_tested;
+			tabentry->consistent_rejected += tabmsg->t_counts.t_consistent_rejected;
+			tabentry->leaf_rechecked += tabmsg->t_counts.t_leaf_rechecked;
 			tabentry->tuples_inserted += tabmsg->t_counts.t_tuples_inserted;
 			tabentry->tuples_updated += tabmsg->t_counts.t_tuples_updated;
 			tabentry->tuples_deleted += tabmsg->t_counts.t_tuples_deleted;
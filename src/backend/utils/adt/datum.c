@@ -45,6 +45,7 @@
 #include "access/detoast.h"
 #include "fmgr.h"
 #include "utils/datum.h"
+#include "utils/hashutils.h"
 #include "utils/expandeddatum.h"
 
 
@@ -298,12 +299,79 @@ datum_image_eq(Datum value1, Datum value2, bool typByVal, int typLen)
 	{
 		result = (value1 == value2);
 	}
-	else
+	else if (typLen > 0)
 	{
 		result = (memcmp(DatumGetPointer(value1),
 						 DatumGetPointer(value2),
 						 typLen) == 0);
 	}
+	else if (typLen == -2)
+	{
+		char	   *s1,
+				   *s2;
+
+		/* Compare cstring datums */
+		s1 = DatumGetCString(value1);
+		s2 = DatumGetCString(value2);
+		result = (strcmp(s1, s2) == 0);
+	}
+	else
+		elog(ERROR, "unexpected typLen: %d", typLen);
+
+	return result;
+}
+
+/*-------------------------------------------------------------------------
+ * datum_image_hash
+ *
+ * Generate a hash value based on the binary representation of 'value'.  Most
+ * use cases will want to use the hash function specific to the Datum's type,
+ * however, some corner cases require generating a hash value based on the
+ * actual bits rather than the logical value.  Two datums which compare
+ * equal with datum_image_eq() always produce the same hash value.
+ *-------------------------------------------------------------------------
+ */
+uint32
+datum_image_hash(Datum value, bool typByVal, int typLen)
+{
+	Size		len;
+	uint32		result;
+
+	if (typByVal)
+		result = DatumGetUInt32(hash_any((unsigned char *) &value,
+										 sizeof(Datum)));
+	else if (typLen > 0)
+		result = DatumGetUInt32(hash_any((unsigned char *) DatumGetPointer(value),
+										 typLen));
+	else if (typLen == -1)
+	{
+		struct varlena *val;
+
+		len = toast_raw_datum_size(value);
+
+		val = PG_DETOAST_DATUM_PACKED(value);
+
+		result = DatumGetUInt32(hash_any((unsigned char *) VARDATA_ANY(val),
+										 len - VARHDRSZ));
+
+		/* Only free memory if it's a copy made here. */
+		if ((Pointer) val != (Pointer) value)
+			pfree(val);
+	}
+	else if (typLen == -2)
+	{
+		char	   *s;
+
+		s = DatumGetCString(value);
+		len = strlen(s) + 1;
+
+		result = DatumGetUInt32(hash_any((unsigned char *) s, len));
+	}
+	else
+	{
+		elog(ERROR, "unexpected typLen: %d", typLen);
+		result = 0;				/* keep compiler quiet */
+	}
 
 	return result;
 }
@@ -0,0 +1,312 @@
+/*-------------------------------------------------------------------------
+ *
+ * geo_batch.c
+ *	  Geometric tests and distances applied to many boxes at once
+ *
+ * Index scans spend much of their time testing the keys of the entries on
+ * a page against the same query, one key at a time.  The functions here do
+ * the same for a whole array of boxes in a tight loop.  Where the platform
+ * supports it, two coordinates are compared, or two distances computed, per
+ * instruction with SSE2; otherwise, or for values that need special care,
+ * plain C code is used.  Either way, the results are exactly the same as
+ * those of the corresponding scalar functions in geo_ops.c.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/geo_batch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "port/simd.h"
+#include "utils/float.h"
+#include "utils/geo_decls.h"
+
+/*
+ * The vectorized comparisons implement the fuzzy FPle() as a subtraction
+ * and a comparison with EPSILON, so they can only be used if the fuzzy
+ * comparisons are enabled.
+ */
+#if defined(USE_SSE2) && defined(EPSILON)
+#define USE_SSE2_GEO_BATCH
+#endif
+
+static inline float8 point_box_distance_internal(Point *point, BOX *box);
+
+
+/*
+ * box_ov_batch
+ *		Does each box overlap the query box?  Same as box_overlap().
+ */
+void
+box_ov_batch(BOX **boxes, int nboxes, BOX *query, bool *result)
+{
+	int			i = 0;
+
+#ifdef USE_SSE2_GEO_BATCH
+	const __m128d eps = _mm_set1_pd(EPSILON);
+	const __m128d qlow = _mm_loadu_pd(&query->low.x);
+	const __m128d qhigh = _mm_loadu_pd(&query->high.x);
+
+	for (; i < nboxes; i++)
+	{
+		__m128d		low = _mm_loadu_pd(&boxes[i]->low.x);
+		__m128d		high = _mm_loadu_pd(&boxes[i]->high.x);
+		__m128d		ok;
+
+		/* FPle(box.low, query.high) && FPle(query.low, box.high) */
+		ok = _mm_and_pd(_mm_cmple_pd(_mm_sub_pd(low, qhigh), eps),
+						_mm_cmple_pd(_mm_sub_pd(qlow, high), eps));
+		result[i] = (_mm_movemask_pd(ok) == 3);
+	}
+#endif
+
+	for (; i < nboxes; i++)
+	{
+		BOX		   *box = boxes[i];
+
+		result[i] = (FPle(box->low.x, query->high.x) &&
+					 FPle(query->low.x, box->high.x) &&
+					 FPle(box->low.y, query->high.y) &&
+					 FPle(query->low.y, box->high.y));
+	}
+}
+
+/*
+ * box_contain_batch
+ *		Does each box contain the query box?  Same as box_contain().
+ */
+void
+box_contain_batch(BOX **boxes, int nboxes, BOX *query, bool *result)
+{
+	int			i = 0;
+
+#ifdef USE_SSE2_GEO_BATCH
+	const __m128d eps = _mm_set1_pd(EPSILON);
+	const __m128d qlow = _mm_loadu_pd(&query->low.x);
+	const __m128d qhigh = _mm_loadu_pd(&query->high.x);
+
+	for (; i < nboxes; i++)
+	{
+		__m128d		low = _mm_loadu_pd(&boxes[i]->low.x);
+		__m128d		high = _mm_loadu_pd(&boxes[i]->high.x);
+		__m128d		ok;
+
+		/* FPge(box.high, query.high) && FPle(box.low, query.low) */
+		ok = _mm_and_pd(_mm_cmple_pd(_mm_sub_pd(qhigh, high), eps),
+						_mm_cmple_pd(_mm_sub_pd(low, qlow), eps));
+		result[i] = (_mm_movemask_pd(ok) == 3);
+	}
+#endif
+
+	for (; i < nboxes; i++)
+	{
+		BOX		   *box = boxes[i];
+
+		result[i] = (FPge(box->high.x, query->high.x) &&
+					 FPle(box->low.x, query->low.x) &&
+					 FPge(box->high.y, query->high.y) &&
+					 FPle(box->low.y, query->low.y));
+	}
+}
+
+/*
+ * box_contained_batch
+ *		Is each box contained by the query box?  Same as box_contained().
+ */
+void
+box_contained_batch(BOX **boxes, int nboxes, BOX *query, bool *result)
+{
+	int			i = 0;
+
+#ifdef USE_SSE2_GEO_BATCH
+	const __m128d eps = _mm_set1_pd(EPSILON);
+	const __m128d qlow = _mm_loadu_pd(&query->low.x);
+	const __m128d qhigh = _mm_loadu_pd(&query->high.x);
+
+	for (; i < nboxes; i++)
+	{
+		__m128d		low = _mm_loadu_pd(&boxes[i]->low.x);
+		__m128d		high = _mm_loadu_pd(&boxes[i]->high.x);
+		__m128d		ok;
+
+		/* FPge(query.high, box.high) && FPle(query.low, box.low) */
+		ok = _mm_and_pd(_mm_cmple_pd(_mm_sub_pd(high, qhigh), eps),
+						_mm_cmple_pd(_mm_sub_pd(qlow, low), eps));
+		result[i] = (_mm_movemask_pd(ok) == 3);
+	}
+#endif
+
+	for (; i < nboxes; i++)
+	{
+		BOX		   *box = boxes[i];
+
+		result[i] = (FPge(query->high.x, box->high.x) &&
+					 FPle(query->low.x, box->low.x) &&
+					 FPge(query->high.y, box->high.y) &&
+					 FPle(query->low.y, box->low.y));
+	}
+}
+
+/*
+ * box_ov_exact_batch
+ *		Does each box overlap the query box, using exact comparisons?
+ *
+ * For a box that is really a point, this is the same as on_pb().
+ */
+void
+box_ov_exact_batch(BOX **boxes, int nboxes, BOX *query, bool *result)
+{
+	int			i = 0;
+
+#ifdef USE_SSE2
+	const __m128d qlow = _mm_loadu_pd(&query->low.x);
+	const __m128d qhigh = _mm_loadu_pd(&query->high.x);
+
+	for (; i < nboxes; i++)
+	{
+		__m128d		low = _mm_loadu_pd(&boxes[i]->low.x);
+		__m128d		high = _mm_loadu_pd(&boxes[i]->high.x);
+		__m128d		ok;
+
+		ok = _mm_and_pd(_mm_cmpge_pd(high, qlow), _mm_cmple_pd(low, qhigh));
+		result[i] = (_mm_movemask_pd(ok) == 3);
+	}
+#endif
+
+	for (; i < nboxes; i++)
+	{
+		BOX		   *box = boxes[i];
+
+		result[i] = (box->high.x >= query->low.x &&
+					 box->low.x <= query->high.x &&
+					 box->high.y >= query->low.y &&
+					 box->low.y <= query->high.y);
+	}
+}
+
+/*
+ * Distance from a point to an axis-aligned box, for one box
+ */
+static inline float8
+point_box_distance_internal(Point *point, BOX *box)
+{
+	float8		dx,
+				dy;
+
+	if (isnan(point->x) || isnan(box->low.x) ||
+		isnan(point->y) || isnan(box->low.y))
+		return get_float8_nan();
+
+	if (point->x < box->low.x)
+		dx = box->low.x - point->x;
+	else if (point->x > box->high.x)
+		dx = point->x - box->high.x;
+	else
+		dx = 0.0;
+
+	if (point->y < box->low.y)
+		dy = box->low.y - point->y;
+	else if (point->y > box->high.y)
+		dy = point->y - box->high.y;
+	else
+		dy = 0.0;
+
+	return HYPOT(dx, dy);
+}
+
+#ifdef USE_SSE2
+/*
+ * The X and Y distances from a point to a box, as computed by
+ * point_box_distance_internal() for points and boxes without NaNs
+ */
+static inline __m128d
+point_box_delta_sse2(__m128d point, __m128d low, __m128d high)
+{
+	__m128d		below = _mm_cmplt_pd(point, low);
+	__m128d		above = _mm_cmpgt_pd(point, high);
+
+	return _mm_or_pd(_mm_and_pd(below, _mm_sub_pd(low, point)),
+					 _mm_andnot_pd(below,
+								   _mm_and_pd(above,
+											  _mm_sub_pd(point, high))));
+}
+#endif
+
+/*
+ * point_box_distance_batch
+ *		Distance from the point to each box
+ *
+ * The boxes are assumed to be aligned by axis, as in the index keys of the
+ * geometric operator classes.  Distances are computed the same way as by
+ * pg_hypot().
+ */
+void
+point_box_distance_batch(BOX **boxes, int nboxes, Point *point,
+						 float8 *result)
+{
+	int			i = 0;
+
+#ifdef USE_SSE2
+	if (!isnan(point->x) && !isnan(point->y))
+	{
+		const __m128d pt = _mm_loadu_pd(&point->x);
+		const __m128d zero = _mm_setzero_pd();
+		const __m128d one = _mm_set1_pd(1.0);
+
+		/* Two boxes at a time, one in each lane */
+		for (; i + 1 < nboxes; i += 2)
+		{
+			__m128d		low0 = _mm_loadu_pd(&boxes[i]->low.x);
+			__m128d		high0 = _mm_loadu_pd(&boxes[i]->high.x);
+			__m128d		low1 = _mm_loadu_pd(&boxes[i + 1]->low.x);
+			__m128d		high1 = _mm_loadu_pd(&boxes[i + 1]->high.x);
+			__m128d		d0 = point_box_delta_sse2(pt, low0, high0);
+			__m128d		d1 = point_box_delta_sse2(pt, low1, high1);
+			__m128d		dx = _mm_unpacklo_pd(d0, d1);
+			__m128d		dy = _mm_unpackhi_pd(d0, d1);
+			__m128d		x,
+						y,
+						yx,
+						dist,
+						yzero,
+						special;
+
+			/* The deltas are never negative, so x is the larger */
+			x = _mm_max_pd(dx, dy);
+			y = _mm_min_pd(dx, dy);
+			yx = _mm_div_pd(y, x);
+			dist = _mm_mul_pd(x, _mm_sqrt_pd(_mm_add_pd(one,
+														_mm_mul_pd(yx, yx))));
+
+			/* If y is zero, the hypotenuse is x */
+			yzero = _mm_cmpeq_pd(y, zero);
+			dist = _mm_or_pd(_mm_and_pd(yzero, x), _mm_andnot_pd(yzero, dist));
+
+			/*
+			 * Let the scalar code deal with NaN corners, and with infinite
+			 * deltas or results, which include overflows that must be
+			 * reported.
+			 */
+			special = _mm_or_pd(_mm_cmpunord_pd(low0, low1),
+								_mm_cmpneq_pd(_mm_sub_pd(dist, dist), zero));
+			if (_mm_movemask_pd(special) != 0)
+			{
+				result[i] = point_box_distance_internal(point, boxes[i]);
+				result[i + 1] = point_box_distance_internal(point, boxes[i + 1]);
+			}
+			else
+				_mm_storeu_pd(&result[i], dist);
+		}
+	}
+#endif
+
+	for (; i < nboxes; i++)
+		result[i] = point_box_distance_internal(point, boxes[i]);
+}
@@ -0,0 +1,230 @@
+/*-------------------------------------------------------------------------
+ *
+ * geo_curve.c
+ *	  Positions of geometric values along space-filling curves
+ *
+ * A space-filling curve visits every cell of a 2^order x 2^order grid once,
+ * so the position of a cell along the curve is a single integer key.  Cells
+ * that are close to each other along the curve are close in space too, so
+ * sorting, clustering or range-partitioning by the key keeps nearby values
+ * together.  The Hilbert curve preserves locality better; the Z-order
+ * (Morton) curve, which geohashes are based on, is cheaper to compute and
+ * its keys can be truncated to coarser cells by shifting.
+ *
+ * The SQL-callable functions map a point, or the center of a box, into a
+ * grid laid over a given extent.  Values outside the extent are clamped to
+ * the border cells, and NaN coordinates are put in the last cell.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/geo_curve.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "utils/builtins.h"
+#include "utils/geo_decls.h"
+
+/* The largest order whose keys fit in a non-negative int8 */
+#define MAX_CURVE_ORDER		31
+
+static uint32 curve_cell(float8 value, float8 low, float8 high, int order);
+static void curve_point_cells(Point *point, BOX *extent, int order,
+							  uint32 *x, uint32 *y);
+
+
+/*
+ * hilbert_curve_position
+ *		Distance along the Hilbert curve of the given order to cell (x, y)
+ *
+ * x and y must be less than 2^order, and order at most 32.
+ */
+uint64
+hilbert_curve_position(uint32 x, uint32 y, int order)
+{
+	uint64		d = 0;
+	uint32		s;
+
+	Assert(order >= 1 && order <= 32);
+
+	for (s = ((uint32) 1) << (order - 1); s > 0; s >>= 1)
+	{
+		uint32		rx = (x & s) ? 1 : 0;
+		uint32		ry = (y & s) ? 1 : 0;
+
+		d += (uint64) s * s * ((3 * rx) ^ ry);
+
+		/* Rotate the quadrant, so that the curve continues from it */
+		if (ry == 0)
+		{
+			uint32		tmp;
+
+			if (rx == 1)
+			{
+				x = ~x;
+				y = ~y;
+			}
+			tmp = x;
+			x = y;
+			y = tmp;
+		}
+	}
+
+	return d;
+}
+
+/*
+ * Spread the bits of a 32-bit value to the even bit positions of a 64-bit one
+ */
+static inline uint64
+spread_bits(uint32 value)
+{
+	uint64		v = value;
+
+	v = (v | (v << 16)) & UINT64CONST(0x0000FFFF0000FFFF);
+	v = (v | (v << 8)) & UINT64CONST(0x00FF00FF00FF00FF);
+	v = (v | (v << 4)) & UINT64CONST(0x0F0F0F0F0F0F0F0F);
+	v = (v | (v << 2)) & UINT64CONST(0x3333333333333333);
+	v = (v | (v << 1)) & UINT64CONST(0x5555555555555555);
+
+	return v;
+}
+
+/*
+ * zorder_curve_position
+ *		Position of cell (x, y) along the Z-order curve
+ *
+ * The bits of x and y are interleaved, with the bits of x in the even
+ * positions.
+ */
+uint64
+zorder_curve_position(uint32 x, uint32 y)
+{
+	return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+/*
+ * The cell of the 2^order cells between low and high that the value falls in
+ */
+static uint32
+curve_cell(float8 value, float8 low, float8 high, int order)
+{
+	float8		ncells = (float8) (((uint64) 1) << order);
+	float8		pos;
+
+	if (isnan(value))
+		return (uint32) (ncells - 1);
+
+	/* all values fall in the first cell of an empty extent */
+	if (!(high > low))
+		return 0;
+
+	/* halve first, so that the differences can't overflow */
+	pos = (value / 2 - low / 2) / (high / 2 - low / 2) * ncells;
+
+	if (!(pos > 0))
+		return 0;
+	if (pos >= ncells)
+		return (uint32) (ncells - 1);
+	return (uint32) pos;
+}
+
+static void
+curve_point_cells(Point *point, BOX *extent, int order, uint32 *x, uint32 *y)
+{
+	if (order < 1 || order > MAX_CURVE_ORDER)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("curve order must be between 1 and %d",
+						MAX_CURVE_ORDER)));
+
+	*x = curve_cell(point->x, extent->low.x, extent->high.x, order);
+	*y = curve_cell(point->y, extent->low.y, extent->high.y, order);
+}
+
+/* The center of a box, computed without overflow */
+static void
+curve_box_center(BOX *box, Point *center)
+{
+	center->x = box->low.x / 2 + box->high.x / 2;
+	center->y = box->low.y / 2 + box->high.y / 2;
+}
+
+
+/*
+ * hilbert_key(point, extent, order)
+ */
+Datum
+point_hilbert_key(PG_FUNCTION_ARGS)
+{
+	Point	   *point = PG_GETARG_POINT_P(0);
+	BOX		   *extent = PG_GETARG_BOX_P(1);
+	int32		order = PG_GETARG_INT32(2);
+	uint32		x,
+				y;
+
+	curve_point_cells(point, extent, order, &x, &y);
+
+	PG_RETURN_INT64((int64) hilbert_curve_position(x, y, order));
+}
+
+/*
+ * hilbert_key(box, extent, order)
+ */
+Datum
+box_hilbert_key(PG_FUNCTION_ARGS)
+{
+	BOX		   *box = PG_GETARG_BOX_P(0);
+	BOX		   *extent = PG_GETARG_BOX_P(1);
+	int32		order = PG_GETARG_INT32(2);
+	Point		center;
+	uint32		x,
+				y;
+
+	curve_box_center(box, &center);
+	curve_point_cells(&center, extent, order, &x, &y);
+
+	PG_RETURN_INT64((int64) hilbert_curve_position(x, y, order));
+}
+
+/*
+ * zorder_key(point, extent, order)
+ */
+Datum
+point_zorder_key(PG_FUNCTION_ARGS)
+{
+	Point	   *point = PG_GETARG_POINT_P(0);
+	BOX		   *extent = PG_GETARG_BOX_P(1);
+	int32		order = PG_GETARG_INT32(2);
+	uint32		x,
+				y;
+
+	curve_point_cells(point, extent, order, &x, &y);
+
+	PG_RETURN_INT64((int64) zorder_curve_position(x, y));
+}
+
+/*
+ * zorder_key(box, extent, order)
+ */
+Datum
+box_zorder_key(PG_FUNCTION_ARGS)
+{
+	BOX		   *box = PG_GETARG_BOX_P(0);
+	BOX		   *extent = PG_GETARG_BOX_P(1);
+	int32		order = PG_GETARG_INT32(2);
+	Point		center;
+	uint32		x,
+				y;
+
+	curve_box_center(box, &center);
+	curve_point_cells(&center, extent, order, &x, &y);
+
+	PG_RETURN_INT64((int64) zorder_curve_position(x, y));
+}
@@ -29,11 +29,13 @@
 #include <float.h>
 #include <ctype.h>
 
+#include "catalog/pg_type.h"
 #include "libpq/pqformat.h"
 #include "miscadmin.h"
 #include "utils/float.h"
 #include "utils/fmgrprotos.h"
 #include "utils/geo_decls.h"
+#include "utils/memutils.h"
 
 /*
  * * Type constructors have this form:
@@ -121,11 +123,60 @@ static float8 box_closept_lseg(Point *result, BOX *box, LSEG *lseg);
 /* Routines for circles */
 static float8 circle_ar(CIRCLE *circle);
 
+/*
+ * A "prepared" polygon is a copy of a constant polygon argument, together
+ * with an index over its edges.  The edges are bucketed into horizontal
+ * bands of equal height, and each edge is entered into every band its
+ * bounding box overlaps, after widening the box by a margin that covers the
+ * fuzziness of the FP comparisons.  A point or segment then only needs to
+ * be tested against the edges in the bands it falls into, which for most
+ * shapes is a small constant number of edges, rather than all of them.
+ *
+ * Prepared polygons are built on the first call of an operator whose
+ * polygon argument is a constant (or a parameter that is fixed for the
+ * whole query), and cached in fn_extra for the rest of the query.  The same
+ * FmgrInfo can see different values of a stable argument, for example when
+ * a cached plan is reused with a new parameter value, so each call checks
+ * that the argument still matches the cached copy and rebuilds it if not.
+ */
+typedef struct PreparedPolygon
+{
+	POLYGON    *poly;			/* copy of the polygon */
+	float8		tol;			/* FP tolerance used for the margins */
+	float8		limit;			/* largest coordinate we can handle */
+	float8		low;			/* lower edge of the first band */
+	float8		high;			/* upper edge of the last band */
+	int			nbands;			/* number of bands */
+	int		   *band_start;		/* offsets into band_edges, nbands + 1 */
+	int		   *band_edges;		/* edge numbers, band by band */
+	BOX		   *edge_box;		/* widened bounding box of each edge */
+	int		   *edge_mark;		/* for removing duplicate candidates */
+	int			mark;			/* current value for edge_mark */
+} PreparedPolygon;
+
+typedef struct PreparedPolygonCache
+{
+	bool		checked[2];		/* have we looked at the argument? */
+	bool		stable[2];		/* is it fixed for the whole query? */
+	PreparedPolygon *prep[2];	/* prepared argument, or NULL */
+	MemoryContext cxt[2];		/* context holding prep, or NULL */
+} PreparedPolygonCache;
+
 /* Routines for polygons */
 static void make_bound_box(POLYGON *poly);
 static void poly_to_circle(CIRCLE *result, POLYGON *poly);
-static bool lseg_inside_poly(Point *a, Point *b, POLYGON *poly, int start);
-static bool poly_contain_poly(POLYGON *contains_poly, POLYGON *contained_poly);
+static bool lseg_inside_poly(Point *a, Point *b, POLYGON *poly,
+							 PreparedPolygon *prep, int start);
+static bool poly_contain_poly(POLYGON *contains_poly, POLYGON *contained_poly,
+							  PreparedPolygon *prep);
+static PreparedPolygon *get_prepared_polygon(FunctionCallInfo fcinfo,
+											 int argno, POLYGON *poly);
+static PreparedPolygon *prepare_polygon(POLYGON *poly, MemoryContext mcxt);
+static bool prepared_polygon_fits(PreparedPolygon *prep, BOX *box);
+static int	prepared_polygon_band(PreparedPolygon *prep, float8 y);
+static int	prepared_polygon_candidates(PreparedPolygon *prep, LSEG *seg,
+										int start, bool sorted, int *cand);
+static int	prepared_point_inside(Point *p, PreparedPolygon *prep);
 static bool plist_same(int npts, Point *p1, Point *p2);
 static float8 dist_ppoly_internal(Point *pt, POLYGON *poly);
 
@@ -3791,6 +3842,8 @@ poly_overlap(PG_FUNCTION_ARGS)
 {
 	POLYGON    *polya = PG_GETARG_POLYGON_P(0);
 	POLYGON    *polyb = PG_GETARG_POLYGON_P(1);
+	PreparedPolygon *prepa = NULL;
+	PreparedPolygon *prepb = NULL;
 	bool		result;
 
 	Assert(polya->npts > 0 && polyb->npts > 0);
@@ -3798,13 +3851,80 @@ poly_overlap(PG_FUNCTION_ARGS)
 	/* Quick check by bounding box */
 	result = box_ov(&polya->boundbox, &polyb->boundbox);
 
-	/*
-	 * Brute-force algorithm - try to find intersected edges, if so then
-	 * polygons are overlapped else check is one polygon inside other or not
-	 * by testing single point of them.
-	 */
 	if (result)
 	{
+		prepa = get_prepared_polygon(fcinfo, 0, polya);
+		if (prepa == NULL)
+			prepb = get_prepared_polygon(fcinfo, 1, polyb);
+
+		if (prepa != NULL && !prepared_polygon_fits(prepa, &polyb->boundbox))
+			prepa = NULL;
+		if (prepb != NULL && !prepared_polygon_fits(prepb, &polya->boundbox))
+			prepb = NULL;
+	}
+
+	if (result && (prepa != NULL || prepb != NULL))
+	{
+		/*
+		 * One of the polygons is prepared.  Do the same as the brute-force
+		 * algorithm below, but only test each edge of the other polygon
+		 * against the nearby edges of the prepared one.
+		 */
+		PreparedPolygon *prep = (prepa != NULL) ? prepa : prepb;
+		POLYGON    *poly = (prepa != NULL) ? polyb : polya;
+		int		   *cand;
+		int			ncand;
+		int			i,
+					k;
+		LSEG		s,
+					sp;
+
+		cand = (int *) palloc(sizeof(int) * prep->poly->npts);
+
+		s.p[0] = poly->p[poly->npts - 1];
+		result = false;
+
+		for (i = 0; i < poly->npts && !result; i++)
+		{
+			s.p[1] = poly->p[i];
+
+			ncand = prepared_polygon_candidates(prep, &s, 0, false, cand);
+			for (k = 0; k < ncand && !result; k++)
+			{
+				int			ip = cand[k];
+
+				sp.p[0] = prep->poly->p[(ip == 0) ? (prep->poly->npts - 1) : (ip - 1)];
+				sp.p[1] = prep->poly->p[ip];
+
+				/* polya's edge goes first, as in the brute-force loop */
+				if (prepa != NULL)
+					result = lseg_interpt_lseg(NULL, &sp, &s);
+				else
+					result = lseg_interpt_lseg(NULL, &s, &sp);
+			}
+
+			s.p[0] = s.p[1];
+		}
+
+		pfree(cand);
+
+		if (!result)
+		{
+			if (prepa != NULL)
+				result = (point_inside(polya->p, polyb->npts, polyb->p) ||
+						  prepared_point_inside(polyb->p, prepa));
+			else
+				result = (prepared_point_inside(polya->p, prepb) ||
+						  point_inside(polyb->p, polya->npts, polya->p));
+		}
+	}
+	else if (result)
+	{
+		/*
+		 * Brute-force algorithm - try to find intersected edges, if so then
+		 * polygons are overlapped else check is one polygon inside other or
+		 * not by testing single point of them.
+		 */
 		int			ia,
 					ib;
 		LSEG		sa,
@@ -3863,7 +3983,8 @@ poly_overlap(PG_FUNCTION_ARGS)
  */
 
 static bool
-touched_lseg_inside_poly(Point *a, Point *b, LSEG *s, POLYGON *poly, int start)
+touched_lseg_inside_poly(Point *a, Point *b, LSEG *s, POLYGON *poly,
+						 PreparedPolygon *prep, int start)
 {
 	/* point a is on s, b is not */
 	LSEG		t;
@@ -3874,20 +3995,20 @@ touched_lseg_inside_poly(Point *a, Point *b, LSEG *s, POLYGON *poly, int start)
 	if (point_eq_point(a, s->p))
 	{
 		if (lseg_contain_point(&t, s->p + 1))
-			return lseg_inside_poly(b, s->p + 1, poly, start);
+			return lseg_inside_poly(b, s->p + 1, poly, prep, start);
 	}
 	else if (point_eq_point(a, s->p + 1))
 	{
 		if (lseg_contain_point(&t, s->p))
-			return lseg_inside_poly(b, s->p, poly, start);
+			return lseg_inside_poly(b, s->p, poly, prep, start);
 	}
 	else if (lseg_contain_point(&t, s->p))
 	{
-		return lseg_inside_poly(b, s->p, poly, start);
+		return lseg_inside_poly(b, s->p, poly, prep, start);
 	}
 	else if (lseg_contain_point(&t, s->p + 1))
 	{
-		return lseg_inside_poly(b, s->p + 1, poly, start);
+		return lseg_inside_poly(b, s->p + 1, poly, prep, start);
 	}
 
 	return true;				/* may be not true, but that will check later */
@@ -3896,27 +4017,40 @@ touched_lseg_inside_poly(Point *a, Point *b, LSEG *s, POLYGON *poly, int start)
 /*
  * Returns true if segment (a,b) is in polygon, option
  * start is used for optimization - function checks
- * polygon's edges starting from start
+ * polygon's edges starting from start.  If the polygon
+ * is prepared, only the edges near (a,b) are checked.
  */
 static bool
-lseg_inside_poly(Point *a, Point *b, POLYGON *poly, int start)
+lseg_inside_poly(Point *a, Point *b, POLYGON *poly, PreparedPolygon *prep,
+				 int start)
 {
 	LSEG		s,
 				t;
-	int			i;
+	int		   *cand = NULL;
+	int			ncand;
+	int			k;
 	bool		res = true,
 				intersection = false;
 
 	t.p[0] = *a;
 	t.p[1] = *b;
-	s.p[0] = poly->p[(start == 0) ? (poly->npts - 1) : (start - 1)];
 
-	for (i = start; i < poly->npts && res; i++)
+	if (prep != NULL)
+	{
+		cand = (int *) palloc(sizeof(int) * poly->npts);
+		ncand = prepared_polygon_candidates(prep, &t, start, true, cand);
+	}
+	else
+		ncand = poly->npts - start;
+
+	for (k = 0; k < ncand && res; k++)
 	{
 		Point		interpt;
+		int			i = (cand != NULL) ? cand[k] : start + k;
 
 		CHECK_FOR_INTERRUPTS();
 
+		s.p[0] = poly->p[(i == 0) ? (poly->npts - 1) : (i - 1)];
 		s.p[1] = poly->p[i];
 
 		if (lseg_contain_point(&s, t.p))
@@ -3925,12 +4059,12 @@ lseg_inside_poly(Point *a, Point *b, POLYGON *poly, int start)
 				return true;	/* t is contained by s */
 
 			/* Y-cross */
-			res = touched_lseg_inside_poly(t.p, t.p + 1, &s, poly, i + 1);
+			res = touched_lseg_inside_poly(t.p, t.p + 1, &s, poly, prep, i + 1);
 		}
 		else if (lseg_contain_point(&s, t.p + 1))
 		{
 			/* Y-cross */
-			res = touched_lseg_inside_poly(t.p + 1, t.p, &s, poly, i + 1);
+			res = touched_lseg_inside_poly(t.p + 1, t.p, &s, poly, prep, i + 1);
 		}
 		else if (lseg_interpt_lseg(&interpt, &t, &s))
 		{
@@ -3939,14 +4073,15 @@ lseg_inside_poly(Point *a, Point *b, POLYGON *poly, int start)
 			 */
 
 			intersection = true;
-			res = lseg_inside_poly(t.p, &interpt, poly, i + 1);
+			res = lseg_inside_poly(t.p, &interpt, poly, prep, i + 1);
 			if (res)
-				res = lseg_inside_poly(t.p + 1, &interpt, poly, i + 1);
+				res = lseg_inside_poly(t.p + 1, &interpt, poly, prep, i + 1);
 		}
-
-		s.p[0] = s.p[1];
 	}
 
+	if (cand != NULL)
+		pfree(cand);
+
 	if (res && !intersection)
 	{
 		Point		p;
@@ -3958,17 +4093,22 @@ lseg_inside_poly(Point *a, Point *b, POLYGON *poly, int start)
 		p.x = float8_div(float8_pl(t.p[0].x, t.p[1].x), 2.0);
 		p.y = float8_div(float8_pl(t.p[0].y, t.p[1].y), 2.0);
 
-		res = point_inside(&p, poly->npts, poly->p);
+		if (prep != NULL)
+			res = prepared_point_inside(&p, prep);
+		else
+			res = point_inside(&p, poly->npts, poly->p);
 	}
 
 	return res;
 }
 
 /*
- * Check whether the first polygon contains the second
+ * Check whether the first polygon contains the second.  prep is the
+ * prepared form of the first polygon, or NULL.
  */
 static bool
-poly_contain_poly(POLYGON *contains_poly, POLYGON *contained_poly)
+poly_contain_poly(POLYGON *contains_poly, POLYGON *contained_poly,
+				  PreparedPolygon *prep)
 {
 	int			i;
 	LSEG		s;
@@ -3982,12 +4122,15 @@ poly_contain_poly(POLYGON *contains_poly, POLYGON *contained_poly)
 	if (!box_contain_box(&contains_poly->boundbox, &contained_poly->boundbox))
 		return false;
 
+	if (prep != NULL && !prepared_polygon_fits(prep, &contained_poly->boundbox))
+		prep = NULL;
+
 	s.p[0] = contained_poly->p[contained_poly->npts - 1];
 
 	for (i = 0; i < contained_poly->npts; i++)
 	{
 		s.p[1] = contained_poly->p[i];
-		if (!lseg_inside_poly(s.p, s.p + 1, contains_poly, 0))
+		if (!lseg_inside_poly(s.p, s.p + 1, contains_poly, prep, 0))
 			return false;
 		s.p[0] = s.p[1];
 	}
@@ -4002,7 +4145,8 @@ poly_contain(PG_FUNCTION_ARGS)
 	POLYGON    *polyb = PG_GETARG_POLYGON_P(1);
 	bool		result;
 
-	result = poly_contain_poly(polya, polyb);
+	result = poly_contain_poly(polya, polyb,
+							   get_prepared_polygon(fcinfo, 0, polya));
 
 	/*
 	 * Avoid leaking memory for toasted inputs ... needed for rtree indexes
@@ -4025,7 +4169,8 @@ poly_contained(PG_FUNCTION_ARGS)
 	bool		result;
 
 	/* Just switch the arguments and pass it off to poly_contain */
-	result = poly_contain_poly(polyb, polya);
+	result = poly_contain_poly(polyb, polya,
+							   get_prepared_polygon(fcinfo, 1, polyb));
 
 	/*
 	 * Avoid leaking memory for toasted inputs ... needed for rtree indexes
@@ -4042,6 +4187,10 @@ poly_contain_pt(PG_FUNCTION_ARGS)
 {
 	POLYGON    *poly = PG_GETARG_POLYGON_P(0);
 	Point	   *p = PG_GETARG_POINT_P(1);
+	PreparedPolygon *prep = get_prepared_polygon(fcinfo, 0, poly);
+
+	if (prep != NULL)
+		PG_RETURN_BOOL(prepared_point_inside(p, prep) != 0);
 
 	PG_RETURN_BOOL(point_inside(p, poly->npts, poly->p) != 0);
 }
@@ -4051,6 +4200,10 @@ pt_contained_poly(PG_FUNCTION_ARGS)
 {
 	Point	   *p = PG_GETARG_POINT_P(0);
 	POLYGON    *poly = PG_GETARG_POLYGON_P(1);
+	PreparedPolygon *prep = get_prepared_polygon(fcinfo, 1, poly);
+
+	if (prep != NULL)
+		PG_RETURN_BOOL(prepared_point_inside(p, prep) != 0);
 
 	PG_RETURN_BOOL(point_inside(p, poly->npts, poly->p) != 0);
 }
@@ -5445,6 +5598,353 @@ lseg_crossing(float8 x, float8 y, float8 prev_x, float8 prev_y)
 }
 
 
+/*
+ * Prepared polygons
+ *
+ * The margin of an edge must cover every point that lseg_contain_point()
+ * would consider to be on it: the set of points whose distances to the two
+ * endpoints add up to at most the length plus the tolerance is an ellipse,
+ * which extends sqrt(length * tolerance / 2) from the edge.  The tolerance
+ * includes an allowance for rounding errors at the largest coordinates we
+ * are prepared to handle; objects with larger coordinates are processed
+ * the slow way.
+ */
+
+#ifdef EPSILON
+#define PREPARED_POLYGON_EPSILON	EPSILON
+#else
+#define PREPARED_POLYGON_EPSILON	0.0
+#endif
+
+/* Polygons with fewer points are not worth preparing */
+#define PREPARED_POLYGON_MIN_POINTS	32
+
+#define PREPARED_POLYGON_MAX_BANDS	65536
+
+/*
+ * Return the prepared form of argument argno of the current function call,
+ * or NULL if it is not constant for the whole query or too small to be
+ * worth preparing.  "poly" is the detoasted argument.
+ */
+static PreparedPolygon *
+get_prepared_polygon(FunctionCallInfo fcinfo, int argno, POLYGON *poly)
+{
+	FmgrInfo   *flinfo = fcinfo->flinfo;
+	PreparedPolygonCache *cache;
+	PreparedPolygon *prep;
+
+	Assert(argno == 0 || argno == 1);
+
+	if (flinfo == NULL)
+		return NULL;
+
+	cache = (PreparedPolygonCache *) flinfo->fn_extra;
+	if (cache == NULL)
+	{
+		cache = (PreparedPolygonCache *)
+			MemoryContextAllocZero(flinfo->fn_mcxt,
+								   sizeof(PreparedPolygonCache));
+		flinfo->fn_extra = cache;
+	}
+
+	if (!cache->checked[argno])
+	{
+		cache->checked[argno] = true;
+		cache->stable[argno] = get_fn_expr_arg_stable(flinfo, argno);
+	}
+
+	if (!cache->stable[argno])
+		return NULL;
+
+	/* Use the cached copy if it's still for the same polygon */
+	prep = cache->prep[argno];
+	if (prep != NULL &&
+		VARSIZE(prep->poly) == VARSIZE(poly) &&
+		memcmp(prep->poly, poly, VARSIZE(poly)) == 0)
+		return prep;
+
+	/* Otherwise, throw it away and prepare the new one */
+	if (prep != NULL)
+	{
+		MemoryContextReset(cache->cxt[argno]);
+		cache->prep[argno] = NULL;
+	}
+
+	if (poly->npts >= PREPARED_POLYGON_MIN_POINTS)
+	{
+		if (cache->cxt[argno] == NULL)
+			cache->cxt[argno] = AllocSetContextCreate(flinfo->fn_mcxt,
+													  "prepared polygon",
+													  ALLOCSET_SMALL_SIZES);
+		cache->prep[argno] = prepare_polygon(poly, cache->cxt[argno]);
+	}
+
+	return cache->prep[argno];
+}
+
+/*
+ * Build the prepared form of a polygon in the given memory context.
+ * Returns NULL if the polygon has non-finite coordinates.
+ */
+static PreparedPolygon *
+prepare_polygon(POLYGON *poly, MemoryContext mcxt)
+{
+	PreparedPolygon *prep;
+	MemoryContext oldcxt;
+	float8		maxabs = 1.0;
+	int			npts = poly->npts;
+	int			i;
+	int64		nentries;
+
+	for (i = 0; i < npts; i++)
+	{
+		if (!isfinite(poly->p[i].x) || !isfinite(poly->p[i].y))
+			return NULL;
+		maxabs = Max(maxabs, fabs(poly->p[i].x));
+		maxabs = Max(maxabs, fabs(poly->p[i].y));
+	}
+
+	oldcxt = MemoryContextSwitchTo(mcxt);
+
+	prep = (PreparedPolygon *) palloc(sizeof(PreparedPolygon));
+	prep->poly = (POLYGON *) palloc(VARSIZE(poly));
+	memcpy(prep->poly, poly, VARSIZE(poly));
+	prep->limit = 64.0 * maxabs;
+	prep->tol = PREPARED_POLYGON_EPSILON + 16.0 * DBL_EPSILON * prep->limit;
+
+	/* Compute the widened bounding box of each edge */
+	prep->edge_box = (BOX *) palloc(sizeof(BOX) * npts);
+	for (i = 0; i < npts; i++)
+	{
+		Point	   *prev = &poly->p[(i == 0) ? (npts - 1) : (i - 1)];
+		Point	   *cur = &poly->p[i];
+		BOX		   *box = &prep->edge_box[i];
+		float8		margin;
+
+		margin = sqrt(point_dt(prev, cur) * prep->tol) + prep->tol;
+		box->low.x = Min(prev->x, cur->x) - margin;
+		box->low.y = Min(prev->y, cur->y) - margin;
+		box->high.x = Max(prev->x, cur->x) + margin;
+		box->high.y = Max(prev->y, cur->y) + margin;
+
+		if (i == 0 || box->low.y < prep->low)
+			prep->low = box->low.y;
+		if (i == 0 || box->high.y > prep->high)
+			prep->high = box->high.y;
+	}
+
+	/*
+	 * Aim for about one edge per band, but use fewer bands if long edges
+	 * would make the index much bigger than the polygon.
+	 */
+	prep->nbands = Min(npts, PREPARED_POLYGON_MAX_BANDS);
+	for (;;)
+	{
+		nentries = 0;
+		for (i = 0; i < npts; i++)
+			nentries += prepared_polygon_band(prep, prep->edge_box[i].high.y) -
+				prepared_polygon_band(prep, prep->edge_box[i].low.y) + 1;
+
+		if (prep->nbands == 1 || nentries <= 4 * (int64) npts)
+			break;
+		prep->nbands /= 2;
+	}
+
+	/* Count the edges in each band, then fill the bands */
+	prep->band_start = (int *) palloc0(sizeof(int) * (prep->nbands + 1));
+	prep->band_edges = (int *) palloc(sizeof(int) * nentries);
+
+	for (i = 0; i < npts; i++)
+	{
+		int			lo = prepared_polygon_band(prep, prep->edge_box[i].low.y);
+		int			hi = prepared_polygon_band(prep, prep->edge_box[i].high.y);
+		int			b;
+
+		for (b = lo; b <= hi; b++)
+			prep->band_start[b + 1]++;
+	}
+	for (i = 0; i < prep->nbands; i++)
+		prep->band_start[i + 1] += prep->band_start[i];
+
+	prep->edge_mark = (int *) palloc0(sizeof(int) * npts);
+	for (i = 0; i < npts; i++)
+	{
+		int			lo = prepared_polygon_band(prep, prep->edge_box[i].low.y);
+		int			hi = prepared_polygon_band(prep, prep->edge_box[i].high.y);
+		int			b;
+
+		/* use edge_mark as the fill pointer of each band for now */
+		for (b = lo; b <= hi; b++)
+			prep->band_edges[prep->band_start[b] + prep->edge_mark[b]++] = i;
+	}
+	memset(prep->edge_mark, 0, sizeof(int) * npts);
+	prep->mark = 0;
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return prep;
+}
+
+/*
+ * Can objects within the given bounding box be tested against the
+ * prepared polygon?
+ */
+static bool
+prepared_polygon_fits(PreparedPolygon *prep, BOX *box)
+{
+	/* this is false for NaNs, too */
+	return (fabs(box->low.x) <= prep->limit &&
+			fabs(box->low.y) <= prep->limit &&
+			fabs(box->high.x) <= prep->limit &&
+			fabs(box->high.y) <= prep->limit);
+}
+
+/*
+ * Return the band that the given Y coordinate falls into.  Coordinates
+ * outside the range of the bands are mapped to the first or last band.
+ */
+static int
+prepared_polygon_band(PreparedPolygon *prep, float8 y)
+{
+	float8		band;
+
+	band = (y - prep->low) / (prep->high - prep->low) * prep->nbands;
+	if (band < 0.0)
+		return 0;
+	if (band >= prep->nbands)
+		return prep->nbands - 1;
+	return (int) band;
+}
+
+static int
+edge_number_cmp(const void *a, const void *b)
+{
+	int			ea = *(const int *) a;
+	int			eb = *(const int *) b;
+
+	return (ea > eb) - (ea < eb);
+}
+
+/*
+ * Collect the edges of the prepared polygon, starting from edge number
+ * start, that might touch or cross the given segment.  The edge numbers
+ * are stored in cand, which must have room for all the edges, and the
+ * number of them is returned.  If sorted is true, they are returned in
+ * ascending order.
+ */
+static int
+prepared_polygon_candidates(PreparedPolygon *prep, LSEG *seg, int start,
+							bool sorted, int *cand)
+{
+	BOX			box;
+	float8		margin;
+	int			lo,
+				hi,
+				b,
+				j;
+	int			ncand = 0;
+
+	/* Objects the index can't handle are checked against all the edges */
+	box.low.x = Min(seg->p[0].x, seg->p[1].x);
+	box.low.y = Min(seg->p[0].y, seg->p[1].y);
+	box.high.x = Max(seg->p[0].x, seg->p[1].x);
+	box.high.y = Max(seg->p[0].y, seg->p[1].y);
+	if (!prepared_polygon_fits(prep, &box))
+	{
+		for (j = start; j < prep->poly->npts; j++)
+			cand[ncand++] = j;
+		return ncand;
+	}
+
+	margin = sqrt(point_dt(&seg->p[0], &seg->p[1]) * prep->tol) + prep->tol;
+	box.low.x -= margin;
+	box.low.y -= margin;
+	box.high.x += margin;
+	box.high.y += margin;
+
+	if (box.high.y < prep->low || box.low.y > prep->high)
+		return 0;
+
+	/* An edge spanning several bands must be reported only once */
+	if (prep->mark == INT_MAX)
+	{
+		memset(prep->edge_mark, 0, sizeof(int) * prep->poly->npts);
+		prep->mark = 0;
+	}
+	prep->mark++;
+
+	lo = prepared_polygon_band(prep, box.low.y);
+	hi = prepared_polygon_band(prep, box.high.y);
+	for (b = lo; b <= hi; b++)
+	{
+		for (j = prep->band_start[b]; j < prep->band_start[b + 1]; j++)
+		{
+			int			e = prep->band_edges[j];
+			BOX		   *ebox = &prep->edge_box[e];
+
+			if (e < start || prep->edge_mark[e] == prep->mark)
+				continue;
+			prep->edge_mark[e] = prep->mark;
+
+			if (ebox->high.x < box.low.x || ebox->low.x > box.high.x ||
+				ebox->high.y < box.low.y || ebox->low.y > box.high.y)
+				continue;
+
+			cand[ncand++] = e;
+		}
+	}
+
+	if (sorted && ncand > 1)
+		qsort(cand, ncand, sizeof(int), edge_number_cmp);
+
+	return ncand;
+}
+
+/*
+ * Same as point_inside(), for a prepared polygon
+ *
+ * Only the edges whose Y range includes the point can cross the positive
+ * X-axis drawn from it, so the others are skipped.
+ */
+static int
+prepared_point_inside(Point *p, PreparedPolygon *prep)
+{
+	POLYGON    *poly = prep->poly;
+	int			b,
+				j;
+	int			cross,
+				total_cross = 0;
+
+	if (!(fabs(p->x) <= prep->limit && fabs(p->y) <= prep->limit))
+		return point_inside(p, poly->npts, poly->p);
+
+	if (p->y < prep->low || p->y > prep->high)
+		return 0;
+
+	b = prepared_polygon_band(prep, p->y);
+	for (j = prep->band_start[b]; j < prep->band_start[b + 1]; j++)
+	{
+		int			e = prep->band_edges[j];
+		Point	   *prev = &poly->p[(e == 0) ? (poly->npts - 1) : (e - 1)];
+		Point	   *cur = &poly->p[e];
+
+		if (p->y < prep->edge_box[e].low.y || p->y > prep->edge_box[e].high.y)
+			continue;
+
+		cross = lseg_crossing(float8_mi(cur->x, p->x),
+							  float8_mi(cur->y, p->y),
+							  float8_mi(prev->x, p->x),
+							  float8_mi(prev->y, p->y));
+		if (cross == POINT_ON_POLYGON)
+			return 2;
+		total_cross += cross;
+	}
+
+	if (total_cross != 0)
+		return 1;
+	return 0;
+}
+
 static bool
 plist_same(int npts, Point *p1, Point *p2)
 {
@@ -5549,3 +6049,54 @@ pg_hypot(float8 x, float8 y)
 
 	return result;
 }
+
+
+/*
+ * Does geo_datum_bbox() support the given type?
+ */
+bool
+geo_type_has_bbox(Oid typid)
+{
+	return (typid == POINTOID || typid == BOXOID ||
+			typid == POLYGONOID || typid == CIRCLEOID);
+}
+
+/*
+ * Compute the bounding box of a value of the geometric type "typid".
+ *
+ * Only point, box, polygon and circle are supported; returns false for any
+ * other type.
+ */
+bool
+geo_datum_bbox(Oid typid, Datum value, BOX *bbox)
+{
+	switch (typid)
+	{
+		case POINTOID:
+			{
+				Point	   *pt = DatumGetPointP(value);
+
+				bbox->low = *pt;
+				bbox->high = *pt;
+				return true;
+			}
+		case BOXOID:
+			*bbox = *DatumGetBoxP(value);
+			return true;
+		case POLYGONOID:
+			*bbox = DatumGetPolygonP(value)->boundbox;
+			return true;
+		case CIRCLEOID:
+			{
+				CIRCLE	   *circle = DatumGetCircleP(value);
+
+				bbox->low.x = circle->center.x - circle->radius;
+				bbox->low.y = circle->center.y - circle->radius;
+				bbox->high.x = circle->center.x + circle->radius;
+				bbox->high.y = circle->center.y + circle->radius;
+				return true;
+			}
+		default:
+			return false;
+	}
+}
@@ -4,6 +4,10 @@
  *	  Selectivity routines registered in the operator catalog in the
  *	  "oprrest" and "oprjoin" attributes.
  *
+ * Estimates are based on the grid of bounding box centers collected by
+ * geo_typanalyze() for point, box, polygon and circle columns.  When no such
+ * statistics are available, we fall back to fixed default estimates.
+ *
  * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -11,21 +15,26 @@
  * IDENTIFICATION
  *	  src/backend/utils/adt/geo_selfuncs.c
  *
- *	XXX These are totally bogus.  Perhaps someone will make them do
- *	something reasonable, someday.
- *
  *-------------------------------------------------------------------------
  */
 #include "postgres.h"
 
+#include <math.h>
+
+#include "access/htup_details.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
 #include "utils/builtins.h"
+#include "utils/float.h"
 #include "utils/geo_decls.h"
+#include "utils/lsyscache.h"
+#include "utils/selfuncs.h"
+#include "utils/syscache.h"
 
 
 /*
- *	Selectivity functions for geometric operators.  These are bogus -- unless
- *	we know the actual key distribution in the index, we can't make a good
- *	prediction of the selectivity of these operators.
+ *	Default selectivities, used when we have no statistics to work with.
  *
  *	Note: the values used here may look unreasonably small.  Perhaps they
  *	are.  For now, we want to make sure that the optimizer will make use
@@ -36,10 +45,577 @@
  *	that all occurrences of the same key have been found.  Because of this,
  *	the estimated cost for scanning the index ought to be higher than the
  *	output selectivity would indicate.  gistcostestimate(), over in selfuncs.c,
- *	ought to be adjusted accordingly --- but until we can generate somewhat
- *	realistic numbers here, it hardly matters...
+ *	ought to be adjusted accordingly.
+ */
+#define DEFAULT_AREA_SEL		0.005
+#define DEFAULT_POSITION_SEL	0.1
+#define DEFAULT_CONT_SEL		0.001
+
+/*
+ * The geometric operators we know how to estimate, classified by what they
+ * require of the bounding boxes of their arguments.
+ */
+typedef enum
+{
+	GEO_SEL_UNKNOWN,
+	GEO_SEL_OVERLAP,			/* && */
+	GEO_SEL_CONTAINS,			/* @> */
+	GEO_SEL_CONTAINED,			/* <@ */
+	GEO_SEL_LEFT,				/* << */
+	GEO_SEL_RIGHT,				/* >> */
+	GEO_SEL_OVERLEFT,			/* &< */
+	GEO_SEL_OVERRIGHT,			/* &> */
+	GEO_SEL_BELOW,				/* <<| and <^ */
+	GEO_SEL_ABOVE,				/* |>> and >^ */
+	GEO_SEL_OVERBELOW,			/* &<| */
+	GEO_SEL_OVERABOVE			/* |&> */
+} GeoSelOperator;
+
+/*
+ * Contents of a STATISTIC_KIND_BOUNDS_GRID slot, unpacked.
+ */
+typedef struct
+{
+	AttStatsSlot sslot;
+	int			n;				/* grid has n x n cells */
+	BOX		   *extent;			/* extent of the bounding box centers */
+	float4	   *fracs;			/* fraction of non-null rows in each cell */
+	float8		halfwidth;		/* average half-width of bounding boxes */
+	float8		halfheight;		/* average half-height of bounding boxes */
+	float4		nullfrac;
+} GeoGridStats;
+
+static GeoSelOperator geo_classify_operator(Oid operator);
+static bool geo_get_grid(VariableStatData *vardata, GeoGridStats *grid);
+static void geo_grid_weights(float8 low, float8 high, int n,
+							 float8 rlow, float8 rhigh, float8 *weights);
+static double geo_grid_selectivity(GeoGridStats *grid, GeoSelOperator op,
+								   bool varonleft, const BOX *query);
+static double geo_join_grid_selectivity(GeoGridStats *outer,
+										 GeoGridStats *inner,
+										 GeoSelOperator op, bool outeronleft,
+										 bool semi, double inner_rows);
+static double geo_restriction_selectivity(PlannerInfo *root, Oid operator,
+										  List *args, int varRelid,
+										  double default_sel);
+static double geo_join_selectivity(PlannerInfo *root, Oid operator,
+								   List *args, SpecialJoinInfo *sjinfo,
+								   double default_sel);
+
+
+/*
+ * Classify a geometric operator by its name.  All the geometric types use
+ * the same operator names for the same bounding box relationships, so this
+ * saves us from listing every operator OID.
+ */
+static GeoSelOperator
+geo_classify_operator(Oid operator)
+{
+	GeoSelOperator result = GEO_SEL_UNKNOWN;
+	char	   *opname = get_opname(operator);
+
+	if (opname == NULL)
+		return GEO_SEL_UNKNOWN;
+
+	if (strcmp(opname, "&&") == 0 || strcmp(opname, "?#") == 0)
+		result = GEO_SEL_OVERLAP;
+	else if (strcmp(opname, "@>") == 0 || strcmp(opname, "~") == 0)
+		result = GEO_SEL_CONTAINS;
+	else if (strcmp(opname, "<@") == 0 || strcmp(opname, "@") == 0)
+		result = GEO_SEL_CONTAINED;
+	else if (strcmp(opname, "<<") == 0)
+		result = GEO_SEL_LEFT;
+	else if (strcmp(opname, ">>") == 0)
+		result = GEO_SEL_RIGHT;
+	else if (strcmp(opname, "&<") == 0)
+		result = GEO_SEL_OVERLEFT;
+	else if (strcmp(opname, "&>") == 0)
+		result = GEO_SEL_OVERRIGHT;
+	else if (strcmp(opname, "<<|") == 0 || strcmp(opname, "<^") == 0)
+		result = GEO_SEL_BELOW;
+	else if (strcmp(opname, "|>>") == 0 || strcmp(opname, ">^") == 0)
+		result = GEO_SEL_ABOVE;
+	else if (strcmp(opname, "&<|") == 0)
+		result = GEO_SEL_OVERBELOW;
+	else if (strcmp(opname, "|&>") == 0)
+		result = GEO_SEL_OVERABOVE;
+
+	pfree(opname);
+	return result;
+}
+
+/*
+ * Does the operator hold only for values whose bounding boxes overlap?
+ *
+ * This is true of the overlap, containment and "same as" operators between
+ * the geometric types geo_datum_bbox() knows about.  The spatial join
+ * executor node relies on it to match values by their bounding boxes.
+ */
+bool
+geo_operator_implies_overlap(Oid operator)
+{
+	HeapTuple	tp;
+	Form_pg_operator optup;
+	bool		result = false;
+
+	tp = SearchSysCache1(OPEROID, ObjectIdGetDatum(operator));
+	if (!HeapTupleIsValid(tp))
+		return false;
+	optup = (Form_pg_operator) GETSTRUCT(tp);
+
+	if (geo_type_has_bbox(optup->oprleft) &&
+		geo_type_has_bbox(optup->oprright) &&
+		optup->oprresult == BOOLOID)
+	{
+		if (strcmp(NameStr(optup->oprname), "~=") == 0)
+			result = true;
+		else
+		{
+			switch (geo_classify_operator(operator))
+			{
+				case GEO_SEL_OVERLAP:
+				case GEO_SEL_CONTAINS:
+				case GEO_SEL_CONTAINED:
+					result = true;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
+	ReleaseSysCache(tp);
+	return result;
+}
+
+/*
+ * Fetch the grid statistics of a variable.  Returns false if there are none.
+ * On success, the caller must release the slot with free_attstatsslot().
+ */
+static bool
+geo_get_grid(VariableStatData *vardata, GeoGridStats *grid)
+{
+	int			ncells;
+
+	if (!HeapTupleIsValid(vardata->statsTuple))
+		return false;
+
+	if (!get_attstatsslot(&grid->sslot, vardata->statsTuple,
+						  STATISTIC_KIND_BOUNDS_GRID, InvalidOid,
+						  ATTSTATSSLOT_VALUES | ATTSTATSSLOT_NUMBERS))
+		return false;
+
+	ncells = grid->sslot.nnumbers - 2;
+	grid->n = (int) rint(sqrt((double) Max(ncells, 0)));
+	if (grid->sslot.nvalues != 1 || grid->n < 1 || grid->n * grid->n != ncells)
+		elog(ERROR, "invalid bounds grid statistic");	/* shouldn't happen */
+
+	grid->extent = DatumGetBoxP(grid->sslot.values[0]);
+	grid->fracs = grid->sslot.numbers;
+	grid->halfwidth = grid->sslot.numbers[ncells] / 2.0;
+	grid->halfheight = grid->sslot.numbers[ncells + 1] / 2.0;
+	grid->nullfrac =
+		((Form_pg_statistic) GETSTRUCT(vardata->statsTuple))->stanullfrac;
+
+	return true;
+}
+
+/*
+ * Return the point at fraction "frac" of the way from low to high.
+ *
+ * The extent of the grid may be wider than the largest finite float8, so
+ * interpolate rather than scaling the difference of the bounds.
+ */
+static inline float8
+geo_grid_coord(float8 low, float8 high, float8 frac)
+{
+	return low * (1.0 - frac) + high * frac;
+}
+
+/*
+ * Fill weights[] with the fraction of each of the n cells evenly dividing
+ * [low, high] that lies within [rlow, rhigh].  The grid statistics only tell
+ * us how many centers fall in each cell, so we assume they are spread
+ * uniformly within it.
  */
+static void
+geo_grid_weights(float8 low, float8 high, int n, float8 rlow, float8 rhigh,
+				 float8 *weights)
+{
+	int			i;
+
+	for (i = 0; i < n; i++)
+	{
+		float8		clow = geo_grid_coord(low, high, (float8) i / n);
+		float8		chigh = geo_grid_coord(low, high, (float8) (i + 1) / n);
 
+		if (rlow > rhigh)
+			weights[i] = 0.0;
+		else if (high <= low || chigh <= clow)
+		{
+			/* degenerate cell, all the centers are on a single line */
+			weights[i] = (rlow <= clow && clow <= rhigh) ? 1.0 : 0.0;
+		}
+		else
+		{
+			float8		w;
+
+			/* halve the coordinates, so that the differences can't overflow */
+			w = (Min(chigh, rhigh) / 2 - Max(clow, rlow) / 2) /
+				(chigh / 2 - clow / 2);
+			weights[i] = Max(Min(w, 1.0), 0.0);
+		}
+	}
+}
+
+/*
+ * Estimate the fraction of non-null rows that satisfy "var OP query" (or
+ * "query OP var", if varonleft is false), using the grid statistics of var.
+ *
+ * Each value of the column is approximated by a bounding box of the average
+ * size centered on its real center.  That turns every operator into a
+ * condition that the center falls in some rectangle (possibly unbounded, or
+ * empty), and we sum up the grid cells covered by that rectangle.
+ */
+static double
+geo_grid_selectivity(GeoGridStats *grid, GeoSelOperator op, bool varonleft,
+					 const BOX *query)
+{
+	float8		hw = grid->halfwidth;
+	float8		hh = grid->halfheight;
+	float8		xlow = -get_float8_infinity();
+	float8		xhigh = get_float8_infinity();
+	float8		ylow = -get_float8_infinity();
+	float8		yhigh = get_float8_infinity();
+	float8	   *xweights;
+	float8	   *yweights;
+	double		selec = 0.0;
+	int			n = grid->n;
+	int			i,
+				j;
+
+	/* Commute the operator, so that we can assume var is on the left */
+	if (!varonleft)
+	{
+		switch (op)
+		{
+			case GEO_SEL_CONTAINS:
+				op = GEO_SEL_CONTAINED;
+				break;
+			case GEO_SEL_CONTAINED:
+				op = GEO_SEL_CONTAINS;
+				break;
+			case GEO_SEL_LEFT:
+				op = GEO_SEL_RIGHT;
+				break;
+			case GEO_SEL_RIGHT:
+				op = GEO_SEL_LEFT;
+				break;
+			case GEO_SEL_BELOW:
+				op = GEO_SEL_ABOVE;
+				break;
+			case GEO_SEL_ABOVE:
+				op = GEO_SEL_BELOW;
+				break;
+			default:
+				/* the overlap and "over" operators are handled below */
+				break;
+		}
+	}
+
+	switch (op)
+	{
+		case GEO_SEL_OVERLAP:
+			xlow = query->low.x - hw;
+			xhigh = query->high.x + hw;
+			ylow = query->low.y - hh;
+			yhigh = query->high.y + hh;
+			break;
+		case GEO_SEL_CONTAINED:
+			xlow = query->low.x + hw;
+			xhigh = query->high.x - hw;
+			ylow = query->low.y + hh;
+			yhigh = query->high.y - hh;
+			break;
+		case GEO_SEL_CONTAINS:
+			xlow = query->high.x - hw;
+			xhigh = query->low.x + hw;
+			ylow = query->high.y - hh;
+			yhigh = query->low.y + hh;
+			break;
+		case GEO_SEL_LEFT:
+			xhigh = query->low.x - hw;
+			break;
+		case GEO_SEL_RIGHT:
+			xlow = query->high.x + hw;
+			break;
+		case GEO_SEL_BELOW:
+			yhigh = query->low.y - hh;
+			break;
+		case GEO_SEL_ABOVE:
+			ylow = query->high.y + hh;
+			break;
+		case GEO_SEL_OVERLEFT:
+			/* var.high.x <= query.high.x, or the reverse */
+			if (varonleft)
+				xhigh = query->high.x - hw;
+			else
+				xlow = query->high.x - hw;
+			break;
+		case GEO_SEL_OVERRIGHT:
+			/* var.low.x >= query.low.x, or the reverse */
+			if (varonleft)
+				xlow = query->low.x + hw;
+			else
+				xhigh = query->low.x + hw;
+			break;
+		case GEO_SEL_OVERBELOW:
+			if (varonleft)
+				yhigh = query->high.y - hh;
+			else
+				ylow = query->high.y - hh;
+			break;
+		case GEO_SEL_OVERABOVE:
+			if (varonleft)
+				ylow = query->low.y + hh;
+			else
+				yhigh = query->low.y + hh;
+			break;
+		case GEO_SEL_UNKNOWN:
+			elog(ERROR, "unexpected geometric operator");
+			break;
+	}
+
+	xweights = (float8 *) palloc(sizeof(float8) * n);
+	yweights = (float8 *) palloc(sizeof(float8) * n);
+	geo_grid_weights(grid->extent->low.x, grid->extent->high.x, n,
+					 xlow, xhigh, xweights);
+	geo_grid_weights(grid->extent->low.y, grid->extent->high.y, n,
+					 ylow, yhigh, yweights);
+
+	for (j = 0; j < n; j++)
+	{
+		if (yweights[j] == 0.0)
+			continue;
+		for (i = 0; i < n; i++)
+			selec += grid->fracs[j * n + i] * xweights[i] * yweights[j];
+	}
+
+	pfree(xweights);
+	pfree(yweights);
+
+	return selec;
+}
+
+/*
+ * Common code for the restriction selectivity functions.
+ */
+static double
+geo_restriction_selectivity(PlannerInfo *root, Oid operator, List *args,
+							int varRelid, double default_sel)
+{
+	VariableStatData vardata;
+	Node	   *other;
+	bool		varonleft;
+	GeoSelOperator op;
+	GeoGridStats grid;
+	BOX			query;
+	double		selec;
+
+	op = geo_classify_operator(operator);
+	if (op == GEO_SEL_UNKNOWN)
+		return default_sel;
+
+	/*
+	 * If expression is not (variable op something) or (something op
+	 * variable), then punt and return a default estimate.
+	 */
+	if (!get_restriction_variable(root, args, varRelid,
+								  &vardata, &other, &varonleft))
+		return default_sel;
+
+	/*
+	 * Can't do anything useful if the something is not a constant, either.
+	 */
+	if (!IsA(other, Const))
+	{
+		ReleaseVariableStats(vardata);
+		return default_sel;
+	}
+
+	/*
+	 * All the geometric operators are strict, so we can cope with a NULL
+	 * constant right away.
+	 */
+	if (((Const *) other)->constisnull)
+	{
+		ReleaseVariableStats(vardata);
+		return 0.0;
+	}
+
+	if (!geo_datum_bbox(((Const *) other)->consttype,
+						((Const *) other)->constvalue, &query) ||
+		!geo_get_grid(&vardata, &grid))
+	{
+		ReleaseVariableStats(vardata);
+		return default_sel;
+	}
+
+	selec = geo_grid_selectivity(&grid, op, varonleft, &query);
+	selec *= 1.0 - grid.nullfrac;
+
+	free_attstatsslot(&grid.sslot);
+	ReleaseVariableStats(vardata);
+
+	CLAMP_PROBABILITY(selec);
+
+	return selec;
+}
+
+/*
+ * Estimate the selectivity of a join between two columns with grid
+ * statistics.
+ *
+ * Every cell of the outer grid is treated as a single box of the average
+ * size, centered on the cell, and estimated against the inner grid like a
+ * restriction clause.  That gives the fraction of inner rows matching an
+ * outer row in the cell.  For an inner join we sum those up; for a semijoin
+ * we want the probability that at least one of the inner_rows inner rows
+ * matches, assuming they do so independently.
+ */
+static double
+geo_join_grid_selectivity(GeoGridStats *outer, GeoGridStats *inner,
+						  GeoSelOperator op, bool outeronleft,
+						  bool semi, double inner_rows)
+{
+	double		selec = 0.0;
+	int			n = outer->n;
+	int			i,
+				j;
+
+	for (j = 0; j < n; j++)
+	{
+		for (i = 0; i < n; i++)
+		{
+			float4		frac = outer->fracs[j * n + i];
+			BOX			cell;
+			float8		cx,
+						cy;
+			double		s;
+
+			if (frac == 0.0)
+				continue;
+
+			cx = geo_grid_coord(outer->extent->low.x, outer->extent->high.x,
+								(i + 0.5) / n);
+			cy = geo_grid_coord(outer->extent->low.y, outer->extent->high.y,
+								(j + 0.5) / n);
+			cell.low.x = cx - outer->halfwidth;
+			cell.high.x = cx + outer->halfwidth;
+			cell.low.y = cy - outer->halfheight;
+			cell.high.y = cy + outer->halfheight;
+
+			s = geo_grid_selectivity(inner, op, !outeronleft, &cell);
+			s *= 1.0 - inner->nullfrac;
+			CLAMP_PROBABILITY(s);
+			if (semi)
+				s = 1.0 - pow(1.0 - s, inner_rows);
+
+			selec += frac * s;
+		}
+	}
+
+	return selec * (1.0 - outer->nullfrac);
+}
+
+/*
+ * Common code for the join selectivity functions.
+ */
+static double
+geo_join_selectivity(PlannerInfo *root, Oid operator, List *args,
+					 SpecialJoinInfo *sjinfo, double default_sel)
+{
+	VariableStatData vardata1;
+	VariableStatData vardata2;
+	bool		join_is_reversed;
+	GeoSelOperator op;
+	GeoGridStats grid1;
+	GeoGridStats grid2;
+	double		selec;
+
+	op = geo_classify_operator(operator);
+	if (op == GEO_SEL_UNKNOWN)
+		return default_sel;
+
+	get_join_variables(root, args, sjinfo,
+					   &vardata1, &vardata2, &join_is_reversed);
+
+	if (!geo_get_grid(&vardata1, &grid1))
+	{
+		ReleaseVariableStats(vardata1);
+		ReleaseVariableStats(vardata2);
+		return default_sel;
+	}
+	if (!geo_get_grid(&vardata2, &grid2))
+	{
+		free_attstatsslot(&grid1.sslot);
+		ReleaseVariableStats(vardata1);
+		ReleaseVariableStats(vardata2);
+		return default_sel;
+	}
+
+	switch (sjinfo->jointype)
+	{
+		case JOIN_INNER:
+		case JOIN_LEFT:
+		case JOIN_FULL:
+
+			/*
+			 * Selectivity for left/full join is not exactly the same as inner
+			 * join, but we neglect the difference, as eqjoinsel does.
+			 */
+			selec = geo_join_grid_selectivity(&grid1, &grid2, op, true,
+											  false, 0);
+			break;
+		case JOIN_SEMI:
+		case JOIN_ANTI:
+			{
+				/* Here, it's important that we use the outer var's grid */
+				VariableStatData *innerdata;
+
+				innerdata = join_is_reversed ? &vardata1 : &vardata2;
+				if (innerdata->rel == NULL)
+				{
+					/* can't tell how many inner rows there are */
+					selec = default_sel;
+				}
+				else if (!join_is_reversed)
+					selec = geo_join_grid_selectivity(&grid1, &grid2, op, true,
+													  true,
+													  innerdata->rel->rows);
+				else
+					selec = geo_join_grid_selectivity(&grid2, &grid1, op, false,
+													  true,
+													  innerdata->rel->rows);
+				break;
+			}
+		default:
+			/* other values not expected here */
+			elog(ERROR, "unrecognized join type: %d",
+				 (int) sjinfo->jointype);
+			selec = 0;			/* keep compiler quiet */
+			break;
+	}
+
+	free_attstatsslot(&grid1.sslot);
+	free_attstatsslot(&grid2.sslot);
+	ReleaseVariableStats(vardata1);
+	ReleaseVariableStats(vardata2);
+
+	CLAMP_PROBABILITY(selec);
+
+	return selec;
+}
 
 /*
  * Selectivity for operators that depend on area, such as "overlap".
@@ -48,13 +624,25 @@
 Datum
 areasel(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_FLOAT8(0.005);
+	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
+	Oid			operator = PG_GETARG_OID(1);
+	List	   *args = (List *) PG_GETARG_POINTER(2);
+	int			varRelid = PG_GETARG_INT32(3);
+
+	PG_RETURN_FLOAT8(geo_restriction_selectivity(root, operator, args,
+												 varRelid, DEFAULT_AREA_SEL));
 }
 
 Datum
 areajoinsel(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_FLOAT8(0.005);
+	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
+	Oid			operator = PG_GETARG_OID(1);
+	List	   *args = (List *) PG_GETARG_POINTER(2);
+	SpecialJoinInfo *sjinfo = (SpecialJoinInfo *) PG_GETARG_POINTER(4);
+
+	PG_RETURN_FLOAT8(geo_join_selectivity(root, operator, args, sjinfo,
+										  DEFAULT_AREA_SEL));
 }
 
 /*
@@ -67,30 +655,54 @@ areajoinsel(PG_FUNCTION_ARGS)
 Datum
 positionsel(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_FLOAT8(0.1);
+	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
+	Oid			operator = PG_GETARG_OID(1);
+	List	   *args = (List *) PG_GETARG_POINTER(2);
+	int			varRelid = PG_GETARG_INT32(3);
+
+	PG_RETURN_FLOAT8(geo_restriction_selectivity(root, operator, args,
+												 varRelid, DEFAULT_POSITION_SEL));
 }
 
 Datum
 positionjoinsel(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_FLOAT8(0.1);
+	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
+	Oid			operator = PG_GETARG_OID(1);
+	List	   *args = (List *) PG_GETARG_POINTER(2);
+	SpecialJoinInfo *sjinfo = (SpecialJoinInfo *) PG_GETARG_POINTER(4);
+
+	PG_RETURN_FLOAT8(geo_join_selectivity(root, operator, args, sjinfo,
+										  DEFAULT_POSITION_SEL));
 }
 
 /*
  *	contsel -- How likely is a box to contain (be contained by) a given box?
  *
- * This is a tighter constraint than "overlap", so produce a smaller
- * estimate than areasel does.
+ * Without statistics, this is a tighter constraint than "overlap", so
+ * produce a smaller estimate than areasel does.
  */
 
 Datum
 contsel(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_FLOAT8(0.001);
+	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
+	Oid			operator = PG_GETARG_OID(1);
+	List	   *args = (List *) PG_GETARG_POINTER(2);
+	int			varRelid = PG_GETARG_INT32(3);
+
+	PG_RETURN_FLOAT8(geo_restriction_selectivity(root, operator, args,
+												 varRelid, DEFAULT_CONT_SEL));
 }
 
 Datum
 contjoinsel(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_FLOAT8(0.001);
+	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
+	Oid			operator = PG_GETARG_OID(1);
+	List	   *args = (List *) PG_GETARG_POINTER(2);
+	SpecialJoinInfo *sjinfo = (SpecialJoinInfo *) PG_GETARG_POINTER(4);
+
+	PG_RETURN_FLOAT8(geo_join_selectivity(root, operator, args, sjinfo,
+										  DEFAULT_CONT_SEL));
 }
@@ -73,6 +73,9 @@
 
 #include "postgres.h"
 
+#include <float.h>
+#include <math.h>
+
 #include "access/spgist.h"
 #include "access/spgist_private.h"
 #include "access/stratnum.h"
@@ -81,6 +84,7 @@
 #include "utils/fmgroids.h"
 #include "utils/fmgrprotos.h"
 #include "utils/geo_decls.h"
+#include "utils/memutils.h"
 
 /*
  * Comparator for qsort
@@ -118,6 +122,32 @@ typedef struct
 	RangeBox	range_box_y;
 } RectBox;
 
+/*
+ * Traversal value
+ *
+ * A RectBox is only kept in this compact form between calls of the inner
+ * consistent function.  The bounds are rounded outwards to float4, so the
+ * stored region always covers the real one: the checks below can only get
+ * less selective, and the distances smaller, which is safe for both.
+ */
+typedef struct
+{
+	float4		range_box_x[4];	/* left.low, left.high, right.low, right.high */
+	float4		range_box_y[4];
+} PackedRectBox;
+
+/*
+ * Traversal values are allocated from a slab context for the scan, which is
+ * remembered in fn_extra of the inner consistent function.  The context is
+ * a child of the scan's traversal memory context, so it goes away when that
+ * is reset; the callback notices that.
+ */
+typedef struct
+{
+	MemoryContext context;		/* slab for PackedRectBoxes, or NULL */
+	MemoryContextCallback callback;
+} RectBoxAllocator;
+
 /*
  * Calculate the quadrant
  *
@@ -153,18 +183,14 @@ getQuadrant(BOX *centroid, BOX *inBox)
  * of representing points in 4D space.  It also is more convenient to
  * access the values with this structure.
  */
-static RangeBox *
-getRangeBox(BOX *box)
+static void
+getRangeBox(BOX *box, RangeBox *range_box)
 {
-	RangeBox   *range_box = (RangeBox *) palloc(sizeof(RangeBox));
-
 	range_box->left.low = box->low.x;
 	range_box->left.high = box->high.x;
 
 	range_box->right.low = box->low.y;
 	range_box->right.high = box->high.y;
-
-	return range_box;
 }
 
 /*
@@ -173,10 +199,9 @@ getRangeBox(BOX *box)
  * In the beginning, we don't have any restrictions.  We have to
  * initialize the struct to cover the whole 4D space.
  */
-static RectBox *
-initRectBox(void)
+static void
+initRectBox(RectBox *rect_box)
 {
-	RectBox    *rect_box = (RectBox *) palloc(sizeof(RectBox));
 	float8		infinity = get_float8_infinity();
 
 	rect_box->range_box_x.left.low = -infinity;
@@ -190,8 +215,6 @@ initRectBox(void)
 
 	rect_box->range_box_y.right.low = -infinity;
 	rect_box->range_box_y.right.high = infinity;
-
-	return rect_box;
 }
 
 /*
@@ -201,12 +224,11 @@ initRectBox(void)
  * boxes.  When we are traversing the tree, we must calculate RectBox,
  * using centroid and quadrant.
  */
-static RectBox *
-nextRectBox(RectBox *rect_box, RangeBox *centroid, uint8 quadrant)
+static void
+nextRectBox(RectBox *rect_box, RangeBox *centroid, uint8 quadrant,
+			RectBox *next_rect_box)
 {
-	RectBox    *next_rect_box = (RectBox *) palloc(sizeof(RectBox));
-
-	memcpy(next_rect_box, rect_box, sizeof(RectBox));
+	*next_rect_box = *rect_box;
 
 	if (quadrant & 0x8)
 		next_rect_box->range_box_x.left.low = centroid->left.low;
@@ -227,8 +249,120 @@ nextRectBox(RectBox *rect_box, RangeBox *centroid, uint8 quadrant)
 		next_rect_box->range_box_y.right.low = centroid->right.high;
 	else
 		next_rect_box->range_box_y.right.high = centroid->right.high;
+}
+
+/*
+ * Round a lower bound down to float4
+ *
+ * Converting a value beyond the float4 range to float4 is undefined, so
+ * such bounds are clamped first: to the largest float4 below a huge value,
+ * or to minus infinity below a hugely negative one.
+ */
+static inline float4
+lowerBoundFloat4(float8 val)
+{
+	float4		result;
 
-	return next_rect_box;
+	if (val > FLT_MAX)
+		return FLT_MAX;
+	if (val < -FLT_MAX)
+		return -get_float4_infinity();
+
+	result = (float4) val;
+	if (result > val)
+		result = nextafterf(result, -get_float4_infinity());
+	return result;
+}
+
+/* Round an upper bound up to float4, clamping like lowerBoundFloat4 */
+static inline float4
+upperBoundFloat4(float8 val)
+{
+	float4		result;
+
+	if (val < -FLT_MAX)
+		return -FLT_MAX;
+	if (val > FLT_MAX)
+		return get_float4_infinity();
+
+	result = (float4) val;
+	if (result < val)
+		result = nextafterf(result, get_float4_infinity());
+	return result;
+}
+
+static void
+packRangeBox(RangeBox *range_box, float4 *packed)
+{
+	packed[0] = lowerBoundFloat4(range_box->left.low);
+	packed[1] = upperBoundFloat4(range_box->left.high);
+	packed[2] = lowerBoundFloat4(range_box->right.low);
+	packed[3] = upperBoundFloat4(range_box->right.high);
+}
+
+static void
+unpackRangeBox(float4 *packed, RangeBox *range_box)
+{
+	range_box->left.low = packed[0];
+	range_box->left.high = packed[1];
+	range_box->right.low = packed[2];
+	range_box->right.high = packed[3];
+}
+
+/* Reset callback of the traversal value context */
+static void
+rectBoxAllocatorReset(void *arg)
+{
+	RectBoxAllocator *allocator = (RectBoxAllocator *) arg;
+
+	allocator->context = NULL;
+}
+
+/*
+ * Store a traversal value for a child node
+ *
+ * Only the nodes that are going to be visited get one, so there's nothing
+ * to free for the others.
+ */
+static PackedRectBox *
+packRectBox(FmgrInfo *flinfo, MemoryContext traversalCxt, RectBox *rect_box)
+{
+	RectBoxAllocator *allocator = (RectBoxAllocator *) flinfo->fn_extra;
+	PackedRectBox *packed;
+
+	if (allocator == NULL)
+	{
+		allocator = MemoryContextAllocZero(flinfo->fn_mcxt,
+										   sizeof(RectBoxAllocator));
+		flinfo->fn_extra = allocator;
+	}
+
+	if (allocator->context == NULL)
+	{
+		allocator->context = SlabContextCreate(traversalCxt,
+											   "SP-GiST box traversal values",
+											   SLAB_DEFAULT_BLOCK_SIZE,
+											   sizeof(PackedRectBox));
+		allocator->callback.func = rectBoxAllocatorReset;
+		allocator->callback.arg = allocator;
+		MemoryContextRegisterResetCallback(allocator->context,
+										   &allocator->callback);
+	}
+	Assert(MemoryContextGetParent(allocator->context) == traversalCxt);
+
+	packed = (PackedRectBox *) MemoryContextAlloc(allocator->context,
+												  sizeof(PackedRectBox));
+	packRangeBox(&rect_box->range_box_x, packed->range_box_x);
+	packRangeBox(&rect_box->range_box_y, packed->range_box_y);
+
+	return packed;
+}
+
+static void
+unpackRectBox(PackedRectBox *packed, RectBox *rect_box)
+{
+	unpackRangeBox(packed->range_box_x, &rect_box->range_box_x);
+	unpackRangeBox(packed->range_box_y, &rect_box->range_box_y);
 }
 
 /* Can any range from range_box overlap with this argument? */
@@ -555,20 +689,20 @@ spg_box_quad_inner_consistent(PG_FUNCTION_ARGS)
 	spgInnerConsistentIn *in = (spgInnerConsistentIn *) PG_GETARG_POINTER(0);
 	spgInnerConsistentOut *out = (spgInnerConsistentOut *) PG_GETARG_POINTER(1);
 	int			i;
-	MemoryContext old_ctx;
-	RectBox    *rect_box;
+	RectBox		rect_box;
 	uint8		quadrant;
-	RangeBox   *centroid,
-			  **queries;
+	RangeBox	centroid,
+			   *queries;
+	double	   *distances = NULL;
 
 	/*
 	 * We are saving the traversal value or initialize it an unbounded one, if
 	 * we have just begun to walk the tree.
 	 */
 	if (in->traversalValue)
-		rect_box = in->traversalValue;
+		unpackRectBox((PackedRectBox *) in->traversalValue, &rect_box);
 	else
-		rect_box = initRectBox();
+		initRectBox(&rect_box);
 
 	if (in->allTheSame)
 	{
@@ -587,18 +721,13 @@ spg_box_quad_inner_consistent(PG_FUNCTION_ARGS)
 			{
 				Point	   *pt = DatumGetPointP(in->orderbys[j].sk_argument);
 
-				distances[j] = pointToRectBoxDistance(pt, rect_box);
+				distances[j] = pointToRectBoxDistance(pt, &rect_box);
 			}
 
+			/* All the nodes have the same distances, so share the array */
 			out->distances = (double **) palloc(sizeof(double *) * in->nNodes);
-			out->distances[0] = distances;
-
-			for (i = 1; i < in->nNodes; i++)
-			{
-				out->distances[i] = palloc(sizeof(double) * in->norderbys);
-				memcpy(out->distances[i], distances,
-					   sizeof(double) * in->norderbys);
-			}
+			for (i = 0; i < in->nNodes; i++)
+				out->distances[i] = distances;
 		}
 
 		PG_RETURN_VOID();
@@ -608,13 +737,13 @@ spg_box_quad_inner_consistent(PG_FUNCTION_ARGS)
 	 * We are casting the prefix and queries to RangeBoxes for ease of the
 	 * following operations.
 	 */
-	centroid = getRangeBox(DatumGetBoxP(in->prefixDatum));
-	queries = (RangeBox **) palloc(in->nkeys * sizeof(RangeBox *));
+	getRangeBox(DatumGetBoxP(in->prefixDatum), &centroid);
+	queries = (RangeBox *) palloc(in->nkeys * sizeof(RangeBox));
 	for (i = 0; i < in->nkeys; i++)
 	{
 		BOX		   *box = spg_box_quad_get_scankey_bbox(&in->scankeys[i], NULL);
 
-		queries[i] = getRangeBox(box);
+		getRangeBox(box, &queries[i]);
 	}
 
 	/* Allocate enough memory for nodes */
@@ -622,20 +751,25 @@ spg_box_quad_inner_consistent(PG_FUNCTION_ARGS)
 	out->nodeNumbers = (int *) palloc(sizeof(int) * in->nNodes);
 	out->traversalValues = (void **) palloc(sizeof(void *) * in->nNodes);
 	if (in->norderbys > 0)
+	{
+		/* Distances of all the nodes go in a single array */
 		out->distances = (double **) palloc(sizeof(double *) * in->nNodes);
+		distances = (double *) palloc(sizeof(double) * in->nNodes *
+									  in->norderbys);
+	}
 
 	/*
-	 * We switch memory context, because we want to allocate memory for new
-	 * traversal values (next_rect_box) and pass these pieces of memory to
-	 * further call of this function.
+	 * The bounds of each quadrant are computed on the stack, and only the
+	 * quadrants that pass all the checks get a traversal value, allocated in
+	 * the traversal memory context by packRectBox().
 	 */
-	old_ctx = MemoryContextSwitchTo(in->traversalMemoryContext);
-
 	for (quadrant = 0; quadrant < in->nNodes; quadrant++)
 	{
-		RectBox    *next_rect_box = nextRectBox(rect_box, centroid, quadrant);
+		RectBox		next_rect_box;
 		bool		flag = true;
 
+		nextRectBox(&rect_box, &centroid, quadrant, &next_rect_box);
+
 		for (i = 0; i < in->nkeys; i++)
 		{
 			StrategyNumber strategy = in->scankeys[i].sk_strategy;
@@ -643,48 +777,48 @@ spg_box_quad_inner_consistent(PG_FUNCTION_ARGS)
 			switch (strategy)
 			{
 				case RTOverlapStrategyNumber:
-					flag = overlap4D(next_rect_box, queries[i]);
+					flag = overlap4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTContainsStrategyNumber:
-					flag = contain4D(next_rect_box, queries[i]);
+					flag = contain4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTSameStrategyNumber:
 				case RTContainedByStrategyNumber:
-					flag = contained4D(next_rect_box, queries[i]);
+					flag = contained4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTLeftStrategyNumber:
-					flag = left4D(next_rect_box, queries[i]);
+					flag = left4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTOverLeftStrategyNumber:
-					flag = overLeft4D(next_rect_box, queries[i]);
+					flag = overLeft4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTRightStrategyNumber:
-					flag = right4D(next_rect_box, queries[i]);
+					flag = right4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTOverRightStrategyNumber:
-					flag = overRight4D(next_rect_box, queries[i]);
+					flag = overRight4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTAboveStrategyNumber:
-					flag = above4D(next_rect_box, queries[i]);
+					flag = above4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTOverAboveStrategyNumber:
-					flag = overAbove4D(next_rect_box, queries[i]);
+					flag = overAbove4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTBelowStrategyNumber:
-					flag = below4D(next_rect_box, queries[i]);
+					flag = below4D(&next_rect_box, &queries[i]);
 					break;
 
 				case RTOverBelowStrategyNumber:
-					flag = overBelow4D(next_rect_box, queries[i]);
+					flag = overBelow4D(&next_rect_box, &queries[i]);
 					break;
 
 				default:
@@ -698,39 +832,31 @@ spg_box_quad_inner_consistent(PG_FUNCTION_ARGS)
 
 		if (flag)
 		{
-			out->traversalValues[out->nNodes] = next_rect_box;
+			out->traversalValues[out->nNodes] =
+				packRectBox(fcinfo->flinfo, in->traversalMemoryContext,
+							&next_rect_box);
 			out->nodeNumbers[out->nNodes] = quadrant;
 
 			if (in->norderbys > 0)
 			{
-				double	   *distances = palloc(sizeof(double) * in->norderbys);
+				double	   *nodeDistances;
 				int			j;
 
-				out->distances[out->nNodes] = distances;
+				nodeDistances = distances + out->nNodes * in->norderbys;
+				out->distances[out->nNodes] = nodeDistances;
 
 				for (j = 0; j < in->norderbys; j++)
 				{
 					Point	   *pt = DatumGetPointP(in->orderbys[j].sk_argument);
 
-					distances[j] = pointToRectBoxDistance(pt, next_rect_box);
+					nodeDistances[j] = pointToRectBoxDistance(pt, &next_rect_box);
 				}
 			}
 
 			out->nNodes++;
 		}
-		else
-		{
-			/*
-			 * If this node is not selected, we don't need to keep the next
-			 * traversal value in the memory context.
-			 */
-			pfree(next_rect_box);
-		}
 	}
 
-	/* Switch back */
-	MemoryContextSwitchTo(old_ctx);
-
 	PG_RETURN_VOID();
 }
 
@@ -878,3 +1004,457 @@ spg_poly_quad_compress(PG_FUNCTION_ARGS)
 
 	PG_RETURN_BOX_P(box);
 }
+
+
+/*
+ * Loose quad tree over boxes
+ *
+ * The 4-D quad tree above never lets a box straddle a split, but the price
+ * is that boxes lying near a centroid in 2-D space can be far apart in 4-D
+ * space, so a 2-D range query has to descend into many quadrants.  The
+ * loose quad tree partitions the plane by box centers instead, and enlarges
+ * every child cell by the index's looseness factor (see the "looseness"
+ * storage parameter): a child cell of width w is widened by
+ * (looseness - 1) * w / 2 on both sides.  A box descends into the child
+ * cell containing its center only if it fits within the enlarged cell;
+ * otherwise it stays at the current level, in an extra node that holds the
+ * boxes too large for any child.  Thus small boxes sink to the levels whose
+ * cells match their extent, while big ones are kept near the root.
+ *
+ * The prefix of an inner tuple is its cell, computed by picksplit as the
+ * bounding box of the centers of the boxes being split.  A box inserted
+ * later can have its center outside of the cell; it is then simply checked
+ * against the enlarged cell of the nearest child like any other box.
+ *
+ * While descending, the traversal value is the region that bounds every
+ * box below the current node: the intersection of the enlarged child cells
+ * chosen so far, or NULL while it's still unbounded.  Boxes in the extra
+ * node inherit the region of their parent.
+ */
+
+/* Node of the inner tuple that holds boxes not fitting any child cell */
+#define LOOSE_QUAD_STAY_NODE	4
+#define LOOSE_QUAD_NNODES		5
+
+/*
+ * Calculate the center of the box
+ *
+ * We halve before adding to avoid overflow on huge but finite boxes.
+ */
+static void
+getBoxCenter(BOX *box, Point *center)
+{
+	center->x = box->low.x / 2.0 + box->high.x / 2.0;
+	center->y = box->low.y / 2.0 + box->high.y / 2.0;
+}
+
+/*
+ * Calculate the quadrant of the cell containing the given center
+ *
+ * The quadrant is 2 bit unsigned integer: 0x2 is set for the right
+ * half of the cell, and 0x1 for its upper half.
+ */
+static uint8
+getLooseQuadrant(BOX *cell, Point *center)
+{
+	Point		middle;
+	uint8		quadrant = 0;
+
+	getBoxCenter(cell, &middle);
+
+	if (center->x > middle.x)
+		quadrant |= 0x2;
+
+	if (center->y > middle.y)
+		quadrant |= 0x1;
+
+	return quadrant;
+}
+
+/*
+ * Calculate the enlarged bounds of a child cell
+ */
+static void
+getLooseChildCell(BOX *cell, uint8 quadrant, double looseness, BOX *child)
+{
+	Point		middle;
+	float8		marginX = (cell->high.x - cell->low.x) / 4.0 * (looseness - 1.0);
+	float8		marginY = (cell->high.y - cell->low.y) / 4.0 * (looseness - 1.0);
+
+	getBoxCenter(cell, &middle);
+
+	if (quadrant & 0x2)
+	{
+		child->low.x = middle.x - marginX;
+		child->high.x = cell->high.x + marginX;
+	}
+	else
+	{
+		child->low.x = cell->low.x - marginX;
+		child->high.x = middle.x + marginX;
+	}
+
+	if (quadrant & 0x1)
+	{
+		child->low.y = middle.y - marginY;
+		child->high.y = cell->high.y + marginY;
+	}
+	else
+	{
+		child->low.y = cell->low.y - marginY;
+		child->high.y = middle.y + marginY;
+	}
+}
+
+/*
+ * Choose the node for the box: the quadrant of its center, if the box fits
+ * the enlarged child cell, or else the stay node
+ *
+ * Both choose and picksplit rely on this, and the inner consistent function
+ * relies on the boxes in each quadrant node being within the enlarged cell.
+ * We use exact comparisons, so the placement doesn't depend on EPSILON.
+ */
+static int
+getLooseNode(BOX *cell, BOX *box, double looseness)
+{
+	Point		center;
+	BOX			child;
+	uint8		quadrant;
+
+	getBoxCenter(box, &center);
+	quadrant = getLooseQuadrant(cell, &center);
+	getLooseChildCell(cell, quadrant, looseness, &child);
+
+	if (box->low.x >= child.low.x && box->high.x <= child.high.x &&
+		box->low.y >= child.low.y && box->high.y <= child.high.y)
+		return quadrant;
+
+	return LOOSE_QUAD_STAY_NODE;
+}
+
+/*
+ * Intersect the region with a child cell, to get the region of the child
+ *
+ * The result is allocated in the current memory context.  A NULL region
+ * stands for the whole plane.
+ */
+static BOX *
+intersectLooseRegion(BOX *region, BOX *child)
+{
+	BOX		   *result = (BOX *) palloc(sizeof(BOX));
+
+	*result = *child;
+
+	if (region != NULL)
+	{
+		result->low.x = Max(result->low.x, region->low.x);
+		result->high.x = Min(result->high.x, region->high.x);
+		result->low.y = Max(result->low.y, region->low.y);
+		result->high.y = Min(result->high.y, region->high.y);
+	}
+
+	return result;
+}
+
+/*
+ * Can any box contained in the region satisfy the query?
+ *
+ * This uses the same fuzzy comparisons as the box operators themselves, so
+ * that no box they would accept is excluded here.
+ */
+static bool
+looseRegionConsistent(BOX *region, StrategyNumber strategy, BOX *query)
+{
+	/* Nothing is known about an unbounded region */
+	if (region == NULL)
+		return true;
+
+	switch (strategy)
+	{
+		case RTOverlapStrategyNumber:
+		case RTContainedByStrategyNumber:
+			return FPle(region->low.x, query->high.x) &&
+				FPge(region->high.x, query->low.x) &&
+				FPle(region->low.y, query->high.y) &&
+				FPge(region->high.y, query->low.y);
+
+		case RTContainsStrategyNumber:
+		case RTSameStrategyNumber:
+			return FPle(region->low.x, query->low.x) &&
+				FPge(region->high.x, query->high.x) &&
+				FPle(region->low.y, query->low.y) &&
+				FPge(region->high.y, query->high.y);
+
+		case RTLeftStrategyNumber:
+			return FPlt(region->low.x, query->low.x);
+
+		case RTOverLeftStrategyNumber:
+			return FPle(region->low.x, query->high.x);
+
+		case RTRightStrategyNumber:
+			return FPgt(region->high.x, query->high.x);
+
+		case RTOverRightStrategyNumber:
+			return FPge(region->high.x, query->low.x);
+
+		case RTBelowStrategyNumber:
+			return FPlt(region->low.y, query->low.y);
+
+		case RTOverBelowStrategyNumber:
+			return FPle(region->low.y, query->high.y);
+
+		case RTAboveStrategyNumber:
+			return FPgt(region->high.y, query->high.y);
+
+		case RTOverAboveStrategyNumber:
+			return FPge(region->high.y, query->low.y);
+
+		default:
+			elog(ERROR, "unrecognized strategy: %d", strategy);
+	}
+
+	return false;
+}
+
+/* Lower bound for the distance between point and the region */
+static double
+pointToLooseRegionDistance(Point *point, BOX *region)
+{
+	double		dx;
+	double		dy;
+
+	if (region == NULL)
+		return 0.0;
+
+	if (point->x < region->low.x)
+		dx = region->low.x - point->x;
+	else if (point->x > region->high.x)
+		dx = point->x - region->high.x;
+	else
+		dx = 0;
+
+	if (point->y < region->low.y)
+		dy = region->low.y - point->y;
+	else if (point->y > region->high.y)
+		dy = point->y - region->high.y;
+	else
+		dy = 0;
+
+	return HYPOT(dx, dy);
+}
+
+/*
+ * SP-GiST config function
+ */
+Datum
+spg_box_loose_quad_config(PG_FUNCTION_ARGS)
+{
+	spgConfigOut *cfg = (spgConfigOut *) PG_GETARG_POINTER(1);
+
+	cfg->prefixType = BOXOID;	/* The cell of the inner tuple */
+	cfg->labelType = VOIDOID;	/* We don't need node labels. */
+	cfg->canReturnData = true;
+	cfg->longValuesOK = false;
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * SP-GiST choose function
+ */
+Datum
+spg_box_loose_quad_choose(PG_FUNCTION_ARGS)
+{
+	spgChooseIn *in = (spgChooseIn *) PG_GETARG_POINTER(0);
+	spgChooseOut *out = (spgChooseOut *) PG_GETARG_POINTER(1);
+	BOX		   *box = DatumGetBoxP(in->leafDatum);
+
+	out->resultType = spgMatchNode;
+	out->result.matchNode.restDatum = BoxPGetDatum(box);
+
+	/* nodeN will be set by core, when allTheSame. */
+	if (!in->allTheSame)
+		out->result.matchNode.nodeN =
+			getLooseNode(DatumGetBoxP(in->prefixDatum), box, in->looseness);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * SP-GiST pick-split function
+ *
+ * It takes the bounding box of the centers of the boxes as the cell, and
+ * distributes the boxes among its enlarged quadrants and the stay node.
+ */
+Datum
+spg_box_loose_quad_picksplit(PG_FUNCTION_ARGS)
+{
+	spgPickSplitIn *in = (spgPickSplitIn *) PG_GETARG_POINTER(0);
+	spgPickSplitOut *out = (spgPickSplitOut *) PG_GETARG_POINTER(1);
+	BOX		   *cell;
+	bool		first = true;
+	int			i;
+
+	cell = palloc0(sizeof(BOX));
+
+	/*
+	 * Boxes with infinite coordinates don't have a meaningful center, so we
+	 * leave them out; they will end up in the stay node anyway.  If there
+	 * are only such boxes, the cell stays empty at the origin.
+	 */
+	for (i = 0; i < in->nTuples; i++)
+	{
+		Point		center;
+
+		getBoxCenter(DatumGetBoxP(in->datums[i]), &center);
+
+		if (isinf(center.x) || isnan(center.x) ||
+			isinf(center.y) || isnan(center.y))
+			continue;
+
+		if (first)
+		{
+			cell->low = center;
+			cell->high = center;
+			first = false;
+		}
+		else
+		{
+			cell->low.x = Min(cell->low.x, center.x);
+			cell->high.x = Max(cell->high.x, center.x);
+			cell->low.y = Min(cell->low.y, center.y);
+			cell->high.y = Max(cell->high.y, center.y);
+		}
+	}
+
+	/* Fill the output */
+	out->hasPrefix = true;
+	out->prefixDatum = BoxPGetDatum(cell);
+
+	out->nNodes = LOOSE_QUAD_NNODES;
+	out->nodeLabels = NULL;		/* We don't need node labels. */
+
+	out->mapTuplesToNodes = palloc(sizeof(int) * in->nTuples);
+	out->leafTupleDatums = palloc(sizeof(Datum) * in->nTuples);
+
+	for (i = 0; i < in->nTuples; i++)
+	{
+		BOX		   *box = DatumGetBoxP(in->datums[i]);
+
+		out->leafTupleDatums[i] = BoxPGetDatum(box);
+		out->mapTuplesToNodes[i] = getLooseNode(cell, box, in->looseness);
+	}
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * SP-GiST inner consistent function
+ */
+Datum
+spg_box_loose_quad_inner_consistent(PG_FUNCTION_ARGS)
+{
+	spgInnerConsistentIn *in = (spgInnerConsistentIn *) PG_GETARG_POINTER(0);
+	spgInnerConsistentOut *out = (spgInnerConsistentOut *) PG_GETARG_POINTER(1);
+	BOX		   *region = (BOX *) in->traversalValue;
+	BOX		   *cell = DatumGetBoxP(in->prefixDatum);
+	MemoryContext old_ctx;
+	double	   *distances = NULL;
+	int			node,
+				i,
+				j;
+
+	/* Allocate enough memory for nodes */
+	out->nNodes = 0;
+	out->nodeNumbers = (int *) palloc(sizeof(int) * in->nNodes);
+	out->traversalValues = (void **) palloc(sizeof(void *) * in->nNodes);
+	if (in->norderbys > 0)
+	{
+		/* Distances of all the nodes go in a single array */
+		out->distances = (double **) palloc(sizeof(double *) * in->nNodes);
+		distances = (double *) palloc(sizeof(double) * in->nNodes *
+									  in->norderbys);
+	}
+
+	/*
+	 * We switch memory context, because we want to allocate memory for new
+	 * traversal values and pass these pieces of memory to further calls of
+	 * this function.
+	 */
+	old_ctx = MemoryContextSwitchTo(in->traversalMemoryContext);
+
+	for (node = 0; node < in->nNodes; node++)
+	{
+		BOX		   *next_region;
+		bool		flag = true;
+
+		/*
+		 * Nodes of an allTheSame tuple, and the stay node, can contain any
+		 * box of the current region.  The other nodes are restricted to the
+		 * enlarged cell of their quadrant.
+		 */
+		if (in->allTheSame || node == LOOSE_QUAD_STAY_NODE)
+		{
+			next_region = NULL;
+			if (region != NULL)
+			{
+				next_region = (BOX *) palloc(sizeof(BOX));
+				*next_region = *region;
+			}
+		}
+		else
+		{
+			BOX			child;
+
+			getLooseChildCell(cell, (uint8) node, in->looseness, &child);
+			next_region = intersectLooseRegion(region, &child);
+		}
+
+		for (i = 0; i < in->nkeys; i++)
+		{
+			flag = looseRegionConsistent(next_region,
+										 in->scankeys[i].sk_strategy,
+										 DatumGetBoxP(in->scankeys[i].sk_argument));
+
+			/* If any check is failed, we have found our answer. */
+			if (!flag)
+				break;
+		}
+
+		if (flag)
+		{
+			out->traversalValues[out->nNodes] = next_region;
+			out->nodeNumbers[out->nNodes] = node;
+
+			if (in->norderbys > 0)
+			{
+				double	   *nodeDistances;
+
+				nodeDistances = distances + out->nNodes * in->norderbys;
+				out->distances[out->nNodes] = nodeDistances;
+
+				for (j = 0; j < in->norderbys; j++)
+				{
+					Point	   *pt = DatumGetPointP(in->orderbys[j].sk_argument);
+
+					nodeDistances[j] = pointToLooseRegionDistance(pt, next_region);
+				}
+			}
+
+			out->nNodes++;
+		}
+		else if (next_region)
+		{
+			/*
+			 * If this node is not selected, we don't need to keep the next
+			 * traversal value in the memory context.
+			 */
+			pfree(next_region);
+		}
+	}
+
+	/* Switch back */
+	MemoryContextSwitchTo(old_ctx);
+
+	PG_RETURN_VOID();
+}
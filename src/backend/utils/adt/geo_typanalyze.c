@@ -0,0 +1,262 @@
+/*-------------------------------------------------------------------------
+ *
+ * geo_typanalyze.c
+ *	  Functions for gathering statistics from geometric columns
+ *
+ * For point, box, polygon and circle columns, we collect a two-dimensional grid
+ * describing where the bounding boxes of the values lie.  Each value is
+ * reduced to the center of its bounding box, and the centers are counted in
+ * a regular n x n grid laid over the extent of all the centers.  The average
+ * width and height of the bounding boxes are stored alongside, so that the
+ * selectivity functions in geo_selfuncs.c can reason about overlap and
+ * containment as well as position.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/geo_typanalyze.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <float.h>
+#include <math.h>
+
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "commands/vacuum.h"
+#include "utils/builtins.h"
+#include "utils/float.h"
+#include "utils/geo_decls.h"
+#include "utils/lsyscache.h"
+
+/*
+ * The grid has n x n cells, where n grows with the square root of the
+ * statistics target so that the number of cells is comparable to the number
+ * of histogram entries std_typanalyze would store.  The join selectivity
+ * estimator visits every cell of one grid for every cell of the other, so
+ * keep the grid reasonably small even at large statistics targets.
+ */
+#define GEO_GRID_MAX_SIZE	32
+
+static void compute_geo_stats(VacAttrStats *stats,
+							  AnalyzeAttrFetchFunc fetchfunc, int samplerows, double totalrows);
+static int	geo_grid_cell(float8 val, float8 low, float8 high, int n);
+
+/*
+ * geo_typanalyze -- typanalyze function for geometric columns
+ */
+Datum
+geo_typanalyze(PG_FUNCTION_ARGS)
+{
+	VacAttrStats *stats = (VacAttrStats *) PG_GETARG_POINTER(0);
+	Form_pg_attribute attr = stats->attr;
+
+	if (attr->attstattarget < 0)
+		attr->attstattarget = default_statistics_target;
+
+	stats->compute_stats = compute_geo_stats;
+	stats->extra_data = NULL;
+	/* same as in std_typanalyze */
+	stats->minrows = 300 * attr->attstattarget;
+
+	PG_RETURN_BOOL(true);
+}
+
+/*
+ * Return the cell number of "val" in a grid of n cells evenly dividing
+ * [low, high].  Values on the upper boundary belong to the last cell.
+ */
+static int
+geo_grid_cell(float8 val, float8 low, float8 high, int n)
+{
+	float8		width = high - low;
+	float8		pos;
+
+	if (!(high > low))
+		return 0;
+
+	/*
+	 * The distance between two finite values can overflow, but half of it
+	 * can't.
+	 */
+	if (isinf(width))
+		pos = (val / 2 - low / 2) / (high / 2 - low / 2) * n;
+	else
+		pos = (val - low) / width * n;
+
+	/* Clamp while still in float8, so the cast can't overflow */
+	if (isnan(pos) || pos < 0)
+		return 0;
+	if (pos >= n)
+		return n - 1;
+	return (int) pos;
+}
+
+/*
+ * compute_geo_stats() -- compute statistics for a geometric column
+ */
+static void
+compute_geo_stats(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfunc,
+				  int samplerows, double totalrows)
+{
+	Oid			typid = getBaseType(stats->attrtypid);
+	bool		is_varwidth = (stats->attrtype->typlen < 0);
+	int			null_cnt = 0;
+	int			non_null_cnt = 0;
+	int			finite_cnt = 0;
+	int			value_no;
+	int			i;
+	Point	   *centers;
+	BOX			extent;
+	double		total_width = 0;
+	double		avg_bbox_halfwidth = 0;
+	double		avg_bbox_halfheight = 0;
+
+	/* Remember the bounding box center of each sampled value */
+	centers = (Point *) palloc(sizeof(Point) * samplerows);
+
+	for (value_no = 0; value_no < samplerows; value_no++)
+	{
+		Datum		value;
+		bool		isnull;
+		BOX			bbox;
+
+		vacuum_delay_point();
+
+		value = fetchfunc(stats, value_no, &isnull);
+		if (isnull)
+		{
+			/* value is null, just count that */
+			null_cnt++;
+			continue;
+		}
+		non_null_cnt++;
+
+		if (is_varwidth)
+			total_width += VARSIZE_ANY(DatumGetPointer(value));
+		else
+			total_width += stats->attrtype->typlen;
+
+		if (!geo_datum_bbox(typid, value, &bbox))
+			elog(ERROR, "unexpected geometric type: %u", typid);
+
+		/*
+		 * Values that aren't finite can't be placed in the grid.  They are
+		 * still counted as non-null values, so the cell fractions of the
+		 * finite ones add up to less than 1.
+		 */
+		if (isnan(bbox.low.x) || isnan(bbox.low.y) ||
+			isnan(bbox.high.x) || isnan(bbox.high.y) ||
+			isinf(bbox.low.x) || isinf(bbox.low.y) ||
+			isinf(bbox.high.x) || isinf(bbox.high.y))
+			continue;
+
+		/*
+		 * Work with halves of the coordinates, which can't overflow even for
+		 * the largest finite boxes, and keep running averages of the sizes
+		 * rather than sums.
+		 */
+		centers[finite_cnt].x = bbox.low.x / 2 + bbox.high.x / 2;
+		centers[finite_cnt].y = bbox.low.y / 2 + bbox.high.y / 2;
+		avg_bbox_halfwidth += (bbox.high.x / 2 - bbox.low.x / 2 -
+							   avg_bbox_halfwidth) / (finite_cnt + 1);
+		avg_bbox_halfheight += (bbox.high.y / 2 - bbox.low.y / 2 -
+								avg_bbox_halfheight) / (finite_cnt + 1);
+
+		if (finite_cnt == 0)
+		{
+			extent.low = centers[0];
+			extent.high = centers[0];
+		}
+		else
+		{
+			extent.low.x = Min(extent.low.x, centers[finite_cnt].x);
+			extent.low.y = Min(extent.low.y, centers[finite_cnt].y);
+			extent.high.x = Max(extent.high.x, centers[finite_cnt].x);
+			extent.high.y = Max(extent.high.y, centers[finite_cnt].y);
+		}
+		finite_cnt++;
+	}
+
+	/* We can only compute real stats if we found some non-null values. */
+	if (non_null_cnt > 0)
+	{
+		stats->stats_valid = true;
+		/* Do the simple null-frac and width stats */
+		stats->stanullfrac = (double) null_cnt / (double) samplerows;
+		stats->stawidth = total_width / (double) non_null_cnt;
+		stats->stadistinct = 0.0;	/* "unknown" */
+
+		/* Generate a grid slot entry if there are any finite values */
+		if (finite_cnt > 0)
+		{
+			MemoryContext old_cxt;
+			int			n;
+			int			ncells;
+			float4	   *numbers;
+			Datum	   *values;
+			BOX		   *extentp;
+
+			n = (int) sqrt(4.0 * stats->attr->attstattarget);
+			n = Max(n, 1);
+			n = Min(n, GEO_GRID_MAX_SIZE);
+			ncells = n * n;
+
+			/* Must copy the target values into anl_context */
+			old_cxt = MemoryContextSwitchTo(stats->anl_context);
+
+			numbers = (float4 *) palloc0(sizeof(float4) * (ncells + 2));
+			for (i = 0; i < finite_cnt; i++)
+			{
+				int			cx = geo_grid_cell(centers[i].x, extent.low.x,
+											   extent.high.x, n);
+				int			cy = geo_grid_cell(centers[i].y, extent.low.y,
+											   extent.high.y, n);
+
+				numbers[cy * n + cx] += 1.0;
+			}
+			for (i = 0; i < ncells; i++)
+				numbers[i] /= (double) non_null_cnt;
+
+			/*
+			 * The sizes are stored as float4.  Store the ones that don't fit
+			 * as infinity, rather than leaving the conversion undefined.
+			 */
+			numbers[ncells] = (avg_bbox_halfwidth * 2 > FLT_MAX) ?
+				get_float4_infinity() : avg_bbox_halfwidth * 2;
+			numbers[ncells + 1] = (avg_bbox_halfheight * 2 > FLT_MAX) ?
+				get_float4_infinity() : avg_bbox_halfheight * 2;
+
+			extentp = (BOX *) palloc(sizeof(BOX));
+			*extentp = extent;
+			values = (Datum *) palloc(sizeof(Datum));
+			values[0] = BoxPGetDatum(extentp);
+
+			stats->stakind[0] = STATISTIC_KIND_BOUNDS_GRID;
+			stats->staop[0] = InvalidOid;
+			stats->stacoll[0] = InvalidOid;
+			stats->stanumbers[0] = numbers;
+			stats->numnumbers[0] = ncells + 2;
+			stats->stavalues[0] = values;
+			stats->numvalues[0] = 1;
+			stats->statypid[0] = BOXOID;
+			stats->statyplen[0] = sizeof(BOX);
+			stats->statypbyval[0] = false;
+			stats->statypalign[0] = 'd';
+
+			MemoryContextSwitchTo(old_cxt);
+		}
+	}
+	else if (null_cnt > 0)
+	{
+		/* We found only nulls; assume the column is entirely null */
+		stats->stats_valid = true;
+		stats->stanullfrac = 1.0;
+		stats->stawidth = 0;	/* "unknown" */
+		stats->stadistinct = 0.0;	/* "unknown" */
+	}
+}
@@ -84,6 +84,70 @@ pg_stat_get_tuples_fetched(PG_FUNCTION_ARGS)
 }
 
 
+Datum
+pg_stat_get_inner_visited(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int64		result;
+	PgStat_StatTabEntry *tabentry;
+
+	if ((tabentry = pgstat_fetch_stat_tabentry(relid)) == NULL)
+		result = 0;
+	else
+		result = (int64) (tabentry->inner_visited);
+
+	PG_RETURN_INT64(result);
+}
+
+
+Datum
+pg_stat_get_leaf_tested(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int64		result;
+	PgStat_StatTabEntry *tabentry;
+
+	if ((tabentry = pgstat_fetch_stat_tabentry(relid)) == NULL)
+		result = 0;
+	else
+		result = (int64) (tabentry->leaf_tested);
+
+	PG_RETURN_INT64(result);
+}
+
+
+Datum
+pg_stat_get_consistent_rejected(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int64		result;
+	PgStat_StatTabEntry *tabentry;
+
+	if ((tabentry = pgstat_fetch_stat_tabentry(relid)) == NULL)
+		result = 0;
+	else
+		result = (int64) (tabentry->consistent_rejected);
+
+	PG_RETURN_INT64(result);
+}
+
+
+Datum
+pg_stat_get_leaf_rechecked(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int64		result;
+	PgStat_StatTabEntry *tabentry;
+
+	if ((tabentry = pgstat_fetch_stat_tabentry(relid)) == NULL)
+		result = 0;
+	else
+		result = (int64) (tabentry->leaf_rechecked);
+
+	PG_RETURN_INT64(result);
+}
+
+
 Datum
 pg_stat_get_tuples_inserted(PG_FUNCTION_ARGS)
 {
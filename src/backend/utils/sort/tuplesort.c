@@ -96,11 +96,13 @@
 
 #include <limits.h>
 
+#include "access/gist.h"
 #include "access/hash.h"
 #include "access/htup_details.h"
 #include "access/nbtree.h"
 #include "catalog/index.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_collation.h"
 #include "commands/tablespace.h"
 #include "executor/executor.h"
 #include "miscadmin.h"
@@ -241,7 +243,10 @@ struct Tuplesortstate
 	int64		allowedMem;		/* total memory allowed, in bytes */
 	int			maxTapes;		/* number of tapes (Knuth's T) */
 	int			tapeRange;		/* maxTapes-1 (Knuth's P) */
-	MemoryContext sortcontext;	/* memory context holding most sort data */
+	MemoryContext maincontext;	/* memory context for sort metadata that
+								 * persists across tuplesort_reset() */
+	MemoryContext sortcontext;	/* sub-context of maincontext holding most
+								 * per-batch sort data */
 	MemoryContext tuplecontext; /* sub-context of sortcontext for tuple data */
 	LogicalTapeSet *tapeset;	/* logtape.c object for tapes in a temp file */
 
@@ -432,6 +437,7 @@ struct Tuplesortstate
 	 */
 	IndexInfo  *indexInfo;		/* info about index being used for reference */
 	EState	   *estate;			/* for evaluating index expressions */
+	Relation	clusterIndexRel;	/* GiST index to order by, or NULL */
 
 	/*
 	 * These variables are specific to the IndexTuple case; they are set by
@@ -591,6 +597,7 @@ struct Sharedsort
 static Tuplesortstate *tuplesort_begin_common(int workMem,
 											  SortCoordinate coordinate,
 											  bool randomAccess);
+static void tuplesort_begin_batch(Tuplesortstate *state);
 static void puttuple_common(Tuplesortstate *state, SortTuple *tuple);
 static bool consider_abort_common(Tuplesortstate *state);
 static void inittapes(Tuplesortstate *state, bool mergeruns);
@@ -622,6 +629,12 @@ static void readtup_heap(Tuplesortstate *state, SortTuple *stup,
 static int	comparetup_cluster(const SortTuple *a, const SortTuple *b,
 							   Tuplesortstate *state);
 static void copytup_cluster(Tuplesortstate *state, SortTuple *stup, void *tup);
+static int	comparetup_cluster_gist(const SortTuple *a, const SortTuple *b,
+									Tuplesortstate *state);
+static void copytup_cluster_gist(Tuplesortstate *state, SortTuple *stup,
+								 void *tup);
+static void cluster_gist_keys(Tuplesortstate *state, HeapTuple tuple,
+							  Datum *values, bool *isnull);
 static void writetup_cluster(Tuplesortstate *state, int tapenum,
 							 SortTuple *stup);
 static void readtup_cluster(Tuplesortstate *state, SortTuple *stup,
@@ -682,8 +695,8 @@ tuplesort_begin_common(int workMem, SortCoordinate coordinate,
 					   bool randomAccess)
 {
 	Tuplesortstate *state;
+	MemoryContext maincontext;
 	MemoryContext sortcontext;
-	MemoryContext tuplecontext;
 	MemoryContext oldcontext;
 
 	/* See leader_takeover_tapes() remarks on randomAccess support */
@@ -691,31 +704,26 @@ tuplesort_begin_common(int workMem, SortCoordinate coordinate,
 		elog(ERROR, "random access disallowed under parallel sort");
 
 	/*
-	 * Create a working memory context for this sort operation. All data
-	 * needed by the sort will live inside this context.
+	 * Memory context surviving tuplesort_reset.  This memory context holds
+	 * data which is useful to keep while sorting multiple similar batches.
 	 */
-	sortcontext = AllocSetContextCreate(CurrentMemoryContext,
+	maincontext = AllocSetContextCreate(CurrentMemoryContext,
 										"TupleSort main",
 										ALLOCSET_DEFAULT_SIZES);
 
 	/*
-	 * Caller tuple (e.g. IndexTuple) memory context.
-	 *
-	 * A dedicated child context used exclusively for caller passed tuples
-	 * eases memory management.  Resetting at key points reduces
-	 * fragmentation. Note that the memtuples array of SortTuples is allocated
-	 * in the parent context, not this context, because there is no need to
-	 * free memtuples early.
+	 * Create a working memory context for one sort operation.  The content of
+	 * this context is deleted by tuplesort_reset.
 	 */
-	tuplecontext = AllocSetContextCreate(sortcontext,
-										 "Caller tuples",
-										 ALLOCSET_DEFAULT_SIZES);
+	sortcontext = AllocSetContextCreate(maincontext,
+										"TupleSort sort",
+										ALLOCSET_DEFAULT_SIZES);
 
 	/*
-	 * Make the Tuplesortstate within the per-sort context.  This way, we
-	 * don't need a separate pfree() operation for it at shutdown.
+	 * Make the Tuplesortstate within the main context.  This way, we don't
+	 * need a separate pfree() operation for it at shutdown.
 	 */
-	oldcontext = MemoryContextSwitchTo(sortcontext);
+	oldcontext = MemoryContextSwitchTo(maincontext);
 
 	state = (Tuplesortstate *) palloc0(sizeof(Tuplesortstate));
 
@@ -724,11 +732,8 @@ tuplesort_begin_common(int workMem, SortCoordinate coordinate,
 		pg_rusage_init(&state->ru_start);
 #endif
 
-	state->status = TSS_INITIAL;
 	state->randomAccess = randomAccess;
-	state->bounded = false;
 	state->tuples = true;
-	state->boundUsed = false;
 
 	/*
 	 * workMem is forced to be at least 64KB, the current minimum valid value
@@ -737,38 +742,10 @@ tuplesort_begin_common(int workMem, SortCoordinate coordinate,
 	 * with very little memory.
 	 */
 	state->allowedMem = Max(workMem, 64) * (int64) 1024;
-	state->availMem = state->allowedMem;
+	state->maincontext = maincontext;
 	state->sortcontext = sortcontext;
-	state->tuplecontext = tuplecontext;
-	state->tapeset = NULL;
-
-	state->memtupcount = 0;
-
-	/*
-	 * Initial size of array must be more than ALLOCSET_SEPARATE_THRESHOLD;
-	 * see comments in grow_memtuples().
-	 */
-	state->memtupsize = Max(1024,
-							ALLOCSET_SEPARATE_THRESHOLD / sizeof(SortTuple) + 1);
-
-	state->growmemtuples = true;
-	state->slabAllocatorUsed = false;
-	state->memtuples = (SortTuple *) palloc(state->memtupsize * sizeof(SortTuple));
-
-	USEMEM(state, GetMemoryChunkSpace(state->memtuples));
-
-	/* workMem must be large enough for the minimal memtuples array */
-	if (LACKMEM(state))
-		elog(ERROR, "insufficient memory allowed for sort");
 
-	state->currentRun = 0;
-
-	/*
-	 * maxTapes, tapeRange, and Algorithm D variables will be initialized by
-	 * inittapes(), if needed
-	 */
-
-	state->result_tape = -1;	/* flag that result tape has not been formed */
+	tuplesort_begin_batch(state);
 
 	/*
 	 * Initialize parallel-related state based on coordination information
@@ -802,6 +779,72 @@ tuplesort_begin_common(int workMem, SortCoordinate coordinate,
 	return state;
 }
 
+/*
+ *		tuplesort_begin_batch
+ *
+ * Set up, or reset, all state needed for processing a new set of tuples with
+ * this sort state.  Called both from tuplesort_begin_common (the first time
+ * sorting with this sort state) and tuplesort_reset (for subsequent usages).
+ */
+static void
+tuplesort_begin_batch(Tuplesortstate *state)
+{
+	MemoryContext oldcontext;
+
+	oldcontext = MemoryContextSwitchTo(state->sortcontext);
+
+	/*
+	 * Caller tuple (e.g. IndexTuple) memory context.
+	 *
+	 * A dedicated child context used exclusively for caller passed tuples
+	 * eases memory management.  Resetting at key points reduces
+	 * fragmentation. Note that the memtuples array of SortTuples is allocated
+	 * in the parent context, not this context, because there is no need to
+	 * free memtuples early.
+	 */
+	state->tuplecontext = AllocSetContextCreate(state->sortcontext,
+												"Caller tuples",
+												ALLOCSET_DEFAULT_SIZES);
+
+	state->status = TSS_INITIAL;
+	state->bounded = false;
+	state->boundUsed = false;
+
+	state->availMem = state->allowedMem;
+
+	state->tapeset = NULL;
+
+	state->memtupcount = 0;
+
+	/*
+	 * Initial size of array must be more than ALLOCSET_SEPARATE_THRESHOLD;
+	 * see comments in grow_memtuples().
+	 */
+	state->memtupsize = Max(1024,
+							ALLOCSET_SEPARATE_THRESHOLD / sizeof(SortTuple) + 1);
+
+	state->growmemtuples = true;
+	state->slabAllocatorUsed = false;
+	state->memtuples = (SortTuple *) palloc(state->memtupsize * sizeof(SortTuple));
+
+	USEMEM(state, GetMemoryChunkSpace(state->memtuples));
+
+	/* workMem must be large enough for the minimal memtuples array */
+	if (LACKMEM(state))
+		elog(ERROR, "insufficient memory allowed for sort");
+
+	state->currentRun = 0;
+
+	/*
+	 * maxTapes, tapeRange, and Algorithm D variables will be initialized by
+	 * inittapes(), if needed
+	 */
+
+	state->result_tape = -1;	/* flag that result tape has not been formed */
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
 Tuplesortstate *
 tuplesort_begin_heap(TupleDesc tupDesc,
 					 int nkeys, AttrNumber *attNums,
@@ -814,7 +857,7 @@ tuplesort_begin_heap(TupleDesc tupDesc,
 	MemoryContext oldcontext;
 	int			i;
 
-	oldcontext = MemoryContextSwitchTo(state->sortcontext);
+	oldcontext = MemoryContextSwitchTo(state->maincontext);
 
 	AssertArg(nkeys > 0);
 
@@ -884,13 +927,13 @@ tuplesort_begin_cluster(TupleDesc tupDesc,
 {
 	Tuplesortstate *state = tuplesort_begin_common(workMem, coordinate,
 												   randomAccess);
-	BTScanInsert indexScanKey;
 	MemoryContext oldcontext;
 	int			i;
 
-	Assert(indexRel->rd_rel->relam == BTREE_AM_OID);
+	Assert(indexRel->rd_rel->relam == BTREE_AM_OID ||
+		   indexRel->rd_rel->relam == GIST_AM_OID);
 
-	oldcontext = MemoryContextSwitchTo(state->sortcontext);
+	oldcontext = MemoryContextSwitchTo(state->maincontext);
 
 #ifdef TRACE_SORT
 	if (trace_sort)
@@ -909,8 +952,17 @@ tuplesort_begin_cluster(TupleDesc tupDesc,
 								randomAccess,
 								PARALLEL_SORT(state));
 
-	state->comparetup = comparetup_cluster;
-	state->copytup = copytup_cluster;
+	if (indexRel->rd_rel->relam == GIST_AM_OID)
+	{
+		state->comparetup = comparetup_cluster_gist;
+		state->copytup = copytup_cluster_gist;
+		state->clusterIndexRel = indexRel;
+	}
+	else
+	{
+		state->comparetup = comparetup_cluster;
+		state->copytup = copytup_cluster;
+	}
 	state->writetup = writetup_cluster;
 	state->readtup = readtup_cluster;
 	state->abbrevNext = 10;
@@ -919,9 +971,8 @@ tuplesort_begin_cluster(TupleDesc tupDesc,
 
 	state->tupDesc = tupDesc;	/* assume we need not copy tupDesc */
 
-	indexScanKey = _bt_mkscankey(indexRel, NULL);
-
-	if (state->indexInfo->ii_Expressions != NULL)
+	if (state->indexInfo->ii_Expressions != NULL ||
+		state->clusterIndexRel != NULL)
 	{
 		TupleTableSlot *slot;
 		ExprContext *econtext;
@@ -930,10 +981,12 @@ tuplesort_begin_cluster(TupleDesc tupDesc,
 		 * We will need to use FormIndexDatum to evaluate the index
 		 * expressions.  To do that, we need an EState, as well as a
 		 * TupleTableSlot to put the table tuples into.  The econtext's
-		 * scantuple has to point to that slot, too.
+		 * scantuple has to point to that slot, too.  The GiST case also uses
+		 * the per-tuple memory context of the EState for the compressed
+		 * keys.
 		 */
 		state->estate = CreateExecutorState();
-		slot = MakeSingleTupleTableSlot(tupDesc, &TTSOpsVirtual);
+		slot = MakeSingleTupleTableSlot(tupDesc, &TTSOpsHeapTuple);
 		econtext = GetPerTupleExprContext(state->estate);
 		econtext->ecxt_scantuple = slot;
 	}
@@ -942,29 +995,55 @@ tuplesort_begin_cluster(TupleDesc tupDesc,
 	state->sortKeys = (SortSupport) palloc0(state->nKeys *
 											sizeof(SortSupportData));
 
-	for (i = 0; i < state->nKeys; i++)
+	if (state->clusterIndexRel != NULL)
 	{
-		SortSupport sortKey = state->sortKeys + i;
-		ScanKey		scanKey = indexScanKey->scankeys + i;
-		int16		strategy;
+		/*
+		 * A GiST index has no order of its own, so order the heap by the
+		 * sort support functions of its operator classes, as a sorted build
+		 * of the index would order its entries.
+		 */
+		for (i = 0; i < state->nKeys; i++)
+		{
+			SortSupport sortKey = state->sortKeys + i;
 
-		sortKey->ssup_cxt = CurrentMemoryContext;
-		sortKey->ssup_collation = scanKey->sk_collation;
-		sortKey->ssup_nulls_first =
-			(scanKey->sk_flags & SK_BT_NULLS_FIRST) != 0;
-		sortKey->ssup_attno = scanKey->sk_attno;
-		/* Convey if abbreviation optimization is applicable in principle */
-		sortKey->abbreviate = (i == 0);
+			sortKey->ssup_cxt = CurrentMemoryContext;
+			sortKey->ssup_collation = indexRel->rd_indcollation[i];
+			sortKey->ssup_nulls_first = false;
+			sortKey->ssup_attno = i + 1;
+			/* Convey if abbreviation optimization is applicable in principle */
+			sortKey->abbreviate = (i == 0);
 
-		AssertState(sortKey->ssup_attno != 0);
+			PrepareSortSupportFromGistIndexRel(indexRel, sortKey);
+		}
+	}
+	else
+	{
+		BTScanInsert indexScanKey = _bt_mkscankey(indexRel, NULL);
 
-		strategy = (scanKey->sk_flags & SK_BT_DESC) != 0 ?
-			BTGreaterStrategyNumber : BTLessStrategyNumber;
+		for (i = 0; i < state->nKeys; i++)
+		{
+			SortSupport sortKey = state->sortKeys + i;
+			ScanKey		scanKey = indexScanKey->scankeys + i;
+			int16		strategy;
 
-		PrepareSortSupportFromIndexRel(indexRel, strategy, sortKey);
-	}
+			sortKey->ssup_cxt = CurrentMemoryContext;
+			sortKey->ssup_collation = scanKey->sk_collation;
+			sortKey->ssup_nulls_first =
+				(scanKey->sk_flags & SK_BT_NULLS_FIRST) != 0;
+			sortKey->ssup_attno = scanKey->sk_attno;
+			/* Convey if abbreviation optimization is applicable in principle */
+			sortKey->abbreviate = (i == 0);
 
-	pfree(indexScanKey);
+			AssertState(sortKey->ssup_attno != 0);
+
+			strategy = (scanKey->sk_flags & SK_BT_DESC) != 0 ?
+				BTGreaterStrategyNumber : BTLessStrategyNumber;
+
+			PrepareSortSupportFromIndexRel(indexRel, strategy, sortKey);
+		}
+
+		pfree(indexScanKey);
+	}
 
 	MemoryContextSwitchTo(oldcontext);
 
@@ -985,7 +1064,7 @@ tuplesort_begin_index_btree(Relation heapRel,
 	MemoryContext oldcontext;
 	int			i;
 
-	oldcontext = MemoryContextSwitchTo(state->sortcontext);
+	oldcontext = MemoryContextSwitchTo(state->maincontext);
 
 #ifdef TRACE_SORT
 	if (trace_sort)
@@ -1063,7 +1142,7 @@ tuplesort_begin_index_hash(Relation heapRel,
 												   randomAccess);
 	MemoryContext oldcontext;
 
-	oldcontext = MemoryContextSwitchTo(state->sortcontext);
+	oldcontext = MemoryContextSwitchTo(state->maincontext);
 
 #ifdef TRACE_SORT
 	if (trace_sort)
@@ -1095,6 +1174,73 @@ tuplesort_begin_index_hash(Relation heapRel,
 	return state;
 }
 
+Tuplesortstate *
+tuplesort_begin_index_gist(Relation heapRel,
+						   Relation indexRel,
+						   int workMem,
+						   SortCoordinate coordinate,
+						   bool randomAccess)
+{
+	Tuplesortstate *state = tuplesort_begin_common(workMem, coordinate,
+												   randomAccess);
+	MemoryContext oldcontext;
+	int			i;
+
+	oldcontext = MemoryContextSwitchTo(state->maincontext);
+
+#ifdef TRACE_SORT
+	if (trace_sort)
+		elog(LOG,
+			 "begin index sort: workMem = %d, randomAccess = %c",
+			 workMem, randomAccess ? 't' : 'f');
+#endif
+
+	state->nKeys = IndexRelationGetNumberOfKeyAttributes(indexRel);
+
+	TRACE_POSTGRESQL_SORT_START(INDEX_SORT,
+								false,	/* no unique check */
+								state->nKeys,
+								workMem,
+								randomAccess,
+								PARALLEL_SORT(state));
+
+	/* The tuples are compared just like for a non-unique btree build */
+	state->comparetup = comparetup_index_btree;
+	state->copytup = copytup_index;
+	state->writetup = writetup_index;
+	state->readtup = readtup_index;
+	state->abbrevNext = 10;
+
+	state->heapRel = heapRel;
+	state->indexRel = indexRel;
+	state->enforceUnique = false;
+
+	/* Prepare SortSupport data for each column */
+	state->sortKeys = (SortSupport) palloc0(state->nKeys *
+											sizeof(SortSupportData));
+
+	for (i = 0; i < state->nKeys; i++)
+	{
+		SortSupport sortKey = state->sortKeys + i;
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation = indexRel->rd_indcollation[i];
+		sortKey->ssup_nulls_first = false;
+		sortKey->ssup_attno = i + 1;
+		/* Convey if abbreviation optimization is applicable in principle */
+		sortKey->abbreviate = (i == 0);
+
+		AssertState(sortKey->ssup_attno != 0);
+
+		/* Look for a sort support function */
+		PrepareSortSupportFromGistIndexRel(indexRel, sortKey);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return state;
+}
+
 Tuplesortstate *
 tuplesort_begin_datum(Oid datumType, Oid sortOperator, Oid sortCollation,
 					  bool nullsFirstFlag, int workMem,
@@ -1106,7 +1252,7 @@ tuplesort_begin_datum(Oid datumType, Oid sortOperator, Oid sortCollation,
 	int16		typlen;
 	bool		typbyval;
 
-	oldcontext = MemoryContextSwitchTo(state->sortcontext);
+	oldcontext = MemoryContextSwitchTo(state->maincontext);
 
 #ifdef TRACE_SORT
 	if (trace_sort)
@@ -1224,16 +1370,12 @@ tuplesort_set_bound(Tuplesortstate *state, int64 bound)
 }
 
 /*
- * tuplesort_end
- *
- *	Release resources and clean up.
+ * tuplesort_free
  *
- * NOTE: after calling this, any pointers returned by tuplesort_getXXX are
- * pointing to garbage.  Be careful not to attempt to use or free such
- * pointers afterwards!
+ *	Internal routine for freeing resources of tuplesort.
  */
-void
-tuplesort_end(Tuplesortstate *state)
+static void
+tuplesort_free(Tuplesortstate *state)
 {
 	/* context swap probably not needed, but let's be safe */
 	MemoryContext oldcontext = MemoryContextSwitchTo(state->sortcontext);
@@ -1286,15 +1428,64 @@ tuplesort_end(Tuplesortstate *state)
 
 		ExecDropSingleTupleTableSlot(econtext->ecxt_scantuple);
 		FreeExecutorState(state->estate);
+		state->estate = NULL;
 	}
 
 	MemoryContextSwitchTo(oldcontext);
 
 	/*
-	 * Free the per-sort memory context, thereby releasing all working memory,
-	 * including the Tuplesortstate struct itself.
+	 * Free the per-sort memory context, thereby releasing all working memory.
 	 */
-	MemoryContextDelete(state->sortcontext);
+	MemoryContextReset(state->sortcontext);
+}
+
+/*
+ * tuplesort_end
+ *
+ *	Release resources and clean up.
+ *
+ * NOTE: after calling this, any pointers returned by tuplesort_getXXX are
+ * pointing to garbage.  Be careful not to attempt to use or free such
+ * pointers afterwards!
+ */
+void
+tuplesort_end(Tuplesortstate *state)
+{
+	tuplesort_free(state);
+
+	/*
+	 * Free the main memory context, including the Tuplesortstate struct
+	 * itself.
+	 */
+	MemoryContextDelete(state->maincontext);
+}
+
+/*
+ * tuplesort_reset
+ *
+ *	Reset the tuplesort.  Reset all the data in the tuplesort, but leave the
+ *	meta-information in.  After tuplesort_reset, tuplesort is ready to start
+ *	a new sort.  This allows avoiding recreation of tuple sort states (and
+ *	save resources) when sorting multiple small batches.
+ */
+void
+tuplesort_reset(Tuplesortstate *state)
+{
+	/* Reuse is only supported for serial sorts */
+	Assert(SERIAL(state));
+
+	tuplesort_free(state);
+
+	/*
+	 * After we've freed up per-batch memory, re-setup all of the state common
+	 * to both the first batch and any subsequent batch.
+	 */
+	tuplesort_begin_batch(state);
+
+	state->lastReturnedTuple = NULL;
+	state->slabMemoryBegin = NULL;
+	state->slabMemoryEnd = NULL;
+	state->slabFreeHead = NULL;
 }
 
 /*
@@ -3888,6 +4079,158 @@ copytup_cluster(Tuplesortstate *state, SortTuple *stup, void *tup)
 	}
 }
 
+/*
+ * Routines specialized for CLUSTER on a GiST index (HeapTuple data, with
+ * comparisons per the sort support functions of the index's operator
+ * classes)
+ *
+ * The sort support functions compare keys as they are stored in the index,
+ * so each key has to be passed through the opclass's compress function
+ * first.  The compressed keys are not kept with the tuples: datum1 holds the
+ * abbreviated leading key when abbreviation is in use, and is ignored
+ * otherwise, and the keys are recomputed whenever a full comparison is
+ * needed.
+ */
+
+static int
+comparetup_cluster_gist(const SortTuple *a, const SortTuple *b,
+						Tuplesortstate *state)
+{
+	SortSupport sortKey = state->sortKeys;
+	Datum		l_values[INDEX_MAX_KEYS];
+	bool		l_isnull[INDEX_MAX_KEYS];
+	Datum		r_values[INDEX_MAX_KEYS];
+	bool		r_isnull[INDEX_MAX_KEYS];
+	int			nkey;
+	int32		compare;
+
+	/* Compare the abbreviated leading keys, if we have them */
+	if (sortKey->abbrev_converter)
+	{
+		compare = ApplySortComparator(a->datum1, a->isnull1,
+									  b->datum1, b->isnull1,
+									  sortKey);
+		if (compare != 0)
+			return compare;
+	}
+
+	/* Reset context each time to prevent memory leakage */
+	ResetPerTupleExprContext(state->estate);
+
+	cluster_gist_keys(state, (HeapTuple) a->tuple, l_values, l_isnull);
+	cluster_gist_keys(state, (HeapTuple) b->tuple, r_values, r_isnull);
+
+	for (nkey = 0; nkey < state->nKeys; nkey++, sortKey++)
+	{
+		if (nkey == 0 && sortKey->abbrev_converter)
+			compare = ApplySortAbbrevFullComparator(l_values[nkey],
+													l_isnull[nkey],
+													r_values[nkey],
+													r_isnull[nkey],
+													sortKey);
+		else
+			compare = ApplySortComparator(l_values[nkey],
+										  l_isnull[nkey],
+										  r_values[nkey],
+										  r_isnull[nkey],
+										  sortKey);
+		if (compare != 0)
+			return compare;
+	}
+
+	return 0;
+}
+
+static void
+copytup_cluster_gist(Tuplesortstate *state, SortTuple *stup, void *tup)
+{
+	HeapTuple	tuple = (HeapTuple) tup;
+	MemoryContext oldcontext = MemoryContextSwitchTo(state->tuplecontext);
+
+	/* copy the tuple into sort storage */
+	tuple = heap_copytuple(tuple);
+	stup->tuple = (void *) tuple;
+	USEMEM(state, GetMemoryChunkSpace(tuple));
+
+	MemoryContextSwitchTo(oldcontext);
+
+	stup->datum1 = (Datum) 0;
+	stup->isnull1 = false;
+
+	/*
+	 * Set up the abbreviated leading key, unless abbreviation is not used or
+	 * has just been given up on.  In the latter case there's no need to
+	 * touch the tuples already copied, as comparetup_cluster_gist won't look
+	 * at their datum1 anymore.
+	 */
+	if (state->sortKeys->abbrev_converter && !consider_abort_common(state))
+	{
+		Datum		values[INDEX_MAX_KEYS];
+		bool		isnull[INDEX_MAX_KEYS];
+
+		ResetPerTupleExprContext(state->estate);
+
+		cluster_gist_keys(state, tuple, values, isnull);
+
+		stup->isnull1 = isnull[0];
+		if (!isnull[0])
+			stup->datum1 = state->sortKeys->abbrev_converter(values[0],
+															 state->sortKeys);
+	}
+}
+
+/*
+ * Compute the key columns of the GiST index for a heap tuple, compressed as
+ * they would be in a leaf tuple of the index.  The results are allocated in
+ * the per-tuple memory context of state->estate, which the caller must reset.
+ */
+static void
+cluster_gist_keys(Tuplesortstate *state, HeapTuple tuple,
+				  Datum *values, bool *isnull)
+{
+	Relation	indexRel = state->clusterIndexRel;
+	TupleTableSlot *ecxt_scantuple;
+	MemoryContext oldcontext;
+	int			i;
+
+	oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(state->estate));
+
+	ecxt_scantuple = GetPerTupleExprContext(state->estate)->ecxt_scantuple;
+
+	ExecStoreHeapTuple(tuple, ecxt_scantuple, false);
+	FormIndexDatum(state->indexInfo, ecxt_scantuple, state->estate,
+				   values, isnull);
+
+	for (i = 0; i < state->nKeys; i++)
+	{
+		GISTENTRY	centry;
+		GISTENTRY  *cep;
+		Oid			collation;
+
+		/* there may not be a compress function in opclass */
+		if (isnull[i] ||
+			!OidIsValid(index_getprocid(indexRel, i + 1, GIST_COMPRESS_PROC)))
+			continue;
+
+		/* same as the support collation in initGISTstate() */
+		if (OidIsValid(indexRel->rd_indcollation[i]))
+			collation = indexRel->rd_indcollation[i];
+		else
+			collation = DEFAULT_COLLATION_OID;
+
+		gistentryinit(centry, values[i], indexRel, NULL, (OffsetNumber) 0,
+					  true);
+		cep = (GISTENTRY *)
+			DatumGetPointer(FunctionCall1Coll(index_getprocinfo(indexRel, i + 1,
+																GIST_COMPRESS_PROC),
+											  collation,
+											  PointerGetDatum(&centry)));
+		values[i] = cep->key;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
 static void
 writetup_cluster(Tuplesortstate *state, int tapenum, SortTuple *stup)
 {
@@ -1680,6 +1680,7 @@ psql_completion(const char *text, int start, int end)
 					  "vacuum_cleanup_index_scale_factor",	/* BTREE */
 					  "fastupdate", "gin_pending_list_limit",	/* GIN */
 					  "buffering",	/* GiST */
+					  "looseness", "split_strategy",	/* SP-GiST */
 					  "pages_per_range", "autosummarize"	/* BRIN */
 			);
 	else if (Matches("ALTER", "INDEX", MatchAny, "SET", "("))
@@ -1687,6 +1688,7 @@ psql_completion(const char *text, int start, int end)
 					  "vacuum_cleanup_index_scale_factor =",	/* BTREE */
 					  "fastupdate =", "gin_pending_list_limit =",	/* GIN */
 					  "buffering =",	/* GiST */
+					  "looseness =", "split_strategy =",	/* SP-GiST */
 					  "pages_per_range =", "autosummarize ="	/* BRIN */
 			);
 
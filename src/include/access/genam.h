@@ -89,6 +89,9 @@ typedef struct SysScanDescData *SysScanDesc;
 
 typedef struct ParallelIndexScanDescData *ParallelIndexScanDesc;
 
+/* struct definition is private to knnbatch.c */
+typedef struct IndexKnnBatchData *IndexKnnBatch;
+
 /*
  * Enumeration specifying the type of uniqueness check to perform in
  * index_insert().
@@ -189,6 +192,24 @@ extern void index_store_float8_orderby_distances(IndexScanDesc scan,
 												 IndexOrderByDistance *distances,
 												 bool recheckOrderBy);
 
+/*
+ * batched nearest-neighbour searches (in knnbatch.c)
+ */
+extern IndexKnnBatch index_knn_batch(Relation heapRelation,
+									 Relation indexRelation,
+									 Snapshot snapshot,
+									 Oid orderbyop,
+									 Datum *queries, int nqueries,
+									 int k);
+extern int	index_knn_batch_results(IndexKnnBatch batch, int query,
+									ItemPointer *tids, double **distances);
+extern void index_knn_batch_end(IndexKnnBatch batch);
+extern bool index_knn_batch_useful(IndexKnnBatch batch,
+								   const double *distances,
+								   double *priority);
+extern void index_knn_batch_add(IndexKnnBatch batch, ItemPointer tid,
+								const double *distances);
+
 /*
  * index access method support routines (in genam.c)
  */
@@ -16,6 +16,7 @@
 #ifndef GIST_H
 #define GIST_H
 
+#include "access/stratnum.h"
 #include "access/transam.h"
 #include "access/xlog.h"
 #include "access/xlogdefs.h"
@@ -35,7 +36,9 @@
 #define GIST_EQUAL_PROC					7
 #define GIST_DISTANCE_PROC				8
 #define GIST_FETCH_PROC					9
-#define GISTNProcs					9
+#define GIST_SORTSUPPORT_PROC			10
+#define GIST_BATCH_CONSISTENT_PROC		11
+#define GISTNProcs					11
 
 /*
  * Page opaque data in a GiST index page.
@@ -135,6 +138,28 @@ typedef struct GISTENTRY
 	bool		leafkey;
 } GISTENTRY;
 
+/*
+ * A batch of leaf entries to be tested against one scan key, passed to the
+ * optional batch consistent support function.  The keys have already been
+ * decompressed, and entries with NULL keys are left out.  The function sets
+ * match[i] to tell whether keys[i] satisfies "key op query", and recheck[i]
+ * if that needs to be rechecked against the heap tuple.  recheck[] is
+ * initialized to true, so a function that forgets to set it is safe.
+ */
+typedef struct GISTLeafBatch
+{
+	Relation	rel;			/* the index, and the leaf page being scanned */
+	Page		page;
+	int			nentries;		/* number of entries in the batch */
+	OffsetNumber *offsets;		/* page offset of each entry */
+	Datum	   *keys;			/* decompressed key of each entry */
+	Datum		query;			/* the scan key's comparison value */
+	StrategyNumber strategy;	/* and its strategy number and subtype */
+	Oid			subtype;
+	bool	   *match;			/* output: does each entry match? */
+	bool	   *recheck;		/* output: must each match be rechecked? */
+} GISTLeafBatch;
+
 #define GistPageGetOpaque(page) ( (GISTPageOpaque) PageGetSpecialPointer(page) )
 
 #define GistPageIsLeaf(page)	( GistPageGetOpaque(page)->flags & F_LEAF)
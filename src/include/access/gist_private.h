@@ -20,6 +20,9 @@
 #include "lib/pairingheap.h"
 #include "storage/bufmgr.h"
 #include "storage/buffile.h"
+#include "storage/condition_variable.h"
+#include "storage/shm_toc.h"
+#include "storage/spin.h"
 #include "utils/hsearch.h"
 #include "access/genam.h"
 
@@ -92,6 +95,7 @@ typedef struct GISTSTATE
 	FmgrInfo	equalFn[INDEX_MAX_KEYS];
 	FmgrInfo	distanceFn[INDEX_MAX_KEYS];
 	FmgrInfo	fetchFn[INDEX_MAX_KEYS];
+	FmgrInfo	batchConsistentFn[INDEX_MAX_KEYS];
 
 	/* Collations to pass to the support functions */
 	Oid			supportCollation[INDEX_MAX_KEYS];
@@ -157,6 +161,7 @@ typedef struct GISTScanOpaqueData
 	Oid		   *orderByTypes;	/* datatypes of ORDER BY expressions */
 
 	pairingheap *queue;			/* queue of unvisited items */
+	int64		queueLength;	/* number of items in queue */
 	MemoryContext queueCxt;		/* context holding the queue */
 	bool		qual_ok;		/* false if qual can never be satisfied */
 	bool		firstCall;		/* true until first gistgettuple call */
@@ -164,6 +169,10 @@ typedef struct GISTScanOpaqueData
 	/* pre-allocated workspace arrays */
 	IndexOrderByDistance *distances;	/* output area for gistindex_keytest */
 
+	/* batch consistent functions, one per scan key, if all keys have one */
+	FmgrInfo   *batchConsistentFns;
+	bool		useBatchConsistent;
+
 	/* info about killed items if any (killedItems is NULL if never used) */
 	OffsetNumber *killedItems;	/* offset numbers of killed items */
 	int			numKilled;		/* number of currently stored items */
@@ -180,6 +189,34 @@ typedef struct GISTScanOpaqueData
 
 typedef GISTScanOpaqueData *GISTScanOpaque;
 
+/*
+ * GISTParallelScanDescData: shared state of a parallel GiST scan
+ *
+ * The first participant to start reads the root page and publishes the
+ * downlinks on it that match the scan keys, or the root page itself if it
+ * is a leaf.  The participants then claim those pages one at a time, and
+ * scan the subtree below each one on their own.
+ */
+typedef enum
+{
+	GISTPARALLEL_NOT_STARTED,	/* nobody has read the root yet */
+	GISTPARALLEL_ADVANCING,		/* somebody is reading it; others must wait */
+	GISTPARALLEL_READY			/* pages to scan are available */
+} GISTParallelStatus;
+
+typedef struct GISTParallelScanDescData
+{
+	slock_t		mutex;			/* protects status and nextblock */
+	ConditionVariable cv;		/* signaled when status becomes READY */
+	GISTParallelStatus status;
+	GistNSN		rootlsn;		/* LSN of the root when read, if not a leaf */
+	int			nblocks;		/* number of valid entries in blocks[] */
+	int			nextblock;		/* next entry of blocks[] to be claimed */
+	BlockNumber blocks[MaxIndexTuplesPerPage];
+} GISTParallelScanDescData;
+
+typedef GISTParallelScanDescData *GISTParallelScanDesc;
+
 /* despite the name, gistxlogPage is not part of any xlog record */
 typedef struct gistxlogPage
 {
@@ -385,7 +422,8 @@ typedef enum GistOptBufferingMode
 {
 	GIST_OPTION_BUFFERING_AUTO,
 	GIST_OPTION_BUFFERING_ON,
-	GIST_OPTION_BUFFERING_OFF
+	GIST_OPTION_BUFFERING_OFF,
+	GIST_OPTION_BUFFERING_SORTED
 } GistOptBufferingMode;
 
 /*
@@ -458,6 +496,7 @@ extern XLogRecPtr gistXLogSplit(bool page_is_leaf,
 /* gistget.c */
 extern bool gistgettuple(IndexScanDesc scan, ScanDirection dir);
 extern int64 gistgetbitmap(IndexScanDesc scan, TIDBitmap *tbm);
+extern void gistknnbatch(IndexScanDesc scan, IndexKnnBatch batch);
 extern bool gistcanreturn(Relation index, int attno);
 
 /* gistvalidate.c */
@@ -475,6 +514,7 @@ extern bytea *gistoptions(Datum reloptions, bool validate);
 extern bool gistproperty(Oid index_oid, int attno,
 						 IndexAMProperty prop, const char *propname,
 						 bool *res, bool *isnull);
+extern char *gistbuildphasename(int64 phasenum);
 extern bool gistfitpage(IndexTuple *itvec, int len);
 extern bool gistnospace(Page page, IndexTuple *itvec, int len, OffsetNumber todelete, Size freespace);
 extern void gistcheckpage(Relation rel, Buffer buf);
@@ -495,12 +535,16 @@ extern IndexTuple gistgetadjusted(Relation r,
 								  GISTSTATE *giststate);
 extern IndexTuple gistFormTuple(GISTSTATE *giststate,
 								Relation r, Datum *attdata, bool *isnull, bool isleaf);
+extern void gistCompressValues(GISTSTATE *giststate, Relation r,
+							   Datum *attdata, bool *isnull, bool isleaf,
+							   Datum *compatt);
 
 extern OffsetNumber gistchoose(Relation r, Page p,
 							   IndexTuple it,
 							   GISTSTATE *giststate);
 
 extern void GISTInitBuffer(Buffer b, uint32 f);
+extern void gistinitpage(Page page, uint32 f);
 extern void gistdentryinit(GISTSTATE *giststate, int nkey, GISTENTRY *e,
 						   Datum k, Relation r, Page pg, OffsetNumber o,
 						   bool l, bool isNull);
@@ -540,6 +584,16 @@ extern void gistSplitByKey(Relation r, Page page, IndexTuple *itup,
 extern IndexBuildResult *gistbuild(Relation heap, Relation index,
 								   struct IndexInfo *indexInfo);
 extern void gistValidateBufferingOption(const char *value);
+extern void _gist_parallel_build_main(dsm_segment *seg, shm_toc *toc);
+
+/*
+ * Constant definition for progress reporting.  Phase numbers must match
+ * gistbuildphasename.
+ */
+/* PROGRESS_CREATEIDX_SUBPHASE_INITIALIZE is 1 (see progress.h) */
+#define PROGRESS_GIST_PHASE_INDEXBUILD_TABLESCAN		2
+#define PROGRESS_GIST_PHASE_PERFORMSORT					3
+#define PROGRESS_GIST_PHASE_LOAD						4
 
 /* gistbuildbuffers.c */
 extern GISTBuildBuffers *gistInitBuildBuffers(int pagesPerBuffer, int levelStep,
@@ -91,6 +91,24 @@ typedef struct IndexFetchTableData
 	Relation	rel;
 } IndexFetchTableData;
 
+/*
+ * Counters describing the work done by an index scan.  Index AMs that test
+ * the entries of a search tree against the scan keys one by one (GiST and
+ * SP-GiST) keep these up to date; the others leave them at zero.  They
+ * accumulate across rescans, and are shown by EXPLAIN ANALYZE and added to
+ * the cumulative statistics of the index when the scan ends.
+ */
+typedef struct IndexScanInstrumentation
+{
+	uint64		inner_visited;	/* inner (non-leaf) entries tested */
+	uint64		leaf_tested;	/* leaf entries tested */
+	uint64		consistent_rejected;	/* child pointers and leaf entries
+										 * excluded by the consistent tests */
+	uint64		leaf_rechecked; /* matching leaf entries needing a recheck */
+	int64		queue_peak;		/* largest number of items in the search
+								 * queue */
+} IndexScanInstrumentation;
+
 /*
  * We use the same IndexScanDescData structure for both amgettuple-based
  * and amgetbitmap-based index scans.  Some fields are only relevant in
@@ -149,6 +167,9 @@ typedef struct IndexScanDescData
 
 	/* parallel index scan information, in shared memory */
 	struct ParallelIndexScanDescData *parallel_scan;
+
+	/* work done by the scan, filled in by the index AM */
+	IndexScanInstrumentation instrument;
 }			IndexScanDescData;
 
 /* Generic structure for parallel scans */
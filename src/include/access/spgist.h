@@ -17,11 +17,15 @@
 #include "access/amapi.h"
 #include "access/xlogreader.h"
 #include "lib/stringinfo.h"
+#include "storage/shm_toc.h"
 
 
 /* reloption parameters */
 #define SPGIST_MIN_FILLFACTOR			10
 #define SPGIST_DEFAULT_FILLFACTOR		80
+#define SPGIST_MIN_LOOSENESS			1.0
+#define SPGIST_MAX_LOOSENESS			4.0
+#define SPGIST_DEFAULT_LOOSENESS		2.0
 
 /* SPGiST opclass support function numbers */
 #define SPGIST_CONFIG_PROC				1
@@ -58,6 +62,7 @@ typedef struct spgChooseIn
 	Datum		datum;			/* original datum to be indexed */
 	Datum		leafDatum;		/* current datum to be stored at leaf */
 	int			level;			/* current level (counting from zero) */
+	double		looseness;		/* index's cell enlargement factor */
 
 	/* Data from current inner tuple */
 	bool		allTheSame;		/* tuple is marked all-the-same? */
@@ -110,11 +115,25 @@ typedef struct spgChooseOut
 /*
  * Argument structs for spg_picksplit method
  */
+
+/*
+ * How to choose the split point, for operator classes that offer a choice
+ * (set by the split_strategy reloption)
+ */
+typedef enum spgSplitStrategy
+{
+	spgSplitMean,				/* mean of the values */
+	spgSplitMedian,				/* median of the values */
+	spgSplitHistogram			/* balance the children, judging by a sample */
+} spgSplitStrategy;
+
 typedef struct spgPickSplitIn
 {
 	int			nTuples;		/* number of leaf tuples */
 	Datum	   *datums;			/* their datums (array of length nTuples) */
 	int			level;			/* current level (counting from zero) */
+	double		looseness;		/* index's cell enlargement factor */
+	spgSplitStrategy splitStrategy; /* index's preferred split strategy */
 } spgPickSplitIn;
 
 typedef struct spgPickSplitOut
@@ -145,6 +164,7 @@ typedef struct spgInnerConsistentIn
 	MemoryContext traversalMemoryContext;	/* put new traverse values here */
 	int			level;			/* current level (counting from zero) */
 	bool		returnData;		/* original data must be returned? */
+	double		looseness;		/* index's cell enlargement factor */
 
 	/* Data from current inner tuple */
 	bool		allTheSame;		/* tuple is marked all-the-same? */
@@ -203,6 +223,7 @@ extern bool spginsert(Relation index, Datum *values, bool *isnull,
 					  ItemPointer ht_ctid, Relation heapRel,
 					  IndexUniqueCheck checkUnique,
 					  struct IndexInfo *indexInfo);
+extern void _spg_parallel_build_main(dsm_segment *seg, shm_toc *toc);
 
 /* spgscan.c */
 extern IndexScanDesc spgbeginscan(Relation rel, int keysz, int orderbysz);
@@ -211,7 +232,11 @@ extern void spgrescan(IndexScanDesc scan, ScanKey scankey, int nscankeys,
 					  ScanKey orderbys, int norderbys);
 extern int64 spggetbitmap(IndexScanDesc scan, TIDBitmap *tbm);
 extern bool spggettuple(IndexScanDesc scan, ScanDirection dir);
+extern void spgknnbatch(IndexScanDesc scan, IndexKnnBatch batch);
 extern bool spgcanreturn(Relation index, int attno);
+extern Size spgestimateparallelscan(void);
+extern void spginitparallelscan(void *target);
+extern void spgparallelrescan(IndexScanDesc scan);
 
 /* spgvacuum.c */
 extern IndexBulkDeleteResult *spgbulkdelete(IndexVacuumInfo *info,
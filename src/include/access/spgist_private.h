@@ -18,6 +18,7 @@
 #include "access/spgist.h"
 #include "nodes/tidbitmap.h"
 #include "storage/buf.h"
+#include "storage/dsm.h"
 #include "utils/geo_decls.h"
 #include "utils/relcache.h"
 
@@ -96,6 +97,8 @@ typedef struct SpGistMetaPageData
 {
 	uint32		magicNumber;	/* for identity cross-check */
 	SpGistLUPCache lastUsedPages;	/* shared storage of last-used info */
+	double		looseness;		/* looseness the index was built with, or 0
+								 * if not recorded (pre-v13 index) */
 } SpGistMetaPageData;
 
 #define SPGIST_MAGIC_NUMBER (0xBA0BABEE)
@@ -103,6 +106,28 @@ typedef struct SpGistMetaPageData
 #define SpGistPageGetMeta(p) \
 	((SpGistMetaPageData *) PageGetContents(p))
 
+/*
+ * Storage type for SP-GiST's reloptions
+ */
+typedef struct SpGistOptions
+{
+	int32		vl_len_;		/* varlena header (do not touch directly!) */
+	int			fillfactor;		/* page fill factor in percent (0..100) */
+	double		looseness;		/* cell enlargement factor for opclasses
+								 * that use loose partitioning */
+	spgSplitStrategy split_strategy;	/* split point choice for opclasses
+										 * that offer one */
+} SpGistOptions;
+
+#define SpGistGetLooseness(relation) \
+	((relation)->rd_options ? \
+	 ((SpGistOptions *) (relation)->rd_options)->looseness : \
+	 SPGIST_DEFAULT_LOOSENESS)
+#define SpGistGetSplitStrategy(relation) \
+	((relation)->rd_options ? \
+	 ((SpGistOptions *) (relation)->rd_options)->split_strategy : \
+	 spgSplitMean)
+
 /*
  * Private state of index AM.  SpGistState is common to both insert and
  * search code; SpGistScanOpaque is for searches only.
@@ -127,8 +152,15 @@ typedef struct SpGistState
 
 	char	   *deadTupleStorage;	/* workspace for spgFormDeadTuple */
 
+	double		looseness;		/* cell enlargement factor, from metapage */
+	spgSplitStrategy splitStrategy; /* split strategy, from reloptions */
+
 	TransactionId myXid;		/* XID to use when creating a redirect tuple */
 	bool		isBuild;		/* true if doing index build */
+
+	Relation	heapRel;		/* heap relation, when inserting into an
+								 * existing index; lets killed leaf tuples
+								 * be deleted */
 } SpGistState;
 
 typedef struct SpGistSearchItem
@@ -158,6 +190,7 @@ typedef struct SpGistScanOpaqueData
 {
 	SpGistState state;			/* see above */
 	pairingheap *scanQueue;		/* queue of to be visited items */
+	int64		queueLength;	/* number of items in scanQueue */
 	MemoryContext tempCxt;		/* short-lived memory context */
 	MemoryContext traversalCxt; /* single scan lifetime memory context */
 
@@ -189,12 +222,30 @@ typedef struct SpGistScanOpaqueData
 	TIDBitmap  *tbm;			/* bitmap being filled */
 	int64		ntids;			/* number of TIDs passed to bitmap */
 
+	/* Skip leaf tuples that have been marked as killed? */
+	bool		ignoreKilledTuples;
+
+	/* Counters of the work done, in the IndexScanDesc */
+	struct IndexScanInstrumentation *instrument;
+
+	/* Location of the leaf tuple being reported, if known */
+	ItemPointerData curLeafTid;
+	XLogRecPtr	curLeafLSN;		/* LSN of its page when we read it */
+
 	/* These fields are only used in amgettuple scans: */
 	bool		want_itup;		/* are we reconstructing tuples? */
 	TupleDesc	indexTupDesc;	/* if so, tuple descriptor for them */
 	int			nPtrs;			/* number of TIDs found on current page */
 	int			iPtr;			/* index for scanning through same */
 	ItemPointerData heapPtrs[MaxIndexTuplesPerPage];	/* TIDs from cur page */
+	ItemPointerData leafTids[MaxIndexTuplesPerPage];	/* their leaf tuples'
+														 * locations, or
+														 * invalid */
+	XLogRecPtr	leafLSNs[MaxIndexTuplesPerPage];	/* LSNs of those leaf
+													 * pages when read */
+	int			numKilled;		/* number of killed items */
+	int			killedItems[MaxIndexTuplesPerPage]; /* their indexes in
+													 * heapPtrs */
 	bool		recheck[MaxIndexTuplesPerPage]; /* their recheck flags */
 	bool		recheckDistances[MaxIndexTuplesPerPage];	/* distance recheck
 															 * flags */
@@ -203,6 +254,15 @@ typedef struct SpGistScanOpaqueData
 	/* distances (for recheck) */
 	IndexOrderByDistance *distances[MaxIndexTuplesPerPage];
 
+	/* Search items that can be reused, linked through phNode.next_sibling */
+	SpGistSearchItem *freeItems;
+
+	/* These fields are only used in parallel scans: */
+	struct SpGistParallelScanDescData *parallelScan;	/* shared state */
+	SpGistSearchItem **parallelItems;	/* subtrees divided between the
+										 * participants */
+	int			nParallelItems; /* number of them, or -1 if not known yet */
+
 	/*
 	 * Note: using MaxIndexTuplesPerPage above is a bit hokey since
 	 * SpGistLeafTuples aren't exactly IndexTuples; however, they are larger,
@@ -225,6 +285,8 @@ typedef struct SpGistCache
 	SpGistTypeDesc attPrefixType;	/* type of inner-tuple prefix values */
 	SpGistTypeDesc attLabelType;	/* type of node label values */
 
+	double		looseness;		/* cell enlargement factor, from metapage */
+
 	SpGistLUPCache lastUsedPages;	/* local storage of last-used info */
 } SpGistCache;
 
@@ -422,6 +484,16 @@ typedef SpGistDeadTupleData *SpGistDeadTuple;
 #define GBUF_REQ_LEAF(flags)	(((flags) & GBUF_PARITY_MASK) == GBUF_LEAF)
 #define GBUF_REQ_NULLS(flags)	((flags) & GBUF_NULLS)
 
+/*
+ * Constant definition for progress reporting.  Phase numbers must match
+ * spgbuildphasename.
+ */
+/* PROGRESS_CREATEIDX_SUBPHASE_INITIALIZE is 1 (see progress.h) */
+#define PROGRESS_SPGIST_PHASE_INDEXBUILD_TABLESCAN		2
+#define PROGRESS_SPGIST_PHASE_PARTITION					3
+#define PROGRESS_SPGIST_PHASE_LOAD						4
+#define PROGRESS_SPGIST_PHASE_LEFTOVERS					5
+
 /* spgutils.c */
 extern SpGistCache *spgGetCache(Relation index);
 extern void initSpGistState(SpGistState *state, Relation index);
@@ -432,7 +504,7 @@ extern Buffer SpGistGetBuffer(Relation index, int flags,
 extern void SpGistSetLastUsedPage(Relation index, Buffer buffer);
 extern void SpGistInitPage(Page page, uint16 f);
 extern void SpGistInitBuffer(Buffer b, uint16 f);
-extern void SpGistInitMetapage(Page page);
+extern void SpGistInitMetapage(Page page, double looseness);
 extern unsigned int SpGistGetTypeSize(SpGistTypeDesc *att, Datum datum);
 extern SpGistLeafTuple spgFormLeafTuple(SpGistState *state,
 										ItemPointer heapPtr,
@@ -453,6 +525,7 @@ extern OffsetNumber SpGistPageAddNewItem(SpGistState *state, Page page,
 extern bool spgproperty(Oid index_oid, int attno,
 						IndexAMProperty prop, const char *propname,
 						bool *res, bool *isnull);
+extern char *spgbuildphasename(int64 phasenum);
 
 /* spgdoinsert.c */
 extern void spgUpdateNodeLink(SpGistInnerTuple tup, int nodeN,
@@ -461,12 +534,53 @@ extern void spgPageIndexMultiDelete(SpGistState *state, Page page,
 									OffsetNumber *itemnos, int nitems,
 									int firststate, int reststate,
 									BlockNumber blkno, OffsetNumber offnum);
+extern bool spgCheckAllTheSame(spgPickSplitIn *in, spgPickSplitOut *out,
+							   bool tooBig, bool *includeNew);
 extern bool spgdoinsert(Relation index, SpGistState *state,
 						ItemPointer heapPtr, Datum datum, bool isnull);
 
+/* spgvacuum.c */
+extern void spgDeleteLeafTuples(Relation index, SpGistState *state,
+								Buffer buffer, bool *deletable,
+								int nDeletable,
+								TransactionId latestRemovedXid);
+
+/* spgbulk.c */
+typedef struct SpGistBulkState SpGistBulkState;
+typedef struct SpGistBulkShared SpGistBulkShared;
+
+/*
+ * Information a participant in a parallel build needs to coordinate with
+ * the others.  The leader's participant number is the number of workers
+ * launched, so participant numbers run from 0 to nParticipants - 1.
+ */
+typedef struct SpGistBulkCoordinateData
+{
+	bool		isWorker;		/* Worker process? */
+	int			participant;	/* Participant number */
+	int			nParticipants;	/* Number of participants (leader only) */
+	SpGistBulkShared *sharedbulk;	/* Shared state of the bulk load */
+} SpGistBulkCoordinateData;
+
+typedef struct SpGistBulkCoordinateData *SpGistBulkCoordinate;
+
+extern Size spgBulkEstimateShared(int nParticipants);
+extern void spgBulkInitializeShared(SpGistBulkShared *shared,
+									int nParticipants, dsm_segment *seg);
+extern void spgBulkAttachShared(SpGistBulkShared *shared, dsm_segment *seg);
+extern SpGistBulkState *spgBulkBegin(Relation index, SpGistState *state,
+									 int memKB,
+									 SpGistBulkCoordinate coordinate);
+extern void spgBulkAdd(SpGistBulkState *bstate, ItemPointer heapPtr,
+					   Datum datum, bool isnull);
+extern void spgBulkFinish(SpGistBulkState *bstate);
+
 /* spgproc.c */
 extern double *spg_key_orderbys_distances(Datum key, bool isLeaf,
 										  ScanKey orderbys, int norderbys);
+extern double **spg_boxes_orderbys_distances(BOX **boxes, int nboxes,
+											 ScanKey orderbys, int norderbys);
+extern bool spg_box_overlaps_circles(BOX *box, ScanKey scankeys, int nkeys);
 extern BOX *box_copy(BOX *orig);
 
 #endif							/* SPGIST_PRIVATE_H */
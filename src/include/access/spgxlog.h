@@ -207,6 +207,9 @@ typedef struct spgxlogVacuumLeaf
 
 	spgxlogState stateSrc;
 
+	/* newest XID of the removed heap tuples, if not removed by VACUUM */
+	TransactionId latestRemovedXid;
+
 	/*----------
 	 * data follows:
 	 *		tuple numbers to become DEAD
@@ -270,6 +270,18 @@ typedef FormData_pg_statistic *Form_pg_statistic;
  */
 #define STATISTIC_KIND_BOUNDS_HISTOGRAM  7
 
+/*
+ * A "bounds grid" slot describes the spatial distribution of a geometric
+ * column.  Each non-null value is reduced to the center of its bounding box.
+ * stavalues contains a single box, the extent of all the centers.  That
+ * extent is divided into an n x n grid of equal cells, and stanumbers
+ * contains the fraction of non-null rows whose center falls in each cell, in
+ * row-major order starting from the lower left cell, followed by two more
+ * members: the average width and the average height of the bounding boxes.
+ * Values with non-finite coordinates are not counted in any cell.
+ */
+#define STATISTIC_KIND_BOUNDS_GRID  8
+
 #endif							/* EXPOSE_TO_CLIENT_CODE */
 
 #endif							/* PG_STATISTIC_H */
@@ -0,0 +1,120 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.h
+ *	  Batch-at-a-time evaluation of scan quals and aggregate inputs
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/executor/execBatch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef EXECBATCH_H
+#define EXECBATCH_H
+
+#include "nodes/execnodes.h"
+
+/* GUC parameter */
+extern PGDLLIMPORT bool enable_batch_execution;
+
+/* Maximum number of rows in a TupleBatch */
+#define EXEC_BATCH_SIZE		1024
+
+/*
+ * One column of a TupleBatch.  Only integer and float8 columns are
+ * supported; their values are widened to int64 or double when loaded, so
+ * that the batch never points into a tuple that has since gone away.
+ */
+typedef struct BatchColumn
+{
+	AttrNumber	attno;			/* table attribute number */
+	Oid			typid;			/* INT2OID, INT4OID, INT8OID or FLOAT8OID */
+	int64	   *ivalues;		/* values, for the integer types */
+	double	   *fvalues;		/* values, for float8 */
+	bool	   *nulls;			/* null flags */
+} BatchColumn;
+
+/*
+ * TupleBatch: up to EXEC_BATCH_SIZE rows of a scan, stored column-wise.
+ *
+ * Only the columns some batch expression asked for are loaded.  Quals don't
+ * remove rows from the vectors; they shrink the selection vector, which
+ * lists the positions of the rows that are still alive, in order.
+ */
+typedef struct TupleBatch
+{
+	int			ncolumns;		/* number of loaded columns */
+	int			maxcolumns;		/* allocated length of columns[] */
+	BatchColumn *columns;
+	AttrNumber	last_attno;		/* highest attno of any column */
+
+	int			nrows;			/* number of rows in the vectors */
+	int			nselected;		/* number of entries in selection[] */
+	int		   *selection;		/* positions of the selected rows */
+} TupleBatch;
+
+/* Kind of values produced by a BatchExprState */
+typedef enum BatchValueKind
+{
+	BATCH_INT64,
+	BATCH_FLOAT8
+} BatchValueKind;
+
+typedef enum BatchExprOp
+{
+	BEXPR_COLUMN,
+	BEXPR_CONST,
+	BEXPR_INT4_ADD,
+	BEXPR_INT4_SUB,
+	BEXPR_INT4_MUL,
+	BEXPR_INT8_ADD,
+	BEXPR_INT8_SUB,
+	BEXPR_INT8_MUL,
+	BEXPR_FLOAT8_ADD,
+	BEXPR_FLOAT8_SUB,
+	BEXPR_FLOAT8_MUL,
+	BEXPR_EQ,
+	BEXPR_NE,
+	BEXPR_LT,
+	BEXPR_LE,
+	BEXPR_GT,
+	BEXPR_GE
+} BatchExprOp;
+
+/*
+ * BatchExprState: a compiled expression over the columns of a TupleBatch.
+ *
+ * Arithmetic nodes produce a vector of values and null flags, computed only
+ * at the selected positions.  Comparison nodes appear only at the top of a
+ * qual and work by shrinking the batch's selection vector.  Columns and
+ * constants don't compute anything: they point at the batch's vectors, or at
+ * vectors filled with the constant once at initialization.
+ */
+typedef struct BatchExprState
+{
+	BatchExprOp op;
+	BatchValueKind kind;		/* kind of values in the result vectors */
+	Oid			typid;			/* SQL type of the expression */
+	struct BatchExprState *left;	/* arguments of operators */
+	struct BatchExprState *right;
+	int			column;			/* index into batch->columns, for
+								 * BEXPR_COLUMN */
+
+	/* result vectors; only one of ivalues and fvalues is used */
+	int64	   *ivalues;
+	double	   *fvalues;
+	bool	   *nulls;
+} BatchExprState;
+
+extern TupleBatch *ExecCreateTupleBatch(void);
+extern BatchExprState *ExecInitBatchExpr(Expr *node, TupleBatch *batch,
+										 Index scanrelid, List *outer_tlist);
+extern bool ExecInitBatchQual(List *qual, TupleBatch *batch,
+							  Index scanrelid, List **result);
+extern void ExecBatchStoreSlot(TupleBatch *batch, TupleTableSlot *slot);
+extern void ExecEvalBatchExpr(BatchExprState *state, TupleBatch *batch);
+extern void ExecBatchQual(List *qual, TupleBatch *batch);
+extern Datum ExecBatchGetDatum(BatchExprState *state, int row, bool *isnull);
+
+#endif							/* EXECBATCH_H */
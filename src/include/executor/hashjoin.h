@@ -110,6 +110,28 @@ typedef struct HashSkewBucket
 #define SKEW_WORK_MEM_PERCENT  2
 #define SKEW_MIN_OUTER_FRACTION  0.01
 
+/*
+ * When the outer input of the join is a sequential scan, we build a Bloom
+ * filter over the hash values of all inner tuples while loading the hash
+ * table, and the scan uses it to throw away outer tuples that cannot have a
+ * match before they are projected and passed up (see HashRuntimeFilter in
+ * execnodes.h).  The bitset has a power of two number of bits.  In a Parallel
+ * Hash it lives in DSA memory and all participants set bits concurrently,
+ * which is why the words are atomics; a private filter only ever uses plain
+ * reads and writes on them.
+ */
+typedef struct HashBloomFilter
+{
+	uint32		mask;			/* number of bits - 1 */
+	int			nhashes;		/* number of bits set per element */
+	pg_atomic_uint32 words[FLEXIBLE_ARRAY_MEMBER];
+} HashBloomFilter;
+
+#define BLOOM_BITS_PER_TUPLE	8
+#define BLOOM_MIN_BITS			1024
+#define BLOOM_MAX_HASHES		8
+#define BLOOM_WORK_MEM_PERCENT	25
+
 /*
  * To reduce palloc overhead, the HashJoinTuples for the current batch are
  * packed in 32kB buffers instead of pallocing each tuple individually.
@@ -240,6 +262,7 @@ typedef struct ParallelHashJoinState
 	int			nbuckets;		/* number of buckets */
 	ParallelHashGrowth growth;	/* control batch/bucket growth */
 	dsa_pointer chunk_work_queue;	/* chunk work queue */
+	dsa_pointer bloom;			/* shared HashBloomFilter, if any */
 	int			nparticipants;
 	size_t		space_allowed;
 	size_t		total_tuples;	/* total number of inner tuples */
@@ -357,6 +380,10 @@ typedef struct HashJoinTableData
 	ParallelHashJoinState *parallel_state;
 	ParallelHashJoinBatchAccessor *batches;
 	dsa_pointer current_chunk_shared;
+
+	/* Bloom filter over inner hash values, and the scan consulting it */
+	HashBloomFilter *bloom;
+	HashRuntimeFilter *runtime_filter;
 }			HashJoinTableData;
 
 #endif							/* HASHJOIN_H */
@@ -280,6 +280,8 @@ typedef struct AggStatePerPhaseData
 	Sort	   *sortnode;		/* Sort node for input ordering for phase */
 
 	ExprState  *evaltrans;		/* evaluation of transition functions  */
+	ExprState  *evaltrans_spill;	/* same, for tuples read back from hash
+									 * aggregation spill files (phase 0 only) */
 }			AggStatePerPhaseData;
 
 /*
@@ -310,5 +312,8 @@ extern void ExecEndAgg(AggState *node);
 extern void ExecReScanAgg(AggState *node);
 
 extern Size hash_agg_entry_size(int numAggs);
+extern void hash_agg_set_limits(double hashentrysize, double input_groups,
+								int used_bits, Size *mem_limit,
+								int *num_partitions);
 
 #endif							/* NODEAGG_H */
@@ -49,6 +49,9 @@ extern bool ExecHashGetHashValue(HashJoinTable hashtable,
 								 bool outer_tuple,
 								 bool keep_nulls,
 								 uint32 *hashvalue);
+extern bool ExecHashRuntimeFilterRejects(HashRuntimeFilter *filter,
+										 TupleTableSlot *slot,
+										 ExprContext *econtext);
 extern void ExecHashGetBucketAndBatch(HashJoinTable hashtable,
 									  uint32 hashvalue,
 									  int *bucketno,
@@ -0,0 +1,26 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeSpatialjoin.h
+ *	  prototypes for nodeSpatialjoin.c
+ *
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/executor/nodeSpatialjoin.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef NODESPATIALJOIN_H
+#define NODESPATIALJOIN_H
+
+#include "nodes/execnodes.h"
+
+extern SpatialJoinState *ExecInitSpatialJoin(SpatialJoin *node, EState *estate, int eflags);
+extern void ExecEndSpatialJoin(SpatialJoinState *node);
+extern void ExecReScanSpatialJoin(SpatialJoinState *node);
+
+extern int	ExecChooseSpatialJoinGrid(double outer_rows, int outer_width,
+									  double inner_rows, int inner_width);
+
+#endif							/* NODESPATIALJOIN_H */
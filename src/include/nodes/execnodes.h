@@ -17,6 +17,7 @@
 #include "access/tupconvert.h"
 #include "executor/instrument.h"
 #include "fmgr.h"
+#include "lib/ilist.h"
 #include "lib/pairingheap.h"
 #include "nodes/params.h"
 #include "nodes/plannodes.h"
@@ -1049,6 +1050,11 @@ typedef struct PlanState
 		if (((PlanState *)(node))->instrument) \
 			((PlanState *)(node))->instrument->nfiltered2 += (delta); \
 	} while(0)
+#define InstrCountFiltered3(node, delta) \
+	do { \
+		if (((PlanState *)(node))->instrument) \
+			((PlanState *)(node))->instrument->nfiltered3 += (delta); \
+	} while(0)
 
 /*
  * EPQState is state for executing an EvalPlanQual recheck on a candidate
@@ -1334,6 +1340,25 @@ typedef struct ScanState
 	TupleTableSlot *ss_ScanTupleSlot;
 } ScanState;
 
+/* ----------------
+ *	 HashRuntimeFilter information
+ *
+ *		A Hash Join whose outer input is a sequential scan can push a Bloom
+ *		filter over the hash values of its inner join keys down into that
+ *		scan.  The scan computes the outer hash value of each tuple from the
+ *		key columns listed here and discards the tuple if the filter says it
+ *		can't have a match.  hashtable is set by the Hash node once the
+ *		filter is complete, and reset when the hash table goes away; until
+ *		then every tuple passes.
+ * ----------------
+ */
+typedef struct HashRuntimeFilter
+{
+	int			nkeys;			/* number of hash keys */
+	AttrNumber *keyattnos;		/* scan tuple attribute of each key */
+	struct HashJoinTableData *hashtable;	/* table owning the filter */
+} HashRuntimeFilter;
+
 /* ----------------
  *	 SeqScanState information
  * ----------------
@@ -1342,6 +1367,8 @@ typedef struct SeqScanState
 {
 	ScanState	ss;				/* its first field is NodeTag */
 	Size		pscan_len;		/* size of parallel heap scan descriptor */
+	HashRuntimeFilter *runtime_filter;	/* pushed down by a Hash Join */
+	List	   *batch_qual;		/* BatchExprStates of the qual, in batch mode */
 } SeqScanState;
 
 /* ----------------
@@ -1950,6 +1977,39 @@ typedef struct HashJoinState
 	bool		hj_OuterNotEmpty;
 } HashJoinState;
 
+/* ----------------
+ *	 SpatialJoinState information
+ *
+ *		sj_SpatialClauses		ANDed spatial clauses, rechecked for each
+ *								pair of tuples whose bounding boxes overlap
+ *		sj_OuterKey				expression giving the outer tuple's
+ *								geometric value in the first spatial clause
+ *		sj_InnerKey				same for the inner tuple
+ *		sj_OuterKeyType			data type of sj_OuterKey
+ *		sj_InnerKeyType			data type of sj_InnerKey
+ *		sj_Table				partitioned and sorted input tuples
+ *								(NULL if not built yet)
+ *		sj_OuterTupleSlot		tuple slot for outer tuples read back
+ *		sj_InnerTupleSlot		tuple slot for inner tuples read back
+ * ----------------
+ */
+
+/* this struct is private in nodeSpatialjoin.c: */
+typedef struct SpatialJoinTableData *SpatialJoinTable;
+
+typedef struct SpatialJoinState
+{
+	JoinState	js;				/* its first field is NodeTag */
+	ExprState  *sj_SpatialClauses;
+	ExprState  *sj_OuterKey;
+	ExprState  *sj_InnerKey;
+	Oid			sj_OuterKeyType;
+	Oid			sj_InnerKeyType;
+	SpatialJoinTable sj_Table;
+	TupleTableSlot *sj_OuterTupleSlot;
+	TupleTableSlot *sj_InnerTupleSlot;
+} SpatialJoinState;
+
 
 /* ----------------------------------------------------------------
  *				 Materialization State Information
@@ -1973,6 +2033,68 @@ typedef struct MaterialState
 	Tuplestorestate *tuplestorestate;
 } MaterialState;
 
+struct ResultCacheEntry;
+struct ResultCacheTuple;
+
+/* ----------------
+ *	 ResultCacheInstrumentation information
+ * ----------------
+ */
+typedef struct ResultCacheInstrumentation
+{
+	uint64		cache_hits;		/* number of rescans where we've found the
+								 * scan parameter values to be cached */
+	uint64		cache_misses;	/* number of rescans where we've not found the
+								 * scan parameter values to be cached. */
+	uint64		cache_evictions;	/* number of cache entries removed due to
+									 * the need to free memory */
+	uint64		cache_overflows;	/* number of times we've had to bypass the
+									 * cache when filling it due to not being
+									 * able to free enough space to store the
+									 * current scan's tuples. */
+	uint64		mem_peak;		/* peak memory usage in bytes */
+} ResultCacheInstrumentation;
+
+/* ----------------
+ *	 ResultCacheState information
+ *
+ *		resultcache nodes are used to cache recent and commonly seen results
+ *		from a parameterized scan.
+ * ----------------
+ */
+typedef struct ResultCacheState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	int			rc_status;		/* value of ExecResultCache state machine */
+	int			nkeys;			/* number of cache keys */
+	struct resultcache_hash *hashtable; /* hash table for cache entries */
+	TupleDesc	hashkeydesc;	/* tuple descriptor for cache keys */
+	TupleTableSlot *tableslot;	/* min tuple slot for existing cache entries */
+	TupleTableSlot *probeslot;	/* virtual slot used for hash lookups */
+	ExprState  *cache_eq_expr;	/* Compare exec params to hash key */
+	ExprState **param_exprs;	/* exprs containing the parameters to this
+								 * node */
+	FmgrInfo   *hashfunctions;	/* lookup data for hash funcs nkeys in size */
+	Oid		   *collations;		/* collation for comparisons nkeys in size */
+	uint64		mem_used;		/* bytes of memory used by cache */
+	uint64		mem_limit;		/* memory limit in bytes for the cache */
+	MemoryContext tableContext; /* memory context to store cache data */
+	dlist_head	lru_list;		/* least recently used entry list */
+	struct ResultCacheTuple *last_tuple;	/* Used to point to the last tuple
+											 * returned during a cache hit and
+											 * the tuple we last stored when
+											 * populating the cache. */
+	struct ResultCacheEntry *entry; /* the entry that 'last_tuple' belongs to
+									 * or NULL if 'last_tuple' is NULL. */
+	bool		singlerow;		/* true if the cache entry is to be marked as
+								 * complete after caching the first tuple. */
+	bool		binary_mode;	/* true when cache key should be compared bit
+								 * by bit, false when using hash equality ops */
+	ResultCacheInstrumentation stats;	/* execution statistics */
+	Bitmapset  *keyparamids;	/* Param->paramids of expressions belonging to
+								 * param_exprs */
+} ResultCacheState;
+
 /* ----------------
  *	 Shared memory container for per-worker sort information
  * ----------------
@@ -2001,6 +2123,48 @@ typedef struct SortState
 	SharedSortInfo *shared_info;	/* one entry per worker */
 } SortState;
 
+/* ----------------
+ *	 IncrementalSortState information
+ * ----------------
+ */
+typedef enum
+{
+	INCSORT_LOADFULLSORT,
+	INCSORT_LOADPREFIXSORT,
+	INCSORT_READFULLSORT,
+	INCSORT_READPREFIXSORT
+} IncrementalSortExecutionStatus;
+
+typedef struct IncrementalSortGroupInfo
+{
+	int64		groupCount;		/* number of groups sorted */
+	long		maxDiskSpaceUsed;	/* peak disk usage of one group, in kB */
+	long		totalDiskSpaceUsed;
+	long		maxMemorySpaceUsed; /* peak memory usage of one group, in kB */
+	long		totalMemorySpaceUsed;
+	bits32		sortMethods;	/* bitmask of (1 << TuplesortMethod) */
+} IncrementalSortGroupInfo;
+
+typedef struct IncrementalSortState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	bool		bounded;		/* is the result set bounded? */
+	int64		bound;			/* if bounded, how many tuples are needed */
+	bool		outerNodeDone;	/* finished fetching tuples from outer node */
+	int64		bound_Done;		/* tuples returned so far, counted against
+								 * bound */
+	IncrementalSortExecutionStatus execution_status;
+	bool		fullsort_has_large_group;	/* fullsort holds the start of a
+											 * group too large for it */
+	void	   *fullsort_state; /* sorts all keys, for batches of groups */
+	void	   *prefixsort_state;	/* sorts suffix keys of one large group */
+	ExprState  *presorted_eq;	/* compares presorted keys of two tuples */
+	TupleTableSlot *group_pivot;	/* tuple identifying the current group */
+	/* instrumentation, gathered only when EXPLAIN ANALYZE asks for it */
+	IncrementalSortGroupInfo fullsort_info;
+	IncrementalSortGroupInfo prefixsort_info;
+} IncrementalSortState;
+
 /* ---------------------
  *	GroupState information
  * ---------------------
@@ -2075,12 +2239,31 @@ typedef struct AggState
 	AggStatePerHash perhash;	/* array of per-hashtable data */
 	AggStatePerGroup *hash_pergroup;	/* grouping set indexed array of
 										 * per-group pointers */
+	MemoryContext hash_metacxt; /* memory for hash table itself */
+	struct HashAggSpill *hash_spills;	/* HashAggSpill for each grouping set,
+										 * exists only during first pass */
+	TupleTableSlot *hash_spill_slot;	/* slot for reading from spill files */
+	List	   *hash_batches;	/* hash batches remaining to be processed */
+	bool		hash_ever_spilled;	/* ever spilled during this execution? */
+	bool		hash_spill_mode;	/* we hit the memory limit during the
+									 * current batch and must not create new
+									 * groups */
+	Size		hash_mem_limit; /* limit before spilling hash table */
+	Size		hash_mem_peak;	/* peak hash table memory usage */
+	double		hashentrysize;	/* estimate revised during execution */
+	uint64		hash_ngroups_current;	/* number of groups currently in
+										 * memory in all hash tables */
+	uint64		hash_disk_used; /* bytes of disk space used */
+	int			hash_batches_used;	/* batches used during entire execution */
 
 	/* support for evaluation of agg input expressions: */
-#define FIELDNO_AGGSTATE_ALL_PERGROUPS 34
+#define FIELDNO_AGGSTATE_ALL_PERGROUPS 46
 	AggStatePerGroup *all_pergroups;	/* array of first ->pergroups, than
 										 * ->hash_pergroup */
 	ProjectionInfo *combinedproj;	/* projection machinery */
+
+	/* batch mode; use struct pointer to avoid exposing nodeAgg.c's types */
+	struct AggBatchData *batch;	/* NULL unless running in batch mode */
 } AggState;
 
 /* ----------------
@@ -2277,6 +2460,9 @@ typedef struct HashState
 
 	/* Parallel hash state. */
 	struct ParallelHashJoinState *parallel_state;
+
+	/* Bloom filter pushed down to the outer scan, or NULL if none */
+	HashRuntimeFilter *runtime_filter;
 } HashState;
 
 /* ----------------
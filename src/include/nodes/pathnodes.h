@@ -1426,6 +1426,27 @@ typedef struct MaterialPath
 	Path	   *subpath;
 } MaterialPath;
 
+/*
+ * ResultCachePath represents a ResultCache plan node, i.e., a cache that
+ * caches tuples from parameterized paths to save the underlying node from
+ * having to be rescanned for parameter values which are already cached.
+ */
+typedef struct ResultCachePath
+{
+	Path		path;
+	Path	   *subpath;		/* outerpath to cache tuples from */
+	List	   *hash_operators; /* hash operators for each key */
+	List	   *param_exprs;	/* cache keys */
+	bool		singlerow;		/* true if the cache entry is to be marked as
+								 * complete after caching the first record. */
+	bool		binary_mode;	/* true when cache key should be compared bit
+								 * by bit, false when using hash equality ops */
+	double		calls;			/* expected number of rescans */
+	uint32		est_entries;	/* The maximum number of entries that the
+								 * planner expects will fit in the cache, or 0
+								 * if unknown */
+} ResultCachePath;
+
 /*
  * UniquePath represents elimination of distinct rows from the output of
  * its subpath.
@@ -1572,6 +1593,22 @@ typedef struct HashPath
 	double		inner_rows_total;	/* total inner rows expected */
 } HashPath;
 
+/*
+ * A spatial join path has these fields.
+ *
+ * Like a hashjoin, a spatial join reads both of its inputs in full before
+ * producing any output, so it doesn't care about their order.  The inputs
+ * are divided into num_tiles tiles of the plane, so that each tile fits in
+ * work_mem.
+ */
+
+typedef struct SpatialJoinPath
+{
+	JoinPath	jpath;
+	List	   *path_spatialclauses;	/* join clauses used for partitioning */
+	int			num_tiles;		/* number of tiles expected */
+} SpatialJoinPath;
+
 /*
  * ProjectionPath represents a projection (that is, targetlist computation)
  *
@@ -1618,6 +1655,18 @@ typedef struct SortPath
 	Path	   *subpath;		/* path representing input source */
 } SortPath;
 
+/*
+ * IncrementalSortPath represents an incremental sort step
+ *
+ * This is like a regular sort, except that the first nPresortedCols of the
+ * path's pathkeys are already provided by the subpath.
+ */
+typedef struct IncrementalSortPath
+{
+	SortPath	spath;
+	int			nPresortedCols; /* number of presorted columns */
+} IncrementalSortPath;
+
 /*
  * GroupPath represents grouping (of presorted input)
  *
@@ -2500,6 +2549,9 @@ typedef struct JoinCostWorkspace
 	int			numbuckets;
 	int			numbatches;
 	double		inner_rows_total;
+
+	/* private for cost_spatialjoin code */
+	int			numtiles;
 } JoinCostWorkspace;
 
 #endif							/* PATHNODES_H */
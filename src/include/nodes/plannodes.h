@@ -747,6 +747,22 @@ typedef struct HashJoin
 	List	   *hashkeys;
 } HashJoin;
 
+/* ----------------
+ *		spatial join node
+ *
+ * spatialclauses are join clauses of the form "outer_expr op inner_expr"
+ * that can only be true when the bounding boxes of the two expressions
+ * overlap (see geo_operator_implies_overlap).  The first one determines how
+ * the inputs are partitioned; all of them are checked for each candidate
+ * pair of tuples.
+ * ----------------
+ */
+typedef struct SpatialJoin
+{
+	Join		join;
+	List	   *spatialclauses;
+} SpatialJoin;
+
 /* ----------------
  *		materialization node
  * ----------------
@@ -756,6 +772,34 @@ typedef struct Material
 	Plan		plan;
 } Material;
 
+/* ----------------
+ *		result cache node
+ *
+ * Caches the tuples produced by its subplan, keyed by the values of
+ * param_exprs, so that repeated scans with the same parameter values can
+ * be answered from the cache rather than by rescanning the subplan.
+ * ----------------
+ */
+typedef struct ResultCache
+{
+	Plan		plan;
+
+	int			numKeys;		/* size of the two arrays below */
+
+	Oid		   *hashOperators;	/* hash operators for each key */
+	Oid		   *collations;		/* collation for each key */
+	List	   *param_exprs;	/* exprs containing parameters */
+	bool		singlerow;		/* true if the cache entry should be marked as
+								 * complete after we store the first tuple in
+								 * it. */
+	bool		binary_mode;	/* true when cache key should be compared bit
+								 * by bit, false when using hash equality ops */
+	uint32		est_entries;	/* The maximum number of entries that the
+								 * planner expects will fit in the cache, or 0
+								 * if unknown */
+	Bitmapset  *keyparamids;	/* paramids from param_exprs */
+} ResultCache;
+
 /* ----------------
  *		sort node
  * ----------------
@@ -770,6 +814,20 @@ typedef struct Sort
 	bool	   *nullsFirst;		/* NULLS FIRST/LAST directions */
 } Sort;
 
+/* ----------------
+ *		incremental sort node
+ *
+ * The input is known to be sorted on the first nPresortedCols sort keys, so
+ * only the remaining keys need to be sorted within each group of tuples
+ * having equal presorted keys.
+ * ----------------
+ */
+typedef struct IncrementalSort
+{
+	Sort		sort;
+	int			nPresortedCols; /* number of presorted columns */
+} IncrementalSort;
+
 /* ---------------
  *	 group node -
  *		Used for queries with GROUP BY (but no aggregates) specified.
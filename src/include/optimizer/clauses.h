@@ -50,6 +50,8 @@ extern bool is_pseudo_constant_clause_relids(Node *clause, Relids relids);
 
 extern int	NumRelids(Node *clause);
 
+extern Bitmapset *pull_paramids(Expr *expr);
+
 extern void CommuteOpExpr(OpExpr *clause);
 
 extern Query *inline_set_returning_function(PlannerInfo *root,
@@ -87,6 +87,9 @@ typedef int64 PgStat_Counter;
  * For an index, tuples_returned is the number of index entries returned by
  * the index AM, while tuples_fetched is the number of tuples successfully
  * fetched by heap_fetch under the control of simple indexscans for this index.
+ * inner_visited, leaf_tested, consistent_rejected and leaf_rechecked are only
+ * used for indexes, and are the totals of the IndexScanInstrumentation of
+ * the scans; see relscan.h.
  *
  * tuples_inserted/updated/deleted/hot_updated count attempted actions,
  * regardless of whether the transaction committed.  delta_live_tuples,
@@ -101,6 +104,11 @@ typedef struct PgStat_TableCounts
 	PgStat_Counter t_tuples_returned;
 	PgStat_Counter t_tuples_fetched;
 
+	PgStat_Counter t_inner_visited;
+	PgStat_Counter t_leaf_tested;
+	PgStat_Counter t_consistent_rejected;
+	PgStat_Counter t_leaf_rechecked;
+
 	PgStat_Counter t_tuples_inserted;
 	PgStat_Counter t_tuples_updated;
 	PgStat_Counter t_tuples_deleted;
@@ -581,7 +589,7 @@ typedef union PgStat_Msg
  * ------------------------------------------------------------
  */
 
-#define PGSTAT_FILE_FORMAT_ID	0x01A5BC9D
+#define PGSTAT_FILE_FORMAT_ID	0x01A5BC9E
 
 /* ----------
  * PgStat_StatDBEntry			The collector's data per database
@@ -638,6 +646,11 @@ typedef struct PgStat_StatTabEntry
 	PgStat_Counter tuples_returned;
 	PgStat_Counter tuples_fetched;
 
+	PgStat_Counter inner_visited;
+	PgStat_Counter leaf_tested;
+	PgStat_Counter consistent_rejected;
+	PgStat_Counter leaf_rechecked;
+
 	PgStat_Counter tuples_inserted;
 	PgStat_Counter tuples_updated;
 	PgStat_Counter tuples_deleted;
@@ -824,6 +837,7 @@ typedef enum
 	WAIT_EVENT_CHECKPOINT_DONE,
 	WAIT_EVENT_CHECKPOINT_START,
 	WAIT_EVENT_EXECUTE_GATHER,
+	WAIT_EVENT_GIST_ROOT,
 	WAIT_EVENT_HASH_BATCH_ALLOCATING,
 	WAIT_EVENT_HASH_BATCH_ELECTING,
 	WAIT_EVENT_HASH_BATCH_LOADING,
@@ -847,12 +861,14 @@ typedef enum
 	WAIT_EVENT_MQ_SEND,
 	WAIT_EVENT_PARALLEL_BITMAP_SCAN,
 	WAIT_EVENT_PARALLEL_CREATE_INDEX_SCAN,
+	WAIT_EVENT_PARALLEL_CREATE_INDEX_BUILD,
 	WAIT_EVENT_PARALLEL_FINISH,
 	WAIT_EVENT_PROCARRAY_GROUP_UPDATE,
 	WAIT_EVENT_PROMOTE,
 	WAIT_EVENT_REPLICATION_ORIGIN_DROP,
 	WAIT_EVENT_REPLICATION_SLOT_DROP,
 	WAIT_EVENT_SAFE_SNAPSHOT,
+	WAIT_EVENT_SPGIST_ROOT,
 	WAIT_EVENT_SYNC_REP
 } WaitEventIPC;
 
@@ -1380,6 +1396,18 @@ pgstat_report_wait_end(void)
 		if ((rel)->pgstat_info != NULL)								\
 			(rel)->pgstat_info->t_counts.t_tuples_returned += (n);	\
 	} while (0)
+#define pgstat_count_index_traversal(rel, instr)					\
+	do {															\
+		if ((rel)->pgstat_info != NULL)								\
+		{															\
+			PgStat_TableCounts *counts = &(rel)->pgstat_info->t_counts; \
+																	\
+			counts->t_inner_visited += (instr)->inner_visited;		\
+			counts->t_leaf_tested += (instr)->leaf_tested;			\
+			counts->t_consistent_rejected += (instr)->consistent_rejected; \
+			counts->t_leaf_rechecked += (instr)->leaf_rechecked;	\
+		}															\
+	} while (0)
 #define pgstat_count_buffer_read(rel)								\
 	do {															\
 		if ((rel)->pgstat_info != NULL)								\
@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * simd.h
+ *	  Support for platform-specific vector operations.
+ *
+ * SSE2 instructions are part of the spec for the 64-bit x86 ISA, so we can
+ * assume that compilers targeting that architecture understand the SSE2
+ * intrinsics, and that every CPU running the code has them.  No runtime
+ * check or special compiler flag is needed, unlike for wider instruction
+ * sets such as AVX2, which we don't use.
+ *
+ * Code using these must also provide a portable implementation, for use
+ * when USE_SSE2 is not defined.
+ *
+ * Copyright (c) 2019, PostgreSQL Global Development Group
+ *
+ * src/include/port/simd.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef SIMD_H
+#define SIMD_H
+
+#if (defined(__x86_64__) || defined(_M_AMD64))
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+#endif							/* SIMD_H */
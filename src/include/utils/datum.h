@@ -55,6 +55,14 @@ extern bool datumIsEqual(Datum value1, Datum value2,
 extern bool datum_image_eq(Datum value1, Datum value2,
 						   bool typByVal, int typLen);
 
+/*
+ * datum_image_hash
+ *
+ * Generates hash value for 'value' based on its bits rather than logical
+ * value.
+ */
+extern uint32 datum_image_hash(Datum value, bool typByVal, int typLen);
+
 /*
  * Serialize and restore datums so that we can transfer them to parallel
  * workers.
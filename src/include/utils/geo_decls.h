@@ -171,10 +171,39 @@ typedef struct
 #define PG_RETURN_CIRCLE_P(x) return CirclePGetDatum(x)
 
 
+/*
+ * in geo_batch.c
+ */
+
+extern void box_ov_batch(BOX **boxes, int nboxes, BOX *query, bool *result);
+extern void box_contain_batch(BOX **boxes, int nboxes, BOX *query,
+							  bool *result);
+extern void box_contained_batch(BOX **boxes, int nboxes, BOX *query,
+								bool *result);
+extern void box_ov_exact_batch(BOX **boxes, int nboxes, BOX *query,
+							   bool *result);
+extern void point_box_distance_batch(BOX **boxes, int nboxes, Point *point,
+									 float8 *result);
+
+/*
+ * in geo_curve.c
+ */
+
+extern uint64 hilbert_curve_position(uint32 x, uint32 y, int order);
+extern uint64 zorder_curve_position(uint32 x, uint32 y);
+
 /*
  * in geo_ops.c
  */
 
 extern float8 pg_hypot(float8 x, float8 y);
+extern bool geo_type_has_bbox(Oid typid);
+extern bool geo_datum_bbox(Oid typid, Datum value, BOX *bbox);
+
+/*
+ * in geo_selfuncs.c
+ */
+
+extern bool geo_operator_implies_overlap(Oid operator);
 
 #endif							/* GEO_DECLS_H */
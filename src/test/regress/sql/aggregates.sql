@@ -1014,6 +1014,116 @@ select v||'a', case when v||'a' = 'aa' then 1 else 0 end, count(*)
 -- Make sure that generation of HashAggregate for uniqification purposes
 -- does not lead to array overflow due to unexpected duplicate hash keys
 -- see CAFeeJoKKu0u+A_A9R9316djW-YW3-+Gtgvy3ju655qRHR3jtdA@mail.gmail.com
+set enable_resultcache to off;
 explain (costs off)
   select 1 from tenk1
    where (hundred, thousand) in (select twothousand, twothousand from onek);
+reset enable_resultcache;
+
+--
+-- Hash Aggregation Spill tests
+--
+
+set enable_sort=false;
+set work_mem='64kB';
+
+select unique1, count(*), sum(twothousand) from tenk1
+group by unique1
+having sum(fivethous) > 4975
+order by sum(twothousand);
+
+set work_mem to default;
+set enable_sort to default;
+
+-- Compare results between plans using sorting and plans using hash
+-- aggregation, forcing the hash aggregation to spill to disk, including
+-- recursive spilling of batches.
+
+create table agg_data_20k as select g from generate_series(0, 19999) g;
+analyze agg_data_20k;
+
+set enable_hashagg = false;
+
+create table agg_group_1 as
+select g%1000 as c1, sum(g::numeric) as c2, count(*) as c3,
+       array_length(array_agg(g), 1) as c4
+  from agg_data_20k group by g%1000;
+
+create table agg_group_2 as
+select g%1000 as c1, g%100 as c2, sum(g::numeric) as c3, count(*) as c4
+  from agg_data_20k group by grouping sets ((g%1000), (g%100), ());
+
+set enable_hashagg = true;
+set enable_sort = false;
+set work_mem = '64kB';
+
+create table agg_hash_1 as
+select g%1000 as c1, sum(g::numeric) as c2, count(*) as c3,
+       array_length(array_agg(g), 1) as c4
+  from agg_data_20k group by g%1000;
+
+create table agg_hash_2 as
+select g%1000 as c1, g%100 as c2, sum(g::numeric) as c3, count(*) as c4
+  from agg_data_20k group by grouping sets ((g%1000), (g%100), ());
+
+set enable_sort to default;
+set work_mem to default;
+
+(select * from agg_hash_1 except select * from agg_group_1)
+  union all
+(select * from agg_group_1 except select * from agg_hash_1);
+
+(select * from agg_hash_2 except select * from agg_group_2)
+  union all
+(select * from agg_group_2 except select * from agg_hash_2);
+
+select count(*) from agg_hash_1;
+select count(*) from agg_hash_2;
+
+drop table agg_group_1;
+drop table agg_group_2;
+drop table agg_hash_1;
+drop table agg_hash_2;
+drop table agg_data_20k;
+
+--
+-- Test batch-at-a-time execution of plain aggregates
+--
+create table agg_batch (i2 int2, i4 int4, i8 int8, f8 float8, t text);
+insert into agg_batch
+  select g % 100, g, g * 1000000000::int8,
+         case when g % 7 = 0 then null else g / 4.0 end, g::text
+  from generate_series(1, 5000) g;
+insert into agg_batch values (null, null, null, null, null);
+analyze agg_batch;
+
+set enable_batch_execution = on;
+
+explain (costs off)
+select count(*), sum(i4), avg(i4), sum(f8), sum(i8), min(i2), max(i4 * 2 - 1)
+  from agg_batch where i4 > 100 and f8 < 1000;
+select count(*), sum(i4), avg(i4), sum(f8), sum(i8), min(i2), max(i4 * 2 - 1)
+  from agg_batch where i4 > 100 and f8 < 1000;
+
+-- compare with the regular path
+set enable_batch_execution = off;
+select count(*), sum(i4), avg(i4), sum(f8), sum(i8), min(i2), max(i4 * 2 - 1)
+  from agg_batch where i4 > 100 and f8 < 1000;
+set enable_batch_execution = on;
+
+-- null inputs, cross-type comparisons, other transition functions
+select count(*), count(f8), sum(i2), avg(f8), max(f8 * 2) from agg_batch;
+select count(*), sum(i8) from agg_batch where i2 = 7 and i8 <> 7000000000;
+select count(*), sum(i4) from agg_batch where i4 < 0;
+
+-- these can't use batch mode
+explain (costs off)
+select count(*) from agg_batch where t like '1%';
+explain (costs off)
+select i2, count(*) from agg_batch group by i2;
+
+-- overflow must still be detected
+select sum(i4 * 1000000) from agg_batch;
+
+reset enable_batch_execution;
+drop table agg_batch;
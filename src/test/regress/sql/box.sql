@@ -281,3 +281,233 @@ WHERE seq.id IS NULL OR idx.id IS NULL;
 RESET enable_seqscan;
 RESET enable_indexscan;
 RESET enable_bitmapscan;
+
+--
+-- Test the SP-GiST quad tree with coordinates at and beyond the float4
+-- range, which the traversal values round to float4
+--
+CREATE TABLE quad_box_ext_tbl (id int, b box);
+
+INSERT INTO quad_box_ext_tbl
+  SELECT row_number() OVER (), box(point(x1, y1), point(x2, y2))
+  FROM unnest('{-infinity,-1e300,-3.5e38,-3.4028234e38,-1,-1e-300,0,
+                1e-40,1,1.0000000001,3.4028234e38,3.4028236e38,1e39,
+                1e300,infinity}'::float8[]) x1,
+       unnest('{-infinity,-1e300,-3.4028234e38,0,1e-300,3.4028236e38,
+                1e300,infinity}'::float8[]) y1,
+       unnest('{1,1.000000001,2}'::float8[]) c(xf),
+       unnest('{1,1.000000001,2}'::float8[]) d(yf),
+       LATERAL (VALUES (x1 * xf, y1 * yf)) e(x2, y2);
+
+-- and a cluster of boxes closer together than float4 can tell apart
+INSERT INTO quad_box_ext_tbl
+  SELECT 10000 + i * 100 + j,
+         box(point(1000 + i * 1e-5, 1000 - j * 1e-5), point(1000 + j * 1e-5, 1000 + i * 1e-5))
+  FROM generate_series(-30, 30, 3) i, generate_series(-30, 30, 2) j;
+
+CREATE INDEX quad_box_ext_tbl_idx ON quad_box_ext_tbl USING spgist(b);
+
+CREATE TEMP TABLE quad_box_ext_qs AS
+SELECT box(point(x1, y1), point(x2, y2)) q
+FROM unnest('{-1e300,-3.4028235e38,0,1,3.4028235e38,1e39}'::float8[]) x1,
+     unnest('{-3.5e38,1e-300,3.4028236e38}'::float8[]) y1,
+     unnest('{1.0000000001,3.4028234e38,1e300,infinity}'::float8[]) x2,
+     unnest('{0,3.4028236e38,1e300}'::float8[]) y2
+UNION ALL
+SELECT box(point(1000 + i * 1e-5, 1000 + j * 1e-5), point(1000 + k * 1e-5, 1000 + l * 1e-5))
+FROM generate_series(-25, 25, 25) i, generate_series(-25, 25, 25) j,
+     generate_series(-20, 20, 20) k, generate_series(-20, 20, 20) l;
+
+CREATE TEMP VIEW quad_box_ext_queries AS
+SELECT '<<' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b << q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '&<' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b &< q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '&&' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b && q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '&>' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b &> q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '>>' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b >> q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '<<|' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b <<| q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '&<|' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b &<| q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '|&>' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b |&> q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '|>>' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b |>> q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '@>' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b @> q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '<@' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b <@ q ORDER BY id)::text ids
+FROM quad_box_ext_qs
+UNION ALL
+SELECT '~=' op, q::text arg,
+  array(SELECT id FROM quad_box_ext_tbl WHERE b ~= q ORDER BY id)::text ids
+FROM quad_box_ext_qs;
+
+SET enable_seqscan = OFF;
+SET enable_indexscan = ON;
+SET enable_bitmapscan = OFF;
+
+CREATE TEMP TABLE quad_box_ext_idx AS SELECT * FROM quad_box_ext_queries;
+
+SET enable_indexscan = OFF;
+SET enable_bitmapscan = ON;
+
+CREATE TEMP TABLE quad_box_ext_bitmap AS SELECT * FROM quad_box_ext_queries;
+
+RESET enable_seqscan;
+RESET enable_indexscan;
+RESET enable_bitmapscan;
+
+CREATE TEMP TABLE quad_box_ext_seq AS SELECT * FROM quad_box_ext_queries;
+
+SELECT op, count(*), sum(cardinality(ids::int[]))
+FROM quad_box_ext_seq GROUP BY op ORDER BY op;
+
+SELECT op, arg
+FROM quad_box_ext_seq seq FULL JOIN quad_box_ext_idx idx USING (op, arg)
+WHERE seq.ids IS DISTINCT FROM idx.ids;
+
+SELECT op, arg
+FROM quad_box_ext_seq seq FULL JOIN quad_box_ext_bitmap bmp USING (op, arg)
+WHERE seq.ids IS DISTINCT FROM bmp.ids;
+
+DROP VIEW quad_box_ext_queries;
+DROP TABLE quad_box_ext_tbl;
+
+--
+-- Test the SP-GiST loose quad tree on the same data
+--
+DROP INDEX quad_box_tbl_idx;
+
+CREATE INDEX quad_box_tbl_loose_idx ON quad_box_tbl
+  USING spgist(b loose_quad_box_ops) WITH (looseness = 0.5);
+CREATE INDEX quad_box_tbl_loose_idx ON quad_box_tbl
+  USING spgist(b loose_quad_box_ops) WITH (looseness = 4.5);
+CREATE INDEX quad_box_tbl_loose_idx ON quad_box_tbl
+  USING spgist(b loose_quad_box_ops) WITH (looseness = 1.5);
+
+SET enable_seqscan = OFF;
+SET enable_indexscan = ON;
+SET enable_bitmapscan = ON;
+
+SELECT count(*) FROM quad_box_tbl WHERE b <<  box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b &<  box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b &&  box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b &>  box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b >>  box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b <<| box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b &<| box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b |&> box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b |>> box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b @>  box '((201,301),(202,303))';
+SELECT count(*) FROM quad_box_tbl WHERE b <@  box '((100,200),(300,500))';
+SELECT count(*) FROM quad_box_tbl WHERE b ~=  box '((200,300),(205,305))';
+
+-- changing the looseness doesn't affect the existing tree
+ALTER INDEX quad_box_tbl_loose_idx SET (looseness = 3);
+SELECT count(*) FROM quad_box_tbl WHERE b &&  box '((100,200),(300,500))';
+
+-- test ORDER BY distance
+SET enable_bitmapscan = OFF;
+
+CREATE TEMP TABLE quad_box_tbl_ord_idx3 AS
+SELECT rank() OVER (ORDER BY b <-> point '123,456') n, b <-> point '123,456' dist, id
+FROM quad_box_tbl;
+
+SELECT *
+FROM quad_box_tbl_ord_seq1 seq FULL JOIN quad_box_tbl_ord_idx3 idx
+	ON seq.n = idx.n AND seq.id = idx.id AND
+		(seq.dist = idx.dist OR seq.dist IS NULL AND idx.dist IS NULL)
+WHERE seq.id IS NULL OR idx.id IS NULL;
+
+CREATE TEMP TABLE quad_box_tbl_ord_idx4 AS
+SELECT rank() OVER (ORDER BY b <-> point '123,456') n, b <-> point '123,456' dist, id
+FROM quad_box_tbl WHERE b <@ box '((200,300),(500,600))';
+
+SELECT *
+FROM quad_box_tbl_ord_seq2 seq FULL JOIN quad_box_tbl_ord_idx4 idx
+	ON seq.n = idx.n AND seq.id = idx.id AND
+		(seq.dist = idx.dist OR seq.dist IS NULL AND idx.dist IS NULL)
+WHERE seq.id IS NULL OR idx.id IS NULL;
+
+RESET enable_seqscan;
+RESET enable_indexscan;
+RESET enable_bitmapscan;
+
+-- Test selectivity estimation using the grid statistics collected by ANALYZE.
+-- We only check that the estimates are in the right ballpark.
+CREATE FUNCTION check_box_estimate(text) RETURNS bool
+LANGUAGE plpgsql AS
+$$
+DECLARE
+    ln text;
+    tmp text[];
+BEGIN
+    FOR ln IN EXECUTE format('EXPLAIN ANALYZE %s', $1)
+    LOOP
+        tmp := regexp_match(ln, 'rows=(\d*) .* rows=(\d*)');
+        RETURN tmp[1]::int BETWEEN tmp[2]::int / 3 AND tmp[2]::int * 3;
+    END LOOP;
+END;
+$$;
+
+CREATE TABLE box_stats_tbl AS
+SELECT box(point(x, y), point(x + 2, y + 2)) AS b, point(x, y) AS p
+FROM generate_series(1, 100) x, generate_series(1, 100) y;
+CREATE TABLE box_stats_pts AS
+SELECT point(x, y) AS p
+FROM generate_series(5, 95, 10) x, generate_series(5, 95, 10) y;
+ANALYZE box_stats_tbl, box_stats_pts;
+
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl WHERE b && box ''((10,10),(30,30))''');
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl WHERE b <@ box ''((10,10),(30,30))''');
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl WHERE box ''((10,10),(30,30))'' @> b');
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl WHERE b << box ''((20,0),(21,1))''');
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl WHERE b |>> box ''((0,80),(1,81))''');
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl WHERE p <@ box ''((10,10),(30,30))''');
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl WHERE p << point ''(25.5,0)''');
+SELECT check_box_estimate('SELECT * FROM box_stats_pts s JOIN box_stats_tbl t ON s.p <@ t.b');
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl t WHERE EXISTS (SELECT FROM box_stats_pts s WHERE s.p <@ t.b)');
+SELECT check_box_estimate('SELECT * FROM box_stats_tbl t WHERE NOT EXISTS (SELECT FROM box_stats_pts s WHERE s.p <@ t.b)');
+SELECT check_box_estimate('SELECT * FROM box_stats_pts s WHERE EXISTS (SELECT FROM box_stats_tbl t WHERE s.p <@ t.b)');
+
+DROP TABLE box_stats_tbl, box_stats_pts;
+
+-- The extent of the centers and the sizes of the boxes can be wider than the
+-- largest float8, even though all the coordinates are finite.
+CREATE TABLE box_stats_huge AS
+SELECT box(point(x * 8e305 - 9e307, y), point(x * 8e305 + 9e307, y + 1)) AS b,
+       point(x * 1e306, y) AS p
+FROM generate_series(-90, 90) x, generate_series(1, 50) y;
+ANALYZE box_stats_huge;
+
+SELECT check_box_estimate('SELECT * FROM box_stats_huge WHERE p << point ''(0,0)''');
+SELECT check_box_estimate('SELECT * FROM box_stats_huge WHERE p <@ box ''((-5e307,0),(5e307,25))''');
+SELECT check_box_estimate('SELECT * FROM box_stats_huge WHERE b && box ''((0,0),(1,10))''');
+
+DROP TABLE box_stats_huge;
+DROP FUNCTION check_box_estimate(text);
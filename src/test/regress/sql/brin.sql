@@ -25,7 +25,8 @@ CREATE TABLE brintest (byteacol bytea,
 	uuidcol uuid,
 	int4rangecol int4range,
 	lsncol pg_lsn,
-	boxcol box
+	boxcol box,
+	pointcol point
 ) WITH (fillfactor=10);
 
 INSERT INTO brintest SELECT
@@ -55,7 +56,8 @@ INSERT INTO brintest SELECT
 	format('%s%s-%s-%s-%s-%s%s%s', to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'))::uuid,
 	int4range(thousand, twothousand),
 	format('%s/%s%s', odd, even, tenthous)::pg_lsn,
-	box(point(odd, even), point(thousand, twothousand))
+	box(point(odd, even), point(thousand, twothousand)),
+	point(thousand, twothousand)
 FROM tenk1 ORDER BY unique2 LIMIT 100;
 
 -- throw in some NULL's and different values
@@ -95,7 +97,8 @@ CREATE INDEX brinidx ON brintest USING brin (
 	uuidcol,
 	int4rangecol,
 	lsncol,
-	boxcol
+	boxcol,
+	pointcol
 ) with (pages_per_range = 1);
 
 CREATE TABLE brinopers (colname name, typ text,
@@ -287,7 +290,15 @@ INSERT INTO brinopers VALUES
 	('boxcol', 'box',
 	 '{<<, &<, &&, &>, >>, <<|, &<|, |&>, |>>, @>, <@, ~=}',
 	 '{"((1000,2000),(3000,4000))","((1,2),(3000,4000))","((1,2),(3000,4000))","((1,2),(3000,4000))","((1,2),(3,4))","((1000,2000),(3000,4000))","((1,2000),(3,4000))","((1000,2),(3000,4))","((1,2),(3,4))","((1,2),(300,400))","((1,2),(3000,4000))","((222,1222),(44,45))"}',
-	 '{100, 100, 100, 99, 96, 100, 100, 99, 96, 1, 99, 1}');
+	 '{100, 100, 100, 99, 96, 100, 100, 99, 96, 1, 99, 1}'),
+	('pointcol', 'point',
+	 '{~=}',
+	 '{"(321,321)"}',
+	 '{2}'),
+	('pointcol', 'box',
+	 '{<@, <@}',
+	 '{"((0,0),(500,1000))","((100,100),(300,400))"}',
+	 '{23, 9}');
 
 DO $x$
 DECLARE
@@ -400,7 +411,8 @@ INSERT INTO brintest SELECT
 	format('%s%s-%s-%s-%s-%s%s%s', to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'))::uuid,
 	int4range(thousand, twothousand),
 	format('%s/%s%s', odd, even, tenthous)::pg_lsn,
-	box(point(odd, even), point(thousand, twothousand))
+	box(point(odd, even), point(thousand, twothousand)),
+	point(thousand, twothousand)
 FROM tenk1 ORDER BY unique2 LIMIT 5 OFFSET 5;
 
 SELECT brin_desummarize_range('brinidx', 0);
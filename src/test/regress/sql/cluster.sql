@@ -222,10 +222,18 @@ where row(hundred, thousand, tenthous) <= row(lhundred, lthousand, ltenthous);
 reset enable_indexscan;
 reset maintenance_work_mem;
 
+-- Test CLUSTER on a GiST index, which sorts the rows along a Hilbert curve
+create table clstr_5 (p point);
+insert into clstr_5 select point(x, y) from generate_series(0, 3) x, generate_series(0, 3) y;
+create index clstr_5_idx on clstr_5 using gist (p);
+cluster clstr_5 using clstr_5_idx;
+select p from clstr_5;
+
 -- clean up
 DROP TABLE clustertest;
 DROP TABLE clstr_1;
 DROP TABLE clstr_2;
 DROP TABLE clstr_3;
 DROP TABLE clstr_4;
+DROP TABLE clstr_5;
 DROP USER regress_clstr_user;
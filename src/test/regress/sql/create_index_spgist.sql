@@ -52,6 +52,8 @@ SELECT count(*) FROM quad_point_tbl WHERE p >^ '(5000, 4000)';
 
 SELECT count(*) FROM quad_point_tbl WHERE p ~= '(4585, 365)';
 
+SELECT count(*) FROM quad_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+
 CREATE TEMP TABLE quad_point_tbl_ord_seq1 AS
 SELECT row_number() OVER (ORDER BY p <-> '0,0') n, p <-> '0,0' dist, p
 FROM quad_point_tbl;
@@ -64,6 +66,10 @@ CREATE TEMP TABLE quad_point_tbl_ord_seq3 AS
 SELECT row_number() OVER (ORDER BY p <-> '333,400') n, p <-> '333,400' dist, p
 FROM quad_point_tbl WHERE p IS NOT NULL;
 
+CREATE TEMP TABLE quad_point_tbl_ord_seq4 AS
+SELECT row_number() OVER (ORDER BY p <-> '5000,4000') n, p <-> '5000,4000' dist, p
+FROM quad_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+
 SELECT count(*) FROM radix_text_tbl WHERE t = 'P0123456789abcdef';
 
 SELECT count(*) FROM radix_text_tbl WHERE t = 'P0123456789abcde';
@@ -167,6 +173,20 @@ SELECT * FROM quad_point_tbl_ord_seq3 seq FULL JOIN quad_point_tbl_ord_idx3 idx
 ON seq.n = idx.n
 WHERE seq.dist IS DISTINCT FROM idx.dist;
 
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM quad_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+SELECT count(*) FROM quad_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+
+EXPLAIN (COSTS OFF)
+SELECT row_number() OVER (ORDER BY p <-> '5000,4000') n, p <-> '5000,4000' dist, p
+FROM quad_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+CREATE TEMP TABLE quad_point_tbl_ord_idx4 AS
+SELECT row_number() OVER (ORDER BY p <-> '5000,4000') n, p <-> '5000,4000' dist, p
+FROM quad_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+SELECT * FROM quad_point_tbl_ord_seq4 seq FULL JOIN quad_point_tbl_ord_idx4 idx
+ON seq.n = idx.n
+WHERE seq.dist IS DISTINCT FROM idx.dist;
+
 EXPLAIN (COSTS OFF)
 SELECT count(*) FROM kd_point_tbl WHERE p <@ box '(200,200,1000,1000)';
 SELECT count(*) FROM kd_point_tbl WHERE p <@ box '(200,200,1000,1000)';
@@ -225,10 +245,160 @@ SELECT * FROM quad_point_tbl_ord_seq3 seq FULL JOIN kd_point_tbl_ord_idx3 idx
 ON seq.n = idx.n
 WHERE seq.dist IS DISTINCT FROM idx.dist;
 
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM kd_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+SELECT count(*) FROM kd_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+
+EXPLAIN (COSTS OFF)
+SELECT row_number() OVER (ORDER BY p <-> '5000,4000') n, p <-> '5000,4000' dist, p
+FROM kd_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+CREATE TEMP TABLE kd_point_tbl_ord_idx4 AS
+SELECT row_number() OVER (ORDER BY p <-> '5000,4000') n, p <-> '5000,4000' dist, p
+FROM kd_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+SELECT * FROM quad_point_tbl_ord_seq4 seq FULL JOIN kd_point_tbl_ord_idx4 idx
+ON seq.n = idx.n
+WHERE seq.dist IS DISTINCT FROM idx.dist;
+
 -- check ORDER BY distance to NULL
 SELECT (SELECT p FROM kd_point_tbl ORDER BY p <-> pt, p <-> '0,0' LIMIT 1)
 FROM (VALUES (point '1,2'), (NULL), ('1234,5678')) pts(pt);
 
+-- quad_point_compact_ops stores rounded coordinates, so the index only
+-- finds candidates, which are rechecked
+CREATE TABLE compact_point_tbl AS SELECT * FROM quad_point_tbl;
+CREATE INDEX sp_compact_ind ON compact_point_tbl
+    USING spgist (p quad_point_compact_ops);
+
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM compact_point_tbl WHERE p <@ box '(200,200,1000,1000)';
+SELECT count(*) FROM compact_point_tbl WHERE p <@ box '(200,200,1000,1000)';
+
+SELECT count(*) FROM compact_point_tbl WHERE p << '(5000, 4000)';
+
+SELECT count(*) FROM compact_point_tbl WHERE p >> '(5000, 4000)';
+
+SELECT count(*) FROM compact_point_tbl WHERE p <^ '(5000, 4000)';
+
+SELECT count(*) FROM compact_point_tbl WHERE p >^ '(5000, 4000)';
+
+SELECT count(*) FROM compact_point_tbl WHERE p ~= '(4585, 365)';
+
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM compact_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+SELECT count(*) FROM compact_point_tbl WHERE p <@ circle '<(5000,4000),1000>';
+
+EXPLAIN (COSTS OFF)
+SELECT row_number() OVER (ORDER BY p <-> '0,0') n, p <-> '0,0' dist, p
+FROM compact_point_tbl;
+CREATE TEMP TABLE compact_point_tbl_ord_idx1 AS
+SELECT row_number() OVER (ORDER BY p <-> '0,0') n, p <-> '0,0' dist, p
+FROM compact_point_tbl;
+SELECT * FROM quad_point_tbl_ord_seq1 seq FULL JOIN compact_point_tbl_ord_idx1 idx
+ON seq.n = idx.n
+WHERE seq.dist IS DISTINCT FROM idx.dist;
+
+DROP TABLE compact_point_tbl;
+
+-- Coordinates that float4 can't store exactly, clustered so that inner
+-- tuple centroids and the edges of the queries fall between the rounded
+-- leaf values.  The index must find exactly the points a seqscan finds.
+CREATE TABLE compact_edge_tbl AS
+SELECT row_number() OVER () AS id, p FROM (
+    SELECT point(1000 + i * 1e-5, 1000 - j * 1e-5) p
+    FROM generate_series(-20, 20) i, generate_series(-20, 20) j
+    UNION ALL
+    SELECT point(16777216 + i * 0.3, -16777216 - j * 0.7)
+    FROM generate_series(-10, 10) i, generate_series(-10, 10) j
+    UNION ALL
+    SELECT point(i * 0.1, j * 1e-39)
+    FROM generate_series(-10, 10) i, generate_series(-10, 10) j
+) s;
+CREATE INDEX sp_compact_edge_ind ON compact_edge_tbl
+    USING spgist (p quad_point_compact_ops);
+
+CREATE TEMP TABLE compact_edge_pts AS
+SELECT point(1000 + k * 1e-5 + o, 1000 - k * 1e-5 - o) q
+FROM generate_series(-3, 3) k, unnest('{-1e-7,0,1e-7}'::float8[]) o
+UNION ALL
+SELECT point(16777216 + k * 0.3 + o, -16777216 - k * 0.7 - o)
+FROM generate_series(-3, 3) k, unnest('{-0.1,0,0.1}'::float8[]) o
+UNION ALL
+SELECT point(k * 0.1, o)
+FROM generate_series(-3, 3) k, unnest('{-1e-39,0,1e-39}'::float8[]) o;
+
+CREATE TEMP TABLE compact_edge_boxes AS
+SELECT box(a.q, b.q) b FROM compact_edge_pts a, compact_edge_pts b
+WHERE a.q[0] < b.q[0] AND b.q[0] - a.q[0] < 3
+  AND a.q[1] > b.q[1] AND a.q[1] - b.q[1] < 3;
+
+CREATE TEMP VIEW compact_edge_queries AS
+SELECT 'box' op, b::text arg,
+       array(SELECT id FROM compact_edge_tbl WHERE p <@ b ORDER BY id)::text ids
+FROM compact_edge_boxes
+UNION ALL
+SELECT 'circle', circle(q, r)::text,
+       array(SELECT id FROM compact_edge_tbl WHERE p <@ circle(q, r) ORDER BY id)::text
+FROM compact_edge_pts, unnest('{1e-5,2.00001e-5,1}'::float8[]) r
+UNION ALL
+SELECT 'same', q::text,
+       array(SELECT id FROM compact_edge_tbl WHERE p ~= q ORDER BY id)::text
+FROM compact_edge_pts
+UNION ALL
+SELECT 'left', q::text,
+       array(SELECT id FROM compact_edge_tbl WHERE p << q ORDER BY id)::text
+FROM compact_edge_pts
+UNION ALL
+SELECT 'right', q::text,
+       array(SELECT id FROM compact_edge_tbl WHERE p >> q ORDER BY id)::text
+FROM compact_edge_pts
+UNION ALL
+SELECT 'below', q::text,
+       array(SELECT id FROM compact_edge_tbl WHERE p <^ q ORDER BY id)::text
+FROM compact_edge_pts
+UNION ALL
+SELECT 'above', q::text,
+       array(SELECT id FROM compact_edge_tbl WHERE p >^ q ORDER BY id)::text
+FROM compact_edge_pts
+UNION ALL
+SELECT 'nearest', q::text,
+       array(SELECT p <-> q FROM compact_edge_tbl ORDER BY p <-> q LIMIT 30)::text
+FROM compact_edge_pts;
+
+EXPLAIN (COSTS OFF)
+SELECT array(SELECT id FROM compact_edge_tbl WHERE p <@ b ORDER BY id)
+FROM compact_edge_boxes;
+EXPLAIN (COSTS OFF)
+SELECT array(SELECT p <-> q FROM compact_edge_tbl ORDER BY p <-> q LIMIT 30)
+FROM compact_edge_pts;
+CREATE TEMP TABLE compact_edge_idx AS SELECT * FROM compact_edge_queries;
+
+SET enable_indexscan = OFF;
+SET enable_bitmapscan = ON;
+EXPLAIN (COSTS OFF)
+SELECT array(SELECT id FROM compact_edge_tbl WHERE p <@ b ORDER BY id)
+FROM compact_edge_boxes;
+CREATE TEMP TABLE compact_edge_bitmap AS SELECT * FROM compact_edge_queries;
+
+SET enable_seqscan = ON;
+SET enable_bitmapscan = OFF;
+CREATE TEMP TABLE compact_edge_seq AS SELECT * FROM compact_edge_queries;
+SET enable_seqscan = OFF;
+SET enable_indexscan = ON;
+
+SELECT op, count(*), sum(cardinality(ids::text[])) FROM compact_edge_seq
+GROUP BY op ORDER BY op;
+SELECT seq.op, seq.arg, idx.op, idx.arg
+FROM compact_edge_seq seq FULL JOIN compact_edge_idx idx
+ON seq.op = idx.op AND seq.arg = idx.arg
+WHERE seq.ids IS DISTINCT FROM idx.ids;
+SELECT seq.op, seq.arg, bmp.op, bmp.arg
+FROM compact_edge_seq seq FULL JOIN compact_edge_bitmap bmp
+ON seq.op = bmp.op AND seq.arg = bmp.arg
+WHERE seq.ids IS DISTINCT FROM bmp.ids;
+
+DROP VIEW compact_edge_queries;
+DROP TABLE compact_edge_tbl;
+
 
 EXPLAIN (COSTS OFF)
 SELECT count(*) FROM radix_text_tbl WHERE t = 'P0123456789abcdef';
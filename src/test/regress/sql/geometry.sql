@@ -356,17 +356,24 @@ SELECT f1, f1::box FROM POLYGON_TBL;
 -- To path
 SELECT f1, f1::path FROM POLYGON_TBL;
 
+-- The joins below may be done as a Spatial Join, which doesn't return rows
+-- in nested loop order, so order them by the scan order of the inputs
+
 -- Same as polygon
-SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 ~= p2.f1;
+SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 ~= p2.f1
+  ORDER BY p1.ctid, p2.ctid;
 
 -- Contained by polygon
-SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 <@ p2.f1;
+SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 <@ p2.f1
+  ORDER BY p1.ctid, p2.ctid;
 
 -- Contains polygon
-SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 @> p2.f1;
+SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 @> p2.f1
+  ORDER BY p1.ctid, p2.ctid;
 
 -- Overlap with polygon
-SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 && p2.f1;
+SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 && p2.f1
+  ORDER BY p1.ctid, p2.ctid;
 
 -- Left of polygon
 SELECT p1.f1, p2.f1 FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 << p2.f1;
@@ -427,10 +434,12 @@ SELECT f1, polygon(1, f1) FROM CIRCLE_TBL WHERE f1 >= '<(0,0),1>';
 SELECT f1, polygon(10, f1) FROM CIRCLE_TBL WHERE f1 < '<(0,0),1>';
 
 -- Same as circle
-SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 ~= c2.f1;
+SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 ~= c2.f1
+  ORDER BY c1.ctid, c2.ctid;
 
 -- Overlap with circle
-SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 && c2.f1;
+SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 && c2.f1
+  ORDER BY c1.ctid, c2.ctid;
 
 -- Overlap or left of circle
 SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 &< c2.f1;
@@ -445,10 +454,12 @@ SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 >> c2.f1;
 SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 &> c2.f1;
 
 -- Contained by circle
-SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 <@ c2.f1;
+SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 <@ c2.f1
+  ORDER BY c1.ctid, c2.ctid;
 
 -- Contain by circle
-SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 @> c2.f1;
+SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 @> c2.f1
+  ORDER BY c1.ctid, c2.ctid;
 
 -- Below circle
 SELECT c1.f1, c2.f1 FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 <<| c2.f1;
@@ -506,3 +517,82 @@ SELECT c.f1, p.f1, c.f1 / p.f1 FROM CIRCLE_TBL c, POINT_TBL p WHERE p.f1 ~= '(0,
 
 -- Distance to polygon
 SELECT c.f1, p.f1, c.f1 <-> p.f1 FROM CIRCLE_TBL c, POLYGON_TBL p;
+
+--
+-- Spatial joins
+--
+SET enable_spatialjoin = on;
+
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 && p2.f1;
+SELECT count(*) FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 && p2.f1;
+SELECT count(*) FROM POLYGON_TBL p1, POLYGON_TBL p2 WHERE p1.f1 @> p2.f1;
+SELECT count(*) FROM POLYGON_TBL poly, POINT_TBL p WHERE poly.f1 @> p.f1;
+SELECT count(*) FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 && c2.f1;
+SELECT count(*) FROM CIRCLE_TBL c1, CIRCLE_TBL c2 WHERE c1.f1 <@ c2.f1;
+
+-- with a join qual besides the spatial clause, and columns of both inputs
+EXPLAIN (COSTS OFF)
+SELECT b1.*, b2.* FROM BOX_TBL b1, BOX_TBL b2
+  WHERE b1.f1 @> b2.f1 AND NOT b1.f1 ~= b2.f1;
+SELECT b1.*, b2.* FROM BOX_TBL b1, BOX_TBL b2
+  WHERE b1.f1 @> b2.f1 AND NOT b1.f1 ~= b2.f1;
+
+-- Larger inputs, first in memory, then partitioned into tiles
+CREATE TEMP TABLE sj_points AS
+  SELECT point(x, y) AS p
+    FROM generate_series(1, 100) x, generate_series(1, 100) y;
+CREATE TEMP TABLE sj_boxes AS
+  SELECT box(point(x, y), point(x + 15, y + 15)) AS b
+    FROM generate_series(0, 1000, 10) x, generate_series(0, 1000, 10) y;
+ANALYZE sj_points;
+ANALYZE sj_boxes;
+
+-- the planner prefers a spatial join here, unless told not to use one
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM sj_boxes b1, sj_boxes b2 WHERE b1.b && b2.b;
+SET enable_spatialjoin = off;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM sj_boxes b1, sj_boxes b2 WHERE b1.b && b2.b;
+SELECT count(*) FROM sj_boxes b1, sj_boxes b2 WHERE b1.b && b2.b;
+SET enable_spatialjoin = on;
+
+SELECT count(*) FROM sj_points p, sj_boxes b WHERE p.p <@ b.b;
+SELECT count(*) FROM sj_boxes b1, sj_boxes b2 WHERE b1.b && b2.b;
+
+SET work_mem = '64kB';
+SELECT count(*) FROM sj_points p, sj_boxes b WHERE p.p <@ b.b;
+SELECT count(*) FROM sj_boxes b1, sj_boxes b2 WHERE b1.b && b2.b;
+
+RESET work_mem;
+RESET enable_spatialjoin;
+
+--
+-- Space-filling curve keys
+--
+SELECT string_agg(x || ',' || y, ' '
+                  ORDER BY hilbert_key(point(x, y), box '((0,0),(4,4))', 2))
+  FROM generate_series(0, 3) x, generate_series(0, 3) y;
+SELECT string_agg(x || ',' || y, ' '
+                  ORDER BY zorder_key(point(x, y), box '((0,0),(4,4))', 2))
+  FROM generate_series(0, 3) x, generate_series(0, 3) y;
+
+-- Boxes are keyed by their centers
+SELECT hilbert_key(box '((0,0),(2,2))', box '((0,0),(4,4))', 2) AS hilbert,
+       zorder_key(box '((0,0),(2,2))', box '((0,0),(4,4))', 2) AS zorder;
+
+-- Values outside the extent go to the border cells, NaN to the last cell
+SELECT hilbert_key(point '(-10,100)', box '((0,0),(4,4))', 2) AS hilbert,
+       zorder_key(point '(-10,100)', box '((0,0),(4,4))', 2) AS zorder;
+SELECT hilbert_key(point '(NaN,0)', box '((0,0),(4,4))', 2) AS hilbert,
+       zorder_key(point '(NaN,0)', box '((0,0),(4,4))', 2) AS zorder;
+
+-- The largest order
+SELECT hilbert_key(point '(1,3)', box '((0,0),(4,4))', 31) AS hilbert,
+       zorder_key(point '(1,3)', box '((0,0),(4,4))', 31) AS zorder;
+SELECT hilbert_key(point '(4,4)', box '((0,0),(4,4))', 31) AS hilbert,
+       zorder_key(point '(4,4)', box '((0,0),(4,4))', 31) AS zorder;
+
+-- Invalid orders
+SELECT hilbert_key(point '(1,1)', box '((0,0),(4,4))', 0);
+SELECT zorder_key(box '((0,0),(1,1))', box '((0,0),(4,4))', 32);
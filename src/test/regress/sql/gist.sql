@@ -97,6 +97,13 @@ select p from
 cross join lateral
   (select p from gist_tbl where p <@ bb order by p <-> bb[0] limit 2) ss;
 
+-- Check nearest neighbors of several points at once
+select n.query, t.p
+  from index_nearest_neighbors('gist_tbl_point_index',
+         array[point(0.201, 0.201), point(0.51, 0.52), point(1.01, 0.98)], 2) n
+  join gist_tbl t on t.ctid = n.tid
+ order by n.query, n.distance;
+
 drop index gist_tbl_point_index;
 
 -- Test index-only scan with box opclass
@@ -142,6 +149,148 @@ and p <@ box(point(5,5), point(6, 6));
 
 drop index gist_tbl_multi_index;
 
+-- Test sorted build, with enough data to make the index a few levels deep
+create table gist_sorted_tbl as
+select point(x, y) as p, box(point(x, y), point(x + 0.5, y + 0.5)) as b
+  from generate_series(1, 200) x, generate_series(1, 200) y;
+create index gist_sorted_point_idx on gist_sorted_tbl using gist (p) with (buffering = sorted);
+create index gist_sorted_box_idx on gist_sorted_tbl using gist (b) with (buffering = sorted, fillfactor = 50);
+
+select count(*) from gist_sorted_tbl where p <@ box '(50,50),(100,100)';
+select p from gist_sorted_tbl order by p <-> point '(100.2,100.1)' limit 3;
+select count(*) from gist_sorted_tbl where b && box '(50,50),(60,60)';
+
+-- Not all opclasses support it
+create index gist_sorted_circle_idx on gist_sorted_tbl using gist (circle(p, 1)) with (buffering = sorted);
+
+-- A sorted build can run in parallel; other builds ignore the request.
+-- Either way, the index must find each of the 40000 rows exactly once.
+drop index gist_sorted_point_idx;
+drop index gist_sorted_box_idx;
+alter table gist_sorted_tbl set (parallel_workers = 2);
+set max_parallel_maintenance_workers = 2;
+create index gist_sorted_point_idx on gist_sorted_tbl using gist (p) with (buffering = sorted);
+create index gist_sorted_box_idx on gist_sorted_tbl using gist (b);
+reset max_parallel_maintenance_workers;
+
+select count(*), count(distinct ctid) from gist_sorted_tbl where p <@ box '(0,0),(201,201)';
+select count(*), count(distinct ctid) from gist_sorted_tbl where b && box '(0,0),(201,201)';
+select count(*) from gist_sorted_tbl where p <@ box '(50,50),(100,100)';
+select p from gist_sorted_tbl order by p <-> point '(100.2,100.1)' limit 3;
+select count(*) from gist_sorted_tbl where b && box '(50,50),(60,60)';
+
+-- Test parallel index scans, which divide the tree below the root between
+-- the participants
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+set min_parallel_table_scan_size = 0;
+set min_parallel_index_scan_size = 0;
+
+-- gist_sorted_tbl is never vacuumed, so none of its pages are all-visible
+-- and the estimated heap fetches, which parallel workers don't share, don't
+-- depend on concurrent transactions
+analyze gist_sorted_tbl;
+explain (costs off)
+select count(*) from gist_sorted_tbl where p <@ box '(50,50),(100,100)';
+select count(*) from gist_sorted_tbl where p <@ box '(50,50),(100,100)';
+
+select count(*) from gist_point_tbl where p <@ box(point(0,0), point(10000, 10000));
+select count(*) from gist_point_tbl where p << point(5000.5, 0);
+
+reset parallel_setup_cost;
+reset parallel_tuple_cost;
+reset min_parallel_table_scan_size;
+reset min_parallel_index_scan_size;
+
+drop table gist_sorted_tbl;
+
+-- Test that testing all the entries of a leaf page at once gives the same
+-- results as testing them one at a time.  IS NOT NULL conditions can't be
+-- batched, so adding one to the query makes the scan test each entry alone.
+create table gist_batch_tbl (id int, b box, p point);
+insert into gist_batch_tbl
+select i, box(point(x, y), point(x + w, y + h)), point(x, y)
+  from generate_series(1, 3000) i,
+       lateral (values ((i % 61) * 0.5 + (i % 3) * 0.0000005,
+                        (i % 47) * 0.5 - (i % 5) * 0.000002,
+                        (i % 7) * 0.25, (i % 11) * 0.25)) v(x, y, w, h);
+insert into gist_batch_tbl
+select 10000 + row_number() over (), box(point(x, y), point(x * 2, y * 2)), point(x, y)
+  from unnest('{-1e100,-1e20,0,10,1e20,1e100}'::float8[]) x,
+       unnest('{-1e100,-1e20,0,10,1e20,1e100}'::float8[]) y;
+create index gist_batch_box_idx on gist_batch_tbl using gist (b);
+create index gist_batch_point_idx on gist_batch_tbl using gist (p);
+
+create temp table gist_batch_qs as
+select box(point(x, y), point(x + 5 + d, y + 7 - d)) q
+  from unnest('{-infinity,0,5,5.000001,9.9999995,20}'::float8[]) x,
+       unnest('{-1e300,0,3,2.999998,15.000002}'::float8[]) y,
+       unnest('{0,0.0000005,0.000002,infinity}'::float8[]) d
+union all
+select b + point(d, -d) q
+  from gist_batch_tbl, unnest('{0,0.0000005,0.000002}'::float8[]) d
+ where id % 101 = 0;
+
+create temp table gist_batch_ops (col text, op text, arg text);
+insert into gist_batch_ops values
+  ('b', '&&', '$1'), ('b', '@>', '$1'), ('b', '<@', '$1'), ('b', '~=', '$1'),
+  ('b', '<<', '$1'), ('b', '&>', '$1'), ('b', '|>>', '$1'),
+  ('p', '<@', '$1'), ('p', '>>', '$1[0]'), ('p', '<^', '$1[1]'),
+  ('p', '~=', '$1[1]');
+
+create function gist_batch_ids(col text, op text, arg text, q box, batched bool)
+returns int[] language plpgsql as
+$$
+declare
+  ids int[];
+begin
+  execute format('select array(select id from gist_batch_tbl where %I %s %s %s order by id)',
+                 col, op, arg,
+                 case when batched then '' else format('and %I is not null', col) end)
+    into ids using q;
+  return ids;
+end;
+$$;
+
+explain (costs off)
+select id from gist_batch_tbl where b && box '(1,1),(2,2)' and b is not null;
+
+create temp table gist_batch_idx as
+select col, op, arg, q::text,
+       gist_batch_ids(col, op, arg, q, true) batched,
+       gist_batch_ids(col, op, arg, q, false) unbatched
+  from gist_batch_qs, gist_batch_ops;
+
+set enable_indexscan = off;
+set enable_bitmapscan = on;
+create temp table gist_batch_bitmap as
+select col, op, arg, q::text,
+       gist_batch_ids(col, op, arg, q, true) batched,
+       gist_batch_ids(col, op, arg, q, false) unbatched
+  from gist_batch_qs, gist_batch_ops;
+
+set enable_seqscan = on;
+set enable_bitmapscan = off;
+create temp table gist_batch_seq as
+select col, op, arg, q::text, gist_batch_ids(col, op, arg, q, true) ids
+  from gist_batch_qs, gist_batch_ops;
+set enable_seqscan = off;
+set enable_indexscan = on;
+
+select col, op, count(*), sum(cardinality(ids))
+  from gist_batch_seq group by col, op order by col, op;
+
+select col, op, arg, q
+  from gist_batch_seq s full join gist_batch_idx i using (col, op, arg, q)
+ where s.ids is distinct from i.batched or s.ids is distinct from i.unbatched;
+
+select col, op, arg, q
+  from gist_batch_seq s full join gist_batch_bitmap i using (col, op, arg, q)
+ where s.ids is distinct from i.batched or s.ids is distinct from i.unbatched;
+
+drop function gist_batch_ids;
+drop table gist_batch_tbl;
+
 -- Clean up
 reset enable_seqscan;
 reset enable_bitmapscan;
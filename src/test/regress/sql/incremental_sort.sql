@@ -0,0 +1,68 @@
+--
+-- Incremental sort
+--
+
+-- When we have to sort the entire table, incremental sort will
+-- be slower than plain sort, so it should not be used.
+explain (costs off)
+select * from (select * from tenk1 order by four) t order by four, ten;
+
+-- When there is a LIMIT clause, incremental sort is beneficial because
+-- it only has to sort some of the groups, and not the entire table.
+explain (costs off)
+select * from (select * from tenk1 order by four) t order by four, ten
+limit 1;
+
+-- When work_mem is not enough to sort the entire table, incremental sort
+-- may be faster if individual groups still fit into work_mem.
+set work_mem to '2MB';
+explain (costs off)
+select * from (select * from tenk1 order by four) t order by four, ten;
+reset work_mem;
+
+create table incsort_t (a int, b int);
+create index incsort_t_a_idx on incsort_t (a);
+
+set enable_seqscan = off;
+set enable_sort = off;
+
+-- Groups of 100 tuples are too large for a single full sort batch, so
+-- each of them gets switched over to the presorted prefix mode.
+insert into incsort_t select i / 100, (i * 37) % 100 from generate_series(1, 1000) i;
+analyze incsort_t;
+
+explain (costs off)
+select * from incsort_t order by a, b;
+select count(*), count(*) filter (where rn <> a * 100 + b) as misordered
+from (select a, b, row_number() over () as rn
+      from (select * from incsort_t order by a, b) s) x;
+
+-- Only the first group needs to be read to satisfy a LIMIT.
+explain (costs off)
+select * from incsort_t order by a, b limit 3;
+select * from incsort_t order by a, b limit 3;
+
+-- Groups of 10 tuples are batched together into full sorts.
+truncate incsort_t;
+insert into incsort_t select i / 10, (i * 7) % 10 from generate_series(1, 1000) i;
+analyze incsort_t;
+
+select count(*), count(*) filter (where rn <> a * 10 + b) as misordered
+from (select a, b, row_number() over () as rn
+      from (select * from incsort_t order by a, b) s) x;
+select * from incsort_t order by a, b limit 12;
+
+-- Rescans start over from the first group.
+select x, (select b from incsort_t where a >= x order by a, b desc limit 1)
+from generate_series(1, 3) x;
+
+reset enable_sort;
+reset enable_seqscan;
+
+-- Turning incremental sort off falls back to a plain sort.
+set enable_incrementalsort = off;
+explain (costs off)
+select * from incsort_t order by a, b;
+reset enable_incrementalsort;
+
+drop table incsort_t;
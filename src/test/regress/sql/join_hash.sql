@@ -538,3 +538,72 @@ WHERE
     AND hjtest_1.a <> hjtest_2.b;
 
 ROLLBACK;
+
+-- Bloom filter pushdown from the hash table into the outer scan
+begin;
+
+set local enable_mergejoin = off;
+set local enable_nestloop = off;
+
+create or replace function explain_bloom(query text) returns setof text
+language plpgsql as
+$$
+declare
+    ln text;
+begin
+    for ln in
+        execute format('explain (analyze, costs off, summary off, timing off) %s',
+            query)
+    loop
+        ln := regexp_replace(ln, 'Memory Usage: \d+', 'Memory Usage: N');
+        return next ln;
+    end loop;
+end;
+$$;
+
+create temp table bloom_outer as
+  select g as id, g % 100 as k from generate_series(1, 10000) g;
+create temp table bloom_inner as
+  select g as k from generate_series(1, 5) g;
+analyze bloom_outer;
+analyze bloom_inner;
+
+-- the scan should drop all rows without a join partner
+select explain_bloom('
+select count(*) from bloom_outer o join bloom_inner i on o.k = i.k');
+select count(*) from bloom_outer o join bloom_inner i on o.k = i.k;
+
+-- same results without the filter
+set local enable_hashjoin_bloom_filter = off;
+select explain_bloom('
+select count(*) from bloom_outer o join bloom_inner i on o.k = i.k');
+select count(*) from bloom_outer o join bloom_inner i on o.k = i.k;
+reset enable_hashjoin_bloom_filter;
+
+-- no filter when unmatched outer rows must be returned
+select explain_bloom('
+select count(*) from bloom_outer o left join bloom_inner i on o.k = i.k');
+select count(*) from bloom_outer o left join bloom_inner i on o.k = i.k;
+
+-- parallel hash join, with the filter shared by all participants
+set local min_parallel_table_scan_size = 0;
+set local parallel_setup_cost = 0;
+set local parallel_tuple_cost = 0;
+set local max_parallel_workers_per_gather = 2;
+set local enable_parallel_hash = on;
+create table bloom_outer_p as
+  select g as id, g % 1000 as k from generate_series(1, 20000) g;
+create table bloom_inner_p as
+  select g as k from generate_series(1, 500) g;
+alter table bloom_outer_p set (parallel_workers = 2);
+alter table bloom_inner_p set (parallel_workers = 2);
+analyze bloom_outer_p;
+analyze bloom_inner_p;
+-- the number of participants can vary, so hide the per-loop row counts
+select regexp_replace(ln, '(rows|loops|Filter|Workers Launched)(=|: )\d+',
+                      '\1\2N', 'g')
+  from explain_bloom('
+select count(*) from bloom_outer_p o join bloom_inner_p i on o.k = i.k') ln;
+select count(*) from bloom_outer_p o join bloom_inner_p i on o.k = i.k;
+
+rollback;
@@ -1272,6 +1272,9 @@ WHERE NOT EXISTS(SELECT 1 FROM pg_amop AS p2
 -- (In principle it could be useful to list such operators in multiple-datatype
 -- btree opfamilies, but in practice you'd expect there to be an opclass for
 -- every datatype the family knows about.)
+-- BRIN inclusion opclasses look up their strategy operators by the type of
+-- the stored summary, so brin/point_inclusion_ops lists the box operators
+-- its point operators are implemented with.
 
 SELECT p1.amopfamily, p1.amopstrategy, p1.amopopr
 FROM pg_amop AS p1
@@ -140,3 +140,52 @@ WHERE seq.id IS NULL OR idx.id IS NULL;
 RESET enable_seqscan;
 RESET enable_indexscan;
 RESET enable_bitmapscan;
+
+-- Test the prepared form of constant polygon arguments, by comparing with
+-- the same polygon coming from a subquery
+CREATE TEMP TABLE prep_poly_tbl AS
+SELECT polygon(circle(point(x * 10, y * 10), 1 + (x + y) % 10)) p,
+	point(x * 10, y * 10) pt
+FROM generate_series(1, 100) x, generate_series(1, 100) y;
+
+SELECT count(*) FROM prep_poly_tbl
+WHERE p && polygon(100, circle '<(500,500),200>');
+
+SELECT count(*) FROM prep_poly_tbl t,
+	(SELECT polygon(100, circle '<(500,500),200>') c OFFSET 0) s
+WHERE t.p && s.c;
+
+SELECT count(*) FROM prep_poly_tbl
+WHERE polygon(100, circle '<(500,500),200>') @> p;
+
+SELECT count(*) FROM prep_poly_tbl t,
+	(SELECT polygon(100, circle '<(500,500),200>') c OFFSET 0) s
+WHERE s.c @> t.p;
+
+SELECT count(*) FROM prep_poly_tbl
+WHERE pt <@ polygon(100, circle '<(500,500),200>');
+
+SELECT count(*) FROM prep_poly_tbl t,
+	(SELECT polygon(100, circle '<(500,500),200>') c OFFSET 0) s
+WHERE t.pt <@ s.c;
+
+-- The same call site can see different values of a stable argument, here
+-- a PL/pgSQL variable in a simple expression evaluated in a loop
+CREATE FUNCTION prep_poly_moving() RETURNS int LANGUAGE plpgsql AS $$
+DECLARE
+	c polygon;
+	n int := 0;
+BEGIN
+	FOR i IN 0..9 LOOP
+		c := polygon(100, circle(point(i * 100, 0), 10));
+		IF point(i * 100, 0) <@ c THEN
+			n := n + 1;
+		END IF;
+	END LOOP;
+	RETURN n;
+END
+$$;
+
+SELECT prep_poly_moving();
+
+DROP FUNCTION prep_poly_moving();
@@ -71,3 +71,168 @@ create index spgist_point_idx2 on spgist_point_tbl using spgist(p) with (fillfac
 -- Modify fillfactor in existing index
 alter index spgist_point_idx set (fillfactor = 90);
 reindex index spgist_point_idx;
+
+-- Test the split strategies of quad_point_ops, on skewed data
+create table spgist_skew_tbl as
+select case when g % 10 = 0 then point(g, g * 7 % 1000)
+            else point(500 + (g % 17) * 0.01, 500 + (g % 19) * 0.01) end as p
+from generate_series(1, 5000) g;
+
+create index spgist_skew_idx on spgist_skew_tbl using spgist (p)
+  with (split_strategy = bogus);
+create index spgist_skew_idx on spgist_skew_tbl using spgist (p)
+  with (split_strategy = median);
+
+set enable_seqscan = off;
+select count(*) from spgist_skew_tbl where p <@ box '(499,499),(501,501)';
+select count(*) from spgist_skew_tbl where p <@ box '(0,0),(2500,300)';
+select count(*) from spgist_skew_tbl where p << point '(500,0)';
+
+drop index spgist_skew_idx;
+create index spgist_skew_idx on spgist_skew_tbl using spgist (p)
+  with (split_strategy = histogram);
+
+select count(*) from spgist_skew_tbl where p <@ box '(499,499),(501,501)';
+select count(*) from spgist_skew_tbl where p <@ box '(0,0),(2500,300)';
+select count(*) from spgist_skew_tbl where p << point '(500,0)';
+
+-- Changing the strategy affects only later splits
+alter index spgist_skew_idx set (split_strategy = mean);
+insert into spgist_skew_tbl select p from spgist_skew_tbl;
+
+select count(*) from spgist_skew_tbl where p <@ box '(499,499),(501,501)';
+select count(*) from spgist_skew_tbl where p << point '(500,0)';
+reset enable_seqscan;
+
+-- Test killed leaf tuples: points that keep moving leave dead versions
+-- behind, which index scans mark as killed and insertions then reclaim
+create table spgist_moving_tbl (id int4, p point)
+  with (autovacuum_enabled = off);
+insert into spgist_moving_tbl
+  select g, point(g % 50, g / 50) from generate_series(1, 2000) g;
+create index spgist_moving_idx on spgist_moving_tbl using spgist (p);
+set enable_seqscan = off;
+set enable_bitmapscan = off;
+update spgist_moving_tbl set p = point(p[0] + 0.25, p[1]);
+select count(id) from spgist_moving_tbl where p <@ box '(0,0),(100,100)';
+update spgist_moving_tbl set p = point(p[0] + 0.25, p[1]);
+select count(id) from spgist_moving_tbl where p <@ box '(0,0),(100,100)';
+update spgist_moving_tbl set p = point(p[0] + 0.25, p[1]);
+select count(id) from spgist_moving_tbl where p <@ box '(0,0),(100,100)';
+update spgist_moving_tbl set p = point(p[0] + 0.25, p[1]);
+select count(id) from spgist_moving_tbl where p <@ box '(0,0),(9.5,100)';
+select count(id) from spgist_moving_tbl where p <@ box '(0,0),(100,100)';
+-- the index must return the current versions of the rows, and only those
+select id, p from spgist_moving_tbl where p <@ box '(0,0),(9.5,0)' order by id;
+reset enable_seqscan;
+reset enable_bitmapscan;
+create temp table spgist_moving_expected as
+  select id, p[0] as x, p[1] as y from spgist_moving_tbl
+  where p <@ box '(0,0),(9.5,100)';
+set enable_seqscan = off;
+set enable_bitmapscan = off;
+explain (costs off)
+select id, p[0] as x, p[1] as y from spgist_moving_tbl
+  where p <@ box '(0,0),(9.5,100)';
+(select id, p[0] as x, p[1] as y from spgist_moving_tbl
+   where p <@ box '(0,0),(9.5,100)'
+ except all
+ select * from spgist_moving_expected)
+union all
+(select * from spgist_moving_expected
+ except all
+ select id, p[0] as x, p[1] as y from spgist_moving_tbl
+   where p <@ box '(0,0),(9.5,100)');
+reset enable_seqscan;
+reset enable_bitmapscan;
+
+-- Test the traversal counters shown by EXPLAIN ANALYZE, on an index that is
+-- a single leaf page
+create table spgist_instr_tbl (id int4, p point);
+insert into spgist_instr_tbl values
+  (1, '(0,0)'), (2, '(1,1)'), (3, '(5,5)'), (4, '(9,9)'), (5, '(9,0)');
+create index spgist_instr_idx on spgist_instr_tbl using spgist (p);
+set enable_seqscan = off;
+set enable_bitmapscan = off;
+explain (analyze, costs off, timing off, summary off)
+select * from spgist_instr_tbl where p <@ box '(0,0),(2,2)';
+explain (analyze, costs off, timing off, summary off)
+select * from spgist_instr_tbl order by p <-> point '(8,8)' limit 2;
+reset enable_seqscan;
+reset enable_bitmapscan;
+
+-- Test bulk loading at index build, with a memory limit small enough to
+-- make it spill to temporary files
+create table spgist_bulk_tbl as
+select point(x, y) as p from generate_series(1, 200) x, generate_series(1, 200) y;
+
+set maintenance_work_mem = '1MB';
+create index spgist_bulk_idx on spgist_bulk_tbl using spgist (p);
+reset maintenance_work_mem;
+
+set enable_seqscan = off;
+select count(*) from spgist_bulk_tbl where p <@ box '(50,50),(100,100)';
+select count(*) from spgist_bulk_tbl where p << point '(10.5,0)';
+select count(*) from spgist_bulk_tbl where p ~= point '(7,7)';
+select p from spgist_bulk_tbl order by p <-> point '(100.2,100.1)' limit 3;
+
+drop index spgist_bulk_idx;
+set maintenance_work_mem = '1MB';
+create index spgist_bulk_idx on spgist_bulk_tbl using spgist (p kd_point_ops);
+reset maintenance_work_mem;
+
+select count(*) from spgist_bulk_tbl where p <@ box '(50,50),(100,100)';
+select count(*) from spgist_bulk_tbl where p << point '(10.5,0)';
+select count(*) from spgist_bulk_tbl where p ~= point '(7,7)';
+select p from spgist_bulk_tbl order by p <-> point '(100.2,100.1)' limit 3;
+
+-- Nearest neighbors of several points at once
+select n.query, t.p, round(n.distance::numeric, 3) as distance
+  from index_nearest_neighbors('spgist_bulk_idx',
+         array[point '(100.2,100.1)', null, point '(0,0)'], 3) n
+  join spgist_bulk_tbl t on t.ctid = n.tid
+ order by n.query, n.distance, t.p[0];
+
+-- Same with a parallel build, on a table that also has some nulls
+drop index spgist_bulk_idx;
+insert into spgist_bulk_tbl select null from generate_series(1, 10);
+alter table spgist_bulk_tbl set (parallel_workers = 2);
+set max_parallel_maintenance_workers = 2;
+set maintenance_work_mem = '96MB';
+create index spgist_bulk_idx on spgist_bulk_tbl using spgist (p);
+reset maintenance_work_mem;
+reset max_parallel_maintenance_workers;
+
+-- each of the 40000 points must be found exactly once
+select count(*), count(distinct ctid) from spgist_bulk_tbl where p <@ box '(0,0),(201,201)';
+select count(*) from spgist_bulk_tbl where p <@ box '(50,50),(100,100)';
+select count(*) from spgist_bulk_tbl where p << point '(10.5,0)';
+select count(*) from spgist_bulk_tbl where p is null;
+select p from spgist_bulk_tbl order by p <-> point '(100.2,100.1)' limit 3;
+select n.query, t.p, round(n.distance::numeric, 3) as distance
+  from index_nearest_neighbors('spgist_bulk_idx',
+         array[point '(100.2,100.1)', null, point '(0,0)'], 3) n
+  join spgist_bulk_tbl t on t.ctid = n.tid
+ order by n.query, n.distance, t.p[0];
+
+-- Test parallel index scans, which divide the upper levels of the tree
+-- between the participants
+analyze spgist_bulk_tbl;
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+set min_parallel_table_scan_size = 0;
+set min_parallel_index_scan_size = 0;
+set enable_bitmapscan = off;
+
+explain (costs off)
+select count(*) from spgist_bulk_tbl where p <@ box '(50,50),(100,100)';
+select count(*) from spgist_bulk_tbl where p <@ box '(50,50),(100,100)';
+select count(*) from spgist_bulk_tbl where p << point '(10.5,0)';
+select count(*) from spgist_bulk_tbl where p is null;
+
+reset parallel_setup_cost;
+reset parallel_tuple_cost;
+reset min_parallel_table_scan_size;
+reset min_parallel_index_scan_size;
+reset enable_bitmapscan;
+reset enable_seqscan;